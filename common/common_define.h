@@ -155,6 +155,9 @@ enum SubscriberType
     kHttpHls = 2,
     kSrt = 3,
     kWebrtc = 4,
+    kCrossLoop = 5,
+
+    kSubscriberTypeCount,
 };
 
 enum WebSocketProtocolDefine
@@ -7,16 +7,25 @@
 #include <unistd.h>
 
 #include <assert.h>
+#include <string.h>
 
 #include <iostream>
 
+// epoll_ctl统计打印间隔
+static const uint64_t kEpollStatIntervalMs = 60*1000;
+
 Epoller::Epoller()
     : IoLoop()
+    , stat_timer_(this)
+    , epoll_ctl_count_(0)
+    , epoll_ctl_skip_count_(0)
 {
 }
 
 Epoller::~Epoller()
 {
+    DeleteWakeupFd();
+
     if (poll_fd_ > 0)
     {
         close(poll_fd_);
@@ -36,6 +45,16 @@ int Epoller::Create()
         }
 
         std::cout << LMSG << "epoll_create success. poll_fd_=" << poll_fd_ << std::endl;
+
+        CreateWakeupFd();
+
+        stat_timer_.RunEvery(kEpollStatIntervalMs, [this]()
+        {
+            std::cout << LMSG << "[STAT] epoll_ctl:" << epoll_ctl_count_ << ",skip:" << epoll_ctl_skip_count_ << std::endl;
+
+            epoll_ctl_count_ = 0;
+            epoll_ctl_skip_count_ = 0;
+        });
     }
 
     return 0;
@@ -49,59 +68,78 @@ void Epoller::RunIOLoop(const int& timeout_in_millsecond)
     }
 }
 
-int Epoller::AddFd(Fd* fd)
+uint32_t Epoller::GetInterest(Fd* fd)
 {
-    struct epoll_event event;
-    event.events = fd->events();
-    event.data.ptr = (void*)fd;
-
-    int ret = epoll_ctl(poll_fd_, EPOLL_CTL_ADD, fd->fd(), &event);
-
-    if (ret < 0)
+    // 边沿触发写事件一直挂着, 开关写不用改; 读跟着events_走, 关了读就真的不再收EPOLLIN
+    if (fd->edge_trigger())
     {
-        std::cout << LMSG << "epoll_ctl faield ret=" << ret << std::endl;
+        return (fd->events() & EPOLLIN) | EPOLLOUT | EPOLLET;
     }
 
-    return ret;
+    return fd->events();
 }
 
-int Epoller::DelFd(Fd* fd)
+int Epoller::Ctl(Fd* fd, const int& op, const uint32_t& events)
 {
     struct epoll_event event;
-    event.events = fd->events();
+    event.events = events;
     event.data.ptr = (void*)fd;
 
-    int ret = epoll_ctl(poll_fd_, EPOLL_CTL_DEL, fd->fd(), &event);
+    ++epoll_ctl_count_;
+
+    int ret = epoll_ctl(poll_fd_, op, fd->fd(), &event);
 
     if (ret < 0)
     {
-        std::cout << LMSG << "epoll_ctl failed, ret=" << ret << std::endl;
+        std::cout << LMSG << "epoll_ctl failed, op=" << op << ",ret=" << ret << ",err:" << strerror(errno) << std::endl;
+        return ret;
     }
 
+    fd->SetRegisteredEvents(op == EPOLL_CTL_DEL ? 0 : events);
+
     return ret;
 }
 
+int Epoller::AddFd(Fd* fd)
+{
+    return Ctl(fd, EPOLL_CTL_ADD, GetInterest(fd));
+}
+
+int Epoller::DelFd(Fd* fd)
+{
+    return Ctl(fd, EPOLL_CTL_DEL, fd->registered_events());
+}
+
 int Epoller::ModFd(Fd* fd)
 {
-    struct epoll_event event;
-    event.events = fd->events();
-    event.data.ptr = (void*)fd;
+    uint32_t interest = GetInterest(fd);
+    uint32_t registered = fd->registered_events();
 
-    int ret = epoll_ctl(poll_fd_, EPOLL_CTL_MOD, fd->fd(), &event);
+    if (interest == registered)
+    {
+        ++epoll_ctl_skip_count_;
+        return 0;
+    }
 
-    if (ret < 0)
+    // 只是关写事件的话先不改, 慢连接上写事件反复开关, 真来了多余的EPOLLOUT再摘
+    if ((interest & ~registered) == 0 && (registered & ~interest) == EPOLLOUT)
     {
-        std::cout << LMSG << "epoll_ctl failed, ret=" << ret << std::endl;
+        ++epoll_ctl_skip_count_;
+        return 0;
     }
 
-    return ret;
+    return Ctl(fd, EPOLL_CTL_MOD, interest);
 }
 
 void Epoller::WaitIO(const int& timeout_in_millsecond)
 {
-    static epoll_event events[1024];
+    SetCurrentLoop();
 
-    int num_event = epoll_wait(poll_fd_, events, sizeof(events), timeout_in_millsecond);
+    epoll_event events[1024];
+
+    int num_event = epoll_wait(poll_fd_, events, sizeof(events) / sizeof(events[0]), GetWaitTimeout(timeout_in_millsecond));
+
+    UpdateTime();
 
     if (num_event > 0)
     {
@@ -114,23 +152,42 @@ void Epoller::WaitIO(const int& timeout_in_millsecond)
                 assert(false);
             }
 
-            if (events[i].events & (EPOLLIN | EPOLLHUP))
+            // 本轮前面的回调里已经要删了
+            if (fd->IsClosing())
+            {
+                continue;
+            }
+
+            uint32_t revents = events[i].events;
+            bool hup = (revents & (EPOLLHUP | EPOLLERR)) != 0;
+
+            // 只在关心读的时候回调OnRead, 比如CloseAfterFlush关了读, 对端的FIN不能把没发完的数据关掉
+            if ((revents & EPOLLIN || hup) && (fd->events() & EPOLLIN))
             {
                 int ret = fd->OnRead();
                 if (ret == kClose || ret == kError)
                 {
                     std::cout << LMSG << "closed, ret:" << ret << std::endl;
-                    delete fd;
-                    return;
+                    DeleteFdLater(fd);
+                    continue;
                 }
             }
 
-            if (events[i].events & EPOLLOUT)
+            // 关了读的时候HUP/ERR交给OnWrite, 写失败会关掉
+            if (revents & EPOLLOUT || hup)
             {
-                int ret = fd->OnWrite();
-                if (ret < 0)
+                if (fd->events() & EPOLLOUT)
+                {
+                    int ret = fd->OnWrite();
+                    if (ret < 0)
+                    {
+                        DeleteFdLater(fd);
+                    }
+                }
+                else if (! fd->edge_trigger() && (revents & EPOLLOUT))
                 {
-                    delete fd;
+                    // 之前延迟没摘的写事件
+                    Ctl(fd, EPOLL_CTL_MOD, fd->events());
                 }
             }
         }
@@ -142,4 +199,9 @@ void Epoller::WaitIO(const int& timeout_in_millsecond)
     else
     {
     }
+
+    RunDeferDelete();
+    RunTimer();
+    RunPendingTask();
+    RunFlush();
 }
@@ -1,7 +1,10 @@
 #ifndef __EPOLLER_H__
 #define __EPOLLER_H__
 
+#include <stdint.h>
+
 #include "io_loop.h"
+#include "timing_wheel.h"
 
 class Fd;
 
@@ -19,6 +22,15 @@ public:
     int ModFd(Fd* fd);
 
     void WaitIO(const int& timeout_in_millsecond);
+
+private:
+    uint32_t GetInterest(Fd* fd);
+    int Ctl(Fd* fd, const int& op, const uint32_t& events);
+
+private:
+    WheelTimer  stat_timer_;
+    uint64_t    epoll_ctl_count_;
+    uint64_t    epoll_ctl_skip_count_;
 };
     
 #endif // __EPOLLER_H__
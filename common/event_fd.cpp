@@ -0,0 +1,47 @@
+#include <sys/eventfd.h>
+
+#include <string.h>
+
+#include "common_define.h"
+#include "event_fd.h"
+
+EventFd::EventFd(IoLoop* io_loop)
+    : Fd(io_loop, eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+{
+    if (fd_ == -1)
+    {
+        std::cout << LMSG << "eventfd err:" << strerror(errno) << std::endl;
+    }
+    else
+    {
+        EnableRead();
+    }
+}
+
+EventFd::~EventFd()
+{
+}
+
+int EventFd::Notify()
+{
+    uint64_t one = 1;
+
+    int bytes = write(fd_, &one, sizeof(one));
+
+    if (bytes != sizeof(one))
+    {
+        return kError;
+    }
+
+    return kSuccess;
+}
+
+int EventFd::OnRead()
+{
+    uint64_t count = 0;
+
+    int bytes = read(fd_, &count, sizeof(count));
+    UNUSED(bytes);
+
+    return kSuccess;
+}
@@ -0,0 +1,32 @@
+#ifndef __EVENT_FD_H__
+#define __EVENT_FD_H__
+
+#include "common_define.h"
+#include "fd.h"
+
+// eventfd, 其他线程用来唤醒阻塞在epoll_wait上的loop
+class EventFd : public Fd
+{
+public:
+    EventFd(IoLoop* io_loop);
+    ~EventFd();
+
+    // 任意线程
+    int Notify();
+
+    int Send(const uint8_t* data, const size_t& len)
+    {
+        UNUSED(data);
+        UNUSED(len);
+
+        return 0;
+    }
+
+    int OnRead();
+    int OnWrite()
+    {
+        return 0;
+    }
+};
+
+#endif // __EVENT_FD_H__
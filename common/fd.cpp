@@ -9,6 +9,10 @@ std::atomic<uint64_t> Fd::id_generator_;
 
 Fd::Fd(IoLoop* io_loop, const int& fd)
     : events_(0)
+    , registered_events_(0)
+    , edge_trigger_(false)
+    , closing_(false)
+    , flush_pending_(false)
     , fd_(fd)
     , io_loop_(io_loop)
     , socket_handler_(NULL)
@@ -19,6 +23,11 @@ Fd::Fd(IoLoop* io_loop, const int& fd)
 
 Fd::~Fd()
 {
+    if (flush_pending_)
+    {
+        io_loop_->CancelFlush(this);
+    }
+
     if (fd_ > 0)
     {
         DisableRead();
@@ -26,6 +35,9 @@ Fd::~Fd()
 
         close(fd_);
     }
+
+    // 还在内核里的请求撤掉, 之后的完成事件不再回调
+    io_loop_->CancelIo(this);
 }
 
 void Fd::EnableRead()
@@ -129,3 +141,33 @@ void Fd::DisableWrite()
         io_loop_->ModFd(this);
     }
 }
+
+int Fd::SendFile(const int& file_fd, const uint64_t& offset, const size_t& len, const std::shared_ptr<void>& holder)
+{
+    UNUSED(holder);
+
+    uint8_t buf[64 * 1024];
+    size_t sent = 0;
+
+    while (sent < len)
+    {
+        size_t want = len - sent < sizeof(buf) ? len - sent : sizeof(buf);
+        ssize_t bytes = pread(file_fd, buf, want, offset + sent);
+
+        if (bytes <= 0)
+        {
+            return -1;
+        }
+
+        int ret = Send(buf, bytes);
+
+        if (ret < 0)
+        {
+            return ret;
+        }
+
+        sent += bytes;
+    }
+
+    return len;
+}
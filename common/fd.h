@@ -6,10 +6,36 @@
 
 #include <atomic>
 #include <functional>
+#include <memory>
+
+#include "ref_ptr.h"
 
 class SocketHandler;
 class IoLoop;
 
+// io_uring完成模式下读怎么提交, 默认还是就绪通知
+enum ReadMode
+{
+    kReadByPoll = 0,
+    kReadByAccept = 1,
+    kReadByRecv = 2,
+};
+
+// 批量发送的一段数据, ref不为空时data指向ref的内存, 没发完的部分只挂引用不拷贝
+struct IoVec
+{
+    IoVec(const uint8_t* d = NULL, const size_t& l = 0, const Payload* r = NULL)
+        : data(d)
+        , len(l)
+        , ref(r)
+    {
+    }
+
+    const uint8_t*  data;
+    size_t          len;
+    const Payload*  ref;
+};
+
 class Fd
 {
 public:
@@ -23,9 +49,35 @@ public:
 
     virtual int OnRead()    = 0;
     virtual int OnWrite()   = 0;
+    virtual void OnFlush()  {}
+
+    // io_uring完成模式下loop直接回调, 数据已经读好/发完; 返回kClose/kError时loop删掉fd.
+    // OnRecv的len为0表示对端关闭
+    virtual int OnAccept(const int& client_fd) { return 0; }
+    virtual int OnRecv(const uint8_t* data, const size_t& len) { return 0; }
+    virtual int OnSendComplete(const int& result) { return 0; }
+
+    virtual int GetReadMode() const { return kReadByPoll; }
 
     int fd() const { return fd_; }
     uint32_t events() const { return events_; }
+
+    // loop里实际注册的事件, 可能比events_多一个还没摘掉的EPOLLOUT
+    uint32_t registered_events() const { return registered_events_; }
+    void SetRegisteredEvents(const uint32_t& events) { registered_events_ = events; }
+
+    // 边沿触发要求OnRead/OnWrite一直读写到EAGAIN, 要在EnableRead之前设置
+    bool edge_trigger() const { return edge_trigger_; }
+    void SetEdgeTrigger(const bool& edge_trigger) { edge_trigger_ = edge_trigger; }
+
+    // 已经交给loop延迟删除了, 本轮剩下的事件不再分发
+    bool IsClosing() const { return closing_; }
+    void SetClosing() { closing_ = true; }
+
+    // 在loop的flush列表里, 本轮结束时调OnFlush
+    bool IsFlushPending() const { return flush_pending_; }
+    void SetFlushPending(const bool& flush_pending) { flush_pending_ = flush_pending; }
+
     SocketHandler* socket_handler() { return socket_handler_; }
     uint64_t id() const { return id_; }
     std::string name() const { return name_; }
@@ -37,6 +89,31 @@ public:
 
     virtual int Send(const uint8_t* data, const size_t& len) { return 0; }
 
+    // 默认逐段Send, TcpSocket用writev一次发出去
+    virtual int SendV(const IoVec* iov, const int& count)
+    {
+        int total = 0;
+        for (int i = 0; i < count; ++i)
+        {
+            int ret = Send(iov[i].data, iov[i].len);
+            if (ret < 0)
+            {
+                return ret;
+            }
+            total += ret;
+        }
+
+        return total;
+    }
+
+    // 发送文件file_fd里[offset, offset + len)这一段, holder在发完之前保证文件不被关掉.
+    // TcpSocket用sendfile, 其余的读出来再Send
+    virtual int SendFile(const int& file_fd, const uint64_t& offset, const size_t& len, const std::shared_ptr<void>& holder);
+
+    // 发送队列里还没写到内核的字节数, 以及最老的数据排了多久, 订阅者据此限流
+    virtual size_t GetPendingBytes() { return 0; }
+    virtual uint64_t GetPendingMs() { return 0; }
+
     static uint64_t GenID()
     {
         return  id_generator_.fetch_add(1);
@@ -45,6 +122,10 @@ public:
 protected:
 
     uint32_t        events_;
+    uint32_t        registered_events_;
+    bool            edge_trigger_;
+    bool            closing_;
+    bool            flush_pending_;
     int             fd_;
     IoLoop*         io_loop_;
     SocketHandler*  socket_handler_;
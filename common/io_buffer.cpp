@@ -8,19 +8,15 @@
 #include "util.h"
 
 IoBuffer::IoBuffer(const size_t& capacity)
-    : capacity_(capacity)
+    : buf_(NULL)
+    , capacity_(0)
+    , start_(NULL)
+    , end_(NULL)
+    , own_(true)
 {
-    if (capacity_ != 0)
+    if (capacity != 0)
     {
-        buf_ = (uint8_t*)malloc(capacity_);
-        start_ = buf_;
-        end_ = buf_;
-    }
-    else
-    {
-        buf_ = NULL;
-        start_ = NULL;
-        end_ = NULL;
+        MakeSpaceIfNeed(capacity);
     }
 }
 
@@ -28,9 +24,10 @@ IoBuffer::~IoBuffer()
 {
     if (buf_ != NULL)
     {
-        //VERBOSE << LMSG << "capacity_:" << capacity_ << ",Size():" << Size() << ",CapacityLeft():" << CapacityLeft() << ",buf:" << (void*)buf_ << std::endl;
-
-        free(buf_);
+        if (own_)
+        {
+            IoBufferPool::Release(buf_);
+        }
         buf_ = NULL;
 
         capacity_ = 0;
@@ -42,7 +39,11 @@ IoBuffer::~IoBuffer()
 
 int IoBuffer::ReadFromFdAndWrite(const int& fd)
 {
-    MakeSpaceIfNeed(kEnlargeSize);
+    if (MakeSpaceIfNeed(kReadMinSpace) < 0)
+    {
+        errno = ENOBUFS;
+        return -1;
+    }
 
     //VERBOSE << LMSG << "IoBuffer capacity:" << CapacityLeft() << std::endl;
     size_t max_read = CapacityLeft();
@@ -75,7 +76,11 @@ int IoBuffer::ReadFromFdAndWrite(const int& fd)
 
 int IoBuffer::ReadFromFdAndWrite(const int& fd, sockaddr* addr, socklen_t* addr_len)
 {
-    MakeSpaceIfNeed(kUdpMaxSize);
+    if (MakeSpaceIfNeed(kUdpMaxSize) < 0)
+    {
+        errno = ENOBUFS;
+        return -1;
+    }
 
     //VERBOSE << LMSG << "IoBuffer capacity:" << CapacityLeft() << std::endl;
 
@@ -203,32 +208,50 @@ int IoBuffer::MakeSpaceIfNeed(const size_t& len)
 {
     assert(end_ >= start_);
 
-    size_t cur_capacity = CapacityLeft();
-    size_t start_pos = start_ - buf_;
-    size_t end_pos = end_ - buf_;
+    if (buf_ != NULL && own_ && (size_t)CapacityLeft() >= len)
+    {
+        return 0;
+    }
+
+    size_t size = end_ - start_;
 
-    if (cur_capacity >= len)
+    // 前面读掉的空间够用, 挪到头上就行
+    if (buf_ != NULL && own_ && capacity_ >= size + len)
     {
+        memmove(buf_, start_, size);
+        start_ = buf_;
+        end_ = buf_ + size;
+
         return 0;
     }
 
-    size_t new_capacity = std::max(capacity_ + len, capacity_ * 2);
+    size_t new_capacity = std::max(size + len, (size_t)capacity_ * 2);
 
-    //std::cout << LMSG << "cur_capacity:" << cur_capacity << ",new_capacity:" << new_capacity << std::endl;
+    //std::cout << LMSG << "size:" << size << ",new_capacity:" << new_capacity << std::endl;
 
-    buf_ = (uint8_t*)realloc(buf_, new_capacity);
+    size_t alloc_capacity = 0;
+    uint8_t* buf = IoBufferPool::Allocate(new_capacity, alloc_capacity);
 
-    if (buf_ == NULL)
+    if (buf == NULL)
     {
         return -1;
     }
 
-    start_ = buf_ + start_pos;
-    end_ = buf_ + end_pos;
+    if (size != 0)
+    {
+        memcpy(buf, start_, size);
+    }
 
-    assert(end_ >= start_);
+    if (buf_ != NULL && own_)
+    {
+        IoBufferPool::Release(buf_);
+    }
 
-    capacity_ = new_capacity;
+    buf_ = buf;
+    own_ = true;
+    capacity_ = alloc_capacity;
+    start_ = buf_;
+    end_ = buf_ + size;
 
     return 0;
 }
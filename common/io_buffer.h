@@ -9,10 +9,10 @@
 #include <string>
 
 #include "common_define.h"
+#include "io_buffer_pool.h"
 
-const uint64_t kDefaultSize = 1024*64;
-const uint64_t kShrinkSize = 2*1024*64;
-const uint64_t kEnlargeSize = 1024*64;
+// 读之前至少要腾出来的空间
+const uint64_t kReadMinSpace = 1024*4;
 const uint64_t kUdpMaxSize = 1460;
 
 class IoBuffer
@@ -63,9 +63,8 @@ public:
 
         if (end_ == start_)
         {
-            ShrinkCapacity(kDefaultSize);
-
-            //VERBOSE << LMSG << "adjust start_ and end_ to buf_" << std::endl;
+            start_ = buf_;
+            end_ = buf_;
         }
 
         assert(end_ >= start_);
@@ -78,23 +77,43 @@ public:
         return capacity_ - (end_ - buf_);
     }
 
-protected:
-    int MakeSpaceIfNeed(const size_t& len);
-    void ShrinkCapacity(const size_t& capacity)
+    // 数据都处理完了就把内存还给池子, 空闲连接不占块.
+    // 之前Read/Peek拿到的指针都失效
+    void ReleaseIfEmpty()
     {
-        if (capacity_ > kShrinkSize)
+        if (buf_ != NULL && end_ == start_)
         {
-            std::cout << LMSG << "shrink " << capacity_ << "->" << capacity << std::endl;
+            if (own_)
+            {
+                IoBufferPool::Release(buf_);
+            }
+
+            buf_ = NULL;
+            capacity_ = 0;
+            start_ = NULL;
+            end_ = NULL;
+        }
+    }
 
-            free(buf_);
-            capacity_ = capacity;
-            buf_ = (uint8_t*)malloc(capacity_);
+    // 不拷贝, 直接把外面的一段数据当成缓冲内容, 内存还是外面的.
+    // 再往里写的话会先拷到自己的块上
+    void Attach(uint8_t* data, const size_t& len)
+    {
+        if (buf_ != NULL && own_)
+        {
+            IoBufferPool::Release(buf_);
         }
 
-        start_ = buf_;
-        end_ = buf_;
+        buf_ = data;
+        capacity_ = len;
+        start_ = data;
+        end_ = data + len;
+        own_ = false;
     }
 
+protected:
+    int MakeSpaceIfNeed(const size_t& len);
+
 protected:
     uint8_t *buf_;
     uint64_t capacity_;
@@ -103,6 +122,9 @@ protected:
     //     |---->      capacity      <----|
     uint8_t *start_;
     uint8_t *end_;
+
+    // buf_是不是从池子里拿的, Attach进来的不用还
+    bool own_;
 };
 
 #endif // __IO_BUFFER_H__
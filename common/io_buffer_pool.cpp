@@ -0,0 +1,218 @@
+#include <stdlib.h>
+
+#include <iostream>
+
+#include "common_define.h"
+#include "io_buffer_pool.h"
+#include "io_loop.h"
+
+// 每个loop最多缓存这么多空闲块(16M), 多出来的还给系统
+static const uint64_t kMaxFreeBlock = 1024;
+
+// 统计打印间隔
+static const uint64_t kIoBufferStatIntervalMs = 60*1000;
+
+uint64_t IoBufferPool::memory_limit_ = 1024ULL*1024*1024;
+std::atomic<uint64_t> IoBufferPool::total_bytes_(0);
+std::atomic<uint64_t> IoBufferPool::reject_count_(0);
+
+// 每块内存前面的头, 16字节, 后面的数据还是对齐的
+struct IoBufferPool::BlockHeader
+{
+    IoBufferPool*   pool;
+    union
+    {
+        uint64_t        capacity;
+        BlockHeader*    next;   // 在空闲链表上的时候
+    };
+};
+
+IoBufferPool::IoBufferPool(IoLoop* io_loop)
+    : io_loop_(io_loop)
+    , free_list_(NULL)
+    , free_count_(0)
+    , in_use_count_(1)
+    , closed_(false)
+    , large_count_(0)
+    , stat_timer_(new WheelTimer(io_loop))
+{
+}
+
+IoBufferPool::~IoBufferPool()
+{
+    while (free_list_ != NULL)
+    {
+        BlockHeader* header = free_list_;
+        free_list_ = header->next;
+
+        header->capacity = kIoBlockSize;
+        FreeToSystem(header);
+    }
+}
+
+void IoBufferPool::Close()
+{
+    delete stat_timer_;
+    stat_timer_ = NULL;
+
+    closed_.store(true, std::memory_order_relaxed);
+
+    if (in_use_count_.load(std::memory_order_relaxed) > 1)
+    {
+        std::cout << LMSG << "io buffer pool closed with " << in_use_count_.load(std::memory_order_relaxed) - 1 << " blocks in use, free it when they come back" << std::endl;
+    }
+
+    Unref();
+}
+
+void IoBufferPool::Unref()
+{
+    if (in_use_count_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        delete this;
+    }
+}
+
+uint8_t* IoBufferPool::Allocate(const size_t& size, size_t& capacity)
+{
+    IoLoop* io_loop = IoLoop::GetCurrentLoop();
+
+    if (size <= kIoBlockSize)
+    {
+        capacity = kIoBlockSize;
+
+        if (io_loop != NULL)
+        {
+            return io_loop->GetIoBufferPool().AllocBlock();
+        }
+    }
+    else
+    {
+        capacity = size;
+
+        if (io_loop != NULL)
+        {
+            ++io_loop->GetIoBufferPool().large_count_;
+        }
+    }
+
+    return AllocFromSystem(NULL, capacity);
+}
+
+void IoBufferPool::Release(uint8_t* buf)
+{
+    BlockHeader* header = (BlockHeader*)buf - 1;
+    IoBufferPool* pool = header->pool;
+
+    if (pool == NULL)
+    {
+        FreeToSystem(header);
+        return;
+    }
+
+    // 只有本loop的定长块能回到池子里, 别的loop的还给系统, 计数都要减
+    if (pool->io_loop_ == IoLoop::GetCurrentLoop() && ! pool->closed_.load(std::memory_order_relaxed))
+    {
+        pool->FreeBlock(header);
+    }
+    else
+    {
+        FreeToSystem(header);
+    }
+
+    pool->Unref();
+}
+
+uint8_t* IoBufferPool::AllocFromSystem(IoBufferPool* pool, const size_t& capacity)
+{
+    uint64_t total = total_bytes_.fetch_add(capacity, std::memory_order_relaxed) + capacity;
+
+    if (memory_limit_ != 0 && total > memory_limit_)
+    {
+        total_bytes_.fetch_sub(capacity, std::memory_order_relaxed);
+
+        if (reject_count_.fetch_add(1, std::memory_order_relaxed) == 0)
+        {
+            std::cout << LMSG << "io buffer memory limit " << memory_limit_ << " reached" << std::endl;
+        }
+
+        return NULL;
+    }
+
+    BlockHeader* header = (BlockHeader*)malloc(sizeof(BlockHeader) + capacity);
+
+    if (header == NULL)
+    {
+        total_bytes_.fetch_sub(capacity, std::memory_order_relaxed);
+        return NULL;
+    }
+
+    header->pool = pool;
+    header->capacity = capacity;
+
+    return (uint8_t*)(header + 1);
+}
+
+void IoBufferPool::FreeToSystem(BlockHeader* header)
+{
+    total_bytes_.fetch_sub(header->capacity, std::memory_order_relaxed);
+
+    free(header);
+}
+
+uint8_t* IoBufferPool::AllocBlock()
+{
+    if (! stat_timer_->IsActive())
+    {
+        stat_timer_->RunEvery(kIoBufferStatIntervalMs, [this]()
+        {
+            PrintStat();
+        });
+    }
+
+    uint8_t* buf = NULL;
+
+    if (free_list_ != NULL)
+    {
+        BlockHeader* header = free_list_;
+        free_list_ = header->next;
+        --free_count_;
+
+        header->capacity = kIoBlockSize;
+
+        buf = (uint8_t*)(header + 1);
+    }
+    else
+    {
+        buf = AllocFromSystem(this, kIoBlockSize);
+    }
+
+    if (buf != NULL)
+    {
+        in_use_count_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    return buf;
+}
+
+void IoBufferPool::FreeBlock(BlockHeader* header)
+{
+    if (free_count_ >= kMaxFreeBlock)
+    {
+        FreeToSystem(header);
+        return;
+    }
+
+    header->next = free_list_;
+    free_list_ = header;
+    ++free_count_;
+}
+
+void IoBufferPool::PrintStat()
+{
+    std::cout << LMSG << "[STAT] io_buffer block_in_use:" << in_use_count_.load(std::memory_order_relaxed) - 1 << ",block_free:" << free_count_
+              << ",large:" << large_count_ << ",total:" << GetTotalBytes() << ",limit:" << memory_limit_
+              << ",reject:" << reject_count_.load(std::memory_order_relaxed) << std::endl;
+
+    large_count_ = 0;
+}
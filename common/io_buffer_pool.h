@@ -0,0 +1,72 @@
+#ifndef __IO_BUFFER_POOL_H__
+#define __IO_BUFFER_POOL_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#include "timing_wheel.h"
+
+class IoLoop;
+
+// IoBuffer的定长块, 读缓冲一次最多读这么多
+const size_t kIoBlockSize = 16*1024;
+
+// 每个loop一个, 给IoBuffer分配内存. 不超过kIoBlockSize的用定长块, 空了还回来缓存复用,
+// 更大的直接malloc. 所有loop加起来有个总上限, 超过了分配失败.
+// 定长块的头指着池子, 池子要等最后一个块还回来才能释放, loop析构时Close.
+class IoBufferPool
+{
+public:
+    explicit IoBufferPool(IoLoop* io_loop);
+
+    // loop析构时调, 块都还回来了才真正释放
+    void Close();
+
+    // 优先用当前线程loop的池子, 返回NULL说明超过总上限了
+    static uint8_t* Allocate(const size_t& size, size_t& capacity);
+    static void Release(uint8_t* buf);
+
+    static void SetMemoryLimit(const uint64_t& limit_bytes)
+    {
+        memory_limit_ = limit_bytes;
+    }
+
+    static uint64_t GetTotalBytes()
+    {
+        return total_bytes_.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct BlockHeader;
+
+    static uint8_t* AllocFromSystem(IoBufferPool* pool, const size_t& capacity);
+    static void FreeToSystem(BlockHeader* header);
+
+    ~IoBufferPool();
+
+    uint8_t* AllocBlock();
+    void FreeBlock(BlockHeader* header);
+    void Unref();
+    void PrintStat();
+
+private:
+    IoLoop*         io_loop_;
+
+    BlockHeader*    free_list_;
+    uint64_t        free_count_;
+    // 发出去的定长块数加上池子自己的1(Close时减掉), 哪个线程还都要减, 减到0的负责释放池子
+    std::atomic<uint64_t>   in_use_count_;
+    std::atomic<bool>       closed_;
+    uint64_t        large_count_;
+
+    // Close时删掉, 池子可能在loop没了之后才释放
+    WheelTimer*     stat_timer_;
+
+    static uint64_t                 memory_limit_;
+    static std::atomic<uint64_t>    total_bytes_;
+    static std::atomic<uint64_t>    reject_count_;
+};
+
+#endif // __IO_BUFFER_POOL_H__
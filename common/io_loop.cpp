@@ -0,0 +1,160 @@
+#include "common_define.h"
+#include "event_fd.h"
+#include "fd.h"
+#include "io_loop.h"
+#include "util.h"
+
+thread_local IoLoop* IoLoop::current_loop_ = NULL;
+
+IoLoop::IoLoop()
+    : poll_fd_(-1)
+    , quit_(false)
+    , wakeup_fd_(NULL)
+    , wakeup_pending_(false)
+    , now_ms_(Util::GetMonotonicMs())
+    , payload_pool_(new PayloadPool(this))
+    , io_buffer_pool_(new IoBufferPool(this))
+{
+    timing_wheel_.Reset(now_ms_);
+}
+
+IoLoop::~IoLoop()
+{
+    // 本线程之后再还块就按别的线程算, 不会再碰这个loop
+    if (current_loop_ == this)
+    {
+        current_loop_ = NULL;
+    }
+
+    payload_pool_->Close();
+    io_buffer_pool_->Close();
+}
+
+void IoLoop::CreateWakeupFd()
+{
+    if (wakeup_fd_ == NULL)
+    {
+        wakeup_fd_ = new EventFd(this);
+    }
+}
+
+void IoLoop::DeleteWakeupFd()
+{
+    // 要在子类析构里调, 那时候DelFd还能用
+    if (wakeup_fd_ != NULL)
+    {
+        delete wakeup_fd_;
+        wakeup_fd_ = NULL;
+    }
+}
+
+void IoLoop::QueueInLoop(const Task& task)
+{
+    pending_task_.Push(task);
+
+    if (! wakeup_pending_.exchange(true, std::memory_order_acq_rel))
+    {
+        if (wakeup_fd_ != NULL)
+        {
+            wakeup_fd_->Notify();
+        }
+    }
+}
+
+void IoLoop::Quit()
+{
+    QueueInLoop([this]()
+    {
+        quit_ = true;
+    });
+}
+
+void IoLoop::DeleteFdLater(Fd* fd)
+{
+    if (fd->IsClosing())
+    {
+        return;
+    }
+
+    fd->SetClosing();
+    defer_delete_fd_.push_back(fd);
+}
+
+void IoLoop::RunDeferDelete()
+{
+    // 析构里可能又触发了DeleteFdLater
+    while (! defer_delete_fd_.empty())
+    {
+        std::vector<Fd*> defer_delete_fd;
+        defer_delete_fd.swap(defer_delete_fd_);
+
+        for (auto& fd : defer_delete_fd)
+        {
+            delete fd;
+        }
+    }
+}
+
+void IoLoop::FlushLater(Fd* fd)
+{
+    if (fd->IsFlushPending())
+    {
+        return;
+    }
+
+    fd->SetFlushPending(true);
+    flush_fd_.push_back(fd);
+}
+
+void IoLoop::CancelFlush(Fd* fd)
+{
+    for (auto& flush_fd : flush_fd_)
+    {
+        if (flush_fd == fd)
+        {
+            flush_fd = NULL;
+        }
+    }
+
+    fd->SetFlushPending(false);
+}
+
+void IoLoop::RunFlush()
+{
+    // OnFlush里可能有别的fd被删掉, 按下标遍历, 删掉的已经置空了
+    for (size_t i = 0; i < flush_fd_.size(); ++i)
+    {
+        Fd* fd = flush_fd_[i];
+
+        if (fd == NULL)
+        {
+            continue;
+        }
+
+        fd->SetFlushPending(false);
+
+        if (! fd->IsClosing())
+        {
+            fd->OnFlush();
+        }
+    }
+
+    flush_fd_.clear();
+}
+
+void IoLoop::RunPendingTask()
+{
+    // 先清标记再取任务, 取任务期间新投递的会重新唤醒, 不会丢
+    wakeup_pending_.store(false, std::memory_order_release);
+
+    Task task;
+    while (pending_task_.Pop(task))
+    {
+        task();
+    }
+}
+
+void IoLoop::UpdateTime()
+{
+    now_ms_ = Util::GetMonotonicMs();
+}
@@ -1,20 +1,28 @@
 #ifndef __IO_LOOP_H__
 #define __IO_LOOP_H__
 
-#include "io_loop.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
 
+#include "io_buffer_pool.h"
+#include "lock_free_queue.h"
+#include "payload_pool.h"
+#include "timing_wheel.h"
+
+class EventFd;
 class Fd;
 
+struct iovec;
+
 class IoLoop
 {
 public:
-    IoLoop() 
-        : poll_fd_(-1)
-        , quit_(false)
-    {
-    }
+    typedef std::function<void()> Task;
 
-    virtual ~IoLoop() {}
+    IoLoop();
+    virtual ~IoLoop();
 
     virtual int Create() = 0;
     virtual void RunIOLoop(const int& timeout_in_millsecond) = 0;
@@ -25,9 +33,111 @@ public:
 
     virtual void WaitIO(const int& timeout_in_millsecond) = 0;
 
+    // 完成模式(io_uring): 发送提交给loop, 本轮攒的一起下发, 完成后回调fd->OnSendComplete.
+    // holder保证数据在完成之前有效, fd可能先析构
+    virtual bool IsCompletionMode() const
+    {
+        return false;
+    }
+
+    virtual int SubmitSend(Fd* fd, const struct iovec* vec, const int& count, const std::shared_ptr<void>& holder)
+    {
+        return -1;
+    }
+
+    // Fd析构时调用
+    virtual void CancelIo(Fd* fd)
+    {
+    }
+
+    // 任意线程可调用, task在本loop线程本轮io处理完之后执行
+    void QueueInLoop(const Task& task);
+
+    // 任意线程, RunIOLoop在本轮结束后返回
+    void Quit();
+
+    // 本线程调用, 本轮io分发完之后再delete, 同一批里后面的事件可能还指向它
+    void DeleteFdLater(Fd* fd);
+
+    // 本线程调用, 本轮的io/定时器/任务都跑完之后调一次fd->OnFlush, 用来攒批发送
+    void FlushLater(Fd* fd);
+    void CancelFlush(Fd* fd);
+
+    // 当前线程正在跑的loop, 还没跑过WaitIO的线程返回NULL
+    static IoLoop* GetCurrentLoop()
+    {
+        return current_loop_;
+    }
+
+    // 单调时钟, 每次从epoll_wait/io_uring_enter返回时更新一次, 包处理路径上直接用这个
+    uint64_t GetNowMs() const
+    {
+        return now_ms_;
+    }
+
+    TimingWheel& GetTimingWheel()
+    {
+        return timing_wheel_;
+    }
+
+    PayloadPool& GetPayloadPool()
+    {
+        return *payload_pool_;
+    }
+
+    IoBufferPool& GetIoBufferPool()
+    {
+        return *io_buffer_pool_;
+    }
+
+protected:
+    // 子类Create成功之后调用, 注册唤醒用的eventfd
+    void CreateWakeupFd();
+    void DeleteWakeupFd();
+
+    void SetCurrentLoop()
+    {
+        current_loop_ = this;
+    }
+
+    void RunPendingTask();
+
+    void RunDeferDelete();
+
+    void RunFlush();
+
+    void UpdateTime();
+
+    int GetWaitTimeout(const int& timeout_in_millsecond) const
+    {
+        return timing_wheel_.GetWaitTimeout(now_ms_, timeout_in_millsecond);
+    }
+
+    void RunTimer()
+    {
+        timing_wheel_.Advance(now_ms_);
+    }
+
 protected:
     int         poll_fd_;
     bool        quit_;
+
+private:
+    EventFd*                wakeup_fd_;
+    std::atomic<bool>       wakeup_pending_;
+    MpscQueue<Task>         pending_task_;
+
+    std::vector<Fd*>        defer_delete_fd_;
+    std::vector<Fd*>        flush_fd_;
+
+    uint64_t                now_ms_;
+    TimingWheel             timing_wheel_;
+
+    // 分出去的块可能比loop活得久, 析构时Close, 最后一个块还回来才释放
+    PayloadPool*            payload_pool_;
+    IoBufferPool*           io_buffer_pool_;
+
+    static thread_local IoLoop* current_loop_;
 };
     
 #endif // __IO_LOOP_H__
@@ -0,0 +1,70 @@
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+
+#include "common_define.h"
+#include "io_loop.h"
+#include "io_loop_thread.h"
+
+IoLoopThread::IoLoopThread(const int& index, IoLoop* io_loop)
+    : index_(index)
+    , cpu_(-1)
+    , io_loop_(io_loop)
+    , thread_(NULL)
+{
+}
+
+IoLoopThread::~IoLoopThread()
+{
+    if (thread_ != NULL)
+    {
+        io_loop_->Quit();
+        thread_->join();
+        delete thread_;
+    }
+
+    delete io_loop_;
+}
+
+int IoLoopThread::Start(const int& cpu)
+{
+    if (thread_ != NULL)
+    {
+        return kError;
+    }
+
+    cpu_ = cpu;
+    thread_ = new std::thread(&IoLoopThread::ThreadMain, this);
+
+    return kSuccess;
+}
+
+int IoLoopThread::BindCpu(const int& cpu)
+{
+    if (cpu < 0)
+    {
+        return kSuccess;
+    }
+
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(cpu, &cpu_set);
+
+    int ret = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+    if (ret != 0)
+    {
+        std::cout << LMSG << "bind cpu " << cpu << " err:" << strerror(ret) << std::endl;
+        return kError;
+    }
+
+    return kSuccess;
+}
+
+void IoLoopThread::ThreadMain()
+{
+    BindCpu(cpu_);
+
+    std::cout << LMSG << "loop " << index_ << " running, cpu:" << cpu_ << std::endl;
+
+    io_loop_->RunIOLoop(100);
+}
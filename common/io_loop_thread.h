@@ -0,0 +1,41 @@
+#ifndef __IO_LOOP_THREAD_H__
+#define __IO_LOOP_THREAD_H__
+
+#include <thread>
+
+class IoLoop;
+
+// 一个线程跑一个IoLoop, 多reactor模式下的worker
+class IoLoopThread
+{
+public:
+    // io_loop已经Create过, 归IoLoopThread所有
+    IoLoopThread(const int& index, IoLoop* io_loop);
+    ~IoLoopThread();
+
+    IoLoop* GetIoLoop()
+    {
+        return io_loop_;
+    }
+
+    int GetIndex() const
+    {
+        return index_;
+    }
+
+    // cpu < 0 表示不绑核
+    int Start(const int& cpu);
+
+    static int BindCpu(const int& cpu);
+
+private:
+    void ThreadMain();
+
+private:
+    int             index_;
+    int             cpu_;
+    IoLoop*         io_loop_;
+    std::thread*    thread_;
+};
+
+#endif // __IO_LOOP_THREAD_H__
@@ -0,0 +1,961 @@
+#include "common_define.h"
+#include "fd.h"
+#include "io_uring_loop.h"
+
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+#include <iostream>
+
+#include <linux/io_uring.h>
+
+// 5.11之后才有EXT_ARG(enter带超时), 头文件太老就整个编译成不可用, 运行时退回Epoller
+#if defined(IORING_FEAT_EXT_ARG) && defined(__NR_io_uring_setup)
+#define HAVE_IO_URING_EXT_ARG 1
+#endif
+
+// 6.0之后才有multishot recv, 头文件太老就只有就绪通知
+#if defined(HAVE_IO_URING_EXT_ARG) && defined(IORING_RECV_MULTISHOT) && defined(IORING_ACCEPT_MULTISHOT)
+#define HAVE_IO_URING_COMPLETION 1
+#endif
+
+// POLL_REMOVE/ASYNC_CANCEL自己的完成事件, 不关心. gen不会是0, 跟正常的user_data不会撞
+static const uint64_t kIgnoreUserData = 0;
+
+// user_data低30位是gen
+static const uint32_t kGenMask = (1U << 30) - 1;
+
+// 空闲槽位在slot_id_里的值
+static const uint64_t kFreeSlot = (uint64_t)-1;
+
+// 公共缓冲环, 每个loop 512 * 16K, 收到马上拷进连接自己的读缓冲再还回去
+static const uint16_t kBufGroup = 0;
+static const uint32_t kBufCount = 512;
+static const uint32_t kBufSize = 16 * 1024;
+
+// 跟TcpSocket一次writev的段数一样
+static const int kMaxSendIoVec = 64;
+
+bool IoUringLoop::enable_completion_io_ = true;
+
+struct IoUringLoop::InflightSend
+{
+    struct msghdr           msg;
+    struct iovec            vec[kMaxSendIoVec];
+    std::shared_ptr<void>   holder;
+};
+
+static bool KernelAtLeast(const int& major, const int& minor)
+{
+    struct utsname name;
+    if (uname(&name) != 0)
+    {
+        return false;
+    }
+
+    int kernel_major = 0;
+    int kernel_minor = 0;
+    if (sscanf(name.release, "%d.%d", &kernel_major, &kernel_minor) != 2)
+    {
+        return false;
+    }
+
+    return kernel_major > major || (kernel_major == major && kernel_minor >= minor);
+}
+
+IoUringLoop::IoUringLoop(const uint32_t& entries)
+    : IoLoop()
+    , entries_(entries)
+    , ring_ptr_(NULL)
+    , ring_size_(0)
+    , sqes_(NULL)
+    , sqes_size_(0)
+    , sq_head_(NULL)
+    , sq_tail_(NULL)
+    , sq_ring_mask_(NULL)
+    , sq_ring_entries_(NULL)
+    , cq_head_(NULL)
+    , cq_tail_(NULL)
+    , cq_ring_mask_(NULL)
+    , cqes_(NULL)
+    , sq_local_tail_(0)
+    , to_submit_(0)
+    , enter_count_(0)
+    , completion_io_(false)
+    , completion_read_(false)
+    , buf_ring_(NULL)
+    , buf_ring_size_(0)
+    , buf_base_(NULL)
+    , buf_ring_tail_(0)
+{
+}
+
+IoUringLoop::~IoUringLoop()
+{
+    DeleteWakeupFd();
+
+    if (sqes_ != NULL)
+    {
+        munmap(sqes_, sqes_size_);
+    }
+
+    if (ring_ptr_ != NULL)
+    {
+        munmap(ring_ptr_, ring_size_);
+    }
+
+    if (poll_fd_ > 0)
+    {
+        close(poll_fd_);
+    }
+
+    // ring关掉之后内核不会再碰这些内存
+    for (auto& kv : inflight_send_)
+    {
+        delete kv.second;
+    }
+
+    if (buf_ring_ != NULL)
+    {
+        munmap(buf_ring_, buf_ring_size_);
+    }
+
+    if (buf_base_ != NULL)
+    {
+        munmap(buf_base_, kBufCount * kBufSize);
+    }
+}
+
+#ifdef HAVE_IO_URING_EXT_ARG
+
+int IoUringLoop::Create()
+{
+    if (poll_fd_ >= 0)
+    {
+        return 0;
+    }
+
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    int ring_fd = syscall(__NR_io_uring_setup, entries_, &params);
+
+    if (ring_fd < 0)
+    {
+        std::cout << LMSG << "io_uring_setup failed, err:" << strerror(errno) << std::endl;
+        return -1;
+    }
+
+    if (! (params.features & IORING_FEAT_EXT_ARG) || ! (params.features & IORING_FEAT_SINGLE_MMAP))
+    {
+        std::cout << LMSG << "io_uring features:" << params.features << " not enough" << std::endl;
+        close(ring_fd);
+        return -1;
+    }
+
+    size_t sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    size_t cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+    ring_size_ = sq_ring_size > cq_ring_size ? sq_ring_size : cq_ring_size;
+    ring_ptr_ = mmap(NULL, ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+
+    if (ring_ptr_ == MAP_FAILED)
+    {
+        std::cout << LMSG << "mmap sq/cq ring failed, err:" << strerror(errno) << std::endl;
+        ring_ptr_ = NULL;
+        close(ring_fd);
+        return -1;
+    }
+
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = (io_uring_sqe*)mmap(NULL, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+
+    if (sqes_ == MAP_FAILED)
+    {
+        std::cout << LMSG << "mmap sqes failed, err:" << strerror(errno) << std::endl;
+        sqes_ = NULL;
+        close(ring_fd);
+        return -1;
+    }
+
+    uint8_t* ring = (uint8_t*)ring_ptr_;
+
+    sq_head_         = (uint32_t*)(ring + params.sq_off.head);
+    sq_tail_         = (uint32_t*)(ring + params.sq_off.tail);
+    sq_ring_mask_    = (uint32_t*)(ring + params.sq_off.ring_mask);
+    sq_ring_entries_ = (uint32_t*)(ring + params.sq_off.ring_entries);
+
+    cq_head_         = (uint32_t*)(ring + params.cq_off.head);
+    cq_tail_         = (uint32_t*)(ring + params.cq_off.tail);
+    cq_ring_mask_    = (uint32_t*)(ring + params.cq_off.ring_mask);
+    cqes_            = (io_uring_cqe*)(ring + params.cq_off.cqes);
+
+    // sqe下标跟ring下标一一对应, 之后不用再填
+    uint32_t* sq_array = (uint32_t*)(ring + params.sq_off.array);
+    for (uint32_t i = 0; i < params.sq_entries; ++i)
+    {
+        sq_array[i] = i;
+    }
+
+    sq_local_tail_ = *sq_tail_;
+    poll_fd_ = ring_fd;
+
+    if (enable_completion_io_ && KernelAtLeast(6, 0) && CreateBufRing() == 0)
+    {
+        completion_io_ = true;
+        completion_read_ = true;
+    }
+
+    std::cout << LMSG << "io_uring_setup success. poll_fd_=" << poll_fd_ << ",sq_entries:" << params.sq_entries
+              << ",cq_entries:" << params.cq_entries << ",completion_io:" << completion_io_ << std::endl;
+
+    CreateWakeupFd();
+
+    return 0;
+}
+
+io_uring_sqe* IoUringLoop::GetSqe()
+{
+    // sq满了先提交一次, 非SQPOLL模式下enter返回时内核已经消费完
+    if (sq_local_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= *sq_ring_entries_)
+    {
+        Enter(0, 0);
+
+        if (sq_local_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= *sq_ring_entries_)
+        {
+            return NULL;
+        }
+    }
+
+    io_uring_sqe* sqe = &sqes_[sq_local_tail_ & *sq_ring_mask_];
+    memset(sqe, 0, sizeof(io_uring_sqe));
+
+    ++sq_local_tail_;
+    ++to_submit_;
+
+    return sqe;
+}
+
+int IoUringLoop::Enter(const uint32_t& min_complete, const int& timeout_in_millsecond)
+{
+    __atomic_store_n(sq_tail_, sq_local_tail_, __ATOMIC_RELEASE);
+
+    uint32_t flags = IORING_ENTER_EXT_ARG;
+    if (min_complete > 0)
+    {
+        flags |= IORING_ENTER_GETEVENTS;
+    }
+
+    __kernel_timespec ts;
+    ts.tv_sec = timeout_in_millsecond / 1000;
+    ts.tv_nsec = (timeout_in_millsecond % 1000) * 1000000L;
+
+    io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    arg.sigmask_sz = _NSIG / 8;
+    if (timeout_in_millsecond >= 0)
+    {
+        arg.ts = (uint64_t)&ts;
+    }
+
+    ++enter_count_;
+
+    int ret = syscall(__NR_io_uring_enter, poll_fd_, to_submit_, min_complete, flags, &arg, sizeof(arg));
+
+    if (ret >= 0)
+    {
+        to_submit_ -= ret;
+    }
+    else if (errno != ETIME && errno != EINTR)
+    {
+        std::cout << LMSG << "io_uring_enter failed, err:" << strerror(errno) << std::endl;
+    }
+
+    return ret;
+}
+
+void IoUringLoop::WaitIO(const int& timeout_in_millsecond)
+{
+    SetCurrentLoop();
+
+    int timeout = GetWaitTimeout(timeout_in_millsecond);
+
+    // 上一轮攒下的arm/cancel和这次等待合并成一次系统调用
+    Enter(timeout == 0 ? 0 : 1, timeout);
+
+    UpdateTime();
+
+    // 先把cqe全拷出来再处理, 回调里可能继续提交
+    uint32_t head = *cq_head_;
+    uint32_t tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+
+    ready_.clear();
+    while (head != tail)
+    {
+        const io_uring_cqe& cqe = cqes_[head & *cq_ring_mask_];
+
+        if (cqe.user_data != kIgnoreUserData)
+        {
+            Completion completion;
+            completion.user_data = cqe.user_data;
+            completion.res = cqe.res;
+            completion.flags = cqe.flags;
+
+            ready_.push_back(completion);
+        }
+
+        ++head;
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+
+    for (const auto& completion : ready_)
+    {
+        uint32_t slot = completion.user_data >> 32;
+        int op = (completion.user_data >> 30) & 0x3;
+        uint32_t gen = completion.user_data & kGenMask;
+
+        // 槽位空着的话找不到表项, 按过期处理
+        uint64_t id = slot < slot_id_.size() ? slot_id_[slot] : kFreeSlot;
+
+        if (op == kOpSend)
+        {
+            HandleSend(id, gen, completion);
+            continue;
+        }
+
+        auto iter = poll_entry_.find(id);
+        bool stale = (iter == poll_entry_.end());
+
+        if (! stale)
+        {
+            stale = (op == kOpPoll) ? (iter->second.gen != gen) : (iter->second.read_gen != gen);
+        }
+
+        if (stale)
+        {
+            // 撤掉之前已经收到的数据/连接, 缓冲要还, 连接要关
+            if (completion.flags & IORING_CQE_F_BUFFER)
+            {
+                RecycleBuf(completion.flags >> IORING_CQE_BUFFER_SHIFT);
+            }
+
+            if (op == kOpAccept && completion.res >= 0)
+            {
+                close(completion.res);
+            }
+
+            continue;
+        }
+
+        if (op == kOpPoll)
+        {
+            HandlePoll(id, completion);
+        }
+        else
+        {
+            HandleRead(id, op, completion);
+        }
+    }
+
+    RunDeferDelete();
+    RunTimer();
+    RunPendingTask();
+    RunFlush();
+}
+
+void IoUringLoop::HandlePoll(const uint64_t& id, const Completion& completion)
+{
+    PollEntry& entry = poll_entry_[id];
+    entry.armed = false;
+
+    Fd* fd = entry.fd;
+    uint32_t revents = 0;
+
+    if (completion.res >= 0)
+    {
+        revents = completion.res;
+    }
+    else if (completion.res != -ECANCELED)
+    {
+        // 出错了也要让上层知道, 不然armed一直是false, 这个fd再也没有事件.
+        // 按关心的事件交给OnRead/OnWrite, 由read/accept/write把错误带出来
+        std::cout << LMSG << "poll failed, err:" << strerror(-completion.res) << std::endl;
+
+        if (entry.events & POLLIN)
+        {
+            revents = POLLERR;
+        }
+        else if (entry.events & POLLOUT)
+        {
+            revents = POLLOUT;
+        }
+    }
+
+    if (fd->IsClosing())
+    {
+        return;
+    }
+
+    if (revents & (POLLIN | POLLHUP | POLLERR))
+    {
+        int ret = fd->OnRead();
+        if (ret == kClose || ret == kError)
+        {
+            std::cout << LMSG << "closed, ret:" << ret << std::endl;
+            DeleteFdLater(fd);
+            return;
+        }
+    }
+
+    if (revents & POLLOUT)
+    {
+        // OnRead里可能把写事件关掉了
+        auto iter = poll_entry_.find(id);
+        if (iter != poll_entry_.end() && (iter->second.events & POLLOUT))
+        {
+            int ret = fd->OnWrite();
+            if (ret < 0)
+            {
+                DeleteFdLater(fd);
+                return;
+            }
+        }
+    }
+
+    // 单次poll是水平触发语义, 处理完再挂上(被取消的也一样); multishot poll是边沿触发, 上层没有按读到EAGAIN来写
+    auto iter = poll_entry_.find(id);
+    if (iter != poll_entry_.end())
+    {
+        UpdateEntry(iter->second);
+    }
+}
+
+void IoUringLoop::HandleRead(const uint64_t& id, const int& op, const Completion& completion)
+{
+    PollEntry& entry = poll_entry_[id];
+
+    // 没有F_MORE说明这个multishot结束了, 处理完要重新挂
+    bool more = (completion.flags & IORING_CQE_F_MORE);
+    if (! more)
+    {
+        entry.read_armed = false;
+    }
+
+    Fd* fd = entry.fd;
+    bool has_buf = (completion.flags & IORING_CQE_F_BUFFER);
+    uint16_t bid = completion.flags >> IORING_CQE_BUFFER_SHIFT;
+
+    int ret = kSuccess;
+
+    if (fd->IsClosing())
+    {
+        if (op == kOpAccept && completion.res >= 0)
+        {
+            close(completion.res);
+        }
+    }
+    else if (completion.res >= 0)
+    {
+        if (op == kOpAccept)
+        {
+            ret = fd->OnAccept(completion.res);
+        }
+        else
+        {
+            // res为0是对端关闭
+            ret = fd->OnRecv(has_buf ? buf_base_ + (size_t)bid * kBufSize : NULL, completion.res);
+        }
+    }
+    else if (completion.res == -ENOBUFS || completion.res == -ECANCELED)
+    {
+        // 缓冲环暂时空了(本轮处理完都会还回去)或者被内核取消, 下面重新挂上
+    }
+    else if (completion.res == -EINVAL && completion_read_)
+    {
+        std::cout << LMSG << "multishot " << (op == kOpAccept ? "accept" : "recv") << " not supported, fallback to poll" << std::endl;
+        completion_read_ = false;
+    }
+    else
+    {
+        // 别的错误交给OnRead, 用普通的read/accept把错误带出来, 不能不管, 不然这个fd再也没有读事件
+        std::cout << LMSG << fd->name() << " " << (op == kOpAccept ? "accept" : "recv") << " failed, err:" << strerror(-completion.res) << std::endl;
+        ret = fd->OnRead();
+    }
+
+    if (has_buf)
+    {
+        RecycleBuf(bid);
+    }
+
+    if (ret == kClose || ret == kError)
+    {
+        std::cout << LMSG << "closed, ret:" << ret << std::endl;
+        DeleteFdLater(fd);
+        return;
+    }
+
+    if (! more)
+    {
+        auto iter = poll_entry_.find(id);
+        if (iter != poll_entry_.end() && ! iter->second.fd->IsClosing())
+        {
+            UpdateEntry(iter->second);
+        }
+    }
+}
+
+void IoUringLoop::HandleSend(const uint64_t& id, const uint32_t& gen, const Completion& completion)
+{
+    // 发送的数据到这里之前一直由holder撑着, fd可能已经没了
+    InflightSend* inflight = NULL;
+
+    auto send_iter = inflight_send_.find(completion.user_data);
+    if (send_iter != inflight_send_.end())
+    {
+        inflight = send_iter->second;
+        inflight_send_.erase(send_iter);
+    }
+
+    auto iter = poll_entry_.find(id);
+    if (iter != poll_entry_.end() && iter->second.send_gen == gen)
+    {
+        iter->second.send_gen = 0;
+
+        Fd* fd = iter->second.fd;
+        if (! fd->IsClosing())
+        {
+            int ret = fd->OnSendComplete(completion.res);
+            if (ret == kClose || ret == kError)
+            {
+                DeleteFdLater(fd);
+            }
+        }
+    }
+
+    delete inflight;
+}
+
+int IoUringLoop::SubmitSend(Fd* fd, const struct iovec* vec, const int& count, const std::shared_ptr<void>& holder)
+{
+    if (! completion_io_ || count <= 0 || count > kMaxSendIoVec)
+    {
+        return -1;
+    }
+
+    PollEntry& entry = GetEntry(fd);
+
+    // 一个fd同时只有一个发送在途, 不然顺序没法保证
+    if (entry.send_gen != 0)
+    {
+        return -1;
+    }
+
+    io_uring_sqe* sqe = GetSqe();
+    if (sqe == NULL)
+    {
+        std::cout << LMSG << "no sqe for send" << std::endl;
+        return -1;
+    }
+
+    InflightSend* inflight = new InflightSend();
+    memset(&inflight->msg, 0, sizeof(inflight->msg));
+    memcpy(inflight->vec, vec, count * sizeof(struct iovec));
+    inflight->msg.msg_iov = inflight->vec;
+    inflight->msg.msg_iovlen = count;
+    inflight->holder = holder;
+
+    entry.send_gen = NextGen(entry.slot);
+
+    uint64_t user_data = EncodeUserData(entry.slot, kOpSend, entry.send_gen);
+    inflight_send_[user_data] = inflight;
+
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd->fd();
+    sqe->addr = (uint64_t)&inflight->msg;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = user_data;
+
+    return 0;
+}
+
+void IoUringLoop::ArmPoll(PollEntry& entry)
+{
+    io_uring_sqe* sqe = GetSqe();
+    if (sqe == NULL)
+    {
+        std::cout << LMSG << "no sqe for poll add" << std::endl;
+        return;
+    }
+
+    entry.gen = NextGen(entry.slot);
+    entry.armed = true;
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = entry.fd->fd();
+    sqe->poll32_events = entry.events;
+    sqe->user_data = EncodeUserData(entry.slot, kOpPoll, entry.gen);
+}
+
+void IoUringLoop::CancelPoll(PollEntry& entry)
+{
+    if (! entry.armed)
+    {
+        return;
+    }
+
+    io_uring_sqe* sqe = GetSqe();
+    if (sqe == NULL)
+    {
+        std::cout << LMSG << "no sqe for poll remove" << std::endl;
+        return;
+    }
+
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->addr = EncodeUserData(entry.slot, kOpPoll, entry.gen);
+    sqe->user_data = kIgnoreUserData;
+
+    entry.armed = false;
+}
+
+void IoUringLoop::ArmRead(PollEntry& entry, const int& read_mode)
+{
+#ifdef HAVE_IO_URING_COMPLETION
+    io_uring_sqe* sqe = GetSqe();
+    if (sqe == NULL)
+    {
+        std::cout << LMSG << "no sqe for " << (read_mode == kReadByAccept ? "accept" : "recv") << std::endl;
+        return;
+    }
+
+    entry.read_mode = read_mode;
+    entry.read_gen = NextGen(entry.slot);
+    entry.read_armed = true;
+
+    sqe->fd = entry.fd->fd();
+
+    if (read_mode == kReadByAccept)
+    {
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+        sqe->accept_flags = SOCK_NONBLOCK;
+        sqe->user_data = EncodeUserData(entry.slot, kOpAccept, entry.read_gen);
+    }
+    else
+    {
+        // 不带缓冲, 数据到了内核从缓冲环里挑一块填
+        sqe->opcode = IORING_OP_RECV;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = kBufGroup;
+        sqe->user_data = EncodeUserData(entry.slot, kOpRecv, entry.read_gen);
+    }
+#else
+    UNUSED(entry);
+    UNUSED(read_mode);
+#endif
+}
+
+void IoUringLoop::CancelRead(PollEntry& entry)
+{
+    if (! entry.read_armed)
+    {
+        return;
+    }
+
+    CancelUserData(EncodeUserData(entry.slot, entry.read_mode == kReadByAccept ? kOpAccept : kOpRecv, entry.read_gen));
+
+    entry.read_armed = false;
+}
+
+void IoUringLoop::CancelUserData(const uint64_t& user_data)
+{
+    io_uring_sqe* sqe = GetSqe();
+    if (sqe == NULL)
+    {
+        std::cout << LMSG << "no sqe for async cancel" << std::endl;
+        return;
+    }
+
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = user_data;
+    sqe->user_data = kIgnoreUserData;
+}
+
+int IoUringLoop::CreateBufRing()
+{
+#ifdef HAVE_IO_URING_COMPLETION
+    // 环和缓冲都要页对齐
+    buf_ring_size_ = kBufCount * sizeof(io_uring_buf);
+    void* ring = mmap(NULL, buf_ring_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED)
+    {
+        std::cout << LMSG << "mmap buf ring failed, err:" << strerror(errno) << std::endl;
+        return -1;
+    }
+
+    void* base = mmap(NULL, kBufCount * kBufSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+    {
+        std::cout << LMSG << "mmap recv buffers failed, err:" << strerror(errno) << std::endl;
+        munmap(ring, buf_ring_size_);
+        return -1;
+    }
+
+    io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)ring;
+    reg.ring_entries = kBufCount;
+    reg.bgid = kBufGroup;
+
+    if (syscall(__NR_io_uring_register, poll_fd_, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+    {
+        std::cout << LMSG << "register buf ring failed, err:" << strerror(errno) << std::endl;
+        munmap(base, kBufCount * kBufSize);
+        munmap(ring, buf_ring_size_);
+        return -1;
+    }
+
+    buf_ring_ = (io_uring_buf_ring*)ring;
+    buf_base_ = (uint8_t*)base;
+    buf_ring_tail_ = 0;
+
+    for (uint32_t bid = 0; bid < kBufCount; ++bid)
+    {
+        RecycleBuf(bid);
+    }
+
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+void IoUringLoop::RecycleBuf(const uint16_t& bid)
+{
+#ifdef HAVE_IO_URING_COMPLETION
+    // 不能用bufs成员, C++里__DECLARE_FLEX_ARRAY前面的空结构体占1字节, bufs整体往后错了8字节
+    io_uring_buf& buf = ((io_uring_buf*)buf_ring_)[buf_ring_tail_ & (kBufCount - 1)];
+    buf.addr = (uint64_t)(buf_base_ + (size_t)bid * kBufSize);
+    buf.len = kBufSize;
+    buf.bid = bid;
+
+    ++buf_ring_tail_;
+    __atomic_store_n(&buf_ring_->tail, buf_ring_tail_, __ATOMIC_RELEASE);
+#else
+    UNUSED(bid);
+#endif
+}
+
+#else
+
+int IoUringLoop::Create()
+{
+    std::cout << LMSG << "io_uring not supported by build headers" << std::endl;
+    return -1;
+}
+
+void IoUringLoop::WaitIO(const int& timeout_in_millsecond)
+{
+    UNUSED(timeout_in_millsecond);
+}
+
+int IoUringLoop::SubmitSend(Fd* fd, const struct iovec* vec, const int& count, const std::shared_ptr<void>& holder)
+{
+    UNUSED(fd);
+    UNUSED(vec);
+    UNUSED(count);
+    UNUSED(holder);
+    return -1;
+}
+
+void IoUringLoop::ArmPoll(PollEntry& entry)
+{
+    UNUSED(entry);
+}
+
+void IoUringLoop::CancelPoll(PollEntry& entry)
+{
+    UNUSED(entry);
+}
+
+void IoUringLoop::ArmRead(PollEntry& entry, const int& read_mode)
+{
+    UNUSED(entry);
+    UNUSED(read_mode);
+}
+
+void IoUringLoop::CancelRead(PollEntry& entry)
+{
+    UNUSED(entry);
+}
+
+void IoUringLoop::CancelUserData(const uint64_t& user_data)
+{
+    UNUSED(user_data);
+}
+
+#endif
+
+void IoUringLoop::RunIOLoop(const int& timeout_in_millsecond)
+{
+    while (! quit_)
+    {
+        WaitIO(timeout_in_millsecond);
+    }
+}
+
+uint32_t IoUringLoop::NextGen(const uint32_t& slot)
+{
+    uint32_t gen = (slot_gen_[slot] + 1) & kGenMask;
+    if (gen == 0)
+    {
+        gen = 1;
+    }
+
+    slot_gen_[slot] = gen;
+
+    return gen;
+}
+
+IoUringLoop::PollEntry& IoUringLoop::GetEntry(Fd* fd)
+{
+    auto ret = poll_entry_.emplace(fd->id(), PollEntry());
+    PollEntry& entry = ret.first->second;
+
+    if (ret.second)
+    {
+        // 复用的槽位gen接着涨, 上一个fd过期的cqe对不上
+        if (free_slot_.empty())
+        {
+            free_slot_.push_back(slot_id_.size());
+            slot_id_.push_back(kFreeSlot);
+            slot_gen_.push_back(0);
+        }
+
+        entry.slot = free_slot_.back();
+        free_slot_.pop_back();
+        slot_id_[entry.slot] = fd->id();
+
+        entry.fd = fd;
+        entry.events = 0;
+        entry.gen = 0;
+        entry.armed = false;
+        entry.read_mode = kReadByPoll;
+        entry.read_gen = 0;
+        entry.read_armed = false;
+        entry.send_gen = 0;
+    }
+
+    return entry;
+}
+
+void IoUringLoop::UpdateEntry(PollEntry& entry)
+{
+    uint32_t events = entry.fd->events();
+    int read_mode = kReadByPoll;
+
+    // 完成模式的读不用POLLIN
+    if (completion_read_ && (events & POLLIN))
+    {
+        read_mode = entry.fd->GetReadMode();
+    }
+
+    if (read_mode != kReadByPoll)
+    {
+        events &= ~POLLIN;
+    }
+
+    if (entry.read_armed && entry.read_mode != read_mode)
+    {
+        CancelRead(entry);
+    }
+
+    if (! entry.read_armed && read_mode != kReadByPoll)
+    {
+        ArmRead(entry, read_mode);
+    }
+
+    // 正在分发这个fd的时候armed是false, 直接按新的events挂上, 分发完不会重复挂
+    if (entry.armed && entry.events != events)
+    {
+        CancelPoll(entry);
+    }
+
+    entry.events = events;
+
+    if (! entry.armed && events != 0)
+    {
+        ArmPoll(entry);
+    }
+}
+
+int IoUringLoop::AddFd(Fd* fd)
+{
+    UpdateEntry(GetEntry(fd));
+
+    return 0;
+}
+
+int IoUringLoop::DelFd(Fd* fd)
+{
+    auto iter = poll_entry_.find(fd->id());
+
+    if (iter == poll_entry_.end())
+    {
+        return -1;
+    }
+
+    // 事件都关了, 在途的发送还要等完成, 表项留到CancelIo
+    UpdateEntry(iter->second);
+
+    return 0;
+}
+
+int IoUringLoop::ModFd(Fd* fd)
+{
+    auto iter = poll_entry_.find(fd->id());
+
+    if (iter == poll_entry_.end())
+    {
+        return -1;
+    }
+
+    UpdateEntry(iter->second);
+
+    return 0;
+}
+
+void IoUringLoop::CancelIo(Fd* fd)
+{
+    auto iter = poll_entry_.find(fd->id());
+
+    if (iter == poll_entry_.end())
+    {
+        return;
+    }
+
+    PollEntry& entry = iter->second;
+
+    CancelPoll(entry);
+    CancelRead(entry);
+
+    // fd已经关了, 不撤掉的话内核里的请求一直占着socket
+    if (entry.send_gen != 0)
+    {
+        CancelUserData(EncodeUserData(entry.slot, kOpSend, entry.send_gen));
+    }
+
+    slot_id_[entry.slot] = kFreeSlot;
+    free_slot_.push_back(entry.slot);
+
+    poll_entry_.erase(iter);
+}
@@ -0,0 +1,172 @@
+#ifndef __IO_URING_LOOP_H__
+#define __IO_URING_LOOP_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "io_loop.h"
+
+class Fd;
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct io_uring_buf_ring;
+
+// io_uring后端, 不依赖liburing, 直接走系统调用.
+// 注册/修改/删除跟等待一起在一次io_uring_enter里批量提交, 没有epoll_ctl.
+// 内核>=6.0时TcpSocket走完成模式: 监听socket用multishot accept, 连接用multishot recv + 公共缓冲环,
+// 发送在本轮结束时每个连接一个SENDMSG一起提交; 别的Fd(udp/eventfd/ssl)还是就绪通知(POLL_ADD).
+// 完成模式下Send只是排队, 发完就要关的连接用TcpSocket::CloseAfterFlush, 不能直接delete.
+class IoUringLoop : public IoLoop
+{
+public:
+    IoUringLoop(const uint32_t& entries = 4096);
+    ~IoUringLoop();
+
+    // 内核不支持(< 5.11)或者被禁用时返回-1, 调用方退回Epoller
+    int Create();
+    void RunIOLoop(const int& timeout_in_millsecond);
+
+    int AddFd(Fd* fd);
+    int DelFd(Fd* fd);
+    int ModFd(Fd* fd);
+
+    void WaitIO(const int& timeout_in_millsecond);
+
+    bool IsCompletionMode() const
+    {
+        return completion_io_;
+    }
+
+    int SubmitSend(Fd* fd, const struct iovec* vec, const int& count, const std::shared_ptr<void>& holder);
+    void CancelIo(Fd* fd);
+
+    // Create之前设置, false时全部走就绪通知
+    static void SetCompletionIo(const bool& completion_io)
+    {
+        enable_completion_io_ = completion_io;
+    }
+
+    // io_uring_enter调用次数, 压测用
+    uint64_t GetEnterCount() const
+    {
+        return enter_count_;
+    }
+
+private:
+    enum Op
+    {
+        kOpPoll = 0,
+        kOpAccept = 1,
+        kOpRecv = 2,
+        kOpSend = 3,
+    };
+
+    struct PollEntry
+    {
+        Fd*         fd;
+        uint32_t    slot;
+
+        // poll挂着的事件, 完成模式读的时候不含POLLIN
+        uint32_t    events;
+        uint32_t    gen;
+        bool        armed;
+
+        // multishot accept/recv
+        int         read_mode;
+        uint32_t    read_gen;
+        bool        read_armed;
+
+        // 在途的发送, 0表示没有
+        uint32_t    send_gen;
+    };
+
+    struct Completion
+    {
+        uint64_t    user_data;
+        int32_t     res;
+        uint32_t    flags;
+    };
+
+    // 提交到完成之间内核要用的msghdr/iovec, 以及保证数据有效的holder
+    struct InflightSend;
+
+    io_uring_sqe* GetSqe();
+    int Enter(const uint32_t& min_complete, const int& timeout_in_millsecond);
+
+    int CreateBufRing();
+    void RecycleBuf(const uint16_t& bid);
+
+    uint32_t NextGen(const uint32_t& slot);
+
+    // 按fd当前的events和读模式挂上/撤掉poll和multishot读
+    void UpdateEntry(PollEntry& entry);
+
+    void ArmPoll(PollEntry& entry);
+    void CancelPoll(PollEntry& entry);
+    void ArmRead(PollEntry& entry, const int& read_mode);
+    void CancelRead(PollEntry& entry);
+    void CancelUserData(const uint64_t& user_data);
+
+    PollEntry& GetEntry(Fd* fd);
+
+    // 回调里可能加删fd, map会rehash, 每次回调之后都按id重新找
+    void HandlePoll(const uint64_t& id, const Completion& completion);
+    void HandleRead(const uint64_t& id, const int& op, const Completion& completion);
+    void HandleSend(const uint64_t& id, const uint32_t& gen, const Completion& completion);
+
+    // user_data = 槽位 << 32 | op << 30 | gen, 每次arm换一个gen, 过期的cqe直接丢掉.
+    // 槽位是表项在loop里的编号, fd删掉之后给新fd复用; gen按槽位递增, 复用了也接着涨,
+    // 同一个槽位arm满2^30次才会回绕, 过期的cqe等不到那时候
+    static uint64_t EncodeUserData(const uint32_t& slot, const int& op, const uint32_t& gen)
+    {
+        return ((uint64_t)slot << 32) | ((uint64_t)op << 30) | gen;
+    }
+
+private:
+    uint32_t        entries_;
+
+    void*           ring_ptr_;
+    size_t          ring_size_;
+    io_uring_sqe*   sqes_;
+    size_t          sqes_size_;
+
+    uint32_t*       sq_head_;
+    uint32_t*       sq_tail_;
+    uint32_t*       sq_ring_mask_;
+    uint32_t*       sq_ring_entries_;
+
+    uint32_t*       cq_head_;
+    uint32_t*       cq_tail_;
+    uint32_t*       cq_ring_mask_;
+    io_uring_cqe*   cqes_;
+
+    uint32_t        sq_local_tail_;
+    uint32_t        to_submit_;
+    uint64_t        enter_count_;
+
+    // multishot recv的公共缓冲环, 内核挑一块填好, 处理完马上还回去
+    bool                completion_io_;
+    bool                completion_read_;
+    io_uring_buf_ring*  buf_ring_;
+    size_t              buf_ring_size_;
+    uint8_t*            buf_base_;
+    uint16_t            buf_ring_tail_;
+
+    std::unordered_map<uint64_t, PollEntry>         poll_entry_;
+
+    // 槽位 -> fd id, 空闲的槽位放free_slot_; 每个槽位上一次用掉的gen
+    std::vector<uint64_t>                           slot_id_;
+    std::vector<uint32_t>                           slot_gen_;
+    std::vector<uint32_t>                           free_slot_;
+    std::unordered_map<uint64_t, InflightSend*>     inflight_send_;
+    std::vector<Completion>                         ready_;
+
+    static bool     enable_completion_io_;
+};
+
+#endif // __IO_URING_LOOP_H__
@@ -0,0 +1,156 @@
+#ifndef __LOCK_FREE_QUEUE_H__
+#define __LOCK_FREE_QUEUE_H__
+
+#include <stddef.h>
+
+#include <atomic>
+#include <vector>
+
+// 多生产者单消费者无界队列(Vyukov), 用于跨loop投递任务
+template<typename T>
+class MpscQueue
+{
+public:
+    MpscQueue()
+        : head_(new Node())
+        , tail_(head_.load())
+    {
+    }
+
+    ~MpscQueue()
+    {
+        T tmp;
+        while (Pop(tmp))
+        {
+        }
+
+        delete tail_;
+    }
+
+    // 任意线程
+    void Push(const T& value)
+    {
+        Node* node = new Node(value);
+
+        Node* prev = head_.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    // 仅消费者线程
+    bool Pop(T& value)
+    {
+        Node* tail = tail_;
+        Node* next = tail->next.load(std::memory_order_acquire);
+
+        if (next == NULL)
+        {
+            return false;
+        }
+
+        value = next->value;
+        next->value = T();
+
+        tail_ = next;
+        delete tail;
+
+        return true;
+    }
+
+private:
+    struct Node
+    {
+        Node()
+            : next(NULL)
+        {
+        }
+
+        explicit Node(const T& v)
+            : next(NULL)
+            , value(v)
+        {
+        }
+
+        std::atomic<Node*> next;
+        T value;
+    };
+
+    std::atomic<Node*> head_;
+    Node* tail_;
+};
+
+// 单生产者单消费者有界环形队列, 满了由生产者决定丢弃策略
+template<typename T>
+class SpscRing
+{
+public:
+    explicit SpscRing(const size_t& capacity)
+        : mask_(RoundUpPowerOfTwo(capacity) - 1)
+        , slots_(mask_ + 1)
+        , head_(0)
+        , tail_(0)
+    {
+    }
+
+    bool Push(const T& value)
+    {
+        size_t head = head_.load(std::memory_order_relaxed);
+
+        if (head - tail_.load(std::memory_order_acquire) > mask_)
+        {
+            return false;
+        }
+
+        slots_[head & mask_] = value;
+        head_.store(head + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    bool Pop(T& value)
+    {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+
+        if (tail == head_.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+
+        value = slots_[tail & mask_];
+        slots_[tail & mask_] = T();
+        tail_.store(tail + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    size_t Size() const
+    {
+        return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+    }
+
+    size_t Capacity() const
+    {
+        return mask_ + 1;
+    }
+
+private:
+    static size_t RoundUpPowerOfTwo(size_t n)
+    {
+        size_t ret = 2;
+        while (ret < n)
+        {
+            ret <<= 1;
+        }
+
+        return ret;
+    }
+
+private:
+    size_t              mask_;
+    std::vector<T>      slots_;
+
+    // 生产者和消费者各写一个, 分开cache line避免伪共享
+    alignas(64) std::atomic<size_t> head_;
+    alignas(64) std::atomic<size_t> tail_;
+};
+
+#endif // __LOCK_FREE_QUEUE_H__
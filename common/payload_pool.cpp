@@ -0,0 +1,322 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <iostream>
+#include <new>
+#include <sstream>
+
+#include "common_define.h"
+#include "io_loop.h"
+#include "payload_pool.h"
+#include "ref_ptr.h"
+
+// 每次向系统要一个arena, 正好一个2M大页
+static const size_t kArenaSize = 2 * 1024 * 1024;
+
+// 单个loop的池子上限, 超过之后新块走malloc
+static const uint64_t kMaxArenaBytes = 512 * 1024 * 1024;
+
+// 统计打印间隔
+static const uint64_t kPayloadStatIntervalMs = 60*1000;
+
+// 没Close之前ref_count_的偏置, 别的线程怎么还都减不到0
+static const int64_t kOpenBias = 1LL << 62;
+
+bool PayloadPool::huge_page_ = false;
+
+static RefPtr*& NextFree(RefPtr* block)
+{
+    // 空闲块的数据区第一个字放链表指针, 最小的块也放得下
+    return *(RefPtr**)((uint8_t*)block + sizeof(RefPtr));
+}
+
+PayloadPool::PayloadPool(IoLoop* io_loop)
+    : io_loop_(io_loop)
+    , remote_free_(NULL)
+    , live_blocks_(0)
+    , ref_count_(kOpenBias)
+    , closed_(false)
+    , arena_pos_(NULL)
+    , arena_end_(NULL)
+    , live_bytes_(0)
+    , arena_bytes_(0)
+    , large_count_(0)
+    , alloc_count_(0)
+    , remote_free_count_(0)
+    , stat_timer_(new WheelTimer(io_loop))
+{
+    for (int i = 0; i < kClassNum; ++i)
+    {
+        free_list_[i] = NULL;
+    }
+}
+
+PayloadPool::~PayloadPool()
+{
+    for (const auto& arena : arena_)
+    {
+        munmap(arena.first, arena.second);
+    }
+}
+
+void PayloadPool::Close()
+{
+    delete stat_timer_;
+    stat_timer_ = NULL;
+
+    // 之后本线程还的块也走remote, 不再碰空闲链表
+    closed_.store(true, std::memory_order_relaxed);
+
+    int64_t live = ref_count_.fetch_add(live_blocks_ - kOpenBias, std::memory_order_acq_rel) + live_blocks_ - kOpenBias;
+
+    if (live == 0)
+    {
+        delete this;
+        return;
+    }
+
+    std::cout << LMSG << "payload pool closed with " << live << " blocks alive, free it when they come back" << std::endl;
+}
+
+int PayloadPool::GetSizeClass(const uint64_t& len)
+{
+    uint64_t need = len + sizeof(RefPtr);
+
+    if (need > (1ULL << kMaxShift))
+    {
+        return kLargeClass;
+    }
+
+    int size_class = 0;
+    while ((1ULL << (kMinShift + size_class)) < need)
+    {
+        ++size_class;
+    }
+
+    return size_class;
+}
+
+RefPtr* PayloadPool::Allocate(const uint64_t& len)
+{
+    IoLoop* io_loop = IoLoop::GetCurrentLoop();
+
+    if (io_loop != NULL)
+    {
+        return io_loop->GetPayloadPool().Alloc(len);
+    }
+
+    void* ptr = malloc(sizeof(RefPtr) + len);
+
+    return new (ptr) RefPtr(NULL, kLargeClass);
+}
+
+void PayloadPool::Release(RefPtr* block)
+{
+    PayloadPool* pool = block->pool_;
+
+    if (pool == NULL)
+    {
+        block->~RefPtr();
+        free(block);
+        return;
+    }
+
+    pool->Free(block);
+}
+
+RefPtr* PayloadPool::Alloc(const uint64_t& len)
+{
+    ++alloc_count_;
+
+    if (! stat_timer_->IsActive())
+    {
+        stat_timer_->RunEvery(kPayloadStatIntervalMs, [this]()
+        {
+            PrintStat();
+        });
+    }
+
+    int size_class = GetSizeClass(len);
+
+    if (size_class != kLargeClass)
+    {
+        size_t block_size = 1UL << (kMinShift + size_class);
+
+        if (free_list_[size_class] == NULL && remote_free_.load(std::memory_order_relaxed) != NULL)
+        {
+            DrainRemoteFree();
+        }
+
+        RefPtr* block = free_list_[size_class];
+
+        if (block != NULL)
+        {
+            free_list_[size_class] = NextFree(block);
+            --class_stat_[size_class].free;
+        }
+        else if ((size_t)(arena_end_ - arena_pos_) >= block_size || NewArena())
+        {
+            block = (RefPtr*)arena_pos_;
+            arena_pos_ += block_size;
+        }
+
+        if (block != NULL)
+        {
+            ++live_blocks_;
+            ++class_stat_[size_class].in_use;
+            live_bytes_ += block_size;
+
+            return new (block) RefPtr(this, size_class);
+        }
+    }
+
+    ++large_count_;
+
+    void* ptr = malloc(sizeof(RefPtr) + len);
+
+    return new (ptr) RefPtr(NULL, kLargeClass);
+}
+
+void PayloadPool::Free(RefPtr* block)
+{
+    // 别的loop上最后一个引用没了, 还给所属loop
+    if (closed_.load(std::memory_order_relaxed) || IoLoop::GetCurrentLoop() != io_loop_)
+    {
+        RefPtr* head = remote_free_.load(std::memory_order_relaxed);
+
+        do
+        {
+            NextFree(block) = head;
+        } while (! remote_free_.compare_exchange_weak(head, block, std::memory_order_release, std::memory_order_relaxed));
+
+        // loop已经没了, 最后一个块还回来的时候释放整个池子
+        if (ref_count_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            delete this;
+        }
+
+        return;
+    }
+
+    --live_blocks_;
+
+    PutFree(block);
+}
+
+void PayloadPool::PutFree(RefPtr* block)
+{
+    int size_class = block->size_class_;
+
+    block->~RefPtr();
+
+    NextFree(block) = free_list_[size_class];
+    free_list_[size_class] = block;
+
+    --class_stat_[size_class].in_use;
+    ++class_stat_[size_class].free;
+    live_bytes_ -= 1UL << (kMinShift + size_class);
+}
+
+void PayloadPool::DrainRemoteFree()
+{
+    RefPtr* block = remote_free_.exchange(NULL, std::memory_order_acquire);
+
+    while (block != NULL)
+    {
+        RefPtr* next = NextFree(block);
+
+        ++remote_free_count_;
+        PutFree(block);
+
+        block = next;
+    }
+}
+
+bool PayloadPool::NewArena()
+{
+    if (arena_bytes_ + kArenaSize > kMaxArenaBytes)
+    {
+        return false;
+    }
+
+    // 旧arena剩下的尾巴切成小块挂到空闲链表上
+    while ((size_t)(arena_end_ - arena_pos_) >= (1UL << kMinShift))
+    {
+        int size_class = kClassNum - 1;
+        while ((size_t)(arena_end_ - arena_pos_) < (1UL << (kMinShift + size_class)))
+        {
+            --size_class;
+        }
+
+        RefPtr* block = (RefPtr*)arena_pos_;
+        arena_pos_ += 1UL << (kMinShift + size_class);
+
+        NextFree(block) = free_list_[size_class];
+        free_list_[size_class] = block;
+        ++class_stat_[size_class].free;
+    }
+
+    void* ptr = MAP_FAILED;
+
+    if (huge_page_)
+    {
+        ptr = mmap(NULL, kArenaSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    }
+
+    if (ptr == MAP_FAILED)
+    {
+        // 多映射一个arena再裁掉头尾, 保证2M对齐, 透明大页才能整页映射
+        uint8_t* raw = (uint8_t*)mmap(NULL, kArenaSize * 2, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        if (raw == MAP_FAILED)
+        {
+            std::cout << LMSG << "mmap arena failed, err:" << strerror(errno) << std::endl;
+            return false;
+        }
+
+        uint8_t* aligned = (uint8_t*)(((uintptr_t)raw + kArenaSize - 1) & ~(uintptr_t)(kArenaSize - 1));
+
+        if (aligned > raw)
+        {
+            munmap(raw, aligned - raw);
+        }
+        munmap(aligned + kArenaSize, raw + kArenaSize * 2 - (aligned + kArenaSize));
+
+        ptr = aligned;
+
+        // 没有预留大页就退到透明大页
+        if (huge_page_)
+        {
+            madvise(ptr, kArenaSize, MADV_HUGEPAGE);
+        }
+    }
+
+    arena_.push_back(std::make_pair((uint8_t*)ptr, kArenaSize));
+
+    arena_pos_ = (uint8_t*)ptr;
+    arena_end_ = arena_pos_ + kArenaSize;
+    arena_bytes_ += kArenaSize;
+
+    return true;
+}
+
+void PayloadPool::PrintStat()
+{
+    std::ostringstream os;
+
+    for (int i = 0; i < kClassNum; ++i)
+    {
+        if (class_stat_[i].in_use != 0 || class_stat_[i].free != 0)
+        {
+            os << " " << (1UL << (kMinShift + i)) << ":" << class_stat_[i].in_use << "/" << class_stat_[i].free;
+        }
+    }
+
+    std::cout << LMSG << "[STAT] payload live:" << live_bytes_ << ",arena:" << arena_bytes_ << ",alloc:" << alloc_count_
+              << ",large:" << large_count_ << ",remote_free:" << remote_free_count_ << ",class(in_use/free):" << os.str() << std::endl;
+
+    alloc_count_ = 0;
+    large_count_ = 0;
+    remote_free_count_ = 0;
+}
@@ -0,0 +1,110 @@
+#ifndef __PAYLOAD_POOL_H__
+#define __PAYLOAD_POOL_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <vector>
+
+#include "timing_wheel.h"
+
+class IoLoop;
+class RefPtr;
+
+// 每个loop一个, 按大小分级的payload内存池, 块头(RefPtr)和数据一次分配.
+// 只在所属loop线程分配, 别的线程释放的块挂到remote链表上, 下次分配时收回来.
+// 块可能比loop活得久(在别的loop的GOP缓存/发送队列里), loop析构时Close, 池子等最后一个块还回来再释放.
+class PayloadPool
+{
+public:
+    explicit PayloadPool(IoLoop* io_loop);
+
+    // loop析构时调, 之后不能再分配. 没有块在外面就直接释放, 不然等最后一个块还回来
+    void Close();
+
+    // 优先用当前线程loop的池, 不在loop线程或者太大的直接malloc
+    static RefPtr* Allocate(const uint64_t& len);
+    static void Release(RefPtr* block);
+
+    // 新arena先尝试MAP_HUGETLB, 不行再madvise(MADV_HUGEPAGE), 要在loop跑起来之前设置
+    static void SetHugePage(const bool& huge_page)
+    {
+        huge_page_ = huge_page;
+    }
+
+    uint64_t GetLiveBytes() const
+    {
+        return live_bytes_;
+    }
+
+    uint64_t GetArenaBytes() const
+    {
+        return arena_bytes_;
+    }
+
+private:
+    RefPtr* Alloc(const uint64_t& len);
+    void Free(RefPtr* block);
+    void DrainRemoteFree();
+    bool NewArena();
+    void PrintStat();
+
+    static int GetSizeClass(const uint64_t& len);
+
+    // 只能由Close或者最后一个还回来的块释放
+    ~PayloadPool();
+    void PutFree(RefPtr* block);
+
+private:
+    enum
+    {
+        kMinShift       = 6,    // 64B
+        kMaxShift       = 18,   // 256KB
+        kClassNum       = kMaxShift - kMinShift + 1,
+        kLargeClass     = 0xFF,
+    };
+
+    struct ClassStat
+    {
+        ClassStat()
+            : in_use(0)
+            , free(0)
+        {
+        }
+
+        uint64_t in_use;
+        uint64_t free;
+    };
+
+    IoLoop*                 io_loop_;
+
+    RefPtr*                 free_list_[kClassNum];
+    ClassStat               class_stat_[kClassNum];
+
+    // 别的线程还回来的块, 无锁栈, 本线程一次全部取走
+    std::atomic<RefPtr*>    remote_free_;
+
+    // 分配出去减去本线程还回来的块数, 只有本线程改
+    int64_t                 live_blocks_;
+    // Close之前是一个很大的偏置减去别的线程还回来的块数, Close时换成真正在外面的块数, 减到0的负责释放
+    std::atomic<int64_t>    ref_count_;
+    std::atomic<bool>       closed_;
+
+    std::vector<std::pair<uint8_t*, size_t> > arena_;
+    uint8_t*                arena_pos_;
+    uint8_t*                arena_end_;
+
+    uint64_t                live_bytes_;
+    uint64_t                arena_bytes_;
+    uint64_t                large_count_;
+    uint64_t                alloc_count_;
+    uint64_t                remote_free_count_;
+
+    // Close时删掉, 池子可能在loop没了之后才释放
+    WheelTimer*             stat_timer_;
+
+    static bool             huge_page_;
+};
+
+#endif // __PAYLOAD_POOL_H__
@@ -0,0 +1,339 @@
+#ifndef __REF_PTR_H__
+#define __REF_PTR_H__
+
+#include <assert.h>
+#include <string.h>
+
+#include <atomic>
+#include <iostream>
+
+#include "common_define.h"
+#include "payload_pool.h"
+
+// payload内存块的头, 数据紧跟在头后面, 由PayloadPool一次分配
+class RefPtr
+{
+public:
+    RefPtr(PayloadPool* pool, const uint8_t& size_class)
+        : ref_count_(1)
+        , shared_(false)
+        , size_class_(size_class)
+        , pool_(pool)
+    {
+    }
+
+    // 没出过本loop的payload引用计数不用原子操作,
+    // 要交给别的loop之前先SetShared, 之后自增自减和返回值必须是同一个原子操作
+    uint32_t AddRefCount()
+    {
+        if (! shared_)
+        {
+            uint32_t ref_count = ref_count_.load(std::memory_order_relaxed) + 1;
+            ref_count_.store(ref_count, std::memory_order_relaxed);
+            return ref_count;
+        }
+
+        return ++ref_count_;
+    }
+
+    uint32_t DecRefCount()
+    {
+        if (! shared_)
+        {
+            uint32_t ref_count = ref_count_.load(std::memory_order_relaxed) - 1;
+            ref_count_.store(ref_count, std::memory_order_relaxed);
+            return ref_count;
+        }
+
+        return --ref_count_;
+    }
+
+    void SetShared()
+    {
+        if (! shared_)
+        {
+            shared_ = true;
+        }
+    }
+
+    uint8_t* GetPtr()
+    {
+        return (uint8_t*)(this + 1);
+    }
+
+private:
+    friend class PayloadPool;
+
+    std::atomic<uint32_t>   ref_count_;
+    bool                    shared_;
+    uint8_t                 size_class_;
+    PayloadPool*            pool_;
+};
+
+class Payload
+{
+public:
+    enum
+    {
+        kRefNal = 3,
+        kMaxNaluIndex = 8,
+    };
+
+    Payload()
+        : ref_ptr_(NULL)
+        , offset_(0)
+        , len_(0)
+        , frame_type_(kUnknownFrame)
+        , payload_type_(kUnknownPayload)
+        , nal_ref_idc_(kRefNal)
+        , nalu_count_(0)
+    {
+    }
+
+    // 分配len字节, 内容由调用者通过GetAllData填
+    explicit Payload(const uint64_t& len)
+        : ref_ptr_(PayloadPool::Allocate(len))
+        , offset_(0)
+        , len_(len)
+        , frame_type_(kUnknownFrame)
+        , payload_type_(kUnknownPayload)
+        , nal_ref_idc_(kRefNal)
+        , nalu_count_(0)
+    {
+    }
+
+    // 引用base里[offset, offset + len)这一段, 不拷贝数据, 时间戳和类型由调用者重新设置
+    Payload(const Payload& base, const uint64_t& offset, const uint64_t& len)
+        : ref_ptr_(base.ref_ptr_)
+        , offset_(base.offset_ + offset)
+        , len_(len)
+        , frame_type_(kUnknownFrame)
+        , payload_type_(kUnknownPayload)
+        , nal_ref_idc_(kRefNal)
+        , nalu_count_(0)
+    {
+        assert(offset + len <= base.len_);
+
+        if (ref_ptr_ != NULL)
+        {
+            ref_ptr_->AddRefCount();
+        }
+    }
+
+    void SetIFrame() { frame_type_ = kIframe; }
+
+    // H264 NALU头里的nal_ref_idc, 0表示别的帧不参考它, 拥塞的时候可以先丢
+    void SetNalRefIdc(const uint8_t& nal_ref_idc) { nal_ref_idc_ = nal_ref_idc; }
+    uint8_t GetNalRefIdc() const { return nal_ref_idc_; }
+
+    bool IsDisposable() const { return IsVideo() && ! IsIFrame() && nal_ref_idc_ == 0; }
+
+    // 视频payload是一整帧(access unit), AVCC格式, 每个NALU前面4字节长度.
+    // offset是NALU的4字节长度在GetAllData里的位置, 由生产者按顺序加进来
+    void AddNalu(const uint32_t& offset)
+    {
+        if (nalu_count_ < kMaxNaluIndex)
+        {
+            nalu_offset_[nalu_count_] = offset;
+        }
+
+        ++nalu_count_;
+    }
+
+    size_t GetNaluCount() const { return nalu_count_; }
+
+    // 返回NALU头的位置, 不带长度. 超过索引的部分从最后一个索引往后数
+    uint8_t* GetNalu(const size_t& index, uint32_t& len) const
+    {
+        uint8_t* data = GetAllData();
+        uint32_t offset = 0;
+
+        if (index < kMaxNaluIndex)
+        {
+            offset = nalu_offset_[index];
+        }
+        else
+        {
+            offset = nalu_offset_[kMaxNaluIndex - 1];
+
+            for (size_t i = kMaxNaluIndex - 1; i < index; ++i)
+            {
+                offset += 4 + ReadU32(data + offset);
+            }
+        }
+
+        len = ReadU32(data + offset);
+
+        return data + offset + 4;
+    }
+
+    bool IsIFrame() const { return frame_type_ == kIframe; }
+
+    void SetPts(const uint64_t& pts) { pts_ = pts; }
+    void SetDts(const uint64_t& dts) { dts_ = dts; }
+
+    uint64_t GetPts() const { return pts_; }
+    uint64_t GetDts() const { return dts_; }
+
+    uint32_t GetPts32() const { return (uint32_t)pts_; }
+    uint32_t GetDts32() const { return (uint32_t)dts_; }
+
+    uint8_t GetFrameType() { return frame_type_; }
+
+    void SetAudio() { payload_type_ = kAudioPayload; }
+    void SetVideo() { payload_type_ = kVideoPayload; }
+
+    bool IsAudio() const { return payload_type_ == kAudioPayload; }
+    bool IsVideo() const { return payload_type_ == kVideoPayload; }
+
+    // 要交给别的loop线程之前调用
+    void SetShared() const
+    {
+        if (ref_ptr_ != NULL)
+        {
+            ref_ptr_->SetShared();
+        }
+    }
+
+    ~Payload()
+    {
+        if (ref_ptr_ != NULL)
+        {
+            uint32_t referenct_count = ref_ptr_->DecRefCount();
+
+            if (referenct_count == 0)
+            {
+                PayloadPool::Release(ref_ptr_);
+            }
+        }
+    }
+
+    Payload(const Payload& other)
+    {
+        if (this != &other)
+        {
+            this->ref_ptr_ = other.ref_ptr_;
+            if (ref_ptr_ != NULL)
+            {
+                ref_ptr_->AddRefCount();
+            }
+            this->offset_ = other.offset_;
+            this->len_ = other.len_;
+            this->pts_ = other.pts_;
+            this->dts_ = other.dts_;
+            this->frame_type_ = other.frame_type_;
+            this->payload_type_ = other.payload_type_;
+            this->nal_ref_idc_ = other.nal_ref_idc_;
+            this->nalu_count_ = other.nalu_count_;
+            memcpy(this->nalu_offset_, other.nalu_offset_, sizeof(nalu_offset_));
+        }
+    }
+
+    Payload& operator=(const Payload& other)
+    {
+        if (this != &other)
+        {
+            if (other.ref_ptr_ != NULL)
+            {
+                other.ref_ptr_->AddRefCount();
+            }
+
+            if (ref_ptr_ != NULL && ref_ptr_->DecRefCount() == 0)
+            {
+                PayloadPool::Release(ref_ptr_);
+            }
+
+            this->ref_ptr_ = other.ref_ptr_;
+            this->offset_ = other.offset_;
+            this->len_ = other.len_;
+            this->pts_ = other.pts_;
+            this->dts_ = other.dts_;
+            this->frame_type_ = other.frame_type_;
+            this->payload_type_ = other.payload_type_;
+            this->nal_ref_idc_ = other.nal_ref_idc_;
+            this->nalu_count_ = other.nalu_count_;
+            memcpy(this->nalu_offset_, other.nalu_offset_, sizeof(nalu_offset_));
+        }
+
+        return *this;
+    }
+
+    uint8_t* GetAllData() const
+    {
+        return GetPtr();
+    }
+
+    uint64_t GetAllLen() const
+    {
+        return len_;
+    }
+
+    uint8_t* GetRawData() const
+    {
+        if (GetAllData() == NULL)
+        {
+            return NULL;
+        }
+
+        if (IsAudio())
+        {
+            return GetAllData() + 2;
+        }
+        else if (IsVideo())
+        {
+            return GetAllData() + 4;
+        }
+
+        return NULL;
+    }
+
+    uint64_t GetRawLen() const
+    {
+        if (IsAudio())
+        {
+            return GetAllLen() - 2;
+        }
+        else if (IsVideo())
+        {
+            return GetAllLen() - 4;
+        }
+
+        return 0;
+    }
+
+    void AddLen(const uint64_t& delta)
+    {
+        len_ += delta;
+    }
+
+private:
+    static uint32_t ReadU32(const uint8_t* p)
+    {
+        return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+    }
+
+    uint8_t* GetPtr() const
+    {
+        if (ref_ptr_ == NULL)
+        {
+            return NULL;
+        }
+
+        return ref_ptr_->GetPtr() + offset_;
+    }
+    
+private:
+    RefPtr* ref_ptr_;
+
+    uint64_t offset_;
+    uint64_t len_;
+	uint8_t frame_type_;
+    uint8_t payload_type_;
+    uint8_t nal_ref_idc_;
+    uint16_t nalu_count_;
+    uint32_t nalu_offset_[kMaxNaluIndex];
+    uint64_t pts_;
+    uint64_t dts_;
+};
+
+#endif // __REF_PTR_H__
@@ -228,6 +228,18 @@ namespace socket_util
         return ret;
     }
 
+    inline int ReusePort(const int& fd)
+    {
+        int i = 1;
+        int ret = setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &i, sizeof(i));
+        if (ret < 0)
+        {
+            std::cout << LMSG << "setsockopt err:" << strerror(errno) << std::endl;
+        }
+
+        return ret;
+    }
+
     inline int NoCloseWait(const int& fd)
     {
         linger st_linger;
@@ -242,6 +254,21 @@ namespace socket_util
         return ret;
     }
 
+    // 跟NoCloseWait相反, close之后内核缓冲里没发完的数据照常发完再FIN
+    inline int CloseWait(const int& fd)
+    {
+        linger st_linger;
+        st_linger.l_onoff = 0;
+        st_linger.l_linger = 0;
+        int ret = setsockopt(fd, SOL_SOCKET, SO_LINGER, &st_linger, sizeof(st_linger));
+        if (ret < 0)
+        {
+            std::cout << LMSG << "setsockopt err:" << strerror(errno) << std::endl;
+        }
+
+        return ret;
+    }
+
     inline int SetSendBufSize(const int& fd, const int& send_buf_size, const bool& force = false)
     {
         int opt_name = SO_SNDBUF;
@@ -22,7 +22,10 @@ int SslIoBuffer::ReadFromFdAndWrite(const int& fd)
 {
     UNUSED(fd);
 
-    MakeSpaceIfNeed(kEnlargeSize);
+    if (MakeSpaceIfNeed(kReadMinSpace) < 0)
+    {
+        return -1;
+    }
 
     int max_read = CapacityLeft();
     if (max_read >= 1024*8)
@@ -93,6 +93,7 @@ int SslSocket::OnRead()
                     int err = SSL_get_error(ssl_, ret);
                     if (err == SSL_ERROR_WANT_READ)
                     {
+                        read_buffer_.ReleaseIfEmpty();
                         break;
                     }
 
@@ -122,6 +123,7 @@ int SslSocket::OnWrite()
         if (write_buffer_.Empty())
         {
             std::cout << LMSG << std::endl;
+            write_buffer_.ReleaseIfEmpty();
             DisableWrite();
         }
 
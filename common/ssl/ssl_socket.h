@@ -21,6 +21,8 @@ public:
     virtual int OnWrite();
     virtual int Send(const uint8_t* data, const size_t& len);
 
+    virtual size_t GetPendingBytes() { return write_buffer_.Size(); }
+
     void SetDisconnected()  { connect_status_ = kDisconnected; }
     void SetConnecting()    { connect_status_ = kConnecting; }
     void SetConnected()     { connect_status_ = kConnected; }
@@ -1,4 +1,6 @@
 #include <assert.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
 
 #include <iostream>
 
@@ -7,9 +9,16 @@
 #include "socket_handler.h"
 #include "tcp_socket.h"
 
+// 一次writev最多带的段数
+static const int kMaxIoVec = 64;
+
 TcpSocket::TcpSocket(IoLoop* io_loop, const int& fd, HandlerFactoryT handler_factory)
     : Fd(io_loop, fd)
     , server_socket_(false)
+    , accept_edge_trigger_(false)
+    , pending_bytes_(0)
+    , connect_status_(kDisconnected)
+    , close_after_flush_(false)
     , handler_factory_(handler_factory)
 {
     socket_handler_ = handler_factory_(io_loop, this);
@@ -17,6 +26,12 @@ TcpSocket::TcpSocket(IoLoop* io_loop, const int& fd, HandlerFactoryT handler_fac
 
 TcpSocket::~TcpSocket()
 {
+    // 正常关闭走CloseAfterFlush, 这里还有数据多半是发完直接删了, 完成模式下Send只是排队
+    if (pending_bytes_ != 0 && ! close_after_flush_)
+    {
+        std::cout << LMSG << name() << " deleted with " << pending_bytes_ << " bytes unsent" << std::endl;
+    }
+
     delete socket_handler_;
 }
 
@@ -31,18 +46,7 @@ int TcpSocket::OnRead()
 
         if (client_fd > 0)
         {
-            socket_util::NoCloseWait(client_fd);
-
-            TcpSocket* tcp_socket = new TcpSocket(io_loop_, client_fd, handler_factory_);
-            socket_util::SetNonBlock(client_fd);
-            tcp_socket->SetConnected();
-            tcp_socket->ModName("tcp " + name() + " <-> " + client_ip + ":" + Util::Num2Str(client_port));
-
-            std::cout << LMSG << tcp_socket->name() << " accept" << std::endl;
-
-            socket_handler_->HandleAccept(*tcp_socket);
-
-            tcp_socket->EnableRead();
+            AcceptConnection(client_fd, client_ip, client_port);
         }
     }
     else
@@ -75,6 +79,8 @@ int TcpSocket::OnRead()
                 {
                     if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
                     {
+                        // 没有半包的话读缓冲还给池子, 空闲连接不占内存
+                        read_buffer_.ReleaseIfEmpty();
                         break;
                     }
 
@@ -95,15 +101,39 @@ int TcpSocket::OnWrite()
 {
     if (connect_status_ == kConnected)
     {
-        int ret = write_buffer_.WriteToFd(fd_);
+        // 完成模式下只有文件段发不动或者拿不到sqe的时候才开写事件
+        if (io_loop_->IsCompletionMode())
+        {
+            DisableWrite();
+
+            int ret = SubmitSendQueue();
+            if (ret < 0)
+            {
+                std::cout << LMSG << name() << " write error:" << strerror(errno) << std::endl;
+                socket_handler_->HandleError(read_buffer_, *this);
+                return ret;
+            }
+
+            CheckCloseAfterFlush();
 
-        if (write_buffer_.Empty())
+            return ret;
+        }
+
+        int ret = FlushSendQueue();
+
+        if (send_queue_.empty())
         {
             DisableWrite();
+            CheckCloseAfterFlush();
         }
 
         if (ret < 0)
         {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+            {
+                return kSuccess;
+            }
+
             std::cout << LMSG << name() << " write error:" << ret << std::endl;
             socket_handler_->HandleError(read_buffer_, *this);
         }
@@ -141,34 +171,518 @@ int TcpSocket::OnWrite()
 
 int TcpSocket::Send(const uint8_t* data, const size_t& len)
 {
-    int ret = -1;
-    if (write_buffer_.Empty())
+    IoVec iov(data, len);
+
+    return SendV(&iov, 1);
+}
+
+int TcpSocket::SendV(const IoVec* iov, const int& count)
+{
+    size_t total = 0;
+    for (int i = 0; i < count; ++i)
     {
-        ret = write(fd_, data, len);
+        total += iov[i].len;
+    }
 
-        if (ret > 0)
+    // 前面还有没发完的, 为了保证顺序只能排队.
+    // 完成模式下也先排队, 本轮结束时跟别的连接的发送一起提交
+    if (! send_queue_.empty() || io_loop_->IsCompletionMode())
+    {
+        for (int i = 0; i < count; ++i)
         {
-            if (ret < (int)len)
-            {
-                write_buffer_.Write(data + ret, len - ret);
-                EnableWrite();
-            }
+            Enqueue(iov[i], 0);
         }
-        else
+
+        if (io_loop_->IsCompletionMode())
         {
+            io_loop_->FlushLater(this);
+        }
+
+        return total;
+    }
+
+    int index = 0;
+    size_t written = 0;
+
+    while (index < count)
+    {
+        struct iovec vec[kMaxIoVec];
+        int vec_count = 0;
+        size_t vec_len = 0;
+
+        for (int i = index; i < count && vec_count < kMaxIoVec; ++i, ++vec_count)
+        {
+            size_t skip = (i == index ? written : 0);
+
+            vec[vec_count].iov_base = (void*)(iov[i].data + skip);
+            vec[vec_count].iov_len = iov[i].len - skip;
+            vec_len += vec[vec_count].iov_len;
+        }
+
+        int ret = writev(fd_, vec, vec_count);
+
+        if (ret < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+            {
+                break;
+            }
+
             // FIXME:close socket
 
             std::cout << LMSG << name() << " write error:" << ret << std::endl;
             socket_handler_->HandleError(read_buffer_, *this);
+
+            return ret;
         }
 
-        return ret;
+        size_t left = ret;
+        while (index < count && left >= iov[index].len - written)
+        {
+            left -= iov[index].len - written;
+            written = 0;
+            ++index;
+        }
+        written += left;
+
+        // 内核缓冲满了
+        if ((size_t)ret < vec_len)
+        {
+            break;
+        }
+    }
+
+    // 剩下的等可写
+    for (int i = index; i < count; ++i)
+    {
+        Enqueue(iov[i], i == index ? written : 0);
+    }
+
+    if (! send_queue_.empty())
+    {
+        EnableWrite();
+    }
+
+    return total;
+}
+
+int TcpSocket::SendFile(const int& file_fd, const uint64_t& offset, const size_t& len, const std::shared_ptr<void>& holder)
+{
+    size_t sent = 0;
+
+    // 前面还有没发完的, 为了保证顺序只能排队
+    while (send_queue_.empty() && ! send_inflight_ && sent < len)
+    {
+        off_t file_offset = offset + sent;
+        ssize_t ret = sendfile(fd_, file_fd, &file_offset, len - sent);
+
+        if (ret < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+            {
+                break;
+            }
+
+            std::cout << LMSG << name() << " sendfile error:" << strerror(errno) << std::endl;
+            socket_handler_->HandleError(read_buffer_, *this);
+
+            return ret;
+        }
+
+        if (ret == 0)
+        {
+            // 文件比len短
+            std::cout << LMSG << name() << " sendfile eof, offset:" << file_offset << std::endl;
+            return -1;
+        }
+
+        sent += ret;
+    }
+
+    if (sent < len)
+    {
+        send_queue_.push_back(SendChunk());
+
+        SendChunk& chunk = send_queue_.back();
+        chunk.time_ms = io_loop_->GetNowMs();
+        chunk.file_fd = file_fd;
+        chunk.file_offset = offset + sent;
+        chunk.len = len - sent;
+        chunk.holder = holder;
+
+        pending_bytes_ += len - sent;
+
+        EnableWrite();
+    }
+
+    return len;
+}
+
+void TcpSocket::CloseAfterFlush()
+{
+    close_after_flush_ = true;
+
+    // accept出来的连接设了linger 0, close会发RST把内核缓冲里的数据丢掉
+    socket_util::CloseWait(fd_);
+
+    // 对端再发什么都不处理了
+    DisableRead();
+
+    CheckCloseAfterFlush();
+}
+
+void TcpSocket::CheckCloseAfterFlush()
+{
+    if (close_after_flush_ && send_queue_.empty() && ! send_inflight_)
+    {
+        io_loop_->DeleteFdLater(this);
+    }
+}
+
+uint64_t TcpSocket::GetPendingMs()
+{
+    if (send_inflight_ && ! send_inflight_->empty())
+    {
+        return io_loop_->GetNowMs() - send_inflight_->front().time_ms;
+    }
+
+    if (send_queue_.empty())
+    {
+        return 0;
+    }
+
+    return io_loop_->GetNowMs() - send_queue_.front().time_ms;
+}
+
+void TcpSocket::Enqueue(const IoVec& iov, const size_t& skip)
+{
+    if (iov.len <= skip)
+    {
+        return;
+    }
+
+    size_t len = iov.len - skip;
+
+    if (iov.ref != NULL)
+    {
+        send_queue_.push_back(SendChunk());
+
+        SendChunk& chunk = send_queue_.back();
+        chunk.time_ms = io_loop_->GetNowMs();
+        chunk.ref = *iov.ref;
+        chunk.data = iov.data + skip;
+        chunk.len = len;
     }
     else
     {
-        ret = write_buffer_.Write(data, len);
+        // 没有引用的(一般是头部)拷贝, 连续的拷贝合成一段
+        if (send_queue_.empty() || ! send_queue_.back().IsCopy())
+        {
+            send_queue_.push_back(SendChunk());
+            send_queue_.back().time_ms = io_loop_->GetNowMs();
+        }
+
+        SendChunk& chunk = send_queue_.back();
+
+        if (chunk.offset * 2 > chunk.copy.size())
+        {
+            chunk.copy.erase(0, chunk.offset);
+            chunk.offset = 0;
+        }
+
+        chunk.copy.append((const char*)iov.data + skip, len);
+    }
+
+    pending_bytes_ += len;
+}
+
+int TcpSocket::FlushSendQueue()
+{
+    int ret = 0;
+
+    // 一直写到EAGAIN, 边沿触发下不写完不会再有通知
+    while (! send_queue_.empty())
+    {
+        if (send_queue_.front().IsFile())
+        {
+            ret = SendFileChunk();
+
+            if (ret < 0)
+            {
+                break;
+            }
+
+            continue;
+        }
+
+        struct iovec vec[kMaxIoVec];
+        int vec_count = 0;
+
+        // 碰到文件段就停, 下一轮用sendfile
+        for (std::deque<SendChunk>::const_iterator iter = send_queue_.begin(); iter != send_queue_.end() && ! iter->IsFile() && vec_count < kMaxIoVec; ++iter, ++vec_count)
+        {
+            vec[vec_count].iov_base = (void*)iter->GetData();
+            vec[vec_count].iov_len = iter->GetLen();
+        }
+
+        ret = writev(fd_, vec, vec_count);
+
+        if (ret < 0)
+        {
+            break;
+        }
+
+        size_t left = ret;
+        pending_bytes_ -= left;
+
+        while (left > 0)
+        {
+            SendChunk& chunk = send_queue_.front();
+            size_t chunk_len = chunk.GetLen();
+
+            if (left < chunk_len)
+            {
+                chunk.offset += left;
+                break;
+            }
+
+            left -= chunk_len;
+            send_queue_.pop_front();
+        }
+    }
+
+    return ret;
+}
+
+int TcpSocket::SendFileChunk()
+{
+    SendChunk& chunk = send_queue_.front();
+    off_t file_offset = chunk.file_offset + chunk.offset;
+
+    int ret = sendfile(fd_, chunk.file_fd, &file_offset, chunk.GetLen());
+
+    if (ret <= 0)
+    {
+        // 文件比len短, 当出错处理
+        if (ret == 0)
+        {
+            errno = EIO;
+            ret = -1;
+        }
+
+        return ret;
+    }
+
+    pending_bytes_ -= ret;
+    chunk.offset += ret;
+
+    if (chunk.GetLen() == 0)
+    {
+        send_queue_.pop_front();
     }
 
-    // avoid warning
     return ret;
 }
+
+void TcpSocket::OnFlush()
+{
+    if (connect_status_ != kConnected)
+    {
+        return;
+    }
+
+    if (SubmitSendQueue() < 0)
+    {
+        std::cout << LMSG << name() << " write error:" << strerror(errno) << std::endl;
+        socket_handler_->HandleError(read_buffer_, *this);
+        io_loop_->DeleteFdLater(this);
+        return;
+    }
+
+    CheckCloseAfterFlush();
+}
+
+int TcpSocket::SubmitSendQueue()
+{
+    // 一个连接同时只有一个发送在内核里, 完成之后再提交后面的
+    while (! send_inflight_ && ! send_queue_.empty())
+    {
+        // 文件段还是同步sendfile, 发不动了等可写
+        if (send_queue_.front().IsFile())
+        {
+            int ret = SendFileChunk();
+
+            if (ret < 0)
+            {
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+                {
+                    EnableWrite();
+                    return 0;
+                }
+
+                return ret;
+            }
+
+            continue;
+        }
+
+        std::shared_ptr<std::deque<SendChunk>> inflight = std::make_shared<std::deque<SendChunk>>();
+
+        struct iovec vec[kMaxIoVec];
+        int vec_count = 0;
+
+        while (! send_queue_.empty() && ! send_queue_.front().IsFile() && vec_count < kMaxIoVec)
+        {
+            // deque在两头插入不会挪动已有元素, 拷贝段的数据地址在完成之前不变
+            inflight->push_back(std::move(send_queue_.front()));
+            send_queue_.pop_front();
+
+            vec[vec_count].iov_base = (void*)inflight->back().GetData();
+            vec[vec_count].iov_len = inflight->back().GetLen();
+            ++vec_count;
+        }
+
+        if (io_loop_->SubmitSend(this, vec, vec_count, inflight) < 0)
+        {
+            // 拿不到sqe, 放回队头等可写再提交
+            while (! inflight->empty())
+            {
+                send_queue_.push_front(std::move(inflight->back()));
+                inflight->pop_back();
+            }
+
+            EnableWrite();
+            return 0;
+        }
+
+        send_inflight_ = inflight;
+    }
+
+    return 0;
+}
+
+int TcpSocket::OnSendComplete(const int& result)
+{
+    std::shared_ptr<std::deque<SendChunk>> inflight;
+    inflight.swap(send_inflight_);
+
+    if (result < 0)
+    {
+        std::cout << LMSG << name() << " send error:" << strerror(-result) << std::endl;
+        socket_handler_->HandleError(read_buffer_, *this);
+        return kError;
+    }
+
+    size_t left = result;
+    pending_bytes_ -= left;
+
+    while (! inflight->empty())
+    {
+        SendChunk& chunk = inflight->front();
+        size_t chunk_len = chunk.GetLen();
+
+        if (left < chunk_len)
+        {
+            chunk.offset += left;
+            break;
+        }
+
+        left -= chunk_len;
+        inflight->pop_front();
+    }
+
+    // 短写剩下的放回队头
+    while (! inflight->empty())
+    {
+        send_queue_.push_front(std::move(inflight->back()));
+        inflight->pop_back();
+    }
+
+    if (SubmitSendQueue() < 0)
+    {
+        std::cout << LMSG << name() << " write error:" << strerror(errno) << std::endl;
+        socket_handler_->HandleError(read_buffer_, *this);
+        return kError;
+    }
+
+    CheckCloseAfterFlush();
+
+    return kSuccess;
+}
+
+int TcpSocket::OnAccept(const int& client_fd)
+{
+    std::string client_ip = "";
+    uint16_t client_port = 0;
+    socket_util::GetPeerName(client_fd, client_ip, client_port);
+
+    return AcceptConnection(client_fd, client_ip, client_port);
+}
+
+int TcpSocket::OnRecv(const uint8_t* data, const size_t& len)
+{
+    if (connect_status_ != kConnected)
+    {
+        return kSuccess;
+    }
+
+    if (len == 0)
+    {
+        std::cout << LMSG << name() << " close by peer" << std::endl;
+
+        socket_handler_->HandleClose(read_buffer_, *this);
+
+        return kClose;
+    }
+
+    // 内核填好的是loop的公共缓冲, 要还回去, 拷进自己的读缓冲
+    read_buffer_.Write(data, len);
+
+    int ret = socket_handler_->HandleRead(read_buffer_, *this);
+
+    if (ret == kClose || ret == kError)
+    {
+        std::cout << LMSG << name() << " handle error:" << ret << std::endl;
+        socket_handler_->HandleClose(read_buffer_, *this);
+        return kClose;
+    }
+
+    read_buffer_.ReleaseIfEmpty();
+
+    return kSuccess;
+}
+
+int TcpSocket::GetReadMode() const
+{
+    if (server_socket_)
+    {
+        return kReadByAccept;
+    }
+
+    // 还在连接的用poll等可写
+    if (connect_status_ == kConnected)
+    {
+        return kReadByRecv;
+    }
+
+    return kReadByPoll;
+}
+
+int TcpSocket::AcceptConnection(const int& client_fd, const std::string& client_ip, const uint16_t& client_port)
+{
+    socket_util::NoCloseWait(client_fd);
+
+    TcpSocket* tcp_socket = new TcpSocket(io_loop_, client_fd, handler_factory_);
+    socket_util::SetNonBlock(client_fd);
+    tcp_socket->SetConnected();
+    tcp_socket->SetEdgeTrigger(accept_edge_trigger_);
+    tcp_socket->ModName("tcp " + name() + " <-> " + client_ip + ":" + Util::Num2Str(client_port));
+
+    std::cout << LMSG << tcp_socket->name() << " accept" << std::endl;
+
+    socket_handler_->HandleAccept(*tcp_socket);
+
+    tcp_socket->EnableRead();
+
+    return kSuccess;
+}
@@ -1,7 +1,10 @@
 #ifndef __TCP_SOCKET_H__
 #define __TCP_SOCKET_H__
 
+#include <deque>
 #include <functional>
+#include <memory>
+#include <string>
 
 #include "io_loop.h"
 #include "io_buffer.h"
@@ -21,9 +24,35 @@ public:
         server_socket_ = true;
     }
 
+    // 监听socket上设置, accept出来的连接用边沿触发
+    void SetAcceptEdgeTrigger(const bool& edge_trigger)
+    {
+        accept_edge_trigger_ = edge_trigger;
+    }
+
     virtual int OnRead();
     virtual int OnWrite();
+    virtual void OnFlush();
+
+    virtual int OnAccept(const int& client_fd);
+    virtual int OnRecv(const uint8_t* data, const size_t& len);
+    virtual int OnSendComplete(const int& result);
+    virtual int GetReadMode() const;
+
     virtual int Send(const uint8_t* data, const size_t& len);
+    virtual int SendV(const IoVec* iov, const int& count);
+    virtual int SendFile(const int& file_fd, const uint64_t& offset, const size_t& len, const std::shared_ptr<void>& holder);
+
+    virtual size_t GetPendingBytes()
+    {
+        return pending_bytes_;
+    }
+
+    virtual uint64_t GetPendingMs();
+
+    // 发送队列(包括完成模式下在途的)发完再关, 之后不再读.
+    // 发完Connection: close的回应要关连接时用这个, 不能直接delete, 完成模式下数据还在队列里
+    void CloseAfterFlush();
 
     void SetDisconnected()
     {
@@ -45,12 +74,74 @@ public:
         connect_status_ = kDisconnecting;
     }
 
+private:
+    // 发送队列里的一段, 引用payload的不拷贝, 文件的用sendfile发, 其余的拷进copy
+    struct SendChunk
+    {
+        SendChunk()
+            : data(NULL)
+            , len(0)
+            , offset(0)
+            , time_ms(0)
+            , file_fd(-1)
+            , file_offset(0)
+        {
+        }
+
+        bool IsFile() const
+        {
+            return file_fd >= 0;
+        }
+
+        bool IsCopy() const
+        {
+            return data == NULL && file_fd < 0;
+        }
+
+        const uint8_t* GetData() const
+        {
+            return (data != NULL ? data : (const uint8_t*)copy.data()) + offset;
+        }
+
+        size_t GetLen() const
+        {
+            return (IsCopy() ? copy.size() : len) - offset;
+        }
+
+        Payload         ref;
+        std::string     copy;
+        const uint8_t*  data;
+        size_t          len;
+        size_t          offset;
+        uint64_t        time_ms;
+
+        int                     file_fd;
+        uint64_t                file_offset;
+        std::shared_ptr<void>   holder;
+    };
+
+    int AcceptConnection(const int& client_fd, const std::string& client_ip, const uint16_t& client_port);
+
+    void Enqueue(const IoVec& iov, const size_t& skip);
+    int FlushSendQueue();
+    int SubmitSendQueue();
+    int SendFileChunk();
+
+    void CheckCloseAfterFlush();
+
 private:
     bool            server_socket_;
+    bool            accept_edge_trigger_;
     IoBuffer        read_buffer_;
-    IoBuffer        write_buffer_;
+
+    std::deque<SendChunk>   send_queue_;
+    size_t                  pending_bytes_;
+
+    // 完成模式下已经交给内核还没完成的, 短写剩下的放回send_queue_队头
+    std::shared_ptr<std::deque<SendChunk>>  send_inflight_;
 
     int             connect_status_;
+    bool            close_after_flush_;
 
     HandlerFactoryT  handler_factory_;
 };
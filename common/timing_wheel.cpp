@@ -0,0 +1,280 @@
+#include "common_define.h"
+#include "io_loop.h"
+#include "timing_wheel.h"
+
+WheelTimer::WheelTimer(IoLoop* io_loop)
+    : TimerNode()
+    , io_loop_(io_loop)
+    , expire_ms_(0)
+    , interval_ms_(0)
+    , fire_count_(0)
+    , active_(false)
+{
+}
+
+WheelTimer::~WheelTimer()
+{
+    Cancel();
+}
+
+void WheelTimer::RunAfter(const uint64_t& delay_ms, const Callback& callback)
+{
+    Start(delay_ms, 0, callback);
+}
+
+void WheelTimer::RunEvery(const uint64_t& interval_ms, const Callback& callback)
+{
+    Start(interval_ms, interval_ms == 0 ? 1 : interval_ms, callback);
+}
+
+void WheelTimer::Cancel()
+{
+    io_loop_->GetTimingWheel().Remove(this);
+    active_ = false;
+}
+
+void WheelTimer::Start(const uint64_t& delay_ms, const uint64_t& interval_ms, const Callback& callback)
+{
+    TimingWheel& timing_wheel = io_loop_->GetTimingWheel();
+
+    timing_wheel.Remove(this);
+
+    expire_ms_ = io_loop_->GetNowMs() + delay_ms;
+    interval_ms_ = interval_ms;
+    fire_count_ = 0;
+    active_ = true;
+    callback_ = callback;
+
+    timing_wheel.Add(this);
+}
+
+TimingWheel::TimingWheel()
+    : current_tick_(0)
+    , timer_count_(0)
+    , running_timer_(NULL)
+{
+}
+
+TimingWheel::~TimingWheel()
+{
+    for (int level = 0; level < kLevelNum; ++level)
+    {
+        for (size_t slot = 0; slot < kSlotNum; ++slot)
+        {
+            while (slot_[level][slot].IsLinked())
+            {
+                WheelTimer* timer = static_cast<WheelTimer*>(slot_[level][slot].next);
+                timer->Unlink();
+                timer->active_ = false;
+            }
+        }
+    }
+}
+
+void TimingWheel::Reset(const uint64_t& now_ms)
+{
+    current_tick_ = now_ms / kTickMs;
+}
+
+void TimingWheel::Add(WheelTimer* timer)
+{
+    if (timer->IsLinked())
+    {
+        return;
+    }
+
+    Place(timer);
+    ++timer_count_;
+}
+
+void TimingWheel::Remove(WheelTimer* timer)
+{
+    if (running_timer_ == timer)
+    {
+        running_timer_ = NULL;
+    }
+
+    if (timer->IsLinked())
+    {
+        timer->Unlink();
+        --timer_count_;
+    }
+}
+
+void TimingWheel::Place(WheelTimer* timer)
+{
+    // 向上取整, 不能提前触发
+    uint64_t expire_tick = (timer->expire_ms_ + kTickMs - 1) / kTickMs;
+
+    if (expire_tick <= current_tick_)
+    {
+        expire_tick = current_tick_ + 1;
+    }
+
+    TimerNode* head = NULL;
+
+    if (expire_tick - current_tick_ < kSlotNum)
+    {
+        head = &slot_[0][expire_tick & kSlotMask];
+    }
+    else
+    {
+        for (int level = 1; level < kLevelNum; ++level)
+        {
+            int shift = level * kLevelBits;
+
+            // 按块号的差来选层, 不会落到本块已经级联过的槽里
+            if ((expire_tick >> shift) - (current_tick_ >> shift) < kSlotNum)
+            {
+                head = &slot_[level][(expire_tick >> shift) & kSlotMask];
+                break;
+            }
+        }
+
+        if (head == NULL)
+        {
+            int shift = (kLevelNum - 1) * kLevelBits;
+            head = &slot_[kLevelNum - 1][((current_tick_ >> shift) + kSlotNum - 1) & kSlotMask];
+        }
+    }
+
+    TimerNode* node = timer;
+
+    node->prev = head->prev;
+    node->next = head;
+    head->prev->next = node;
+    head->prev = node;
+}
+
+void TimingWheel::Cascade(const int& level, const size_t& slot)
+{
+    TimerNode list;
+
+    // 整条链先挪到临时链表上, Place可能放回同一个槽
+    if (slot_[level][slot].IsLinked())
+    {
+        list.next = slot_[level][slot].next;
+        list.prev = slot_[level][slot].prev;
+        list.next->prev = &list;
+        list.prev->next = &list;
+
+        slot_[level][slot].next = &slot_[level][slot];
+        slot_[level][slot].prev = &slot_[level][slot];
+    }
+
+    while (list.IsLinked())
+    {
+        WheelTimer* timer = static_cast<WheelTimer*>(list.next);
+        timer->Unlink();
+        Place(timer);
+    }
+}
+
+void TimingWheel::Advance(const uint64_t& now_ms)
+{
+    uint64_t target_tick = now_ms / kTickMs;
+
+    while (current_tick_ < target_tick)
+    {
+        if (timer_count_ == 0)
+        {
+            current_tick_ = target_tick;
+            break;
+        }
+
+        ++current_tick_;
+
+        if ((current_tick_ & kSlotMask) == 0)
+        {
+            size_t slot_1 = (current_tick_ >> kLevelBits) & kSlotMask;
+
+            if (slot_1 == 0)
+            {
+                size_t slot_2 = (current_tick_ >> (2 * kLevelBits)) & kSlotMask;
+
+                if (slot_2 == 0)
+                {
+                    Cascade(3, (current_tick_ >> (3 * kLevelBits)) & kSlotMask);
+                }
+
+                Cascade(2, slot_2);
+            }
+
+            Cascade(1, slot_1);
+        }
+
+        TimerNode& head = slot_[0][current_tick_ & kSlotMask];
+
+        while (head.IsLinked())
+        {
+            WheelTimer* timer = static_cast<WheelTimer*>(head.next);
+
+            timer->Unlink();
+            --timer_count_;
+
+            Fire(timer, now_ms);
+        }
+    }
+}
+
+void TimingWheel::Fire(WheelTimer* timer, const uint64_t& now_ms)
+{
+    timer->active_ = (timer->interval_ms_ != 0);
+    ++timer->fire_count_;
+
+    running_timer_ = timer;
+
+    // 回调里可能重新设置自己, 先拷一份
+    WheelTimer::Callback callback = timer->callback_;
+    callback();
+
+    // 回调里把自己删了或者取消了/重新设置了
+    if (running_timer_ != timer)
+    {
+        return;
+    }
+
+    running_timer_ = NULL;
+
+    if (timer->active_ && ! timer->IsLinked())
+    {
+        timer->expire_ms_ += timer->interval_ms_;
+
+        // 落后太多(比如loop被阻塞)就不补了
+        if (timer->expire_ms_ <= now_ms)
+        {
+            timer->expire_ms_ = now_ms + timer->interval_ms_;
+        }
+
+        Add(timer);
+    }
+}
+
+int TimingWheel::GetWaitTimeout(const uint64_t& now_ms, const int& timeout_in_millsecond) const
+{
+    if (timer_count_ == 0)
+    {
+        return timeout_in_millsecond;
+    }
+
+    uint64_t next_tick = ((current_tick_ >> kLevelBits) + 1) << kLevelBits;
+
+    for (uint64_t tick = current_tick_ + 1; tick < current_tick_ + kSlotNum; ++tick)
+    {
+        if (slot_[0][tick & kSlotMask].IsLinked())
+        {
+            next_tick = tick;
+            break;
+        }
+    }
+
+    uint64_t next_ms = next_tick * kTickMs;
+    int wait_ms = next_ms > now_ms ? (int)(next_ms - now_ms) : 0;
+
+    if (timeout_in_millsecond < 0 || wait_ms < timeout_in_millsecond)
+    {
+        return wait_ms;
+    }
+
+    return timeout_in_millsecond;
+}
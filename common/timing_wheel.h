@@ -0,0 +1,126 @@
+#ifndef __TIMING_WHEEL_H__
+#define __TIMING_WHEEL_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+
+class IoLoop;
+class TimingWheel;
+
+// 双向链表节点, 每个槽是一个带哨兵的环形链表, 增删都是O(1)
+struct TimerNode
+{
+    TimerNode()
+        : prev(this)
+        , next(this)
+    {
+    }
+
+    bool IsLinked() const
+    {
+        return next != this;
+    }
+
+    void Unlink()
+    {
+        prev->next = next;
+        next->prev = prev;
+        prev = this;
+        next = this;
+    }
+
+    TimerNode* prev;
+    TimerNode* next;
+};
+
+// 挂在某个IoLoop上的定时器, 一般作为连接的成员, 析构时自动摘掉.
+// 只能在所属loop线程里使用.
+class WheelTimer : private TimerNode
+{
+public:
+    typedef std::function<void()> Callback;
+
+    explicit WheelTimer(IoLoop* io_loop);
+    ~WheelTimer();
+
+    // 再次调用会先取消之前的
+    void RunAfter(const uint64_t& delay_ms, const Callback& callback);
+    void RunEvery(const uint64_t& interval_ms, const Callback& callback);
+    void Cancel();
+
+    bool IsActive() const
+    {
+        return active_;
+    }
+
+    uint64_t GetFireCount() const
+    {
+        return fire_count_;
+    }
+
+private:
+    WheelTimer(const WheelTimer&);
+    WheelTimer& operator=(const WheelTimer&);
+
+    void Start(const uint64_t& delay_ms, const uint64_t& interval_ms, const Callback& callback);
+
+private:
+    friend class TimingWheel;
+
+    IoLoop*     io_loop_;
+    uint64_t    expire_ms_;
+    uint64_t    interval_ms_;
+    uint64_t    fire_count_;
+    bool        active_;
+    Callback    callback_;
+};
+
+// 分层时间轮, 4层 * 64槽, 精度10ms, 最长约46小时, 更远的放在最高层的最后一个槽里轮转
+class TimingWheel
+{
+public:
+    TimingWheel();
+    ~TimingWheel();
+
+    void Reset(const uint64_t& now_ms);
+
+    void Add(WheelTimer* timer);
+    void Remove(WheelTimer* timer);
+
+    // 执行所有到期的定时器
+    void Advance(const uint64_t& now_ms);
+
+    // 根据最近的到期时间收紧epoll_wait/io_uring_enter的超时
+    int GetWaitTimeout(const uint64_t& now_ms, const int& timeout_in_millsecond) const;
+
+    size_t Size() const
+    {
+        return timer_count_;
+    }
+
+private:
+    void Place(WheelTimer* timer);
+    void Cascade(const int& level, const size_t& slot);
+    void Fire(WheelTimer* timer, const uint64_t& now_ms);
+
+private:
+    enum
+    {
+        kTickMs     = 10,
+        kLevelBits  = 6,
+        kSlotNum    = 1 << kLevelBits,
+        kSlotMask   = kSlotNum - 1,
+        kLevelNum   = 4,
+    };
+
+    TimerNode   slot_[kLevelNum][kSlotNum];
+    uint64_t    current_tick_;
+    size_t      timer_count_;
+
+    // 正在执行回调的定时器, 回调里把自己删了的话会被置空
+    WheelTimer* running_timer_;
+};
+
+#endif // __TIMING_WHEEL_H__
@@ -1,20 +1,119 @@
 #include <assert.h>
+#include <netinet/udp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
 
+#include <algorithm>
 #include <iostream>
+#include <memory>
 
 #include "common_define.h"
+#include "io_loop.h"
 #include "socket_util.h"
 #include "socket_handler.h"
 #include "udp_socket.h"
 
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+
+// 一次recvmmsg最多收多少个包
+static const int kRecvBatch = 32;
+
+// 每个槽的大小, 开了GRO的话一个槽里是好几个包拼起来的
+static const size_t kRecvSlotSize = 64*1024;
+
+// 同一个线程上的UdpSocket共用一个接收环, 一批收上来马上处理完, 不会互相覆盖
+struct UdpRecvRing
+{
+    UdpRecvRing()
+    {
+        buf = (uint8_t*)malloc(kRecvBatch * kRecvSlotSize);
+
+        for (int i = 0; i < kRecvBatch; ++i)
+        {
+            iov[i].iov_base = buf + i * kRecvSlotSize;
+            iov[i].iov_len = kRecvSlotSize;
+        }
+    }
+
+    ~UdpRecvRing()
+    {
+        free(buf);
+    }
+
+    // 每次recvmmsg之前重置, 内核会改写这些长度
+    void Reset()
+    {
+        memset(msgs, 0, sizeof(msgs));
+
+        for (int i = 0; i < kRecvBatch; ++i)
+        {
+            msgs[i].msg_hdr.msg_name = &addr[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(addr[i]);
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_control = control[i];
+            msgs[i].msg_hdr.msg_controllen = sizeof(control[i]);
+        }
+    }
+
+    uint8_t*        buf;
+    mmsghdr         msgs[kRecvBatch];
+    iovec           iov[kRecvBatch];
+    sockaddr_in     addr[kRecvBatch];
+    char            control[kRecvBatch][CMSG_SPACE(sizeof(int))];
+
+private:
+    UdpRecvRing(const UdpRecvRing&);
+    UdpRecvRing& operator=(const UdpRecvRing&);
+};
+
+// 用到UDP的线程才分配, 线程退出时释放
+static thread_local std::unique_ptr<UdpRecvRing> recv_ring;
+
+// 一次sendmmsg最多带多少个消息
+static const int kSendBatch = 64;
+
+// 一个GSO消息最多拼多少个包, 总长不能超过64K
+static const size_t kMaxGsoSegments = 64;
+static const size_t kMaxGsoBytes = 65000;
+
+// 发送队列上限, 对端或者内核发不动的时候超过的直接丢
+static const size_t kMaxSendQueueBytes = 4*1024*1024;
+
+static size_t GetGroSize(msghdr& msg_hdr)
+{
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg_hdr); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg_hdr, cmsg))
+    {
+        if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO)
+        {
+            int gso_size = 0;
+            memcpy(&gso_size, CMSG_DATA(cmsg), sizeof(gso_size));
+
+            return gso_size;
+        }
+    }
+
+    return 0;
+}
+
 UdpSocket::UdpSocket(IoLoop* io_loop, const int& fd, HandlerFactoryT handler_factory)
     : Fd(io_loop, fd)
     , handler_factory_(handler_factory)
+    , gso_(true)
+    , send_drop_count_(0)
 {
     memset(&src_addr_, 0, sizeof(src_addr_));
     src_addr_len_ = sizeof(src_addr_);
 
     socket_handler_ = handler_factory_(io_loop, this);
+
+    EnableGro();
 }
 
 UdpSocket::~UdpSocket()
@@ -22,32 +121,80 @@ UdpSocket::~UdpSocket()
     delete socket_handler_;
 }
 
+bool UdpSocket::EnableGro()
+{
+    int on = 1;
+
+    return setsockopt(fd_, SOL_UDP, UDP_GRO, &on, sizeof(on)) == 0;
+}
+
+void UdpSocket::UpdateSrcAddr(const sockaddr_in& src_addr, const socklen_t& src_addr_len)
+{
+    // 连接上的对端基本不变, 变了才转字符串
+    if (src_addr.sin_addr.s_addr == src_addr_.sin_addr.s_addr && src_addr.sin_port == src_addr_.sin_port && ! client_ip_.empty())
+    {
+        return;
+    }
+
+    src_addr_ = src_addr;
+    src_addr_len_ = src_addr_len;
+
+    socket_util::SocketAddrInetToIpPort(src_addr_, client_ip_, client_port_);
+}
+
 int UdpSocket::OnRead()
 {
+    if (! recv_ring)
+    {
+        recv_ring.reset(new UdpRecvRing());
+    }
+
+    UdpRecvRing& ring = *recv_ring;
+
+    // 包直接挂在接收环上交给上层, 不拷贝
+    IoBuffer io_buffer;
+
     while (true)
     {
-        // TODO:可以重用,加reset接口
-        IoBuffer io_buffer(4096);
+        ring.Reset();
 
-        int bytes = io_buffer.ReadFromFdAndWrite(fd_, (sockaddr*)&src_addr_, &src_addr_len_);
+        int count = recvmmsg(fd_, ring.msgs, kRecvBatch, MSG_DONTWAIT, NULL);
 
-        if (bytes > 0)
-        {
-            socket_util::SocketAddrInetToIpPort(src_addr_, client_ip_, client_port_);
-            socket_handler_->HandleRead(io_buffer, *this);
-        }
-        else if (bytes == 0)
+        if (count <= 0)
         {
-            // impossible
+            if (count < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                std::cout << LMSG << name() << " recvmmsg err:" << strerror(errno) << std::endl;
+            }
+
             break;
         }
-        else
+
+        for (int i = 0; i < count; ++i)
         {
-			if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
-            {   
-                //std::cout << LMSG << "block" << std::endl;
+            msghdr& msg_hdr = ring.msgs[i].msg_hdr;
+
+            UpdateSrcAddr(ring.addr[i], msg_hdr.msg_namelen);
+
+            uint8_t* data = (uint8_t*)ring.iov[i].iov_base;
+            size_t len = ring.msgs[i].msg_len;
+
+            // GRO合并的包按gso_size拆开, 最后一个可能短一些
+            size_t segment_size = GetGroSize(msg_hdr);
+            if (segment_size == 0)
+            {
+                segment_size = len;
             }
 
+            for (size_t pos = 0; pos < len; pos += segment_size)
+            {
+                io_buffer.Attach(data + pos, std::min(segment_size, len - pos));
+                socket_handler_->HandleRead(io_buffer, *this);
+            }
+        }
+
+        if (count < kRecvBatch)
+        {
             break;
         }
     }
@@ -58,12 +205,161 @@ int UdpSocket::OnRead()
 
 int UdpSocket::OnWrite()
 {
+    FlushSendQueue();
+
     return kSuccess;
 }
 
+void UdpSocket::OnFlush()
+{
+    FlushSendQueue();
+}
+
 int UdpSocket::Send(const uint8_t* data, const size_t& len)
 {
-    sendto(fd_, data, len, 0, (sockaddr*)&src_addr_, src_addr_len_);
+    if (send_buf_.size() + len > kMaxSendQueueBytes)
+    {
+        if (send_drop_count_++ % 1000 == 0)
+        {
+            std::cout << LMSG << name() << " send queue full, drop_count:" << send_drop_count_ << std::endl;
+        }
+
+        return kSuccess;
+    }
+
+    SendPacket packet;
+    packet.offset = send_buf_.size();
+    packet.len = len;
+    packet.addr = src_addr_;
+    packet.addr_len = src_addr_len_;
+
+    send_buf_.insert(send_buf_.end(), data, data + len);
+    send_packet_.push_back(packet);
+
+    // 等可写的时候OnWrite会发
+    if ((events_ & EPOLLOUT) == 0)
+    {
+        io_loop_->FlushLater(this);
+    }
 
     return kSuccess;
 }
+
+void UdpSocket::FlushSendQueue()
+{
+    size_t index = 0;
+
+    while (index < send_packet_.size())
+    {
+        mmsghdr msgs[kSendBatch];
+        iovec iov[kSendBatch];
+        char control[kSendBatch][CMSG_SPACE(sizeof(uint16_t))];
+        size_t packet_count[kSendBatch];
+
+        memset(msgs, 0, sizeof(msgs));
+
+        int msg_count = 0;
+        size_t cur = index;
+
+        while (cur < send_packet_.size() && msg_count < kSendBatch)
+        {
+            const SendPacket& first = send_packet_[cur];
+
+            size_t count = 1;
+            size_t total = first.len;
+
+            // 同一个目的地址, 大小一样的连续包(最后一个可以小一些)拼成一个GSO消息
+            while (gso_ && cur + count < send_packet_.size() && count < kMaxGsoSegments)
+            {
+                const SendPacket& prev = send_packet_[cur + count - 1];
+                const SendPacket& next = send_packet_[cur + count];
+
+                if (prev.len != first.len || next.len > first.len || total + next.len > kMaxGsoBytes ||
+                    next.addr.sin_addr.s_addr != first.addr.sin_addr.s_addr || next.addr.sin_port != first.addr.sin_port)
+                {
+                    break;
+                }
+
+                total += next.len;
+                ++count;
+            }
+
+            iov[msg_count].iov_base = &send_buf_[first.offset];
+            iov[msg_count].iov_len = total;
+
+            msghdr& msg_hdr = msgs[msg_count].msg_hdr;
+            msg_hdr.msg_name = (void*)&first.addr;
+            msg_hdr.msg_namelen = first.addr_len;
+            msg_hdr.msg_iov = &iov[msg_count];
+            msg_hdr.msg_iovlen = 1;
+
+            if (count > 1)
+            {
+                msg_hdr.msg_control = control[msg_count];
+                msg_hdr.msg_controllen = sizeof(control[msg_count]);
+
+                cmsghdr* cmsg = CMSG_FIRSTHDR(&msg_hdr);
+                cmsg->cmsg_level = SOL_UDP;
+                cmsg->cmsg_type = UDP_SEGMENT;
+                cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+
+                uint16_t gso_size = first.len;
+                memcpy(CMSG_DATA(cmsg), &gso_size, sizeof(gso_size));
+            }
+
+            packet_count[msg_count] = count;
+
+            cur += count;
+            ++msg_count;
+        }
+
+        int ret = sendmmsg(fd_, msgs, msg_count, 0);
+
+        if (ret < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+            {
+                EnableWrite();
+                break;
+            }
+
+            // 内核不支持UDP_SEGMENT, 退回一个包一个消息
+            if (gso_ && packet_count[0] > 1 && (errno == EINVAL || errno == EIO || errno == ENOPROTOOPT))
+            {
+                std::cout << LMSG << name() << " udp gso not supported, err:" << strerror(errno) << std::endl;
+                gso_ = false;
+                continue;
+            }
+
+            // 比如对端端口不可达, 丢掉这个消息接着发
+            std::cout << LMSG << name() << " sendmmsg err:" << strerror(errno) << std::endl;
+            ret = 1;
+        }
+
+        for (int i = 0; i < ret; ++i)
+        {
+            index += packet_count[i];
+        }
+    }
+
+    if (index == send_packet_.size())
+    {
+        send_buf_.clear();
+        send_packet_.clear();
+
+        DisableWrite();
+
+        return;
+    }
+
+    // 剩下的挪到前面
+    size_t base = send_packet_[index].offset;
+
+    send_buf_.erase(send_buf_.begin(), send_buf_.begin() + base);
+    send_packet_.erase(send_packet_.begin(), send_packet_.begin() + index);
+
+    for (auto& packet : send_packet_)
+    {
+        packet.offset -= base;
+    }
+}
@@ -1,6 +1,8 @@
 #ifndef __UDP_SOCKET_H__
 #define __UDP_SOCKET_H__
 
+#include <vector>
+
 #include "io_buffer.h"
 #include "fd.h"
 
@@ -14,8 +16,14 @@ public:
 
     virtual int OnRead();
     virtual int OnWrite();
+    virtual void OnFlush();
+
+    // 先攒在发送队列里, 本轮loop结束的时候sendmmsg一起发
     virtual int Send(const uint8_t* data, const size_t& len);
 
+    // 内核支持的话打开UDP_GRO, 同一个流连续的同样大小的包合成一个收上来
+    bool EnableGro();
+
     uint16_t GetClientPort() { return client_port_; }
     std::string GetClientIp() { return client_ip_; }
     sockaddr_in GetSrcAddr() { return src_addr_; }
@@ -24,12 +32,30 @@ public:
     void SetSrcAddrLen(socklen_t src_addr_len) { src_addr_len_ = src_addr_len; }
 
 private:
+    void UpdateSrcAddr(const sockaddr_in& src_addr, const socklen_t& src_addr_len);
+    void FlushSendQueue();
+
+private:
+    struct SendPacket
+    {
+        size_t      offset;
+        size_t      len;
+        sockaddr_in addr;
+        socklen_t   addr_len;
+    };
+
     HandlerFactoryT handler_factory_;
     sockaddr_in src_addr_;
     socklen_t src_addr_len_;
 
     std::string client_ip_;
     uint16_t client_port_;
+
+    // 待发送的包, 数据连续放在send_buf_里
+    std::vector<uint8_t>    send_buf_;
+    std::vector<SendPacket> send_packet_;
+    bool                    gso_;
+    uint64_t                send_drop_count_;
 };
 
 #endif // __UDP_SOCKET_H__
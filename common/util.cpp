@@ -3,6 +3,7 @@
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <signal.h>
@@ -246,6 +247,14 @@ uint64_t Util::GetNowUs()
     return tv.tv_sec * 1000000UL + tv.tv_usec;
 }
 
+uint64_t Util::GetMonotonicMs()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000UL + ts.tv_nsec / 1000000;
+}
+
 std::string Util::GetNowStr()
 {
     char time_printf[256];
@@ -284,6 +293,34 @@ std::string Util::GetNowStrHttpFormat()
     return "";
 }
 
+std::string Util::GetHttpDate(const uint64_t& sec)
+{
+    char time_printf[64];
+
+    time_t t = sec;
+    tm time_struct;
+    gmtime_r(&t, &time_struct);
+
+    size_t ret = strftime(time_printf, sizeof(time_printf), "%a, %d %b %Y %H:%M:%S GMT", &time_struct);
+
+    return std::string(time_printf, ret);
+}
+
+uint64_t Util::ParseHttpDate(const std::string& date)
+{
+    tm time_struct;
+    memset(&time_struct, 0, sizeof(time_struct));
+
+    if (strptime(date.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &time_struct) == NULL)
+    {
+        return 0;
+    }
+
+    time_t t = timegm(&time_struct);
+
+    return t < 0 ? 0 : t;
+}
+
 std::string Util::GetNowMsStr()
 {
     char time_printf[256];
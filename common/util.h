@@ -17,8 +17,11 @@ public:
 	static uint64_t GetNowMs();
     static uint64_t GetNow();
     static uint64_t GetNowUs();
+    static uint64_t GetMonotonicMs();
     static std::string GetNowStr();
     static std::string GetNowStrHttpFormat(); // RFC 2822
+    static std::string GetHttpDate(const uint64_t& sec); // RFC 7231, Last-Modified用
+    static uint64_t ParseHttpDate(const std::string& date); // 解析失败返回0
     static std::string GetNowMsStr();
 
 	static std::string ReadFile(const std::string& file_name);
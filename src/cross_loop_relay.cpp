@@ -0,0 +1,424 @@
+#include "common_define.h"
+#include "cross_loop_relay.h"
+#include "io_loop.h"
+#include "global.h"
+#include "media_struct.h"
+
+// 通道里最多缓存的消息数, 按25fps+44.1k aac算大概十几秒
+static const size_t kCrossLoopRingSize = 2048;
+
+// 订阅者都走了之后镜像再留一会, hls只查流不订阅
+static const uint64_t kCrossLoopIdleMs = 30*1000;
+
+CrossLoopChannel::CrossLoopChannel(IoLoop* producer_loop, IoLoop* consumer_loop)
+    : producer_loop_(producer_loop)
+    , consumer_loop_(consumer_loop)
+    , ring_(kCrossLoopRingSize)
+    , scheduled_(false)
+    , stopped_(false)
+    , closed_(false)
+    , drop_count_(0)
+    , producer_(NULL)
+    , consumer_(NULL)
+{
+}
+
+CrossLoopChannel::~CrossLoopChannel()
+{
+}
+
+bool CrossLoopChannel::Push(const CrossLoopMessage& msg)
+{
+    if (! ring_.Push(msg))
+    {
+        drop_count_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    Schedule();
+
+    return true;
+}
+
+void CrossLoopChannel::Stop()
+{
+    stopped_.store(true, std::memory_order_release);
+
+    Schedule();
+}
+
+void CrossLoopChannel::DetachProducer()
+{
+    if (producer_ != NULL)
+    {
+        delete producer_;
+        producer_ = NULL;
+    }
+}
+
+void CrossLoopChannel::Close()
+{
+    consumer_ = NULL;
+    closed_.store(true, std::memory_order_release);
+}
+
+void CrossLoopChannel::ForwardHlsRequest()
+{
+    std::shared_ptr<CrossLoopChannel> self = shared_from_this();
+
+    producer_loop_->QueueInLoop([self]()
+    {
+        self->OnHlsRequest();
+    });
+}
+
+void CrossLoopChannel::OnHlsRequest()
+{
+    // 发布者已经没了, 或者镜像不要了
+    if (producer_ != NULL && ! IsClosed())
+    {
+        producer_->OnHlsRequest();
+    }
+}
+
+void CrossLoopChannel::Schedule()
+{
+    // 消费者还没处理的时候只投递一次任务
+    if (! scheduled_.exchange(true, std::memory_order_acq_rel))
+    {
+        std::shared_ptr<CrossLoopChannel> self = shared_from_this();
+
+        consumer_loop_->QueueInLoop([self]()
+        {
+            self->OnReadable();
+        });
+    }
+}
+
+void CrossLoopChannel::OnReadable()
+{
+    scheduled_.store(false, std::memory_order_release);
+
+    if (consumer_ != NULL)
+    {
+        consumer_->OnChannelReadable();
+    }
+}
+
+CrossLoopSubscriber::CrossLoopSubscriber(const std::shared_ptr<CrossLoopChannel>& channel)
+    : MediaSubscriber(kCrossLoop)
+    , channel_(channel)
+    , wait_key_frame_(false)
+    , detaching_(false)
+    , hls_wait_id_(0)
+{
+}
+
+CrossLoopSubscriber::~CrossLoopSubscriber()
+{
+    StopHls();
+}
+
+int CrossLoopSubscriber::SendMetaData(const std::string& metadata)
+{
+    CrossLoopMessage msg;
+    msg.type = kCrossLoopMetaData;
+    msg.data = metadata;
+
+    return Push(msg);
+}
+
+int CrossLoopSubscriber::SendVideoHeader(const std::string& header)
+{
+    CrossLoopMessage msg;
+    msg.type = kCrossLoopVideoHeader;
+    msg.data = header;
+
+    return Push(msg);
+}
+
+int CrossLoopSubscriber::SendAudioHeader(const std::string& header)
+{
+    CrossLoopMessage msg;
+    msg.type = kCrossLoopAudioHeader;
+    msg.data = header;
+
+    return Push(msg);
+}
+
+int CrossLoopSubscriber::SendMediaData(const Payload& payload)
+{
+    // 丢过帧之后视频要等到下一个关键帧, 不然对端花屏
+    if (wait_key_frame_ && payload.IsVideo())
+    {
+        if (! payload.IsIFrame())
+        {
+            return kSuccess;
+        }
+
+        wait_key_frame_ = false;
+    }
+
+    // 引用计数从这里开始两个loop一起改
+    payload.SetShared();
+
+    CrossLoopMessage msg;
+    msg.type = kCrossLoopMediaData;
+    msg.payload = payload;
+
+    return Push(msg);
+}
+
+int CrossLoopSubscriber::OnStop()
+{
+    // 发布者马上要析构了
+    StopHls();
+    publisher_ = NULL;
+
+    channel_->Stop();
+    Detach();
+
+    return kSuccess;
+}
+
+int CrossLoopSubscriber::Push(const CrossLoopMessage& msg)
+{
+    if (channel_->IsClosed())
+    {
+        Detach();
+        return kError;
+    }
+
+    if (! channel_->Push(msg))
+    {
+        if (! wait_key_frame_)
+        {
+            std::cout << LMSG << "cross loop channel full, drop until next key frame, drop_count:" << channel_->GetDropCount() << std::endl;
+        }
+
+        wait_key_frame_ = true;
+
+        return kError;
+    }
+
+    return kSuccess;
+}
+
+void CrossLoopSubscriber::OnHlsRequest()
+{
+    if (publisher_ == NULL || detaching_)
+    {
+        return;
+    }
+
+    MediaMuxer& media_muxer = publisher_->GetMediaMuxer();
+
+    media_muxer.OnHlsRequest();
+
+    if (hls_wait_id_ == 0)
+    {
+        hls_wait_id_ = media_muxer.WaitHls(std::bind(&CrossLoopSubscriber::OnHlsUpdate, this, std::placeholders::_1));
+
+        // 源站之前已经在切了, 先把现在的给过去; 还没有播放列表的等更新
+        if (media_muxer.HasM3U8())
+        {
+            PushHls();
+        }
+    }
+}
+
+void CrossLoopSubscriber::OnHlsUpdate(const bool& stopped)
+{
+    // 不切了的时候等待已经被清掉了, 下次有请求再挂
+    if (stopped)
+    {
+        hls_wait_id_ = 0;
+    }
+
+    PushHls();
+}
+
+void CrossLoopSubscriber::PushHls()
+{
+    if (channel_->IsClosed())
+    {
+        StopHls();
+        Detach();
+        return;
+    }
+
+    CrossLoopMessage msg;
+    msg.type = kCrossLoopHls;
+    msg.hls = publisher_->GetMediaMuxer().GetHlsPlaylist();
+
+    // 满了就算了, 每次发的都是完整的一份, 下次更新会补上
+    channel_->Push(msg);
+}
+
+void CrossLoopSubscriber::StopHls()
+{
+    if (hls_wait_id_ != 0 && publisher_ != NULL)
+    {
+        publisher_->GetMediaMuxer().CancelHlsWait(hls_wait_id_);
+    }
+
+    hls_wait_id_ = 0;
+}
+
+void CrossLoopSubscriber::Detach()
+{
+    if (detaching_)
+    {
+        return;
+    }
+
+    detaching_ = true;
+
+    // 当前可能正在publisher遍历subscriber_, 放到本轮io之后再删
+    std::shared_ptr<CrossLoopChannel> channel = channel_;
+    channel_->GetProducerLoop()->QueueInLoop([channel]()
+    {
+        channel->DetachProducer();
+    });
+}
+
+CrossLoopPublisher::CrossLoopPublisher(IoLoop* io_loop, IoLoop* origin_loop, const uint64_t& stream_id, const std::string& app, const std::string& stream)
+    : MediaPublisher()
+    , channel_(std::make_shared<CrossLoopChannel>(origin_loop, io_loop))
+    , io_loop_(io_loop)
+    , stream_id_(stream_id)
+    , app_(app)
+    , stream_(stream)
+    , last_access_ms_(io_loop->GetNowMs())
+{
+    media_muxer_.SetApp(app);
+    media_muxer_.SetStreamName(stream);
+
+    channel_->SetConsumer(this);
+
+    std::shared_ptr<CrossLoopChannel> channel = channel_;
+
+    // HLS只在源站切一份, 所有loop回同一套播放列表和切片
+    media_muxer_.SetHlsForward([channel]()
+    {
+        channel->ForwardHlsRequest();
+    });
+    origin_loop->QueueInLoop([channel, app, stream]()
+    {
+        if (channel->IsClosed())
+        {
+            return;
+        }
+
+        MediaPublisher* publisher = g_local_stream_center.GetOriginPublisher(app, stream, channel->GetProducerLoop());
+
+        if (publisher == NULL)
+        {
+            channel->Stop();
+            return;
+        }
+
+        CrossLoopSubscriber* subscriber = new CrossLoopSubscriber(channel);
+        channel->SetProducer(subscriber);
+        publisher->AddSubscriber(subscriber);
+    });
+
+    std::cout << LMSG << "cross loop relay app:" << app_ << ",stream:" << stream_ << std::endl;
+}
+
+CrossLoopPublisher::~CrossLoopPublisher()
+{
+    channel_->Close();
+}
+
+void CrossLoopPublisher::OnChannelReadable()
+{
+    CrossLoopMessage msg;
+
+    while (channel_->Pop(msg))
+    {
+        switch (msg.type)
+        {
+            case kCrossLoopMetaData:
+            {
+                media_muxer_.OnMetaData(msg.data);
+            }
+            break;
+
+            case kCrossLoopVideoHeader:
+            {
+                media_muxer_.OnVideoHeader(msg.data);
+            }
+            break;
+
+            case kCrossLoopAudioHeader:
+            {
+                media_muxer_.OnAudioHeader(msg.data);
+            }
+            break;
+
+            case kCrossLoopHls:
+            {
+                media_muxer_.SetHlsPlaylist(msg.hls);
+            }
+            break;
+
+            case kCrossLoopMediaData:
+            {
+                if (msg.payload.IsVideo())
+                {
+                    media_muxer_.OnVideo(msg.payload);
+                }
+                else
+                {
+                    media_muxer_.OnAudio(msg.payload);
+                }
+
+                subscriber_.SendMediaData(msg.payload);
+            }
+            break;
+
+            default: break;
+        }
+    }
+
+    if (channel_->IsStopped())
+    {
+        OnStop();
+        return;
+    }
+
+    if (subscriber_.Empty() && wait_header_subscriber_.empty())
+    {
+        if (io_loop_->GetNowMs() - last_access_ms_ > kCrossLoopIdleMs)
+        {
+            std::cout << LMSG << "cross loop relay idle, app:" << app_ << ",stream:" << stream_ << std::endl;
+
+            g_local_stream_center.RemoveCrossLoopPublisher(io_loop_, stream_id_, this);
+            delete this;
+        }
+    }
+}
+
+void CrossLoopPublisher::OnStop()
+{
+    std::cout << LMSG << "cross loop relay stop, app:" << app_ << ",stream:" << stream_ << std::endl;
+
+    auto subscriber = wait_header_subscriber_;
+    subscriber_.ForEach([&subscriber](MediaSubscriber* sub)
+    {
+        subscriber.insert(sub);
+    });
+
+    subscriber_.Clear();
+    wait_header_subscriber_.clear();
+
+    for (auto& sub : subscriber)
+    {
+        sub->SetPublisher(NULL);
+        sub->OnStop();
+    }
+
+    g_local_stream_center.RemoveCrossLoopPublisher(io_loop_, stream_id_, this);
+    delete this;
+}
@@ -0,0 +1,152 @@
+#ifndef __CROSS_LOOP_RELAY_H__
+#define __CROSS_LOOP_RELAY_H__
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include "lock_free_queue.h"
+#include "media_publisher.h"
+#include "media_subscriber.h"
+#include "ref_ptr.h"
+
+class CrossLoopPublisher;
+class CrossLoopSubscriber;
+class IoLoop;
+struct HlsPlaylist;
+
+enum CrossLoopMessageType
+{
+    kCrossLoopMetaData    = 0,
+    kCrossLoopVideoHeader = 1,
+    kCrossLoopAudioHeader = 2,
+    kCrossLoopMediaData   = 3,
+    kCrossLoopHls         = 4,
+};
+
+struct CrossLoopMessage
+{
+    CrossLoopMessage()
+        : type(kCrossLoopMediaData)
+    {
+    }
+
+    uint8_t     type;
+    Payload     payload;
+    std::string data;
+    // 源站切好的HLS, 镜像直接拿来回请求
+    std::shared_ptr<const HlsPlaylist> hls;
+};
+
+// 多reactor模式下, 订阅者和发布者不在同一个loop时的单向通道:
+// 发布者loop上挂一个CrossLoopSubscriber, 订阅者loop上挂一个CrossLoopPublisher,
+// 中间是一个SPSC无锁环, 不用锁.
+class CrossLoopChannel : public std::enable_shared_from_this<CrossLoopChannel>
+{
+public:
+    CrossLoopChannel(IoLoop* producer_loop, IoLoop* consumer_loop);
+    ~CrossLoopChannel();
+
+    IoLoop* GetProducerLoop() { return producer_loop_; }
+    IoLoop* GetConsumerLoop() { return consumer_loop_; }
+
+    // ==== 生产者loop ====
+    bool Push(const CrossLoopMessage& msg);
+    void Stop();
+    void SetProducer(CrossLoopSubscriber* producer) { producer_ = producer; }
+    void DetachProducer();
+
+    // ==== 消费者loop ====
+    bool Pop(CrossLoopMessage& msg) { return ring_.Pop(msg); }
+    void SetConsumer(CrossLoopPublisher* consumer) { consumer_ = consumer; }
+    void Close();
+    // 镜像上有HLS请求, 转到源站loop让源站切, 切好的从通道发回来
+    void ForwardHlsRequest();
+
+    bool IsStopped() const { return stopped_.load(std::memory_order_acquire); }
+    bool IsClosed() const { return closed_.load(std::memory_order_acquire); }
+
+    uint64_t GetDropCount() const { return drop_count_.load(std::memory_order_relaxed); }
+
+private:
+    void Schedule();
+    void OnReadable();
+    void OnHlsRequest();
+
+private:
+    IoLoop*                    producer_loop_;
+    IoLoop*                    consumer_loop_;
+
+    SpscRing<CrossLoopMessage>  ring_;
+
+    std::atomic<bool>           scheduled_;
+    std::atomic<bool>           stopped_;   // 发布者没了
+    std::atomic<bool>           closed_;    // 订阅者loop不要了
+    std::atomic<uint64_t>       drop_count_;
+
+    CrossLoopSubscriber*        producer_;
+    CrossLoopPublisher*         consumer_;
+};
+
+// 挂在发布者所在loop
+class CrossLoopSubscriber : public MediaSubscriber
+{
+public:
+    CrossLoopSubscriber(const std::shared_ptr<CrossLoopChannel>& channel);
+    ~CrossLoopSubscriber();
+
+    virtual int SendMetaData(const std::string& metadata);
+    virtual int SendVideoHeader(const std::string& header);
+    virtual int SendAudioHeader(const std::string& header);
+    virtual int SendMediaData(const Payload& payload);
+    virtual int OnStop();
+
+    // 镜像转过来的HLS请求, 源站开始切, 之后播放列表每次更新都发给镜像
+    void OnHlsRequest();
+
+private:
+    int Push(const CrossLoopMessage& msg);
+    void Detach();
+    void OnHlsUpdate(const bool& stopped);
+    void PushHls();
+    void StopHls();
+
+private:
+    std::shared_ptr<CrossLoopChannel> channel_;
+    bool wait_key_frame_;
+    bool detaching_;
+    // 在源站MediaMuxer上等播放列表更新的id, 0是没在等
+    uint64_t hls_wait_id_;
+};
+
+// 挂在订阅者所在loop, 对本loop的订阅者来说就是一个普通的发布者
+class CrossLoopPublisher : public MediaPublisher
+{
+public:
+    // stream_id是源流在LocalStreamCenter里的Entry::id
+    CrossLoopPublisher(IoLoop* io_loop, IoLoop* origin_loop, const uint64_t& stream_id, const std::string& app, const std::string& stream);
+    ~CrossLoopPublisher();
+
+    void OnChannelReadable();
+
+    bool IsStopped() const { return channel_->IsStopped(); }
+
+    void Touch(const uint64_t& now_in_ms) { last_access_ms_ = now_in_ms; }
+
+private:
+    void OnStop();
+
+private:
+    std::shared_ptr<CrossLoopChannel> channel_;
+
+    IoLoop* io_loop_;
+    uint64_t stream_id_;
+    std::string app_;
+    std::string stream_;
+
+    uint64_t last_access_ms_;
+};
+
+#endif // __CROSS_LOOP_RELAY_H__
@@ -0,0 +1,779 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "common_define.h"
+#include "fmp4_packetizer.h"
+#include "ts_segment.h"
+
+static const uint32_t kVideoTimescale = 90000;
+static const uint32_t kAacFrameSamples = 1024;
+static const uint32_t kAacSampleRate[16] = {96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050, 16000, 12000, 11025, 8000, 7350, 0, 0, 0};
+
+// trun里的sample_flags
+static const uint32_t kSyncSampleFlags      = 0x02000000; // depends_on=2
+static const uint32_t kNonSyncSampleFlags   = 0x01010000; // depends_on=1, is_non_sync
+
+static const uint8_t kUnityMatrix[36] =
+{
+    0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x40, 0x00, 0x00, 0x00,
+};
+
+static void Put8(std::string& s, const uint8_t& v)
+{
+    s.push_back((char)v);
+}
+
+static void Put16(std::string& s, const uint16_t& v)
+{
+    s.push_back((char)(v >> 8));
+    s.push_back((char)v);
+}
+
+static void Put24(std::string& s, const uint32_t& v)
+{
+    s.push_back((char)(v >> 16));
+    s.push_back((char)(v >> 8));
+    s.push_back((char)v);
+}
+
+static void Put32(std::string& s, const uint32_t& v)
+{
+    s.push_back((char)(v >> 24));
+    s.push_back((char)(v >> 16));
+    s.push_back((char)(v >> 8));
+    s.push_back((char)v);
+}
+
+static void Put64(std::string& s, const uint64_t& v)
+{
+    Put32(s, (uint32_t)(v >> 32));
+    Put32(s, (uint32_t)v);
+}
+
+static void PutZero(std::string& s, const size_t& n)
+{
+    s.append(n, '\0');
+}
+
+static void Set32(std::string& s, const size_t& pos, const uint32_t& v)
+{
+    s[pos]     = (char)(v >> 24);
+    s[pos + 1] = (char)(v >> 16);
+    s[pos + 2] = (char)(v >> 8);
+    s[pos + 3] = (char)v;
+}
+
+// 先占着size, EndBox时回填
+static size_t BeginBox(std::string& s, const char* type)
+{
+    size_t pos = s.size();
+
+    Put32(s, 0);
+    s.append(type, 4);
+
+    return pos;
+}
+
+static size_t BeginFullBox(std::string& s, const char* type, const uint8_t& version, const uint32_t& flags)
+{
+    size_t pos = BeginBox(s, type);
+
+    Put8(s, version);
+    Put24(s, flags);
+
+    return pos;
+}
+
+static void EndBox(std::string& s, const size_t& pos)
+{
+    Set32(s, pos, (uint32_t)(s.size() - pos));
+}
+
+// esds里的描述符, 长度都小于128, 1个字节
+static size_t BeginDescriptor(std::string& s, const uint8_t& tag)
+{
+    Put8(s, tag);
+    Put8(s, 0);
+
+    return s.size();
+}
+
+static void EndDescriptor(std::string& s, const size_t& pos)
+{
+    s[pos - 1] = (char)(s.size() - pos);
+}
+
+// 读SPS用, 去掉防竞争字节, 读过头了返回0
+class NaluBitReader
+{
+public:
+    NaluBitReader(const std::string& nalu)
+        : pos_(0)
+    {
+        for (size_t i = 0; i < nalu.size(); ++i)
+        {
+            if (nalu[i] == 0x03 && rbsp_.size() >= 2 && rbsp_[rbsp_.size() - 1] == 0 && rbsp_[rbsp_.size() - 2] == 0)
+            {
+                continue;
+            }
+
+            rbsp_.push_back(nalu[i]);
+        }
+    }
+
+    uint32_t ReadBits(const size_t& bits)
+    {
+        uint32_t ret = 0;
+
+        for (size_t i = 0; i < bits; ++i)
+        {
+            ret <<= 1;
+
+            if (pos_ < rbsp_.size() * 8)
+            {
+                ret |= ((uint8_t)rbsp_[pos_ / 8] >> (7 - pos_ % 8)) & 0x01;
+            }
+
+            ++pos_;
+        }
+
+        return ret;
+    }
+
+    uint32_t ReadUe()
+    {
+        size_t zeros = 0;
+
+        while (ReadBits(1) == 0 && zeros < 32)
+        {
+            ++zeros;
+        }
+
+        return ((1u << zeros) - 1) + ReadBits(zeros);
+    }
+
+    int32_t ReadSe()
+    {
+        uint32_t ue = ReadUe();
+
+        return (ue & 0x01) ? (int32_t)((ue + 1) / 2) : -(int32_t)(ue / 2);
+    }
+
+private:
+    std::string rbsp_;
+    size_t pos_;
+};
+
+static void ParseSpsSize(const std::string& sps, uint32_t& width, uint32_t& height)
+{
+    NaluBitReader br(sps);
+
+    br.ReadBits(8); // nal header
+    uint32_t profile_idc = br.ReadBits(8);
+    br.ReadBits(16); // constraint flags + level
+    br.ReadUe(); // sps id
+
+    uint32_t chroma_format_idc = 1;
+
+    if (profile_idc == 100 || profile_idc == 110 || profile_idc == 122 || profile_idc == 244 || profile_idc == 44 ||
+        profile_idc == 83 || profile_idc == 86 || profile_idc == 118 || profile_idc == 128 || profile_idc == 138 ||
+        profile_idc == 139 || profile_idc == 134 || profile_idc == 135)
+    {
+        chroma_format_idc = br.ReadUe();
+
+        if (chroma_format_idc == 3)
+        {
+            br.ReadBits(1); // separate_colour_plane_flag
+        }
+
+        br.ReadUe(); // bit_depth_luma_minus8
+        br.ReadUe(); // bit_depth_chroma_minus8
+        br.ReadBits(1); // qpprime_y_zero_transform_bypass_flag
+
+        if (br.ReadBits(1)) // seq_scaling_matrix_present_flag
+        {
+            for (int i = 0; i < (chroma_format_idc != 3 ? 8 : 12); ++i)
+            {
+                if (br.ReadBits(1) == 0)
+                {
+                    continue;
+                }
+
+                int last_scale = 8;
+                int next_scale = 8;
+
+                for (int j = 0; j < (i < 6 ? 16 : 64) && next_scale != 0; ++j)
+                {
+                    next_scale = (last_scale + br.ReadSe() + 256) % 256;
+                    last_scale = next_scale == 0 ? last_scale : next_scale;
+                }
+            }
+        }
+    }
+
+    br.ReadUe(); // log2_max_frame_num_minus4
+
+    uint32_t pic_order_cnt_type = br.ReadUe();
+
+    if (pic_order_cnt_type == 0)
+    {
+        br.ReadUe();
+    }
+    else if (pic_order_cnt_type == 1)
+    {
+        br.ReadBits(1);
+        br.ReadSe();
+        br.ReadSe();
+
+        uint32_t count = br.ReadUe();
+        for (uint32_t i = 0; i < count && i < 256; ++i)
+        {
+            br.ReadSe();
+        }
+    }
+
+    br.ReadUe(); // max_num_ref_frames
+    br.ReadBits(1); // gaps_in_frame_num_value_allowed_flag
+
+    uint32_t width_in_mbs = br.ReadUe() + 1;
+    uint32_t height_in_map_units = br.ReadUe() + 1;
+    uint32_t frame_mbs_only = br.ReadBits(1);
+
+    if (! frame_mbs_only)
+    {
+        br.ReadBits(1); // mb_adaptive_frame_field_flag
+    }
+
+    br.ReadBits(1); // direct_8x8_inference_flag
+
+    uint32_t crop_left = 0;
+    uint32_t crop_right = 0;
+    uint32_t crop_top = 0;
+    uint32_t crop_bottom = 0;
+
+    if (br.ReadBits(1))
+    {
+        crop_left = br.ReadUe();
+        crop_right = br.ReadUe();
+        crop_top = br.ReadUe();
+        crop_bottom = br.ReadUe();
+    }
+
+    uint32_t crop_unit_x = (chroma_format_idc == 1 || chroma_format_idc == 2) ? 2 : 1;
+    uint32_t crop_unit_y = (chroma_format_idc == 1 ? 2 : 1) * (2 - frame_mbs_only);
+
+    width = width_in_mbs * 16 - (crop_left + crop_right) * crop_unit_x;
+    height = (2 - frame_mbs_only) * height_in_map_units * 16 - (crop_top + crop_bottom) * crop_unit_y;
+}
+
+Fmp4Packetizer::Fmp4Packetizer()
+    : width_(0)
+    , height_(0)
+    , sample_rate_(0)
+    , channels_(0)
+    , audio_object_type_(0)
+    , fragment_seq_(0)
+{
+    video_.track_id = kVideoTrackId;
+    video_.timescale = kVideoTimescale;
+
+    audio_.track_id = kAudioTrackId;
+    audio_.fixed_duration = kAacFrameSamples;
+}
+
+void Fmp4Packetizer::SetVideoConfig(const std::string& sps, const std::string& pps)
+{
+    if (sps.size() < 4 || pps.empty() || (sps == sps_ && pps == pps_))
+    {
+        return;
+    }
+
+    sps_ = sps;
+    pps_ = pps;
+
+    ParseSpsSize(sps_, width_, height_);
+
+    std::cout << LMSG << "fmp4 video " << GetCodecs() << " " << width_ << "x" << height_ << std::endl;
+
+    init_.clear();
+}
+
+void Fmp4Packetizer::SetAudioConfig(const std::string& audio_specific_config)
+{
+    if (audio_specific_config.size() < 2 || audio_specific_config == audio_config_)
+    {
+        return;
+    }
+
+    audio_config_ = audio_specific_config;
+
+    const uint8_t* p = (const uint8_t*)audio_config_.data();
+
+    audio_object_type_ = p[0] >> 3;
+    sample_rate_ = kAacSampleRate[((p[0] & 0x07) << 1) | (p[1] >> 7)];
+    channels_ = (p[1] >> 3) & 0x0F;
+
+    // 采样率当时间基, 不认识的按44100
+    if (sample_rate_ == 0)
+    {
+        sample_rate_ = 44100;
+    }
+
+    audio_.timescale = sample_rate_;
+
+    std::cout << LMSG << "fmp4 audio " << GetCodecs() << " " << sample_rate_ << "Hz " << channels_ << "ch" << std::endl;
+
+    init_.clear();
+}
+
+std::string Fmp4Packetizer::GetCodecs() const
+{
+    std::string codecs;
+    char buf[32];
+
+    if (HasVideo())
+    {
+        snprintf(buf, sizeof(buf), "avc1.%02x%02x%02x", (uint8_t)sps_[1], (uint8_t)sps_[2], (uint8_t)sps_[3]);
+        codecs += buf;
+    }
+
+    if (HasAudio())
+    {
+        snprintf(buf, sizeof(buf), "mp4a.40.%u", (uint32_t)audio_object_type_);
+
+        if (! codecs.empty())
+        {
+            codecs += ",";
+        }
+
+        codecs += buf;
+    }
+
+    return codecs;
+}
+
+const std::string& Fmp4Packetizer::GetInit()
+{
+    if (! init_.empty() || (! HasVideo() && ! HasAudio()))
+    {
+        return init_;
+    }
+
+    std::string& s = init_;
+
+    size_t ftyp = BeginBox(s, "ftyp");
+    s.append("iso6", 4);
+    Put32(s, 0);
+    s.append("iso6cmfcmp41", 12);
+    EndBox(s, ftyp);
+
+    size_t moov = BeginBox(s, "moov");
+
+    size_t mvhd = BeginFullBox(s, "mvhd", 0, 0);
+    Put32(s, 0); // creation_time
+    Put32(s, 0); // modification_time
+    Put32(s, 1000); // timescale
+    Put32(s, 0); // duration
+    Put32(s, 0x00010000); // rate
+    Put16(s, 0x0100); // volume
+    PutZero(s, 10);
+    s.append((const char*)kUnityMatrix, sizeof(kUnityMatrix));
+    PutZero(s, 24); // pre_defined
+    Put32(s, kAudioTrackId + 1); // next_track_ID
+    EndBox(s, mvhd);
+
+    for (int i = 0; i < 2; ++i)
+    {
+        bool video = (i == 0);
+
+        if ((video && ! HasVideo()) || (! video && ! HasAudio()))
+        {
+            continue;
+        }
+
+        const Track& track = video ? video_ : audio_;
+
+        size_t trak = BeginBox(s, "trak");
+
+        size_t tkhd = BeginFullBox(s, "tkhd", 0, 0x03); // enabled | in_movie
+        Put32(s, 0);
+        Put32(s, 0);
+        Put32(s, track.track_id);
+        Put32(s, 0);
+        Put32(s, 0); // duration
+        PutZero(s, 8);
+        Put16(s, 0); // layer
+        Put16(s, 0); // alternate_group
+        Put16(s, video ? 0 : 0x0100); // volume
+        Put16(s, 0);
+        s.append((const char*)kUnityMatrix, sizeof(kUnityMatrix));
+        Put32(s, video ? width_ << 16 : 0);
+        Put32(s, video ? height_ << 16 : 0);
+        EndBox(s, tkhd);
+
+        size_t mdia = BeginBox(s, "mdia");
+
+        size_t mdhd = BeginFullBox(s, "mdhd", 0, 0);
+        Put32(s, 0);
+        Put32(s, 0);
+        Put32(s, track.timescale);
+        Put32(s, 0);
+        Put16(s, 0x55C4); // und
+        Put16(s, 0);
+        EndBox(s, mdhd);
+
+        size_t hdlr = BeginFullBox(s, "hdlr", 0, 0);
+        Put32(s, 0);
+        s.append(video ? "vide" : "soun", 4);
+        PutZero(s, 12);
+        s.append(video ? "VideoHandler" : "SoundHandler");
+        Put8(s, 0);
+        EndBox(s, hdlr);
+
+        size_t minf = BeginBox(s, "minf");
+
+        if (video)
+        {
+            size_t vmhd = BeginFullBox(s, "vmhd", 0, 0x01);
+            PutZero(s, 8); // graphicsmode + opcolor
+            EndBox(s, vmhd);
+        }
+        else
+        {
+            size_t smhd = BeginFullBox(s, "smhd", 0, 0);
+            PutZero(s, 4); // balance + reserved
+            EndBox(s, smhd);
+        }
+
+        size_t dinf = BeginBox(s, "dinf");
+        size_t dref = BeginFullBox(s, "dref", 0, 0);
+        Put32(s, 1);
+        size_t url = BeginFullBox(s, "url ", 0, 0x01); // 数据在本文件里
+        EndBox(s, url);
+        EndBox(s, dref);
+        EndBox(s, dinf);
+
+        size_t stbl = BeginBox(s, "stbl");
+
+        size_t stsd = BeginFullBox(s, "stsd", 0, 0);
+        Put32(s, 1);
+
+        if (video)
+        {
+            size_t avc1 = BeginBox(s, "avc1");
+            PutZero(s, 6);
+            Put16(s, 1); // data_reference_index
+            PutZero(s, 16);
+            Put16(s, (uint16_t)width_);
+            Put16(s, (uint16_t)height_);
+            Put32(s, 0x00480000); // 72dpi
+            Put32(s, 0x00480000);
+            Put32(s, 0);
+            Put16(s, 1); // frame_count
+            PutZero(s, 32); // compressorname
+            Put16(s, 0x0018); // depth
+            Put16(s, 0xFFFF);
+
+            size_t avcc = BeginBox(s, "avcC");
+            Put8(s, 1);
+            Put8(s, (uint8_t)sps_[1]);
+            Put8(s, (uint8_t)sps_[2]);
+            Put8(s, (uint8_t)sps_[3]);
+            Put8(s, 0xFF); // 4字节长度
+            Put8(s, 0xE1); // 1个sps
+            Put16(s, (uint16_t)sps_.size());
+            s.append(sps_);
+            Put8(s, 1);
+            Put16(s, (uint16_t)pps_.size());
+            s.append(pps_);
+            EndBox(s, avcc);
+
+            EndBox(s, avc1);
+        }
+        else
+        {
+            size_t mp4a = BeginBox(s, "mp4a");
+            PutZero(s, 6);
+            Put16(s, 1); // data_reference_index
+            PutZero(s, 8);
+            Put16(s, (uint16_t)channels_);
+            Put16(s, 16); // samplesize
+            Put16(s, 0);
+            Put16(s, 0);
+            Put32(s, (sample_rate_ > 0xFFFF ? 0 : sample_rate_) << 16);
+
+            size_t esds = BeginFullBox(s, "esds", 0, 0);
+            size_t es = BeginDescriptor(s, 0x03);
+            Put16(s, (uint16_t)track.track_id);
+            Put8(s, 0);
+            size_t dcd = BeginDescriptor(s, 0x04);
+            Put8(s, 0x40); // AAC
+            Put8(s, 0x15); // audio stream
+            Put24(s, 0); // bufferSizeDB
+            Put32(s, 0); // maxBitrate
+            Put32(s, 0); // avgBitrate
+            size_t dsi = BeginDescriptor(s, 0x05);
+            s.append(audio_config_);
+            EndDescriptor(s, dsi);
+            EndDescriptor(s, dcd);
+            size_t sl = BeginDescriptor(s, 0x06);
+            Put8(s, 0x02);
+            EndDescriptor(s, sl);
+            EndDescriptor(s, es);
+            EndBox(s, esds);
+
+            EndBox(s, mp4a);
+        }
+
+        EndBox(s, stsd);
+
+        // 样本都在fragment里, 这里都是空表
+        const char* empty_tables[] = {"stts", "stsc", "stco"};
+        for (const auto& type : empty_tables)
+        {
+            size_t table = BeginFullBox(s, type, 0, 0);
+            Put32(s, 0);
+            EndBox(s, table);
+        }
+
+        size_t stsz = BeginFullBox(s, "stsz", 0, 0);
+        Put32(s, 0);
+        Put32(s, 0);
+        EndBox(s, stsz);
+
+        EndBox(s, stbl);
+        EndBox(s, minf);
+        EndBox(s, mdia);
+        EndBox(s, trak);
+    }
+
+    size_t mvex = BeginBox(s, "mvex");
+
+    for (int i = 0; i < 2; ++i)
+    {
+        bool video = (i == 0);
+
+        if ((video && ! HasVideo()) || (! video && ! HasAudio()))
+        {
+            continue;
+        }
+
+        size_t trex = BeginFullBox(s, "trex", 0, 0);
+        Put32(s, video ? video_.track_id : audio_.track_id);
+        Put32(s, 1); // default_sample_description_index
+        Put32(s, 0);
+        Put32(s, 0);
+        Put32(s, 0);
+        EndBox(s, trex);
+    }
+
+    EndBox(s, mvex);
+    EndBox(s, moov);
+
+    return init_;
+}
+
+void Fmp4Packetizer::AddSample(const Payload& payload)
+{
+    if (payload.IsVideo() && HasVideo())
+    {
+        AddSample(video_, payload, payload.GetDts() * 90, payload.GetPts() * 90);
+    }
+    else if (payload.IsAudio() && HasAudio())
+    {
+        AddSample(audio_, payload, payload.GetDts() * sample_rate_ / 1000, payload.GetPts() * sample_rate_ / 1000);
+    }
+}
+
+void Fmp4Packetizer::AddSample(Track& track, const Payload& payload, const uint64_t& dts, const uint64_t& pts)
+{
+    if (track.has_pending)
+    {
+        // 时间戳回退的按1算
+        track.pending.duration = dts > track.pending.dts ? (uint32_t)(dts - track.pending.dts) : 1;
+        track.samples.push_back(track.pending);
+    }
+
+    Sample& sample = track.pending;
+
+    sample.payload = payload;
+    sample.dts = dts;
+    sample.duration = 0;
+    sample.cts_offset = (int32_t)(pts - dts);
+    sample.sync = payload.IsAudio() || payload.IsIFrame();
+    sample.size = 0;
+
+    if (payload.IsVideo())
+    {
+        // 每个NALU前面4字节长度, AUD不要
+        for (size_t i = 0; i < payload.GetNaluCount(); ++i)
+        {
+            uint32_t len = 0;
+            const uint8_t* nalu = payload.GetNalu(i, len);
+
+            if (len != 0 && (nalu[0] & 0x1F) != H264NalType_AUD)
+            {
+                sample.size += 4 + len;
+            }
+        }
+    }
+    else
+    {
+        sample.size = payload.GetRawLen();
+    }
+
+    if (track.fixed_duration != 0)
+    {
+        sample.duration = track.fixed_duration;
+        track.samples.push_back(sample);
+        return;
+    }
+
+    track.has_pending = true;
+}
+
+size_t Fmp4Packetizer::Flush(TsSegment& out)
+{
+    if (video_.samples.empty() && audio_.samples.empty())
+    {
+        return 0;
+    }
+
+    std::string moof;
+    std::vector<size_t> data_offset_pos;
+
+    size_t moof_pos = BeginBox(moof, "moof");
+
+    size_t mfhd = BeginFullBox(moof, "mfhd", 0, 0);
+    Put32(moof, ++fragment_seq_);
+    EndBox(moof, mfhd);
+
+    WriteTraf(moof, video_, data_offset_pos);
+    WriteTraf(moof, audio_, data_offset_pos);
+
+    EndBox(moof, moof_pos);
+
+    size_t video_size = 0;
+    for (const auto& sample : video_.samples)
+    {
+        video_size += sample.size;
+    }
+
+    size_t audio_size = 0;
+    for (const auto& sample : audio_.samples)
+    {
+        audio_size += sample.size;
+    }
+
+    // data_offset从moof开头算, 视频在mdat前面, 音频跟在后面
+    size_t i = 0;
+    if (! video_.samples.empty())
+    {
+        Set32(moof, data_offset_pos[i++], (uint32_t)(moof.size() + 8));
+    }
+
+    if (! audio_.samples.empty())
+    {
+        Set32(moof, data_offset_pos[i++], (uint32_t)(moof.size() + 8 + video_size));
+    }
+
+    std::string mdat_header;
+    Put32(mdat_header, (uint32_t)(8 + video_size + audio_size));
+    mdat_header.append("mdat", 4);
+
+    out.Append((const uint8_t*)moof.data(), moof.size());
+    out.Append((const uint8_t*)mdat_header.data(), mdat_header.size());
+
+    // 样本数据一次留够直接拷进去
+    uint8_t* p = out.Reserve(video_size + audio_size);
+
+    WriteSampleData(p, video_);
+    WriteSampleData(p + video_size, audio_);
+
+    video_.samples.clear();
+    audio_.samples.clear();
+
+    return moof.size() + mdat_header.size() + video_size + audio_size;
+}
+
+void Fmp4Packetizer::Reset()
+{
+    video_.samples.clear();
+    video_.has_pending = false;
+    video_.pending.payload = Payload();
+
+    audio_.samples.clear();
+    audio_.has_pending = false;
+    audio_.pending.payload = Payload();
+}
+
+void Fmp4Packetizer::WriteTraf(std::string& moof, const Track& track, std::vector<size_t>& data_offset_pos)
+{
+    if (track.samples.empty())
+    {
+        return;
+    }
+
+    size_t traf = BeginBox(moof, "traf");
+
+    size_t tfhd = BeginFullBox(moof, "tfhd", 0, 0x020000); // default-base-is-moof
+    Put32(moof, track.track_id);
+    EndBox(moof, tfhd);
+
+    size_t tfdt = BeginFullBox(moof, "tfdt", 1, 0);
+    Put64(moof, track.samples[0].dts);
+    EndBox(moof, tfdt);
+
+    // data_offset | duration | size | flags | cts, version 1的cts是有符号的
+    size_t trun = BeginFullBox(moof, "trun", 1, 0x000F01);
+    Put32(moof, (uint32_t)track.samples.size());
+    data_offset_pos.push_back(moof.size());
+    Put32(moof, 0);
+
+    for (const auto& sample : track.samples)
+    {
+        Put32(moof, sample.duration);
+        Put32(moof, sample.size);
+        Put32(moof, sample.sync ? kSyncSampleFlags : kNonSyncSampleFlags);
+        Put32(moof, (uint32_t)sample.cts_offset);
+    }
+
+    EndBox(moof, trun);
+    EndBox(moof, traf);
+}
+
+void Fmp4Packetizer::WriteSampleData(uint8_t* p, const Track& track)
+{
+    for (const auto& sample : track.samples)
+    {
+        const Payload& payload = sample.payload;
+
+        if (payload.IsAudio())
+        {
+            memcpy(p, payload.GetRawData(), payload.GetRawLen());
+            p += payload.GetRawLen();
+            continue;
+        }
+
+        for (size_t i = 0; i < payload.GetNaluCount(); ++i)
+        {
+            uint32_t len = 0;
+            const uint8_t* nalu = payload.GetNalu(i, len);
+
+            if (len == 0 || (nalu[0] & 0x1F) == H264NalType_AUD)
+            {
+                continue;
+            }
+
+            p[0] = (uint8_t)(len >> 24);
+            p[1] = (uint8_t)(len >> 16);
+            p[2] = (uint8_t)(len >> 8);
+            p[3] = (uint8_t)len;
+
+            memcpy(p + 4, nalu, len);
+            p += 4 + len;
+        }
+    }
+}
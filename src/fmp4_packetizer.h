@@ -0,0 +1,120 @@
+#ifndef __FMP4_PACKETIZER_H__
+#define __FMP4_PACKETIZER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "ref_ptr.h"
+
+class TsSegment;
+
+// CMAF(fMP4)打包, 一个init(ftyp+moov) + 若干fragment(moof+mdat).
+// 视频轨1(H264, 90k), 音频轨2(AAC, 采样率), 音视频在同一个fragment里.
+// 视频帧先攒着, 下一帧来了才知道时长; AAC一帧固定1024个采样. Flush时写成一个fragment追加到切片后面
+class Fmp4Packetizer
+{
+public:
+    enum
+    {
+        kVideoTrackId = 1,
+        kAudioTrackId = 2,
+    };
+
+    Fmp4Packetizer();
+
+    // sps/pps带NAL头, 变了init要重新生成
+    void SetVideoConfig(const std::string& sps, const std::string& pps);
+    void SetAudioConfig(const std::string& audio_specific_config);
+
+    bool HasVideo() const
+    {
+        return ! sps_.empty() && ! pps_.empty();
+    }
+
+    bool HasAudio() const
+    {
+        return audio_config_.size() >= 2;
+    }
+
+    // 没有音视频配置时为空
+    const std::string& GetInit();
+
+    // RFC 6381, 给HLS/DASH的CODECS用, 比如"avc1.42001f,mp4a.40.2"
+    std::string GetCodecs() const;
+
+    uint32_t GetWidth() const
+    {
+        return width_;
+    }
+
+    uint32_t GetHeight() const
+    {
+        return height_;
+    }
+
+    void AddSample(const Payload& payload);
+
+    // 攒着的样本(视频最后一帧除外, 时长还不知道)写成moof+mdat追加到out, 没有样本不写. 返回写了多少字节
+    size_t Flush(TsSegment& out);
+
+    // 丢掉攒着的样本, 重新开始切的时候用
+    void Reset();
+
+private:
+    struct Sample
+    {
+        Payload  payload;
+        uint64_t dts;
+        uint32_t duration;
+        int32_t  cts_offset;
+        uint32_t size;
+        bool     sync;
+    };
+
+    struct Track
+    {
+        Track()
+            : track_id(0)
+            , timescale(0)
+            , fixed_duration(0)
+            , has_pending(false)
+        {
+        }
+
+        uint32_t track_id;
+        uint32_t timescale;
+        // 不为0时每帧都是这个时长, 不用等下一帧
+        uint32_t fixed_duration;
+        // 最后一帧, 下一帧来了才知道时长
+        bool has_pending;
+        Sample pending;
+        std::vector<Sample> samples;
+    };
+
+    void AddSample(Track& track, const Payload& payload, const uint64_t& dts, const uint64_t& pts);
+    void WriteTraf(std::string& moof, const Track& track, std::vector<size_t>& data_offset_pos);
+    void WriteSampleData(uint8_t* p, const Track& track);
+
+private:
+    std::string sps_;
+    std::string pps_;
+    std::string audio_config_;
+
+    uint32_t width_;
+    uint32_t height_;
+    uint32_t sample_rate_;
+    uint32_t channels_;
+    uint8_t  audio_object_type_;
+
+    std::string init_;
+
+    Track video_;
+    Track audio_;
+
+    uint32_t fragment_seq_;
+};
+
+#endif // __FMP4_PACKETIZER_H__
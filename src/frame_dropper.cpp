@@ -0,0 +1,72 @@
+#include <sstream>
+
+#include "frame_dropper.h"
+#include "ref_ptr.h"
+
+size_t FrameDropper::soft_bytes_ = 1024*1024;
+size_t FrameDropper::hard_bytes_ = 4*1024*1024;
+uint64_t FrameDropper::max_delay_ms_ = 5000;
+
+FrameDropper::FrameDropper()
+    : wait_idr_(false)
+    , drop_frames_(0)
+    , drop_bytes_(0)
+    , drop_gops_(0)
+{
+}
+
+bool FrameDropper::ShouldDrop(const Payload& payload, const size_t& pending_bytes, const uint64_t& pending_ms)
+{
+    bool congested = (pending_bytes >= hard_bytes_ || (max_delay_ms_ != 0 && pending_ms >= max_delay_ms_));
+
+    if (wait_idr_)
+    {
+        // 纯音频的流等不到IDR, 音频不堵了就放过
+        if (! payload.IsVideo() && ! congested)
+        {
+            return false;
+        }
+
+        // 队列还没降下来, 这个IDR也丢, 等下一个
+        if (payload.IsIFrame() && ! congested && pending_bytes < soft_bytes_)
+        {
+            wait_idr_ = false;
+            return false;
+        }
+
+        Drop(payload);
+        return true;
+    }
+
+    if (congested)
+    {
+        wait_idr_ = true;
+        ++drop_gops_;
+
+        Drop(payload);
+        return true;
+    }
+
+    if (pending_bytes >= soft_bytes_ && payload.IsDisposable())
+    {
+        Drop(payload);
+        return true;
+    }
+
+    return false;
+}
+
+void FrameDropper::Drop(const Payload& payload)
+{
+    ++drop_frames_;
+    drop_bytes_ += payload.GetAllLen();
+}
+
+std::string FrameDropper::ToString() const
+{
+    std::ostringstream os;
+
+    os << "drop_frames:" << drop_frames_ << ",drop_bytes:" << drop_bytes_ << ",drop_gops:" << drop_gops_;
+
+    return os.str();
+}
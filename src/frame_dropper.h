@@ -0,0 +1,50 @@
+#ifndef __FRAME_DROPPER_H__
+#define __FRAME_DROPPER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+class Payload;
+
+// 订阅者发送队列的限流, 每个订阅者一个. 在数据进发送队列之前判断要不要丢:
+// 超过软上限先丢不被参考的帧(nal_ref_idc == 0), 超过硬上限或者排队太久,
+// 音视频都丢, 一直丢到下一个队列降下来之后的IDR, 直接追到最新.
+class FrameDropper
+{
+public:
+    FrameDropper();
+
+    // 返回true表示这帧不要发了, 视频是一整帧, 多个slice一起丢
+    bool ShouldDrop(const Payload& payload, const size_t& pending_bytes, const uint64_t& pending_ms);
+
+    uint64_t GetDropFrames() const { return drop_frames_; }
+    uint64_t GetDropBytes() const { return drop_bytes_; }
+    uint64_t GetDropGops() const { return drop_gops_; }
+
+    std::string ToString() const;
+
+    static void SetLimit(const size_t& soft_bytes, const size_t& hard_bytes, const uint64_t& max_delay_ms)
+    {
+        soft_bytes_ = soft_bytes;
+        hard_bytes_ = hard_bytes;
+        max_delay_ms_ = max_delay_ms;
+    }
+
+private:
+    void Drop(const Payload& payload);
+
+private:
+    bool        wait_idr_;
+
+    uint64_t    drop_frames_;
+    uint64_t    drop_bytes_;
+    uint64_t    drop_gops_;
+
+    static size_t   soft_bytes_;
+    static size_t   hard_bytes_;
+    static uint64_t max_delay_ms_;
+};
+
+#endif // __FRAME_DROPPER_H__
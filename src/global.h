@@ -2,11 +2,11 @@
 #define __GLOBAL_H__
 
 #include "local_stream_center.h"
-#include "epoller.h"
+#include "io_loop.h"
 #include <openssl/ssl.h>
 
 extern LocalStreamCenter 	            g_local_stream_center;
-extern Epoller*        	                g_epoll;
+extern IoLoop*        	                g_epoll;
 extern SSL_CTX*                         g_tls_ctx;
 extern SSL_CTX*                         g_dtls_ctx;
 extern std::string                           g_dtls_fingerprint;
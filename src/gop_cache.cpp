@@ -0,0 +1,171 @@
+#include <sstream>
+
+#include "gop_cache.h"
+
+// 防止一直不来IDR的流把缓存撑爆
+static const size_t kMaxFrames = 8192;
+static const size_t kInitCapacity = 256;
+
+size_t GopCache::max_gops_ = 2;
+uint64_t GopCache::max_duration_ms_ = 20000;
+
+GopCache::GopCache()
+    : mask_(0)
+    , begin_(0)
+    , end_(0)
+    , bytes_(0)
+    , wait_key_(false)
+{
+}
+
+void GopCache::Push(const Payload& payload)
+{
+    if (wait_key_)
+    {
+        if (! (payload.IsVideo() && payload.IsIFrame()))
+        {
+            return;
+        }
+
+        wait_key_ = false;
+    }
+
+    if (GetFrameCount() == ring_.size())
+    {
+        Grow();
+    }
+
+    if (payload.IsVideo() && payload.IsIFrame())
+    {
+        key_seq_.push_back(end_);
+    }
+
+    ring_[end_ & mask_] = payload;
+    ++end_;
+
+    bytes_ += payload.GetAllLen();
+
+    Evict();
+}
+
+uint64_t GopCache::GetDurationMs() const
+{
+    if (begin_ == end_)
+    {
+        return 0;
+    }
+
+    uint64_t first_dts = Get(begin_).GetDts();
+    uint64_t last_dts = Get(end_ - 1).GetDts();
+
+    // 时间戳回绕或者重置了
+    if (last_dts < first_dts)
+    {
+        return 0;
+    }
+
+    return last_dts - first_dts;
+}
+
+std::string GopCache::ToString() const
+{
+    std::ostringstream os;
+
+    os << "frames:" << GetFrameCount() << " [" << begin_ << "-" << end_ << ")"
+       << ",gops:" << GetGopCount()
+       << ",bytes:" << bytes_
+       << ",duration_ms:" << GetDurationMs()
+       << ",capacity:" << ring_.size();
+
+    return os.str();
+}
+
+void GopCache::Grow()
+{
+    size_t capacity = ring_.empty() ? kInitCapacity : ring_.size() * 2;
+
+    std::vector<Payload> ring(capacity);
+    uint64_t mask = capacity - 1;
+
+    for (uint64_t seq = begin_; seq != end_; ++seq)
+    {
+        ring[seq & mask] = ring_[seq & mask_];
+    }
+
+    ring_.swap(ring);
+    mask_ = mask;
+}
+
+void GopCache::Evict()
+{
+    while (begin_ != end_)
+    {
+        bool too_long = (max_duration_ms_ != 0 && GetDurationMs() > max_duration_ms_);
+        bool too_many = (GetFrameCount() > kMaxFrames);
+
+        if (key_seq_.empty())
+        {
+            if (! too_long && ! too_many)
+            {
+                break;
+            }
+
+            PopFront();
+            continue;
+        }
+
+        // 第一个IDR前面还有帧(缓存刚开始的时候), 也算一个GOP
+        size_t gops = key_seq_.size() + (key_seq_.front() != begin_ ? 1 : 0);
+
+        if (gops <= 1 && ! too_many)
+        {
+            break;
+        }
+
+        // 只有一个GOP还超了帧数, 淘汰它就把IDR也淘汰了, 剩下的P帧解不出来, 全清掉等下一个IDR
+        if (gops <= 1 && too_many)
+        {
+            key_seq_.clear();
+
+            while (begin_ != end_)
+            {
+                PopFront();
+            }
+
+            wait_key_ = true;
+            break;
+        }
+
+        if (gops <= max_gops_ && ! too_long && ! too_many)
+        {
+            break;
+        }
+
+        EvictGop();
+    }
+}
+
+void GopCache::EvictGop()
+{
+    if (! key_seq_.empty() && key_seq_.front() == begin_)
+    {
+        key_seq_.pop_front();
+    }
+
+    uint64_t stop = key_seq_.empty() ? end_ : key_seq_.front();
+
+    while (begin_ != stop)
+    {
+        PopFront();
+    }
+}
+
+void GopCache::PopFront()
+{
+    Payload& payload = ring_[begin_ & mask_];
+
+    bytes_ -= payload.GetAllLen();
+    payload = Payload();
+
+    ++begin_;
+}
@@ -0,0 +1,76 @@
+#ifndef __GOP_CACHE_H__
+#define __GOP_CACHE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "ref_ptr.h"
+
+// 每个流一个, 音视频按到达顺序(DTS序)放在同一个环形数组里, 序号单调递增,
+// 另外记一下每个GOP开头(IDR)的序号. 新的订阅者从最后一个IDR开始发到末尾.
+// 淘汰按整个GOP来, 至少留最后一个GOP. 纯音频的流没有IDR, 按时长一帧一帧淘汰.
+// 一个GOP就超过帧数上限的, 整个清掉, 等下一个IDR来了再开始缓存, 不让新订阅者从P帧开始.
+class GopCache
+{
+public:
+    GopCache();
+
+    void Push(const Payload& payload);
+
+    // [GetFastOutBegin, GetEnd)
+    uint64_t GetFastOutBegin() const
+    {
+        return key_seq_.empty() ? begin_ : key_seq_.back();
+    }
+
+    uint64_t GetBegin() const { return begin_; }
+    uint64_t GetEnd() const { return end_; }
+
+    const Payload& Get(const uint64_t& seq) const
+    {
+        return ring_[seq & mask_];
+    }
+
+    size_t GetFrameCount() const { return end_ - begin_; }
+    size_t GetGopCount() const { return key_seq_.size(); }
+    size_t GetBytes() const { return bytes_; }
+    uint64_t GetDurationMs() const;
+
+    std::string ToString() const;
+
+    static void SetRetention(const size_t& max_gops, const uint64_t& max_duration_ms)
+    {
+        max_gops_ = (max_gops == 0 ? 1 : max_gops);
+        max_duration_ms_ = max_duration_ms;
+    }
+
+private:
+    void Grow();
+    void Evict();
+    void EvictGop();
+    void PopFront();
+
+private:
+    std::vector<Payload>    ring_;
+    uint64_t                mask_;
+
+    uint64_t                begin_;
+    uint64_t                end_;
+
+    // 每个GOP第一个IDR的序号
+    std::deque<uint64_t>    key_seq_;
+
+    size_t                  bytes_;
+
+    // 清掉了唯一的GOP, 下一个IDR之前的帧都不要
+    bool                    wait_key_;
+
+    static size_t   max_gops_;
+    static uint64_t max_duration_ms_;
+};
+
+#endif // __GOP_CACHE_H__
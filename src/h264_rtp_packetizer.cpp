@@ -0,0 +1,190 @@
+#include <string.h>
+
+#include "h264_rtp_packetizer.h"
+
+// H264 RTP封装(RFC 6184)
+static const uint8_t kNaluTypeMask  = 0x1F;
+static const uint8_t kNaluNriMask   = 0x60;
+static const uint8_t kNaluIdr       = 5;
+static const uint8_t kNaluSps       = 7;
+static const uint8_t kNaluPps       = 8;
+static const uint8_t kStapA         = 24;
+static const uint8_t kFuA           = 28;
+static const uint8_t kFuStart       = 0x80;
+static const uint8_t kFuEnd         = 0x40;
+
+H264RtpPacketizer::H264RtpPacketizer(const uint8_t& payload_type, const size_t& max_payload)
+    : payload_type_(payload_type)
+    , max_payload_(max_payload)
+    , parameter_set_sent_(false)
+    , packet_count_(0)
+{
+}
+
+void H264RtpPacketizer::Clear()
+{
+    packet_count_ = 0;
+    parameter_set_sent_ = false;
+}
+
+int H264RtpPacketizer::Packetize(const uint8_t* nalu, const size_t& len, const uint32_t& timestamp, const bool& last)
+{
+    if (len == 0)
+    {
+        return 0;
+    }
+
+    int packet_count = packet_count_;
+    uint8_t nalu_type = nalu[0] & kNaluTypeMask;
+
+    if (nalu_type == kNaluSps)
+    {
+        sps_.assign((const char*)nalu, len);
+        return 0;
+    }
+    else if (nalu_type == kNaluPps)
+    {
+        pps_.assign((const char*)nalu, len);
+        return 0;
+    }
+
+    if (nalu_type == kNaluIdr && ! parameter_set_sent_)
+    {
+        parameter_set_sent_ = true;
+        PacketizeParameterSet(timestamp);
+    }
+
+    PacketizeNalu(nalu, len, timestamp, last);
+
+    return packet_count_ - packet_count;
+}
+
+void H264RtpPacketizer::SetSeqAndSsrc(uint8_t* packet, const uint16_t& seq, const uint32_t& ssrc)
+{
+    packet[2] = (seq >> 8) & 0xFF;
+    packet[3] = seq & 0xFF;
+
+    packet[8]  = (ssrc >> 24) & 0xFF;
+    packet[9]  = (ssrc >> 16) & 0xFF;
+    packet[10] = (ssrc >> 8) & 0xFF;
+    packet[11] = ssrc & 0xFF;
+}
+
+uint8_t* H264RtpPacketizer::NewPacket(const uint32_t& timestamp)
+{
+    // 只增不减, 最大的一帧之后就不再分配
+    if ((size_t)(packet_count_ + 1) * kMaxPacketSize > buf_.size())
+    {
+        buf_.resize((packet_count_ + 1) * kMaxPacketSize);
+        packet_len_.resize(packet_count_ + 1);
+    }
+
+    uint8_t* packet = &buf_[packet_count_ * kMaxPacketSize];
+
+    packet[0] = 0x80; // V=2
+    packet[1] = payload_type_;
+    packet[4] = (timestamp >> 24) & 0xFF;
+    packet[5] = (timestamp >> 16) & 0xFF;
+    packet[6] = (timestamp >> 8) & 0xFF;
+    packet[7] = timestamp & 0xFF;
+
+    SetSeqAndSsrc(packet, 0, 0);
+
+    return packet + kRtpHeaderSize;
+}
+
+void H264RtpPacketizer::CommitPacket(const size_t& payload_len, const bool& marker)
+{
+    uint8_t* packet = &buf_[packet_count_ * kMaxPacketSize];
+
+    if (marker)
+    {
+        packet[1] |= 0x80;
+    }
+
+    packet_len_[packet_count_] = kRtpHeaderSize + payload_len;
+    ++packet_count_;
+}
+
+void H264RtpPacketizer::PacketizeParameterSet(const uint32_t& timestamp)
+{
+    if (sps_.empty() || pps_.empty())
+    {
+        return;
+    }
+
+    size_t stap_len = 1 + 2 + sps_.size() + 2 + pps_.size();
+
+    // 放不下一个包就各自单独发
+    if (stap_len > max_payload_)
+    {
+        PacketizeNalu((const uint8_t*)sps_.data(), sps_.size(), timestamp, false);
+        PacketizeNalu((const uint8_t*)pps_.data(), pps_.size(), timestamp, false);
+        return;
+    }
+
+    uint8_t* p = NewPacket(timestamp);
+    uint8_t nri = ((uint8_t)sps_[0] | (uint8_t)pps_[0]) & kNaluNriMask;
+
+    *p++ = nri | kStapA;
+
+    *p++ = (sps_.size() >> 8) & 0xFF;
+    *p++ = sps_.size() & 0xFF;
+    memcpy(p, sps_.data(), sps_.size());
+    p += sps_.size();
+
+    *p++ = (pps_.size() >> 8) & 0xFF;
+    *p++ = pps_.size() & 0xFF;
+    memcpy(p, pps_.data(), pps_.size());
+
+    CommitPacket(stap_len, false);
+}
+
+void H264RtpPacketizer::PacketizeNalu(const uint8_t* nalu, const size_t& len, const uint32_t& timestamp, const bool& marker)
+{
+    if (len <= max_payload_)
+    {
+        uint8_t* p = NewPacket(timestamp);
+        memcpy(p, nalu, len);
+        CommitPacket(len, marker);
+        return;
+    }
+
+    // FU-A, 去掉原来的NALU头, 每个分片前面加FU indicator和FU header
+    uint8_t fu_indicator = (nalu[0] & (0x80 | kNaluNriMask)) | kFuA;
+    uint8_t nalu_type = nalu[0] & kNaluTypeMask;
+
+    size_t left = len - 1;
+    size_t fragment_num = (left + max_payload_ - 2 - 1) / (max_payload_ - 2);
+    // 分片尽量一样大, 最后一个包不会特别小
+    size_t fragment_size = (left + fragment_num - 1) / fragment_num;
+
+    const uint8_t* data = nalu + 1;
+
+    for (size_t i = 0; i < fragment_num; ++i)
+    {
+        size_t size = (left < fragment_size ? left : fragment_size);
+
+        uint8_t* p = NewPacket(timestamp);
+
+        p[0] = fu_indicator;
+        p[1] = nalu_type;
+
+        if (i == 0)
+        {
+            p[1] |= kFuStart;
+        }
+
+        if (i + 1 == fragment_num)
+        {
+            p[1] |= kFuEnd;
+        }
+
+        memcpy(p + 2, data, size);
+
+        CommitPacket(size + 2, marker && (i + 1 == fragment_num));
+
+        data += size;
+        left -= size;
+    }
+}
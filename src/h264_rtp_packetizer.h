@@ -0,0 +1,65 @@
+#ifndef __H264_RTP_PACKETIZER_H__
+#define __H264_RTP_PACKETIZER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+// 每个流一个, 每个NALU只打一次RTP包, 所有webrtc对端共用这些包, 对端自己只改SSRC和序号再做SRTP.
+// 包放在复用的buffer里, 跑起来之后不再分配内存. 包头里的SSRC和序号填0.
+// SPS/PPS先存着, 下一个IDR帧来的时候用STAP-A聚合成一个包放在IDR前面.
+class H264RtpPacketizer
+{
+public:
+    H264RtpPacketizer(const uint8_t& payload_type, const size_t& max_payload);
+
+    // 一帧开始前调用, 清掉上一帧的包
+    void Clear();
+
+    // nalu不带起始码和长度, timestamp是90k的, 包追加在这一帧后面, last表示帧的最后一个NALU(打marker).
+    // 返回这个NALU生成的包数, SPS/PPS返回0
+    int Packetize(const uint8_t* nalu, const size_t& len, const uint32_t& timestamp, const bool& last);
+
+    int GetPacketCount() const
+    {
+        return packet_count_;
+    }
+
+    const uint8_t* GetPacket(const int& index, size_t& len) const
+    {
+        len = packet_len_[index];
+        return &buf_[index * kMaxPacketSize];
+    }
+
+    static void SetSeqAndSsrc(uint8_t* packet, const uint16_t& seq, const uint32_t& ssrc);
+
+    enum
+    {
+        kRtpHeaderSize  = 12,
+        kMaxPacketSize  = 1500,
+    };
+
+private:
+    uint8_t* NewPacket(const uint32_t& timestamp);
+    void CommitPacket(const size_t& payload_len, const bool& marker);
+
+    void PacketizeParameterSet(const uint32_t& timestamp);
+    void PacketizeNalu(const uint8_t* nalu, const size_t& len, const uint32_t& timestamp, const bool& marker);
+
+private:
+    uint8_t             payload_type_;
+    size_t              max_payload_;
+
+    std::string         sps_;
+    std::string         pps_;
+    // 多slice的IDR只在第一个slice前面放一次
+    bool                parameter_set_sent_;
+
+    std::vector<uint8_t> buf_;
+    std::vector<size_t>  packet_len_;
+    int                  packet_count_;
+};
+
+#endif // __H264_RTP_PACKETIZER_H__
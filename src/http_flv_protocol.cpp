@@ -11,17 +11,23 @@
 #include "rtmp_protocol.h"
 #include "tcp_socket.h"
 
+// 流还没推上来时, 播放请求挂起等待的时间
+static const uint64_t kFlvPendingTimeoutMs = 10000;
+
 HttpFlvProtocol::HttpFlvProtocol(IoLoop* io_loop, Fd* socket)
     : MediaSubscriber(kHttpFlv)
     , io_loop_(io_loop)
     , socket_(socket)
     , media_publisher_(NULL)
     , pre_tag_size_(0)
+    , pending_timer_(io_loop)
+    , watch_id_(0)
 {
 }
 
 HttpFlvProtocol::~HttpFlvProtocol()
 {
+    StopPending();
 }
 
 int HttpFlvProtocol::HandleRead(IoBuffer& io_buffer, Fd& socket)
@@ -47,6 +53,18 @@ int HttpFlvProtocol::Parse(IoBuffer& io_buffer)
             {
                 media_publisher_ = g_local_stream_center.GetMediaPublisherByAppStream(app_, stream_);
 
+                if (media_publisher_ == NULL)
+                {
+                    // 先挂监听再查一次, 两次之间推上来的流不会漏掉
+                    watch_id_ = g_local_stream_center.WatchStream(app_, stream_, std::bind(&HttpFlvProtocol::OnStreamNotify, this, std::placeholders::_1));
+                    media_publisher_ = g_local_stream_center.GetMediaPublisherByAppStream(app_, stream_);
+
+                    if (media_publisher_ != NULL)
+                    {
+                        StopPending();
+                    }
+                }
+
                 if (media_publisher_ != NULL) // 本进程有流
                 {
                     HttpSender http_rsp;
@@ -62,7 +80,11 @@ int HttpFlvProtocol::Parse(IoBuffer& io_buffer)
                 }
                 else
                 {
-					return kError;
+                    std::cout << LMSG << "pending, app_:" << app_ << ",stream_:" << stream_ << std::endl;
+
+                    // 流推上来会通知, 定时器只管超时
+                    expired_time_ms_ = io_loop_->GetNowMs() + kFlvPendingTimeoutMs;
+                    pending_timer_.RunAfter(kFlvPendingTimeoutMs, std::bind(&HttpFlvProtocol::OnPendingTimer, this));
                 }
             }
             else
@@ -134,8 +156,8 @@ int HttpFlvProtocol::SendMetaData(const std::string& metadata)
     uint8_t* buf = NULL;
     int buf_len = flv_tag.Read(buf, flv_tag.Size());
 
-    socket_->Send(buf, buf_len);
-    socket_->Send((const uint8_t*)metadata.data(), metadata.size());
+    IoVec iov[2] = { IoVec(buf, buf_len), IoVec((const uint8_t*)metadata.data(), metadata.size()) };
+    socket_->SendV(iov, 2);
 
     pre_tag_size_ = data_size + 11;
 
@@ -144,6 +166,12 @@ int HttpFlvProtocol::SendMetaData(const std::string& metadata)
 
 int HttpFlvProtocol::SendMediaData(const Payload& payload)
 {
+    // 发不动了先丢帧, 不让发送队列无限涨
+    if (frame_dropper_.ShouldDrop(payload, socket_->GetPendingBytes(), socket_->GetPendingMs()))
+    {
+        return kSuccess;
+    }
+
     if (payload.IsAudio())
     {
         return SendAudio(payload);
@@ -156,70 +184,70 @@ int HttpFlvProtocol::SendMediaData(const Payload& payload)
     return -1;
 }
 
-int HttpFlvProtocol::SendVideo(const Payload& payload)
+void HttpFlvProtocol::SendMediaDataBatch(MediaPublisher* publisher, const std::vector<MediaSubscriber*>& group, const size_t& count, const Payload& payload)
 {
-    IoBuffer flv_tag;
+    if (! payload.IsAudio() && ! payload.IsVideo())
+    {
+        return;
+    }
 
-    uint32_t data_size = payload.GetAllLen() + 5/*5 bytes avc header*/;
+    // 整组共用一个tag, 只查一次缓存
+    const WireFrame& wire = publisher->GetWireCache().GetFlvTag(payload);
 
-    flv_tag.WriteU32(pre_tag_size_);
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (group[i] == NULL)
+        {
+            continue;
+        }
 
-    flv_tag.WriteU8(kVideo);
+        HttpFlvProtocol* flv = static_cast<HttpFlvProtocol*>(group[i]);
 
-    flv_tag.WriteU24(data_size);
-    flv_tag.WriteU24((payload.GetDts32()) & 0x00FFFFFF);
-    flv_tag.WriteU8((payload.GetDts32() >> 24) & 0xFF);
-    flv_tag.WriteU24(0);
+        if (flv->frame_dropper_.ShouldDrop(payload, flv->socket_->GetPendingBytes(), flv->socket_->GetPendingMs()))
+        {
+            continue;
+        }
 
+        flv->SendFlvTag(wire);
+    }
+}
+
+int HttpFlvProtocol::SendVideo(const Payload& payload)
+{
     if (payload.IsIFrame())
     {
         std::cout << LMSG << "I frame" << std::endl;
-        flv_tag.WriteU8(0x17);
-    }
-    else
-    {
-        flv_tag.WriteU8(0x27);
     }
 
-    flv_tag.WriteU8(0x01); // AVC nalu
-
-    uint32_t compositio_time_offset = payload.GetPts32() - payload.GetDts32();
-
-    flv_tag.WriteU24(compositio_time_offset);
-
-    uint8_t* buf = NULL;
-    int buf_len = flv_tag.Read(buf, flv_tag.Size());
-
-    socket_->Send(buf, buf_len);
-    socket_->Send(payload.GetAllData(), payload.GetAllLen());
-
-    pre_tag_size_ = data_size + 11;
-
-    return kSuccess;
+    return SendFlvTag(payload);
 }
 
 int HttpFlvProtocol::SendAudio(const Payload& payload)
 {
-    IoBuffer flv_tag;
-
-    uint32_t data_size = payload.GetAllLen();
-
-    flv_tag.WriteU32(pre_tag_size_);
+    return SendFlvTag(payload);
+}
 
-    flv_tag.WriteU8(kAudio);
+int HttpFlvProtocol::SendFlvTag(const Payload& payload)
+{
+    // tag本身所有播放者都一样, 由发布者缓存, 这里只加自己的PreviousTagSize
+    WireCache local_cache;
+    WireCache& wire_cache = (media_publisher_ != NULL ? media_publisher_->GetWireCache() : local_cache);
 
-    flv_tag.WriteU24(data_size);
-    flv_tag.WriteU24((payload.GetDts32()) & 0x00FFFFFF);
-    flv_tag.WriteU8((payload.GetDts32() >> 24) & 0xFF);
-    flv_tag.WriteU24(0);
+    return SendFlvTag(wire_cache.GetFlvTag(payload));
+}
 
-    uint8_t* buf = NULL;
-    int buf_len = flv_tag.Read(buf, flv_tag.Size());
+int HttpFlvProtocol::SendFlvTag(const WireFrame& wire)
+{
+    uint8_t prefix[4];
+    prefix[0] = (pre_tag_size_ >> 24) & 0xFF;
+    prefix[1] = (pre_tag_size_ >> 16) & 0xFF;
+    prefix[2] = (pre_tag_size_ >> 8) & 0xFF;
+    prefix[3] = pre_tag_size_ & 0xFF;
 
-    socket_->Send(buf, buf_len);
-    socket_->Send(payload.GetAllData(), payload.GetAllLen());
+    IoVec iov[3] = { IoVec(prefix, sizeof(prefix)), wire.iov[0], wire.iov[1] };
+    socket_->SendV(iov, 3);
 
-    pre_tag_size_ = data_size + 11;
+    pre_tag_size_ = wire.header.GetAllLen() + wire.body.GetAllLen();
 
     return kSuccess;
 }
@@ -246,8 +274,8 @@ int HttpFlvProtocol::SendVideoHeader(const std::string& video_header)
     uint8_t* buf = NULL;
     int buf_len = flv_tag.Read(buf, flv_tag.Size());
 
-    socket_->Send(buf, buf_len);
-    socket_->Send((const uint8_t*)video_header.data(), video_header.size());
+    IoVec iov[2] = { IoVec(buf, buf_len), IoVec((const uint8_t*)video_header.data(), video_header.size()) };
+    socket_->SendV(iov, 2);
 
     pre_tag_size_ = data_size + 11;
 
@@ -275,8 +303,8 @@ int HttpFlvProtocol::SendAudioHeader(const std::string& audio_header)
     uint8_t* buf = NULL;
     int buf_len = flv_tag.Read(buf, flv_tag.Size());
 
-    socket_->Send(buf, buf_len);
-    socket_->Send((const uint8_t*)audio_header.data(), audio_header.size());
+    IoVec iov[2] = { IoVec(buf, buf_len), IoVec((const uint8_t*)audio_header.data(), audio_header.size()) };
+    socket_->SendV(iov, 2);
 
     pre_tag_size_ = data_size + 11;
 
@@ -293,25 +321,63 @@ int HttpFlvProtocol::HandleClose(IoBuffer& io_buffer, Fd& socket)
         media_publisher_->RemoveSubscriber(this);
     }
 
+    if (frame_dropper_.GetDropFrames() != 0)
+    {
+        std::cout << LMSG << "app:" << app_ << ",stream:" << stream_ << "," << frame_dropper_.ToString() << std::endl;
+    }
+
     return kSuccess;
 }
 
-int HttpFlvProtocol::EveryNSecond(const uint64_t& now_in_ms, const uint32_t& interval, const uint64_t& count)
+int HttpFlvProtocol::OnStop()
 {
-    UNUSED(interval);
-    UNUSED(count);
+    // 发布者要析构了, 别在HandleClose里再碰它
+    media_publisher_ = NULL;
 
-    if (expired_time_ms_ != 0)
+    return kSuccess;
+}
+
+void HttpFlvProtocol::OnStreamNotify(const bool& published)
+{
+    if (! published || watch_id_ == 0)
     {
-        if (now_in_ms > expired_time_ms_)
-        {
-            std::cout << LMSG << "expired, can't find media source, app_:" << app_ << ",stream_:" << stream_ << std::endl;
+        return;
+    }
 
-            OnPendingArrive();
-        }
-    }    
+    StopPending();
+    OnPendingArrive();
 
-    return kSuccess;
+    if (media_publisher_ == NULL)
+    {
+        // 通知排队期间流又停了, 404发完再关, 连带析构this
+        GetTcpSocket()->CloseAfterFlush();
+    }
+}
+
+void HttpFlvProtocol::OnPendingTimer()
+{
+    StopPending();
+
+    std::cout << LMSG << "expired, can't find media source, app_:" << app_ << ",stream_:" << stream_ << std::endl;
+
+    OnPendingArrive();
+
+    if (media_publisher_ == NULL)
+    {
+        // 404发完再关, 连带析构this
+        GetTcpSocket()->CloseAfterFlush();
+    }
+}
+
+void HttpFlvProtocol::StopPending()
+{
+    pending_timer_.Cancel();
+
+    if (watch_id_ != 0)
+    {
+        g_local_stream_center.UnwatchStream(app_, stream_, watch_id_);
+        watch_id_ = 0;
+    }
 }
 
 int HttpFlvProtocol::OnPendingArrive()
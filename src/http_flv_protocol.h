@@ -5,9 +5,11 @@
 
 #include <string>
 
+#include "frame_dropper.h"
 #include "http_parse.h"
 #include "media_subscriber.h"
 #include "socket_handler.h"
+#include "timing_wheel.h"
 
 class IoLoop;
 class Fd;
@@ -20,6 +22,7 @@ class ServerProtocol;
 class ServerMgr;
 class RtmpMgr;
 class TcpSocket;
+struct WireFrame;
 
 class HttpFlvProtocol 
     : public MediaSubscriber
@@ -41,6 +44,7 @@ public:
     int SendFlvHeader();
 
     virtual int SendMediaData(const Payload& payload);
+    virtual void SendMediaDataBatch(MediaPublisher* publisher, const std::vector<MediaSubscriber*>& group, const size_t& count, const Payload& payload);
     virtual int SendAudioHeader(const std::string& audio_header);
     virtual int SendVideoHeader(const std::string& video_header);
     virtual int SendMetaData(const std::string& metadata);
@@ -49,10 +53,9 @@ public:
     int SendAudio(const Payload& payload);
 
     virtual int OnPendingArrive();
+    virtual int OnStop();
 
-    int EveryNSecond(const uint64_t& now_in_ms, const uint32_t& interval, const uint64_t& count);
-
-    int EveryNMillSecond(const uint64_t& now_in_ms, const uint32_t& interval, const uint64_t& count) { return 0; }
+    const FrameDropper& GetFrameDropper() const { return frame_dropper_; }
 
     std::string GetApp() { return app_; }
     std::string GetStream() { return stream_; }
@@ -63,6 +66,13 @@ private:
         return (TcpSocket*)socket_;
     }
 
+    void OnStreamNotify(const bool& published);
+    void OnPendingTimer();
+    void StopPending();
+
+    int SendFlvTag(const Payload& payload);
+    int SendFlvTag(const WireFrame& wire);
+
 private:
     IoLoop* io_loop_;
     Fd* socket_;
@@ -74,6 +84,12 @@ private:
     uint32_t pre_tag_size_;
 
     HttpParse http_parse_;
+
+    FrameDropper frame_dropper_;
+
+    WheelTimer pending_timer_;
+    // 等流时挂在LocalStreamCenter上的监听, 0表示没有
+    uint64_t watch_id_;
 };
 
 #endif // __HTTP_FLV_PROTOCOL_H__
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <iostream>
 #include <map>
 
@@ -8,18 +9,26 @@
 #include "local_stream_center.h"
 #include "rtmp_protocol.h"
 #include "tcp_socket.h"
+#include "ts_segment.h"
 #include "util.h"
 
+// 还不知道目标时长的时候阻塞请求最多等多久
+static const uint64_t kHlsDefaultWaitMs = 3000;
+
 HttpHlsProtocol::HttpHlsProtocol(IoLoop* io_loop, Fd* socket)
     : MediaSubscriber(kHttpHls)
     , io_loop_(io_loop)
     , socket_(socket)
     , media_publisher_(NULL)
+    , if_modified_since_(0)
+    , wait_timer_(io_loop)
+    , wait_id_(0)
 {
 }
 
 HttpHlsProtocol::~HttpHlsProtocol()
 {
+    StopWaiting();
 }
 
 int HttpHlsProtocol::HandleRead(IoBuffer& io_buffer, Fd& socket)
@@ -39,6 +48,18 @@ int HttpHlsProtocol::Parse(IoBuffer& io_buffer)
 
     int size = io_buffer.Read(data, io_buffer.Size());
 
+    // 上一个请求挂起等待的时候还要用下面这些
+    if (size <= 0)
+    {
+        return kNoEnoughData;
+    }
+
+    // 阻塞刷新还挂着又来了请求(pipeline), 回应要按顺序, 先用现有的列表回掉挂着的, 再处理新的
+    if (wait_id_ != 0)
+    {
+        StopWaiting();
+        Serve(false);
+    }
 
     int r_pos = -1; // '\r'
     int n_pos = -1; // '\n'
@@ -53,8 +74,13 @@ int HttpHlsProtocol::Parse(IoBuffer& io_buffer)
 
     app_.clear();
     stream_.clear();
+    session_.clear();
     ts_.clear();
+    part_.clear();
     type_.clear();
+    args_.clear();
+    if_none_match_.clear();
+    if_modified_since_ = 0;
 
     for (int i = 0; i != size; ++i)
     {
@@ -70,72 +96,35 @@ int HttpHlsProtocol::Parse(IoBuffer& io_buffer)
                 {
                     std::cout << LMSG << "http done" << std::endl;
 
-                    std::cout << LMSG << "app_:" << app_ << ",stream_:" << stream_ << ",ts_:" << ts_ << ",type_:" << type_ << std::endl;
+                    std::cout << LMSG << "app_:" << app_ << ",stream_:" << stream_ << ",ts_:" << ts_ << ",part_:" << part_ << ",type_:" << type_ << std::endl;
+
+                    // CDN/反向代理回源时带着, 没变就回304
+                    if_none_match_ = header["if-none-match"];
+                    if_modified_since_ = Util::ParseHttpDate(header["if-modified-since"]);
+
                     if (! app_.empty() && ! stream_.empty())
                     {
                         media_publisher_ = g_local_stream_center.GetMediaPublisherByAppStream(app_, stream_);
 
                         if (media_publisher_ != NULL)
                         {
-                            if (type_ == "ts")
-                            {
-                                const std::string& ts = media_publisher_->GetMediaMuxer().GetTs(Util::Str2Num<uint64_t>(ts_));
-                                
-                                if (! ts.empty())
-                                {
-                                    std::ostringstream os;
+                            MediaMuxer& media_muxer = media_publisher_->GetMediaMuxer();
 
-					                os << "HTTP/1.1 200 OK\r\n"
-                                       << "Server: trs\r\n"
-                                       << "Content-Type: application/x-mpegurl\r\n"
-                                       << "Connection: keep-alive\r\n"
-                                       << "Content-Length:" << ts.size() << "\r\n"
-                                       << "\r\n";
+                            // 没人看的流不切ts, 有请求了才开始
+                            media_muxer.OnHlsRequest();
 
-					                GetTcpSocket()->Send((const uint8_t*)os.str().data(), os.str().size());
-                                    GetTcpSocket()->Send((const uint8_t*)ts.data(), ts.size());
-                                }
-                                else
-                                {
-                                    std::ostringstream os;
-
-					                os << "HTTP/1.1 404 Not Found\r\n"
-                                       << "Server: trs\r\n"
-                                       << "Connection: close\r\n"
-                                       << "\r\n";
-
-					                GetTcpSocket()->Send((const uint8_t*)os.str().data(), os.str().size());
-                                }
-                            }
-                            else if (type_ == "m3u8")
+                            if (Serve(true) == kNoEnoughData)
                             {
-                                std::string m3u8 = media_publisher_->GetMediaMuxer().GetM3U8();
-                                
-                                if (! m3u8.empty())
-                                {
-                                    std::ostringstream os;
-
-					                os << "HTTP/1.1 200 OK\r\n"
-                                       << "Server: trs\r\n"
-                                       << "Content-Type: application/x-mpegurl\r\n"
-                                       << "Connection: keep-alive\r\n"
-                                       << "Content-Length:" << m3u8.size() << "\r\n"
-                                       << "\r\n";
+                                // 播放列表每次更新都会通知, 定时器只管超时
+                                uint64_t timeout_ms = 3 * media_muxer.GetTargetDurationMs();
 
-					                GetTcpSocket()->Send((const uint8_t*)os.str().data(), os.str().size());
-                                    GetTcpSocket()->Send((const uint8_t*)m3u8.data(), m3u8.size());
-                                }
-                                else
+                                if (timeout_ms == 0)
                                 {
-                                    std::ostringstream os;
-
-					                os << "HTTP/1.1 404 Not Found\r\n"
-                                       << "Server: trs\r\n"
-                                       << "Connection: close\r\n"
-                                       << "\r\n";
-
-					                GetTcpSocket()->Send((const uint8_t*)os.str().data(), os.str().size());
+                                    timeout_ms = kHlsDefaultWaitMs;
                                 }
+
+                                wait_id_ = media_muxer.WaitHls(std::bind(&HttpHlsProtocol::OnHlsNotify, this, std::placeholders::_1));
+                                wait_timer_.RunAfter(timeout_ms, std::bind(&HttpHlsProtocol::OnWaitTimeout, this));
                             }
                         }
                         else
@@ -144,14 +133,7 @@ int HttpHlsProtocol::Parse(IoBuffer& io_buffer)
 
                             expired_time_ms_ = Util::GetNowMs() + 10000;
 
-                            std::ostringstream os;
-
-					        os << "HTTP/1.1 404 Not Found\r\n"
-                               << "Server: trs\r\n"
-                               << "Connection: close\r\n"
-                               << "\r\n";
-
-					        GetTcpSocket()->Send((const uint8_t*)os.str().data(), os.str().size());
+                            SendStatus("404 Not Found");
                         }
                     }
 
@@ -166,49 +148,18 @@ int HttpHlsProtocol::Parse(IoBuffer& io_buffer)
 
                     if (key.find("GET") != std::string::npos)
                     {
-                        //GET /test.flv HTTP/1.1
-                        int s_count = 0;
-                        int x_count = 0; // /
-                        int d_count = 0; // .
-                        for (const auto& ch : key)
+                        //GET /app/stream/xxx.m3u8?_HLS_msn=10&_HLS_part=2 HTTP/1.1
+                        std::vector<std::string> vec = Util::SepStr(key, " ");
+
+                        if (vec.size() >= 2)
                         {
-                            if (ch == ' ')
-                            {
-                                ++s_count;
-                            }
-                            else if (ch == '/')
-                            {
-                                ++x_count;
-                            }
-                            else if (ch == '.')
-                            {
-                                ++d_count;
-                            }
-                            else
-                            {
-                                if (x_count == 1)
-                                {
-                                    app_ += ch;
-                                }
-                                else if (x_count == 2)
-                                {
-                                    stream_ += ch;
-                                }
-                                else if (x_count == 3 && s_count < 2)
-                                {
-                                    if (d_count == 1)
-                                    {
-                                        type_ += ch;
-                                    }
-                                    else
-                                    {
-                                        ts_ += ch;
-                                    }
-                                }
-                            }
+                            ParseUrl(vec[1]);
                         }
                     }
 
+                    // 头的名字不区分大小写
+                    std::transform(key.begin(), key.end(), key.begin(), ::tolower);
+
                     header[key] = value;
                     key.clear();
                     value.clear();
@@ -217,7 +168,7 @@ int HttpHlsProtocol::Parse(IoBuffer& io_buffer)
 
             n_pos = i;
         }
-        else if (data[i] == ':')
+        else if (data[i] == ':' && ! key_value)
         {
             m_pos = i;
             key_value = true;
@@ -254,3 +205,287 @@ int HttpHlsProtocol::Parse(IoBuffer& io_buffer)
 
     return kNoEnoughData;
 }
+
+void HttpHlsProtocol::ParseUrl(const std::string& url)
+{
+    // /app/stream/xxx.m3u8, /app/stream/session_切片.ts, /app/stream/session_切片.part.ts,
+    // fMP4: /app/stream/init.mp4, /app/stream/session_切片.m4s, /app/stream/xxx.mpd
+    std::string path = url;
+    auto pos = url.find('?');
+
+    if (pos != std::string::npos)
+    {
+        path = url.substr(0, pos);
+
+        for (const auto& kv : Util::SepStr(url.substr(pos + 1), "&"))
+        {
+            auto eq = kv.find('=');
+
+            if (eq != std::string::npos)
+            {
+                args_[kv.substr(0, eq)] = kv.substr(eq + 1);
+            }
+        }
+    }
+
+    std::vector<std::string> dirs;
+
+    for (const auto& dir : Util::SepStr(path, "/"))
+    {
+        if (! dir.empty())
+        {
+            dirs.push_back(dir);
+        }
+    }
+
+    if (dirs.size() != 3)
+    {
+        return;
+    }
+
+    std::vector<std::string> names = Util::SepStr(dirs[2], ".");
+
+    if (names.size() < 2 || names.size() > 3)
+    {
+        return;
+    }
+
+    app_ = dirs[0];
+    stream_ = dirs[1];
+    ts_ = names[0];
+    type_ = names.back();
+
+    if (names.size() == 3)
+    {
+        part_ = names[1];
+    }
+
+    auto sep = ts_.find('_');
+
+    if (sep != std::string::npos)
+    {
+        session_ = ts_.substr(0, sep);
+        ts_ = ts_.substr(sep + 1);
+    }
+}
+
+int HttpHlsProtocol::Serve(const bool& can_wait)
+{
+    MediaMuxer& media_muxer = media_publisher_->GetMediaMuxer();
+
+    // 第一个播放列表还没出来(刚开始切, 或者别的loop上的镜像还没收到源站的), 等一下
+    if (! media_muxer.HasM3U8() && can_wait)
+    {
+        return kNoEnoughData;
+    }
+
+    // 切片是ts还是fMP4看配置, 另一种不认
+    if (type_ == (media_muxer.IsFmp4() ? "m4s" : "ts"))
+    {
+        // 上一次推流的切片, 序号可能跟这次的重了
+        if (session_ != media_muxer.GetSession())
+        {
+            SendStatus("404 Not Found");
+            return kSuccess;
+        }
+
+        if (part_.empty())
+        {
+            const HttpCache* http = NULL;
+            std::shared_ptr<TsSegment> ts = media_muxer.GetTs(Util::Str2Num<uint64_t>(ts_), http);
+
+            if (ts && ! ts->Empty())
+            {
+                SendTs(ts, 0, ts->GetSize(), http);
+            }
+            else
+            {
+                SendStatus("404 Not Found");
+            }
+
+            return kSuccess;
+        }
+
+        std::shared_ptr<TsSegment> ts;
+        size_t offset = 0;
+        size_t len = 0;
+        const HttpCache* http = NULL;
+
+        int ret = media_muxer.GetTsPart(Util::Str2Num<uint64_t>(ts_), Util::Str2Num<size_t>(part_), ts, offset, len, http);
+
+        // preload hint指的part还在切
+        if (ret == kNoEnoughData && can_wait)
+        {
+            return kNoEnoughData;
+        }
+
+        if (ret == kSuccess)
+        {
+            SendTs(ts, offset, len, http);
+        }
+        else
+        {
+            SendStatus("404 Not Found");
+        }
+    }
+    else if (type_ == "mp4" && ts_ == "init")
+    {
+        SendHttp(media_muxer.GetFmp4InitHttp());
+    }
+    else if (type_ == "mpd")
+    {
+        SendHttp(media_muxer.GetMpdHttp());
+    }
+    else if (type_ == "m3u8")
+    {
+        auto iter_msn = args_.find("_HLS_msn");
+        bool blocking = media_muxer.IsLowLatency() && iter_msn != args_.end();
+
+        // LL-HLS阻塞刷新, 播放列表里有了要的切片/part再回
+        if (blocking)
+        {
+            uint64_t msn = Util::Str2Num<uint64_t>(iter_msn->second);
+            int64_t part = -1;
+
+            auto iter_part = args_.find("_HLS_part");
+
+            if (iter_part != args_.end())
+            {
+                part = Util::Str2Num<int64_t>(iter_part->second);
+            }
+
+            if (media_muxer.IsTooFarAhead(msn))
+            {
+                SendStatus("400 Bad Request");
+                return kSuccess;
+            }
+
+            if (! media_muxer.HasPlaylistFor(msn, part))
+            {
+                if (can_wait)
+                {
+                    return kNoEnoughData;
+                }
+
+                // 等超时了, 给的列表里没有要的part, 不能按阻塞的回应缓存
+                blocking = false;
+            }
+        }
+
+        auto iter_skip = args_.find("_HLS_skip");
+        bool delta = media_muxer.IsLowLatency() && iter_skip != args_.end() && iter_skip->second == "YES";
+
+        SendHttp(media_muxer.GetM3U8Http(delta, blocking));
+    }
+
+    return kSuccess;
+}
+
+void HttpHlsProtocol::OnHlsNotify(const bool& stopped)
+{
+    // 流没了或者不切了, 等待已经被清掉了
+    if (stopped)
+    {
+        wait_timer_.Cancel();
+        wait_id_ = 0;
+        media_publisher_ = NULL;
+
+        SendStatus("404 Not Found");
+
+        return;
+    }
+
+    if (Serve(true) != kNoEnoughData)
+    {
+        StopWaiting();
+    }
+}
+
+void HttpHlsProtocol::OnWaitTimeout()
+{
+    std::cout << LMSG << "hls wait timeout, app_:" << app_ << ",stream_:" << stream_ << ",ts_:" << ts_ << ",part_:" << part_ << ",type_:" << type_ << std::endl;
+
+    StopWaiting();
+
+    // 不等了, 有什么给什么
+    Serve(false);
+}
+
+void HttpHlsProtocol::StopWaiting()
+{
+    wait_timer_.Cancel();
+
+    if (wait_id_ != 0 && media_publisher_ != NULL)
+    {
+        media_publisher_->GetMediaMuxer().CancelHlsWait(wait_id_);
+    }
+
+    wait_id_ = 0;
+}
+
+bool HttpHlsProtocol::IsNotModified(const HttpCache& http) const
+{
+    // 有If-None-Match就只看它
+    if (! if_none_match_.empty())
+    {
+        return if_none_match_ == "*" || if_none_match_.find(http.etag) != std::string::npos;
+    }
+
+    return if_modified_since_ != 0 && http.last_modified != 0 && http.last_modified <= if_modified_since_;
+}
+
+void HttpHlsProtocol::SendHttp(const HttpCache& http)
+{
+    if (http.ok.empty())
+    {
+        SendStatus("404 Not Found");
+        return;
+    }
+
+    const std::string& response = IsNotModified(http) ? http.not_modified : http.ok;
+
+    GetTcpSocket()->Send((const uint8_t*)response.data(), response.size());
+}
+
+void HttpHlsProtocol::SendTs(const std::shared_ptr<TsSegment>& ts, const size_t& offset, const size_t& len, const HttpCache* http)
+{
+    if (http != NULL)
+    {
+        if (IsNotModified(*http))
+        {
+            GetTcpSocket()->Send((const uint8_t*)http->not_modified.data(), http->not_modified.size());
+            return;
+        }
+
+        // 切片数据不拷贝, 引用着发
+        ts->Send(*GetTcpSocket(), http->ok, offset, len);
+        return;
+    }
+
+    // 还在切的整个切片, 内容还会变, 不能缓存
+    MediaMuxer& media_muxer = media_publisher_->GetMediaMuxer();
+
+    std::ostringstream os;
+
+    os << "HTTP/1.1 200 OK\r\n"
+       << "Server: trs\r\n"
+       << "Connection: keep-alive\r\n"
+       << "Cache-Control: no-store\r\n"
+       << "Content-Type: " << (media_muxer.IsFmp4() ? "video/iso.segment" : "video/mp2t") << "\r\n"
+       << "Content-Length:" << len << "\r\n"
+       << "\r\n";
+
+    ts->Send(*GetTcpSocket(), os.str(), offset, len);
+}
+
+void HttpHlsProtocol::SendStatus(const std::string& status)
+{
+    std::ostringstream os;
+
+    os << "HTTP/1.1 " << status << "\r\n"
+       << "Server: trs\r\n"
+       << "Connection: close\r\n"
+       << "\r\n";
+
+    GetTcpSocket()->Send((const uint8_t*)os.str().data(), os.str().size());
+}
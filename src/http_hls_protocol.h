@@ -3,10 +3,13 @@
 
 #include <stdint.h>
 
+#include <map>
+#include <memory>
 #include <string>
 
 #include "media_subscriber.h"
 #include "socket_handler.h"
+#include "timing_wheel.h"
 
 class IoLoop;
 class Fd;
@@ -18,6 +21,8 @@ class ServerProtocol;
 class ServerMgr;
 class RtmpMgr;
 class TcpSocket;
+class TsSegment;
+struct HttpCache;
 
 class HttpHlsProtocol 
     : public MediaSubscriber
@@ -45,6 +50,24 @@ private:
         return (TcpSocket*)socket_;
     }
 
+    void ParseUrl(const std::string& url);
+
+    // 回应当前请求, can_wait时LL-HLS的阻塞请求还没好返回kNoEnoughData, 挂起来等
+    int Serve(const bool& can_wait);
+
+    void OnHlsNotify(const bool& stopped);
+    void OnWaitTimeout();
+    void StopWaiting();
+
+    // 带着If-None-Match/If-Modified-Since来的, 没变就回304
+    bool IsNotModified(const HttpCache& http) const;
+
+    // 预先生成好的响应, 空的回404
+    void SendHttp(const HttpCache& http);
+    // http为NULL是还在切的切片, 现生成不带缓存的头
+    void SendTs(const std::shared_ptr<TsSegment>& ts, const size_t& offset, const size_t& len, const HttpCache* http);
+    void SendStatus(const std::string& status);
+
 private:
     IoLoop* io_loop_;
     Fd* socket_;
@@ -52,8 +75,20 @@ private:
 
     std::string app_;
     std::string stream_;
+    // 切片地址里的推流session, 跟当前推流的不一样就是旧的
+    std::string session_;
     std::string ts_;
+    // LL-HLS的part序号, 请求的是整个切片时为空
+    std::string part_;
     std::string type_;
+    std::map<std::string, std::string> args_;
+    std::string if_none_match_;
+    // 秒
+    uint64_t if_modified_since_;
+
+    WheelTimer wait_timer_;
+    // 挂在MediaMuxer上等待的id, 0表示没在等
+    uint64_t wait_id_;
 };
 
 #endif // __HTTP_HLS_PROTOCOL_H__
@@ -1,9 +1,30 @@
+#include <assert.h>
+
 #include "common_define.h"
+#include "cross_loop_relay.h"
+#include "io_loop.h"
 #include "global.h"
 #include "local_stream_center.h"
 #include "media_subscriber.h"
 
+// 本loop的跨loop镜像, 流的Entry::id -> 镜像. 只有本loop线程读写, 不用锁.
+// 查的时候已经拿到Entry了, 不用再拼app/stream算一遍
+typedef std::unordered_map<uint64_t, CrossLoopPublisher*> CrossLoopPublisherMap;
+
+static thread_local CrossLoopPublisherMap* t_cross_loop_publisher = NULL;
+
+static CrossLoopPublisherMap& GetCrossLoopPublisherMap()
+{
+    if (t_cross_loop_publisher == NULL)
+    {
+        t_cross_loop_publisher = new CrossLoopPublisherMap();
+    }
+
+    return *t_cross_loop_publisher;
+}
+
 LocalStreamCenter::LocalStreamCenter()
+    : watch_id_(0)
 {
 }
 
@@ -18,104 +39,198 @@ bool LocalStreamCenter::RegisterStream(const std::string& app, const std::string
         return false;
     }
 
-    auto& stream_protocol_ = app_stream_publisher_[app];
-
-    if (stream_protocol_.find(stream) != stream_protocol_.end())
+    if (! streams_.Insert(app, stream, media_publisher, IoLoop::GetCurrentLoop()))
     {
         std::cout << LMSG << "stream:" << stream << " already registered" << std::endl;
         return false;
     }
 
-    stream_protocol_.insert(make_pair(stream, media_publisher));
     std::cout << LMSG << "register app:" << app << ", stream:" << stream << std::endl;
 
+    NotifyWatcher(app + "/" + stream, true);
+
     return true;
 }
 
 bool LocalStreamCenter::UnRegisterStream(const std::string& app, const std::string& stream, MediaPublisher* media_publisher)
 {
-    auto iter_app = app_stream_publisher_.find(app);
-
-    if (iter_app == app_stream_publisher_.end())
+    if (! streams_.Erase(app, stream, media_publisher))
     {
         return false;
     }
 
-    auto iter_stream = iter_app->second.find(stream);
+    std::cout << LMSG << "unregister app:" << app << ", stream:" << stream << std::endl;
+
+    NotifyWatcher(app + "/" + stream, false);
+
+    return true;
+}
+
+MediaPublisher* LocalStreamCenter::GetMediaPublisherByAppStream(const std::string& app, const std::string& stream)
+{
+    StreamRegistry::ReadGuard guard;
+
+    const StreamRegistry::Entry* entry = streams_.Find(app, stream);
 
-    if (iter_stream == iter_app->second.end())
+    if (entry == NULL)
     {
-        return false;
+        return NULL;
     }
 
-    iter_app->second.erase(iter_stream);
+    return GetPublisherInCurrentLoop(entry);
+}
+
+MediaPublisher* LocalStreamCenter::GetOriginPublisher(const std::string& app, const std::string& stream, IoLoop* io_loop)
+{
+    StreamRegistry::ReadGuard guard;
+
+    const StreamRegistry::Entry* entry = streams_.Find(app, stream);
 
-    if (iter_app->second.empty())
+    if (entry == NULL || entry->io_loop != io_loop)
     {
-        app_stream_publisher_.erase(iter_app);
+        return NULL;
     }
 
-    std::cout << LMSG << "unregister app:" << app << ", stream:" << stream << std::endl;
+    return entry->publisher;
+}
 
-    return true;
+void LocalStreamCenter::RemoveCrossLoopPublisher(IoLoop* io_loop, const uint64_t& stream_id, CrossLoopPublisher* publisher)
+{
+    assert(io_loop == IoLoop::GetCurrentLoop());
+    UNUSED(io_loop);
+
+    auto& cross_loop_publisher = GetCrossLoopPublisherMap();
+
+    auto iter = cross_loop_publisher.find(stream_id);
+
+    // 可能已经被新镜像替换了
+    if (iter != cross_loop_publisher.end() && iter->second == publisher)
+    {
+        cross_loop_publisher.erase(iter);
+    }
 }
 
-MediaPublisher* LocalStreamCenter::GetMediaPublisherByAppStream(const std::string& app, const std::string& stream)
+MediaPublisher* LocalStreamCenter::GetPublisherInCurrentLoop(const StreamRegistry::Entry* entry)
 {
-    auto iter_app = app_stream_publisher_.find(app);
+    IoLoop* current_loop = IoLoop::GetCurrentLoop();
 
-    if (iter_app == app_stream_publisher_.end())
+    if (entry->io_loop == NULL || current_loop == NULL || entry->io_loop == current_loop)
     {
-        return NULL;
+        return entry->publisher;
     }
 
-    auto iter_stream = iter_app->second.find(stream);
+    // 同名流重新发布是新的Entry, id不一样, 会建新镜像
+    CrossLoopPublisher*& cross_loop_publisher = GetCrossLoopPublisherMap()[entry->id];
 
-    if (iter_stream == iter_app->second.end())
+    if (cross_loop_publisher == NULL || cross_loop_publisher->IsStopped())
     {
-        return NULL;
+        cross_loop_publisher = new CrossLoopPublisher(current_loop, entry->io_loop, entry->id, entry->app, entry->stream);
     }
 
-    return iter_stream->second;
+    cross_loop_publisher->Touch(current_loop->GetNowMs());
+
+    return cross_loop_publisher;
 }
 
 bool LocalStreamCenter::IsAppStreamExist(const std::string& app, const std::string& stream)
 {
-    auto iter_app = app_stream_publisher_.find(app);
+    StreamRegistry::ReadGuard guard;
+
+    return streams_.Find(app, stream) != NULL;
+}
+
+uint64_t LocalStreamCenter::WatchStream(const std::string& app, const std::string& stream, const StreamCallback& callback)
+{
+    assert(IoLoop::GetCurrentLoop() != NULL);
+
+    std::lock_guard<std::mutex> lock(watch_mutex_);
+
+    Watcher watcher;
+    watcher.io_loop = IoLoop::GetCurrentLoop();
+    watcher.callback = callback;
+
+    uint64_t watch_id = ++watch_id_;
+    watcher_[app + "/" + stream].insert(std::make_pair(watch_id, watcher));
+
+    return watch_id;
+}
+
+void LocalStreamCenter::UnwatchStream(const std::string& app, const std::string& stream, const uint64_t& watch_id)
+{
+    std::lock_guard<std::mutex> lock(watch_mutex_);
+
+    auto iter = watcher_.find(app + "/" + stream);
 
-    if (iter_app == app_stream_publisher_.end())
+    if (iter == watcher_.end())
     {
-        return false;
+        return;
     }
 
-    auto iter_stream = iter_app->second.find(stream);
+    iter->second.erase(watch_id);
 
-    if (iter_stream == iter_app->second.end())
+    if (iter->second.empty())
     {
-        return false;
+        watcher_.erase(iter);
     }
+}
 
-    return true;
+void LocalStreamCenter::NotifyWatcher(const std::string& key, const bool& published)
+{
+    std::lock_guard<std::mutex> lock(watch_mutex_);
+
+    auto iter = watcher_.find(key);
+
+    if (iter == watcher_.end())
+    {
+        return;
+    }
+
+    // 都丢到监听者的loop上去跑, 即使就是当前loop也不在注册流程里直接回调
+    for (const auto& kv : iter->second)
+    {
+        uint64_t watch_id = kv.first;
+
+        kv.second.io_loop->QueueInLoop([this, key, watch_id, published]()
+        {
+            RunWatcher(key, watch_id, published);
+        });
+    }
 }
 
-MediaPublisher* LocalStreamCenter::_DebugGetRandomMediaPublisher(std::string& app, std::string& stream)
+void LocalStreamCenter::RunWatcher(const std::string& key, const uint64_t& watch_id, const bool& published)
 {
-    if (app_stream_publisher_.empty())
+    StreamCallback callback;
+
     {
-        return NULL;
+        std::lock_guard<std::mutex> lock(watch_mutex_);
+
+        auto iter = watcher_.find(key);
+
+        // 回调排队期间已经取消监听了
+        if (iter == watcher_.end() || iter->second.count(watch_id) == 0)
+        {
+            return;
+        }
+
+        callback = iter->second[watch_id].callback;
     }
 
-    auto iter = app_stream_publisher_.begin();
+    callback(published);
+}
 
-    if (iter->second.empty())
+MediaPublisher* LocalStreamCenter::_DebugGetRandomMediaPublisher(std::string& app, std::string& stream)
+{
+    StreamRegistry::ReadGuard guard;
+
+    const StreamRegistry::Entry* entry = streams_.Any();
+
+    if (entry == NULL)
     {
         return NULL;
     }
 
-    auto iter_ret = iter->second.begin();
-
-    app = iter->first;
-    stream = iter_ret->first;
+    app = entry->app;
+    stream = entry->stream;
 
-    return iter_ret->second;
+    return GetPublisherInCurrentLoop(entry);
 }
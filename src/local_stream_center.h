@@ -1,30 +1,70 @@
 #ifndef __LOCAL_STREAM_CENTER_H__
 #define __LOCAL_STREAM_CENTER_H__
 
-#include <set>
+#include <stdint.h>
+
+#include <functional>
 #include <string>
 #include <map>
+#include <mutex>
+#include <unordered_map>
+
+#include "stream_registry.h"
 
+class CrossLoopPublisher;
+class IoLoop;
 class MediaCenterMgr;
 class MediaPublisher;
 class MediaSubscriber;
 
+// 多reactor模式下各个loop线程都会来查. 查询走无锁hash表, 注册/注销在表里加锁.
+// 等流的订阅者可以挂个监听, 流发布/停止时回调到订阅者自己的loop上, 不用轮询.
 class LocalStreamCenter
 {
 public:
+    // published: true是流发布了, false是流停了
+    typedef std::function<void(const bool& published)> StreamCallback;
+
     LocalStreamCenter();
     ~LocalStreamCenter();
 
+    // 返回的publisher一定在当前loop上, 发布者在别的loop时返回本loop的镜像
     MediaPublisher* GetMediaPublisherByAppStream(const std::string& app, const std::string& stream);
     bool IsAppStreamExist(const std::string& app, const std::string& stream);
 
     bool RegisterStream(const std::string& app, const std::string& stream, MediaPublisher* media_publisher);
     bool UnRegisterStream(const std::string& app, const std::string& stream, MediaPublisher* media_publisher);
 
+    // 只在io_loop上调用, 发布者不在io_loop上返回NULL
+    MediaPublisher* GetOriginPublisher(const std::string& app, const std::string& stream, IoLoop* io_loop);
+    // 只在io_loop上调用, stream_id是创建镜像时流的Entry::id
+    void RemoveCrossLoopPublisher(IoLoop* io_loop, const uint64_t& stream_id, CrossLoopPublisher* publisher);
+
+    // 在loop线程上调用, 回调也在这个loop上. 返回监听id, 不用了要UnwatchStream
+    uint64_t WatchStream(const std::string& app, const std::string& stream, const StreamCallback& callback);
+    void UnwatchStream(const std::string& app, const std::string& stream, const uint64_t& watch_id);
+
     MediaPublisher* _DebugGetRandomMediaPublisher(std::string& app, std::string& stream);
 
 private:
-	std::map<std::string, std::map<std::string, MediaPublisher*>> app_stream_publisher_;
+    struct Watcher
+    {
+        IoLoop*         io_loop;
+        StreamCallback  callback;
+    };
+
+    MediaPublisher* GetPublisherInCurrentLoop(const StreamRegistry::Entry* entry);
+
+    void NotifyWatcher(const std::string& key, const bool& published);
+    void RunWatcher(const std::string& key, const uint64_t& watch_id, const bool& published);
+
+private:
+    StreamRegistry streams_;
+
+    std::mutex watch_mutex_;
+    uint64_t watch_id_;
+    // app/stream -> 监听id -> 监听者
+    std::map<std::string, std::map<uint64_t, Watcher>> watcher_;
 };
 
 #endif // __LOCAL_STREAM_CENTER_H__
@@ -1,13 +1,21 @@
+#include <pthread.h>
 #include <signal.h>
 
 #include <iostream>
+#include <mutex>
+#include <vector>
 
 #include "any.h"
 #include "base_64.h"
 #include "bit_buffer.h"
 #include "bit_stream.h"
 #include "epoller.h"
+#include "frame_dropper.h"
+#include "gop_cache.h"
+#include "io_loop_thread.h"
+#include "io_uring_loop.h"
 #include "local_stream_center.h"
+#include "media_muxer.h"
 #include "protocol_factory.h"
 #include "ref_ptr.h"
 #include "socket_util.h"
@@ -16,8 +24,7 @@
 #include "srt_socket.h"
 #include "ssl_socket.h"
 #include "tcp_socket.h"
-#include "timer_in_second.h"
-#include "timer_in_millsecond.h"
+#include "ts_segment.h"
 #include "udp_socket.h"
 #include "util.h"
 
@@ -30,7 +37,7 @@ static void sighandler(int sig_no)
 } 
 
 LocalStreamCenter               g_local_stream_center;
-Epoller*                        g_epoll = NULL;
+IoLoop*                         g_epoll = NULL;
 SSL_CTX*                        g_tls_ctx = NULL;
 SSL_CTX*                        g_dtls_ctx = NULL;
 std::string                     g_dtls_fingerprint = "";
@@ -40,6 +47,92 @@ std::string                     g_remote_ice_pwd = "";
 std::string                     g_remote_ice_ufrag = "";
 std::string                     g_server_ip = "";
 
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+// openssl 1.0.x 多线程下要自己提供锁, https/wss的连接会分到各个worker loop
+static std::mutex* s_ssl_mutex = NULL;
+
+static void SslLockingCallback(int mode, int n, const char* file, int line)
+{
+    UNUSED(file);
+    UNUSED(line);
+
+    if (mode & CRYPTO_LOCK)
+    {
+        s_ssl_mutex[n].lock();
+    }
+    else
+    {
+        s_ssl_mutex[n].unlock();
+    }
+}
+
+static void SslThreadIdCallback(CRYPTO_THREADID* id)
+{
+    CRYPTO_THREADID_set_numeric(id, (unsigned long)pthread_self());
+}
+#endif
+
+template<typename SocketType>
+static SocketType* CreateTcpServer(IoLoop* io_loop, const std::string& name, const uint16_t& port, const bool& reuse_port, HandlerFactoryT handler_factory)
+{
+    int fd = socket_util::CreateNonBlockTcpSocket();
+
+    socket_util::ReuseAddr(fd);
+    if (reuse_port)
+    {
+        socket_util::ReusePort(fd);
+    }
+
+    if (socket_util::Bind(fd, "0.0.0.0", port) != 0)
+    {
+        std::cout << LMSG << "bind " << name << " " << port << " error" << std::endl;
+        return NULL;
+    }
+    if (socket_util::Listen(fd) != 0)
+    {
+        std::cout << LMSG << "listen " << name << " " << port << " error" << std::endl;
+        return NULL;
+    }
+    socket_util::SetNonBlock(fd);
+
+    std::string local_ip = "";
+    uint16_t local_port = 0;
+    socket_util::GetSocketName(fd, local_ip, local_port);
+
+    SocketType* server_socket = new SocketType(io_loop, fd, handler_factory);
+    server_socket->ModName(local_ip + ":" + Util::Num2Str(local_port));
+    // 注册之前标记, io_uring完成模式据此挂multishot accept
+    server_socket->AsServerSocket();
+    server_socket->EnableRead();
+
+    return server_socket;
+}
+
+// io_uring起不来(内核太老, 被seccomp禁掉等)就用epoll
+static IoLoop* CreateIoLoop(const std::string& io_loop_type)
+{
+    if (io_loop_type == "io_uring")
+    {
+        IoUringLoop* io_uring_loop = new IoUringLoop();
+        if (io_uring_loop->Create() == 0)
+        {
+            return io_uring_loop;
+        }
+
+        std::cout << LMSG << "create io_uring loop failed, fallback to epoll" << std::endl;
+        delete io_uring_loop;
+    }
+
+    Epoller* epoller = new Epoller();
+    if (epoller->Create() != 0)
+    {
+        delete epoller;
+        return NULL;
+    }
+
+    return epoller;
+}
+
 void AvLogCallback(void* ptr, int level, const char* fmt, va_list vl)
 {
     UNUSED(ptr);
@@ -65,6 +158,12 @@ int main(int argc, char* argv[])
 
     assert(ret == 1);
 
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+    s_ssl_mutex = new std::mutex[CRYPTO_num_locks()];
+    CRYPTO_THREADID_set_callback(SslThreadIdCallback);
+    CRYPTO_set_locking_callback(SslLockingCallback);
+#endif
+
     // tls init
     g_tls_ctx = SSL_CTX_new(SSLv23_method());
 
@@ -259,15 +358,36 @@ int main(int argc, char* argv[])
 
     bool daemon                     = false;
 
+    uint32_t worker_threads         = 1;
+    std::vector<int> cpu_affinity;
+    std::string io_loop_type        = "epoll";
+    bool edge_trigger               = false;
+
     auto iter_server_ip     = args_map.find("server_ip");
     auto iter_rtmp_port     = args_map.find("rtmp_port");
     auto iter_http_flv_port = args_map.find("http_flv_port");
     auto iter_http_hls_port = args_map.find("http_hls_port");
     auto iter_daemon        = args_map.find("daemon");
+    auto iter_worker_threads= args_map.find("worker_threads");
+    auto iter_cpu_affinity  = args_map.find("cpu_affinity");
+    auto iter_io_loop       = args_map.find("io_loop");
+    auto iter_edge_trigger  = args_map.find("edge_trigger");
+    auto iter_uring_completion = args_map.find("io_uring_completion");
+    auto iter_hugepage      = args_map.find("payload_hugepage");
+    auto iter_buffer_limit  = args_map.find("io_buffer_limit_mb");
+    auto iter_queue_limit   = args_map.find("send_queue_limit_kb");
+    auto iter_queue_delay   = args_map.find("send_queue_delay_ms");
+    auto iter_gop_cache_gops= args_map.find("gop_cache_gops");
+    auto iter_gop_cache_ms  = args_map.find("gop_cache_ms");
+    auto iter_hls_idle_ms   = args_map.find("hls_idle_ms");
+    auto iter_hls_budget_mb = args_map.find("hls_budget_mb");
+    auto iter_hls_memfd     = args_map.find("hls_memfd");
+    auto iter_hls_part_ms   = args_map.find("hls_part_ms");
+    auto iter_hls_fmp4      = args_map.find("hls_fmp4");
 
     if (iter_server_ip == args_map.end())
     {
-        std::cout << "Usage:" << argv[0] << " -server_ip <xxx.xxx.xxx.xxx> -http_flv_port [xxx] -http_hls_port [xxx] -daemon [xxx]" << std::endl;
+        std::cout << "Usage:" << argv[0] << " -server_ip <xxx.xxx.xxx.xxx> -http_flv_port [xxx] -http_hls_port [xxx] -daemon [xxx] -worker_threads [n] -cpu_affinity [0,1,2...] -io_loop [epoll|io_uring] -io_uring_completion [0|1] -edge_trigger [0|1] -payload_hugepage [0|1] -io_buffer_limit_mb [n] -send_queue_limit_kb [n] -send_queue_delay_ms [n] -gop_cache_gops [n] -gop_cache_ms [n] -hls_idle_ms [n] -hls_budget_mb [n] -hls_memfd [0|1] -hls_part_ms [n] -hls_fmp4 [0|1]" << std::endl;
         return 0;
     }
 
@@ -304,228 +424,250 @@ int main(int argc, char* argv[])
         daemon = (! (tmp == 0));
     }
 
-    if (daemon)
+    if (iter_worker_threads != args_map.end())
     {
-        Util::Daemon();
-    }
-
-	signal(SIGUSR1, sighandler);
-    signal(SIGPIPE,SIG_IGN);
-
-    Log::SetLogLevel(kLevelDebug);
-
-    DEBUG << argv[0] << " starting..." << std::endl;
-
-    Epoller epoller;
-    epoller.Create();
-    g_epoll = &epoller;
-
-    std::string local_ip = "";
-    uint16_t local_port = 0;
-
-    // === Init Timer ===
-    TimerInSecond timer_in_second(&epoller);
-    TimerInMillSecond timer_in_millsecond(&epoller);
+        if (! iter_worker_threads->second.empty())
+        {
+            worker_threads = Util::Str2Num<uint32_t>(iter_worker_threads->second);
+        }
 
-    // === Init Server Rtmp Socket ===
-    int server_rtmp_fd = socket_util::CreateNonBlockTcpSocket();
+        if (worker_threads == 0)
+        {
+            worker_threads = 1;
+        }
+    }
 
-    socket_util::ReuseAddr(server_rtmp_fd);
-    if (socket_util::Bind(server_rtmp_fd, "0.0.0.0", rtmp_port) != 0)
+    // 第i个loop绑到cpu_affinity[i % n]上
+    if (iter_cpu_affinity != args_map.end())
     {
-        std::cout << LMSG << "bind rtmp_port " << rtmp_port << " error" << std::endl;
-        return -1;
+        for (const auto& cpu : Util::SepStr(iter_cpu_affinity->second, ","))
+        {
+            if (! cpu.empty())
+            {
+                cpu_affinity.push_back(Util::Str2Num<int>(cpu));
+            }
+        }
     }
-    if (socket_util::Listen(server_rtmp_fd) != 0)
+
+    if (iter_io_loop != args_map.end())
     {
-        std::cout << LMSG << "listen rtmp_port " << rtmp_port << " error" << std::endl;
-        return -1;
+        if (! iter_io_loop->second.empty())
+        {
+            io_loop_type = iter_io_loop->second;
+        }
     }
-    socket_util::SetNonBlock(server_rtmp_fd);
-    socket_util::GetSocketName(server_rtmp_fd, local_ip, local_port);
-
-    TcpSocket server_rtmp_socket(&epoller, server_rtmp_fd, std::bind(&ProtocolFactory::GenRtmpProtocol, std::placeholders::_1, std::placeholders::_2));
-    server_rtmp_socket.ModName(local_ip + ":" + Util::Num2Str(local_port));
-    server_rtmp_socket.EnableRead();
-    server_rtmp_socket.AsServerSocket();
-
-    // === Init Server Http Flv Socket ===
-    int server_http_flv_fd = socket_util::CreateNonBlockTcpSocket();
 
-    socket_util::ReuseAddr(server_http_flv_fd);
-    if (socket_util::Bind(server_http_flv_fd, "0.0.0.0", http_flv_port) != 0)
+    // io_uring下tcp用multishot accept/recv和批量发送, 0的话只用就绪通知
+    if (iter_uring_completion != args_map.end())
     {
-        std::cout << LMSG << "bind http_flv_port " << http_flv_port << " error" << std::endl;
-        return -1;
+        IoUringLoop::SetCompletionIo(Util::Str2Num<int>(iter_uring_completion->second) != 0);
     }
-    if (socket_util::Listen(server_http_flv_fd) != 0)
+
+    // rtmp/http连接用边沿触发, 只对epoll生效
+    if (iter_edge_trigger != args_map.end())
     {
-        std::cout << LMSG << "bind http_flv_port " << http_flv_port << " error" << std::endl;
-        return -1;
+        edge_trigger = (Util::Str2Num<int>(iter_edge_trigger->second) != 0);
     }
-    socket_util::SetNonBlock(server_http_flv_fd);
-    socket_util::GetSocketName(server_http_flv_fd, local_ip, local_port);
-
-    TcpSocket server_http_flv_socket(&epoller, server_http_flv_fd, std::bind(&ProtocolFactory::GenHttpFlvProtocol, std::placeholders::_1, std::placeholders::_2));
-    server_http_flv_socket.ModName(local_ip + ":" + Util::Num2Str(local_port));
-    server_http_flv_socket.EnableRead();
-    server_http_flv_socket.AsServerSocket();
-
-    // === Init Server Https Flv Socket ===
-    int server_https_flv_fd = socket_util::CreateNonBlockTcpSocket();
 
-    socket_util::ReuseAddr(server_https_flv_fd);
-    if (socket_util::Bind(server_https_flv_fd, "0.0.0.0", https_flv_port) != 0)
+    // payload池的arena用大页
+    if (iter_hugepage != args_map.end())
     {
-        std::cout << LMSG << "bind https_flv_port " << https_flv_port << " error" << std::endl;
-        return -1;
+        PayloadPool::SetHugePage(Util::Str2Num<int>(iter_hugepage->second) != 0);
     }
-    if (socket_util::Listen(server_https_flv_fd) != 0)
+
+    // 所有连接读写缓冲加起来的上限, 0不限制
+    if (iter_buffer_limit != args_map.end())
     {
-        std::cout << LMSG << "bind https_flv_port " << https_flv_port << " error" << std::endl;
-        return -1;
+        IoBufferPool::SetMemoryLimit(Util::Str2Num<uint64_t>(iter_buffer_limit->second) * 1024 * 1024);
     }
-    socket_util::SetNonBlock(server_https_flv_fd);
-    socket_util::GetSocketName(server_https_flv_fd, local_ip, local_port);
 
-    SslSocket server_https_flv_socket(&epoller, server_https_flv_fd, std::bind(&ProtocolFactory::GenHttpFlvProtocol, std::placeholders::_1, std::placeholders::_2));
-    server_https_flv_socket.ModName(local_ip + ":" + Util::Num2Str(local_port));
-    server_https_flv_socket.EnableRead();
-    server_https_flv_socket.AsServerSocket();
+    // 每个播放者发送队列的硬上限, 到1/4开始丢非参考帧, 到上限或者排队超过delay丢到下个IDR
+    if (iter_queue_limit != args_map.end() || iter_queue_delay != args_map.end())
+    {
+        size_t hard_bytes = 4*1024*1024;
+        uint64_t max_delay_ms = 5000;
 
-    // === Init Server Http Hls Socket ===
-    int server_http_hls_fd = socket_util::CreateNonBlockTcpSocket();
+        if (iter_queue_limit != args_map.end())
+        {
+            hard_bytes = Util::Str2Num<size_t>(iter_queue_limit->second) * 1024;
+        }
 
-    socket_util::ReuseAddr(server_http_hls_fd);
-    if (socket_util::Bind(server_http_hls_fd, "0.0.0.0", http_hls_port) != 0)
-    {
-        std::cout << LMSG << "bind http_hls_port " << http_hls_port << " error" << std::endl;
-        return -1;
+        if (iter_queue_delay != args_map.end())
+        {
+            max_delay_ms = Util::Str2Num<uint64_t>(iter_queue_delay->second);
+        }
+
+        FrameDropper::SetLimit(hard_bytes / 4, hard_bytes, max_delay_ms);
     }
-    if (socket_util::Listen(server_http_hls_fd) != 0)
+
+    // 每个流缓存多少个GOP/多长时间, 至少留最后一个GOP
+    if (iter_gop_cache_gops != args_map.end() || iter_gop_cache_ms != args_map.end())
     {
-        std::cout << LMSG << "bind http_hls_port " << http_hls_port << " error" << std::endl;
-        return -1;
-    }
-    socket_util::SetNonBlock(server_http_hls_fd);
-    socket_util::GetSocketName(server_http_hls_fd, local_ip, local_port);
+        size_t max_gops = 2;
+        uint64_t max_duration_ms = 20000;
+
+        if (iter_gop_cache_gops != args_map.end())
+        {
+            max_gops = Util::Str2Num<size_t>(iter_gop_cache_gops->second);
+        }
 
-    TcpSocket server_http_hls_socket(&epoller, server_http_hls_fd, std::bind(&ProtocolFactory::GenHttpHlsProtocol, std::placeholders::_1, std::placeholders::_2));
-    server_http_hls_socket.ModName(local_ip + ":" + Util::Num2Str(local_port));
-    server_http_hls_socket.EnableRead();
-    server_http_hls_socket.AsServerSocket();
+        if (iter_gop_cache_ms != args_map.end())
+        {
+            max_duration_ms = Util::Str2Num<uint64_t>(iter_gop_cache_ms->second);
+        }
 
-    // === Init Server Https Hls Socket ===
-    int server_https_hls_fd = socket_util::CreateNonBlockTcpSocket();
+        GopCache::SetRetention(max_gops, max_duration_ms);
+    }
 
-    socket_util::ReuseAddr(server_https_hls_fd);
-    if (socket_util::Bind(server_https_hls_fd, "0.0.0.0", https_hls_port) != 0)
+    // 多久没有HLS请求就停止切ts, 0表示开始切之后不停
+    if (iter_hls_idle_ms != args_map.end())
     {
-        std::cout << LMSG << "bind https_hls_port " << https_hls_port << " error" << std::endl;
-        return -1;
+        MediaMuxer::SetHlsIdleMs(Util::Str2Num<uint64_t>(iter_hls_idle_ms->second));
     }
-    if (socket_util::Listen(server_https_hls_fd) != 0)
+
+    // 所有流保留的ts切片总大小, 超了每个流只留m3u8里的, 0不限
+    if (iter_hls_budget_mb != args_map.end())
     {
-        std::cout << LMSG << "bind https_hls_port " << https_hls_port << " error" << std::endl;
-        return -1;
+        TsSegment::SetBudget(Util::Str2Num<uint64_t>(iter_hls_budget_mb->second) * 1024 * 1024);
     }
-    socket_util::SetNonBlock(server_https_hls_fd);
-    socket_util::GetSocketName(server_https_hls_fd, local_ip, local_port);
 
-    SslSocket server_https_hls_socket(&epoller, server_https_hls_fd, std::bind(&ProtocolFactory::GenHttpHlsProtocol, std::placeholders::_1, std::placeholders::_2));
-    server_https_hls_socket.ModName(local_ip + ":" + Util::Num2Str(local_port));
-    server_https_hls_socket.EnableRead();
-    server_https_hls_socket.AsServerSocket();
+    // ts切片放memfd里用sendfile发
+    if (iter_hls_memfd != args_map.end())
+    {
+        TsSegment::SetUseMemfd(Util::Str2Num<int>(iter_hls_memfd->second) != 0);
+    }
 
-    // === Init WebSocket Socket ===
-    int web_socket_fd = socket_util::CreateNonBlockTcpSocket();
+    // LL-HLS的part时长, 0不开
+    if (iter_hls_part_ms != args_map.end())
+    {
+        MediaMuxer::SetHlsPartMs(Util::Str2Num<uint64_t>(iter_hls_part_ms->second));
+    }
 
-    socket_util::ReuseAddr(web_socket_fd);
-    if (socket_util::Bind(web_socket_fd, "0.0.0.0", web_socket_port) != 0)
+    // 切fMP4(CMAF), HLS和DASH共用切片
+    if (iter_hls_fmp4 != args_map.end())
     {
-        std::cout << LMSG << "bind web_socket_port " << web_socket_port << " error" << std::endl;
-        return -1;
+        MediaMuxer::SetHlsFmp4(Util::Str2Num<int>(iter_hls_fmp4->second) != 0);
     }
-    if (socket_util::Listen(web_socket_fd) != 0)
+
+    if (daemon)
     {
-        std::cout << LMSG << "bind web_socket_port " << web_socket_port << " error" << std::endl;
-        return -1;
+        Util::Daemon();
     }
-    socket_util::SetNonBlock(web_socket_fd);
-    socket_util::GetSocketName(web_socket_fd, local_ip, local_port);
 
-    TcpSocket web_socket_socket(&epoller, web_socket_fd, std::bind(&ProtocolFactory::GenWebSocketProtocol, std::placeholders::_1, std::placeholders::_2));
-    web_socket_socket.ModName(local_ip + ":" + Util::Num2Str(local_port));
-    web_socket_socket.EnableRead();
-    web_socket_socket.AsServerSocket();
+	signal(SIGUSR1, sighandler);
+    signal(SIGPIPE,SIG_IGN);
 
-    // === Init SSL WebSocket Socket ===
-    int ssl_web_socket_fd = socket_util::CreateNonBlockTcpSocket();
+    Log::SetLogLevel(kLevelDebug);
 
-    socket_util::ReuseAddr(ssl_web_socket_fd);
-    if (socket_util::Bind(ssl_web_socket_fd, "0.0.0.0", ssl_web_socket_port) != 0)
-    {
-        std::cout << LMSG << "bind ssl_web_socket_port " << ssl_web_socket_port << " error" << std::endl;
-        return -1;
-    }
-    if (socket_util::Listen(ssl_web_socket_fd) != 0)
+    DEBUG << argv[0] << " starting..." << std::endl;
+
+    IoLoop* main_loop = CreateIoLoop(io_loop_type);
+    if (main_loop == NULL)
     {
-        std::cout << LMSG << "bind ssl_web_socket_port " << ssl_web_socket_port << " error" << std::endl;
         return -1;
     }
-    socket_util::SetNonBlock(ssl_web_socket_fd);
-    socket_util::GetSocketName(ssl_web_socket_fd, local_ip, local_port);
+    g_epoll = main_loop;
 
-    SslSocket ssl_web_socket_socket(&epoller, ssl_web_socket_fd, std::bind(&ProtocolFactory::GenWebSocketProtocol, std::placeholders::_1, std::placeholders::_2));
-    ssl_web_socket_socket.ModName(local_ip + ":" + Util::Num2Str(local_port));
-    ssl_web_socket_socket.EnableRead();
-    ssl_web_socket_socket.AsServerSocket();
+    IoLoopThread::BindCpu(cpu_affinity.empty() ? -1 : cpu_affinity[0]);
 
-    // === Init Server Http File Socket ===
-    int server_http_file_fd = socket_util::CreateNonBlockTcpSocket();
+    // loop 0 就是主线程的loop, 其余的每个worker线程一个loop
+    std::vector<IoLoop*> all_loop;
+    all_loop.push_back(main_loop);
 
-    socket_util::ReuseAddr(server_http_file_fd);
-    if (socket_util::Bind(server_http_file_fd, "0.0.0.0", http_file_port) != 0)
+    std::vector<IoLoopThread*> io_loop_threads;
+    for (uint32_t index = 1; index < worker_threads; ++index)
     {
-        std::cout << LMSG << "bind http_file_port " << http_file_port << " error" << std::endl;
-        return -1;
+        IoLoop* io_loop = CreateIoLoop(io_loop_type);
+        if (io_loop == NULL)
+        {
+            return -1;
+        }
+
+        IoLoopThread* io_loop_thread = new IoLoopThread(index, io_loop);
+
+        io_loop_threads.push_back(io_loop_thread);
+        all_loop.push_back(io_loop);
     }
 
-    if (socket_util::Listen(server_http_file_fd) != 0)
+    // 多个loop时每个loop自己listen同一个端口, 由内核SO_REUSEPORT分发连接
+    bool reuse_port = (worker_threads > 1);
+
+    for (auto& loop : all_loop)
     {
-        std::cout << LMSG << "bind http_file_port " << http_file_port << " error" << std::endl;
-        return -1;
-    }
-    socket_util::SetNonBlock(server_http_file_fd);
-    socket_util::GetSocketName(server_http_file_fd, local_ip, local_port);
+        // === Init Server Rtmp Socket ===
+        TcpSocket* rtmp_server = CreateTcpServer<TcpSocket>(loop, "rtmp_port", rtmp_port, reuse_port, std::bind(&ProtocolFactory::GenRtmpProtocol, std::placeholders::_1, std::placeholders::_2));
+        if (rtmp_server == NULL)
+        {
+            return -1;
+        }
+        rtmp_server->SetAcceptEdgeTrigger(edge_trigger);
 
-    TcpSocket server_http_file_socket(&epoller, server_http_file_fd, std::bind(&ProtocolFactory::GenHttpFileProtocol, std::placeholders::_1, std::placeholders::_2));
-    server_http_file_socket.ModName(local_ip + ":" + Util::Num2Str(local_port));
-    server_http_file_socket.EnableRead();
-    server_http_file_socket.AsServerSocket();
+        // === Init Server Http Flv Socket ===
+        TcpSocket* http_flv_server = CreateTcpServer<TcpSocket>(loop, "http_flv_port", http_flv_port, reuse_port, std::bind(&ProtocolFactory::GenHttpFlvProtocol, std::placeholders::_1, std::placeholders::_2));
+        if (http_flv_server == NULL)
+        {
+            return -1;
+        }
+        http_flv_server->SetAcceptEdgeTrigger(edge_trigger);
+
+        // === Init Server Https Flv Socket ===
+        if (CreateTcpServer<SslSocket>(loop, "https_flv_port", https_flv_port, reuse_port, std::bind(&ProtocolFactory::GenHttpFlvProtocol, std::placeholders::_1, std::placeholders::_2)) == NULL)
+        {
+            return -1;
+        }
 
-    // === Init Server Https File Socket ===
-    int server_https_file_fd = socket_util::CreateNonBlockTcpSocket();
+        // === Init Server Http Hls Socket ===
+        TcpSocket* http_hls_server = CreateTcpServer<TcpSocket>(loop, "http_hls_port", http_hls_port, reuse_port, std::bind(&ProtocolFactory::GenHttpHlsProtocol, std::placeholders::_1, std::placeholders::_2));
+        if (http_hls_server == NULL)
+        {
+            return -1;
+        }
+        http_hls_server->SetAcceptEdgeTrigger(edge_trigger);
+
+        // === Init Server Https Hls Socket ===
+        if (CreateTcpServer<SslSocket>(loop, "https_hls_port", https_hls_port, reuse_port, std::bind(&ProtocolFactory::GenHttpHlsProtocol, std::placeholders::_1, std::placeholders::_2)) == NULL)
+        {
+            return -1;
+        }
 
-    socket_util::ReuseAddr(server_https_file_fd);
-    if (socket_util::Bind(server_https_file_fd, "0.0.0.0", https_file_port) != 0)
+        // === Init Server Http File Socket ===
+        TcpSocket* http_file_server = CreateTcpServer<TcpSocket>(loop, "http_file_port", http_file_port, reuse_port, std::bind(&ProtocolFactory::GenHttpFileProtocol, std::placeholders::_1, std::placeholders::_2));
+        if (http_file_server == NULL)
+        {
+            return -1;
+        }
+        http_file_server->SetAcceptEdgeTrigger(edge_trigger);
+
+        // === Init Server Https File Socket ===
+        if (CreateTcpServer<SslSocket>(loop, "https_file_port", https_file_port, reuse_port, std::bind(&ProtocolFactory::GenHttpFileProtocol, std::placeholders::_1, std::placeholders::_2)) == NULL)
+        {
+            return -1;
+        }
+    }
+
+    // WebSocket是webrtc的信令, 跟webrtc共用ice全局变量, 只放在主loop
+    // === Init WebSocket Socket ===
+    if (CreateTcpServer<TcpSocket>(main_loop, "web_socket_port", web_socket_port, false, std::bind(&ProtocolFactory::GenWebSocketProtocol, std::placeholders::_1, std::placeholders::_2)) == NULL)
     {
-        std::cout << LMSG << "bind https_file_port " << https_file_port << " error" << std::endl;
         return -1;
     }
-    if (socket_util::Listen(server_https_file_fd) != 0)
+
+    // === Init SSL WebSocket Socket ===
+    if (CreateTcpServer<SslSocket>(main_loop, "ssl_web_socket_port", ssl_web_socket_port, false, std::bind(&ProtocolFactory::GenWebSocketProtocol, std::placeholders::_1, std::placeholders::_2)) == NULL)
     {
-        std::cout << LMSG << "bind https_file_port " << https_file_port << " error" << std::endl;
         return -1;
     }
-    
-    socket_util::SetNonBlock(server_https_file_fd);
-    socket_util::GetSocketName(server_http_file_fd, local_ip, local_port);
 
-    SslSocket server_https_file_socket(&epoller, server_https_file_fd, std::bind(&ProtocolFactory::GenHttpFileProtocol, std::placeholders::_1, std::placeholders::_2));
-    server_https_file_socket.ModName(local_ip + ":" + Util::Num2Str(local_port));
-    server_https_file_socket.EnableRead();
-    server_https_file_socket.AsServerSocket();
+    for (size_t index = 0; index < io_loop_threads.size(); ++index)
+    {
+        int cpu = -1;
+        if (! cpu_affinity.empty())
+        {
+            cpu = cpu_affinity[(index + 1) % cpu_affinity.size()];
+        }
+
+        io_loop_threads[index]->Start(cpu);
+    }
 
     // === Init WebRTC Socket ===
     int webrtc_fd = socket_util::CreateNonBlockUdpSocket();
@@ -538,7 +680,7 @@ int main(int argc, char* argv[])
     }
     socket_util::SetNonBlock(webrtc_fd);
 
-    UdpSocket server_webrtc_socket(&epoller, webrtc_fd, std::bind(&ProtocolFactory::GenWebrtcProtocol, std::placeholders::_1, std::placeholders::_2));
+    UdpSocket server_webrtc_socket(main_loop, webrtc_fd, std::bind(&ProtocolFactory::GenWebrtcProtocol, std::placeholders::_1, std::placeholders::_2));
     server_webrtc_socket.ModName("udp");
     server_webrtc_socket.EnableRead();
 
@@ -573,12 +715,11 @@ int main(int argc, char* argv[])
     server_srt_socket.EnableRead();
     server_srt_socket.AsServerSocket();
 
+    // srt事件由单独的线程等待, 回调转到主loop执行
+    srt_epoller.Start(main_loop);
+
     // Event Loop
-    while (true)
-    {
-        epoller.WaitIO(100);
-        srt_epoller.WaitIO(0);
-    }
+    main_loop->RunIOLoop(100);
 
     return 0;
 }
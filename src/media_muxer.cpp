@@ -1,33 +1,180 @@
 #include <math.h>
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <iomanip>
 
 #include "bit_buffer.h"
 #include "bit_stream.h"
 #include "global.h"
+#include "io_loop.h"
 #include "media_publisher.h"
 #include "media_subscriber.h"
 #include "media_muxer.h"
 #include "util.h"
 
+// 最多留多少个ts切片
+static const size_t kMaxTsCount = 10;
+// m3u8里列多少个
+static const size_t kM3U8TsCount = 3;
+
+uint64_t MediaMuxer::hls_idle_ms_ = 30000;
+uint64_t MediaMuxer::hls_part_ms_ = 0;
+bool MediaMuxer::hls_fmp4_ = false;
+
+// fMP4模式下给srt打ts的临时切片超过这么大就换一个
+static const size_t kSrtSegmentSize = 1024 * 1024;
+// 切好的切片/part内容不会再变, 地址带推流session不会重用, CDN可以一直缓存
+static const char* kHlsSegmentCacheControl = "max-age=3600, immutable";
+// 镜像隔这么久告诉源站一次还有HLS请求, 比hls_idle_ms_小得多就行
+static const uint64_t kHlsForwardIntervalMs = 1000;
+
+static const uint8_t kStartCode[4] = {0x00, 0x00, 0x00, 0x01};
+
+// [first, end)里结束时间离列表末尾至少limit秒的切片个数, tail是end之后的时长
+static size_t CountOlderThan(std::map<uint64_t, TsMedia>::const_iterator first, std::map<uint64_t, TsMedia>::const_iterator end,
+                             double tail, const double& limit)
+{
+    size_t left = std::distance(first, end);
+
+    while (end != first)
+    {
+        if (tail >= limit)
+        {
+            return left;
+        }
+
+        --end;
+        tail += end->second.duration;
+        --left;
+    }
+
+    return 0;
+}
+
+// 毫秒时间加进程内序号, 重启和同一毫秒里开的推流都不会重
+static std::string NewSession()
+{
+    static std::atomic<uint32_t> session_count(0);
+
+    std::ostringstream os;
+    os << std::hex << Util::GetNowMs() << std::setw(4) << std::setfill('0') << (session_count.fetch_add(1) & 0xFFFF);
+
+    return os.str();
+}
+
+// part的URI是"session_切片序号.part序号.ts", fMP4是.m4s
+static void WriteParts(std::ostringstream& os, const std::string& session, const uint64_t& seq, const TsMedia& ts_media, const char* ext)
+{
+    for (size_t i = 0; i < ts_media.parts.size(); ++i)
+    {
+        const TsPart& part = ts_media.parts[i];
+
+        os << "#EXT-X-PART:DURATION=" << part.duration << ",URI=\"" << session << "_" << seq << "." << i << "." << ext << "\"";
+
+        if (part.independent)
+        {
+            os << ",INDEPENDENT=YES";
+        }
+
+        os << "\n";
+    }
+}
+
+// ISO 8601, MPD里的时间用
+static std::string FormatUtc(const uint64_t& ms)
+{
+    time_t sec = ms / 1000;
+    struct tm tm;
+    gmtime_r(&sec, &tm);
+
+    char buf[64];
+    size_t len = strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", &tm);
+    snprintf(buf + len, sizeof(buf) - len, ".%03uZ", (unsigned)(ms % 1000));
+
+    return buf;
+}
+
+// 生成200和304的响应头, 播放列表的body由调用者接在ok后面
+static void RenderHttp(const std::string& content_type, const size_t& content_length, const std::string& cache_control,
+                       const std::string& etag, const uint64_t& last_modified, HttpCache& http)
+{
+    std::ostringstream os;
+
+    os << "Server: trs\r\n"
+       << "Connection: keep-alive\r\n"
+       << "Cache-Control: " << cache_control << "\r\n";
+
+    if (! etag.empty())
+    {
+        os << "ETag: " << etag << "\r\n";
+    }
+
+    if (last_modified != 0)
+    {
+        os << "Last-Modified: " << Util::GetHttpDate(last_modified) << "\r\n";
+    }
+
+    std::string common = os.str();
+
+    http.etag = etag;
+    http.last_modified = last_modified;
+
+    http.ok = "HTTP/1.1 200 OK\r\n" + common + "Content-Type: " + content_type + "\r\n" + "Content-Length:" + Util::Num2Str(content_length) + "\r\n\r\n";
+    http.not_modified = "HTTP/1.1 304 Not Modified\r\n" + common + "\r\n";
+}
+
+// 播放列表的ETag按内容算, 内容没变就能304
+static void RenderHttpWithBody(const std::string& body, const std::string& content_type, const std::string& cache_control, HttpCache& http)
+{
+    if (body.empty())
+    {
+        http = HttpCache();
+        return;
+    }
+
+    std::ostringstream etag;
+    etag << "\"" << std::hex << std::hash<std::string>()(body) << "\"";
+
+    RenderHttp(content_type, body.size(), cache_control, etag.str(), 0, http);
+    http.ok += body;
+}
+
+// loop缓存的单调时钟, 每帧都要看, 不走系统调用. 不在loop线程里(还没跑起来)才现取
+static uint64_t GetLoopNowMs()
+{
+    IoLoop* io_loop = IoLoop::GetCurrentLoop();
+
+    return io_loop != NULL ? io_loop->GetNowMs() : Util::GetMonotonicMs();
+}
+
 MediaMuxer::MediaMuxer(MediaPublisher* media_publisher)
-    : video_frame_id_(0)
-    , audio_frame_id_(0)
-    , video_frame_recv_count_(0)
+    : video_frame_recv_count_(0)
     , audio_frame_recv_count_(0)
     , video_key_frame_recv_count_(0)
-    , pre_video_key_frame_id_(0)
-    , pre_audio_key_frame_id_(0)
     , video_calc_fps_(0)
     , audio_calc_fps_(0)
     , pre_calc_fps_ms_(0)
-    , ts_seq_(0)
+    , target_duration_(0)
+    , session_(NewSession())
+    , ts_seq_(Util::GetNowMs() / 1000)
     , ts_couter_(0)
     , ts_video_pid_(0x100)
     , ts_audio_pid_(0x101)
     , ts_pmt_pid_(0xABC)
     , ts_pat_continuity_counter_(0)
     , ts_pmt_continuity_counter_(0)
-    , ts_audio_continuity_counter_(0)
-    , ts_video_continuity_counter_(0)
+    , ts_packetizer_(ts_video_pid_, ts_audio_pid_)
+    , ts_muxing_(false)
+    , hls_active_(false)
+    , hls_last_request_ms_(0)
+    , last_dts_(0)
+    , max_dts_gap_(0)
+    , hls_wait_id_(0)
+    , hls_forward_ms_(0)
+    , dash_start_ms_(0)
     , crc_32_(CRC32_HLS)
     , media_publisher_(media_publisher)
 {
@@ -40,11 +187,15 @@ MediaMuxer::MediaMuxer(MediaPublisher* media_publisher)
     adts_header_[4] = 0;
     adts_header_[5] = 0;
     adts_header_[6] = 0;
+
+    PublishHls();
 }
 
 MediaMuxer::~MediaMuxer()
 {
     std::cout << LMSG << std::endl;
+
+    NotifyHlsWaiter(true);
 }
 
 void MediaMuxer::UpdateM3U8()
@@ -57,22 +208,34 @@ void MediaMuxer::UpdateM3U8()
     #EXT-X-MEDIA-SEQUENCE:665
     
     #EXTINF:3.977
-    665.ts
+    18f3a2b4c1d0000_665.ts
     #EXTINF:3.952
-    666.ts
+    18f3a2b4c1d0000_666.ts
     #EXTINF:3.387
-    667.ts
+    18f3a2b4c1d0000_667.ts
     */
 
-    if (ts_queue_.size() < 3)
+    // 镜像只给srt切, 播放列表用源站的
+    if (hls_forward_)
     {
         return;
     }
 
-    uint64_t duration = 0;
-    for (const auto& ts : ts_queue_)
+    // ts_seq_之前的是切好的, ts_seq_是正在切的
+    auto end = ts_queue_.lower_bound(ts_seq_);
+    auto current = ts_queue_.find(ts_seq_);
+    bool low_latency = (hls_part_ms_ != 0);
+
+    // LL-HLS第一个切片还没切完, 有part了也可以先给出去
+    if (ts_queue_.begin() == end && (! low_latency || current == ts_queue_.end() || current->second.parts.empty()))
     {
-        double d = ceil(ts.second.duration);
+        return;
+    }
+
+    uint64_t duration = 1;
+    for (auto iter = ts_queue_.begin(); iter != end; ++iter)
+    {
+        double d = ceil(iter->second.duration);
 
         if (d > duration)
         {
@@ -80,332 +243,345 @@ void MediaMuxer::UpdateM3U8()
         }
     }
 
-    auto riter = ts_queue_.rbegin();
+    target_duration_ = duration;
 
-    uint32_t new_ts_seq = riter->first;
+    auto first = ts_queue_.begin();
 
-    std::ostringstream os;
+    // 最多列最新的3个切片, 刚开始切(或者从GOP缓存补切)的时候有1个就先给出去.
+    // LL-HLS留着的都列上, 老的靠EXT-X-SKIP跳过
+    if (! low_latency)
+    {
+        first = end;
+        for (size_t i = 0; i < kM3U8TsCount && first != ts_queue_.begin(); ++i)
+        {
+            --first;
+        }
+    }
 
-    os << "#EXTM3U\n"
-       << "#EXT-X-VERSION:3\n"
-       << "#EXT-X-ALLOW-CACHE:NO\n"
-       << "#EXT-X-TARGETDURATION:" << duration << "\n"
-       << "#EXT-X-MEDIA-SEQUENCE:" << new_ts_seq << "\n"
-       << "#EXTINF:" << ts_queue_[new_ts_seq - 2].duration << "\n"
-       << (new_ts_seq - 2) << ".ts\n"
-       << "#EXTINF:" << ts_queue_[new_ts_seq - 1].duration << "\n"
-       << (new_ts_seq - 1) << ".ts\n"
-       << "#EXTINF:" << ts_queue_[new_ts_seq].duration << "\n"
-       << new_ts_seq << ".ts\n";
-    
-    os << "\n";
+    // 正在切的切片已经切好的部分
+    double tail = 0;
+    if (current != ts_queue_.end())
+    {
+        for (const auto& part : current->second.parts)
+        {
+            tail += part.duration;
+        }
+    }
 
-    m3u8_ = os.str();
+    // 离列表末尾3个目标时长以内的切片才列part, 6个以外的可以跳过
+    size_t no_part = low_latency ? CountOlderThan(first, end, tail, 3.0 * duration) : 0;
+    size_t skip = low_latency ? CountOlderThan(first, end, tail, 6.0 * duration) : 0;
 
-    std::cout << LMSG << "\n" << TRACE << "\n" << m3u8_ << TRACE << std::endl;
-}
+    m3u8_ = RenderM3U8(first, end, 0, no_part);
+    m3u8_delta_.clear();
 
-void MediaMuxer::PacketTs(const Payload& payload)
-{
-    if (ts_queue_.count(ts_seq_) == 0)
+    if (skip > 0)
     {
-        ts_queue_[ts_seq_].ts_data.reserve(1024*64);
-
-        ts_queue_[ts_seq_].ts_data.append(PacketTsPat());
-        ts_queue_[ts_seq_].ts_data.append(PacketTsPmt());
-        ts_queue_[ts_seq_].first_dts = payload.GetDts();
+        m3u8_delta_ = RenderM3U8(first, end, skip, no_part);
     }
 
-    ts_queue_[ts_seq_].duration = (payload.GetDts() - ts_queue_[ts_seq_].first_dts) / 1000.0;
-
-    const uint8_t* data = payload.GetRawData();
-
-    bool is_video = payload.IsVideo();
+    // 普通的LL-HLS列表每个part都会变, 让CDN每次带ETag来问; 阻塞请求的回应不会过时, 可以缓存6个目标时长
+    std::string cache_control = low_latency ? "no-cache" : "max-age=" + Util::Num2Str(std::max<uint64_t>(1, target_duration_ / 2));
+    std::string blocking_cache_control = "max-age=" + Util::Num2Str(6 * target_duration_);
 
-    uint8_t ts_header_size = 4;
-    uint8_t adaptation_size = 8;
-    uint8_t pes_header_size = 19;
+    RenderHttpWithBody(m3u8_, "application/x-mpegurl", cache_control, m3u8_http_[0]);
+    RenderHttpWithBody(m3u8_, "application/x-mpegurl", blocking_cache_control, m3u8_http_[1]);
+    RenderHttpWithBody(m3u8_delta_, "application/x-mpegurl", cache_control, m3u8_delta_http_[0]);
+    RenderHttpWithBody(m3u8_delta_, "application/x-mpegurl", blocking_cache_control, m3u8_delta_http_[1]);
 
-    if (! is_video)
+    if (hls_fmp4_)
     {
-        adaptation_size = 2;
-        pes_header_size = 14;
+        mpd_ = RenderMpd();
+
+        RenderHttpWithBody(mpd_, "application/dash+xml", "max-age=" + Util::Num2Str(std::max<uint64_t>(1, target_duration_ / 2)), mpd_http_);
     }
 
-    uint64_t i = 0;
-    while (i < payload.GetRawLen())
-    {
-        uint32_t header_size = ts_header_size;
-        uint8_t adaptation_field_control = 1; // 1:无自适应区 2.只有自适应区 3.同时有负载和自适应区
-        uint8_t adaption_stuffing_bytes = 0;
-        uint8_t payload_unit_start_indicator = 0; // 帧首包标识
-        uint8_t extern_data_len = 0;
+    PublishHls();
+    NotifyHlsWaiter(false);
+}
 
-        if (i == 0)
-        {
-            header_size += pes_header_size;
-            payload_unit_start_indicator = 1;
+void MediaMuxer::PublishHls()
+{
+    std::shared_ptr<HlsPlaylist> hls = std::make_shared<HlsPlaylist>();
 
-            if (is_video)
-            {
-                header_size += adaptation_size;
-                adaptation_field_control = 3;
-                extern_data_len = 6; // 添加的nalu分隔符/*00 00 00 01 09 BC*/
-            }
-            else
-            {
-                adaptation_field_control = 1;
-                extern_data_len = 7; // ADTS
-            }
+    hls->session = session_;
+    hls->seq = ts_seq_;
+    hls->muxing = ts_muxing_;
+    hls->target_duration = target_duration_;
 
-            //　音频负载通常小于188,这里要做下处理
-            if (payload.GetRawLen() + ts_header_size + adaptation_size + pes_header_size + extern_data_len < 188)
-            {
-                if (is_video)
-                {
-                    adaption_stuffing_bytes = 188 - (payload.GetRawLen() + ts_header_size + adaptation_size + pes_header_size + extern_data_len/*00 00 00 01 09 BC*/);
-                }
-                else
-                {
-                    adaption_stuffing_bytes = 188 - (payload.GetRawLen() + ts_header_size + adaptation_size + pes_header_size + extern_data_len);
-                }
-
-                //std::cout << LMSG << "payload size:" << payload.GetRawLen() << ", ts_header_size:" << (int)ts_header_size << ", adaptation_size:" << (int)adaptation_size
-                             //<< ",pes_header_size:" << (int)pes_header_size << ",extern_data_len:" << (int)extern_data_len << std::endl;
-
-                if (! is_video)
-                {
-                    header_size += adaptation_size;
-                    adaptation_field_control = 3;
-                }
-
-                header_size += adaption_stuffing_bytes;
-            }
-        }
-        else
+    for (const auto& kv : ts_queue_)
+    {
+        // 切完的不会再变, 上一份里已经有了就接着用
+        if (hls_ && kv.first < hls_->seq)
         {
-            uint32_t left = payload.GetRawLen() - i;
-            
-            if (left + ts_header_size + adaptation_size <= 188)
-            {
-                header_size += adaptation_size;
-                if (left + ts_header_size + adaptation_size == 188)
-                {
-                    header_size -= adaptation_size;
-                    adaptation_field_control = 1;
-                }
-                else
-                {
-                    adaptation_field_control = 3;
-                    adaption_stuffing_bytes = 188 - (left + ts_header_size + adaptation_size);
-                    header_size += adaption_stuffing_bytes;
-                }
-            }
-            else if (left + ts_header_size <= 188)
-            {
-                adaptation_field_control = 1;
-            }
-            else
+            auto iter = hls_->ts.find(kv.first);
+
+            if (iter != hls_->ts.end())
             {
-                adaptation_field_control = 1;
+                hls->ts.insert(*iter);
+                continue;
             }
         }
 
-        BitStream ts_bs;
+        std::shared_ptr<TsMedia> ts_media = std::make_shared<TsMedia>(kv.second);
 
-        // ts header
-        ts_bs.WriteBytes(1, 0x47);  // sync_byte
-        ts_bs.WriteBits(1, 0);      // transport_error_indicator
-        ts_bs.WriteBits(1, payload_unit_start_indicator);      // payload_unit_start_indicator 
-        ts_bs.WriteBits(1, 0);      // transport_priority
-        if (is_video)
+        // 正在切的还会往后写, 给出去的是现在这些数据的快照
+        if (kv.first < ts_seq_)
         {
-            ts_bs.WriteBits(13, ts_video_pid_);    // pid
+            ts_media->segment->SetShared();
         }
         else
         {
-            ts_bs.WriteBits(13, ts_audio_pid_);    // pid
+            ts_media->segment = ts_media->segment->Snapshot();
         }
-        ts_bs.WriteBits(2, 0);              // transport_scrambling_control
-        ts_bs.WriteBits(2, adaptation_field_control);
 
-        if (is_video)
+        hls->ts[kv.first] = ts_media;
+    }
+
+    for (size_t i = 0; i < 2; ++i)
+    {
+        hls->m3u8_http[i] = m3u8_http_[i];
+        hls->m3u8_delta_http[i] = m3u8_delta_http_[i];
+    }
+
+    hls->mpd_http = mpd_http_;
+    hls->init_http = init_http_;
+
+    hls_ = hls;
+}
+
+void MediaMuxer::SetHlsPlaylist(const std::shared_ptr<const HlsPlaylist>& hls)
+{
+    hls_ = hls;
+
+    NotifyHlsWaiter(! hls_->muxing);
+}
+
+std::string MediaMuxer::RenderM3U8(std::map<uint64_t, TsMedia>::const_iterator first, std::map<uint64_t, TsMedia>::const_iterator end,
+                                   const size_t& skip, const size_t& no_part)
+{
+    bool low_latency = (hls_part_ms_ != 0);
+    const char* ext = hls_fmp4_ ? "m4s" : "ts";
+
+    std::ostringstream os;
+
+    os << "#EXTM3U\n"
+       << "#EXT-X-VERSION:" << (low_latency ? 9 : (hls_fmp4_ ? 6 : 3)) << "\n";
+
+    if (! low_latency)
+    {
+        os << "#EXT-X-ALLOW-CACHE:NO\n";
+    }
+
+    os << "#EXT-X-TARGETDURATION:" << target_duration_ << "\n";
+
+    if (low_latency)
+    {
+        double part_target = hls_part_ms_ / 1000.0;
+
+        os << "#EXT-X-SERVER-CONTROL:CAN-BLOCK-RELOAD=YES,CAN-SKIP-UNTIL=" << 6 * target_duration_ << ",PART-HOLD-BACK=" << 3 * part_target << "\n"
+           << "#EXT-X-PART-INF:PART-TARGET=" << part_target << "\n";
+    }
+
+    os << "#EXT-X-MEDIA-SEQUENCE:" << (first == end ? ts_seq_ : first->first) << "\n";
+
+    if (skip > 0)
+    {
+        os << "#EXT-X-SKIP:SKIPPED-SEGMENTS=" << skip << "\n";
+    }
+
+    if (hls_fmp4_)
+    {
+        os << "#EXT-X-MAP:URI=\"init.mp4\"\n";
+    }
+
+    size_t index = 0;
+    for (auto iter = first; iter != end; ++iter, ++index)
+    {
+        if (index < skip)
         {
-            ts_bs.WriteBits(4, GetVideoContinuityCounter());
+            continue;
         }
-        else
+
+        if (low_latency && index >= no_part)
         {
-            ts_bs.WriteBits(4, GetAudioContinuityCounter());
+            WriteParts(os, session_, iter->first, iter->second, ext);
         }
 
-        if (adaptation_field_control == 2 || adaptation_field_control == 3)
-        {
-            // adaption
-            if (is_video)
-            {
-                if (payload_unit_start_indicator == 1)
-                {
-                    // 视频而且是帧的首个包才需要PCR
-                    ts_bs.WriteBytes(1, 7 + adaption_stuffing_bytes);
-                    ts_bs.WriteBytes(1, 0x10);
-                }
-                else
-                {
-                    ts_bs.WriteBytes(1, 1 + adaption_stuffing_bytes);
-                    ts_bs.WriteBytes(1, 0x00);
-                }
-
-
-                if (payload_unit_start_indicator == 1)
-                {
-                    uint64_t dts = payload.GetDts() / 1000; // unit: second
-
-                    // REF:http://blog.csdn.net/xiaojun111111/article/details/40583075
-                    uint64_t pcr_base = (27000000UL * dts / 300) % (2UL<<33);
-                    uint16_t pcr_ext = (27000000UL * dts / 1) % 300;
-
-                    ts_bs.WriteBits(33, pcr_base);
-                    ts_bs.WriteBits(6, 0x00);
-                    ts_bs.WriteBits(9, pcr_ext);
-                }
-                else
-                {
-                    header_size -= 6;
-                }
-            }
-            else
-            {
-                // 音频不需要PCR
-                ts_bs.WriteBytes(1, 1 + adaption_stuffing_bytes);
-                // audio no pcr
-                ts_bs.WriteBytes(1, 0x00);
-            }
+        os << "#EXTINF:" << iter->second.duration << "\n"
+           << session_ << "_" << iter->first << "." << ext << "\n";
+    }
 
-            if (adaption_stuffing_bytes > 0)
-            {
-                for (uint8_t i = 0; i != adaption_stuffing_bytes; ++i)
-                {
-                    ts_bs.WriteBytes(1, 0xFF);
-                }
-            }
-        }
+    if (low_latency)
+    {
+        size_t next_part = 0;
+        auto current = ts_queue_.find(ts_seq_);
 
-        if (payload_unit_start_indicator == 1)
+        if (current != ts_queue_.end())
         {
-            // pes
-            ts_bs.WriteBytes(3, (uint32_t)0x000001);
-            if (is_video)
-            {
-                ts_bs.WriteBytes(1, 0xe0);
-            }
-            else
-            {
-                ts_bs.WriteBytes(1, 0xc0);
-            }
+            WriteParts(os, session_, ts_seq_, current->second, ext);
+            next_part = current->second.parts.size();
+        }
 
-            if (is_video)
-            {
-                // 视频的PES长度这里随便填,无所谓
-                ts_bs.WriteBytes(2, 0x0000);
-            }
-            else
-            {
-                // 音频的一定是音频负载长度+3(PES后面3个flag)+5(只有DTS)+7(adts头长度)
-                ts_bs.WriteBytes(2, (uint64_t)payload.GetRawLen() + 3 + 5 + 7);
-            }
+        os << "#EXT-X-PRELOAD-HINT:TYPE=PART,URI=\"" << session_ << "_" << ts_seq_ << "." << next_part << "." << ext << "\"\n";
+    }
+    
+    os << "\n";
+
+    return os.str();
+}
 
-            ts_bs.WriteBytes(1, 0x80);
+std::string MediaMuxer::RenderMpd()
+{
+    // DASH只列切好的, 跟HLS共用切片和init
+    auto end = ts_queue_.lower_bound(ts_seq_);
 
-            uint64_t pts = payload.GetPts() * 90;
-            uint64_t dts = payload.GetDts() * 90;
+    if (ts_queue_.begin() == end)
+    {
+        return "";
+    }
 
-            if (is_video)
-            {
-                ts_bs.WriteBytes(1, 0xc0);
-                ts_bs.WriteBytes(1, 10);
-            }
-            else
-            {
-                // 音频只需要PTS即可
-                ts_bs.WriteBytes(1, 0x80);
-                ts_bs.WriteBytes(1, 5);
-            }
+    double total_duration = 0;
+    uint64_t total_bytes = 0;
+    for (auto iter = ts_queue_.begin(); iter != end; ++iter)
+    {
+        total_duration += iter->second.duration;
+        total_bytes += iter->second.segment->GetSize();
+    }
 
-            uint16_t t_32_30 = (pts & 0x00000001C0000000) >> 30;
-            uint16_t t_29_15 = (pts & 0x000000003FFF8000) >> 15;
-            uint16_t t_14_0  = (pts & 0x0000000000007FFF);
+    const TsMedia& last = std::prev(end)->second;
+    uint64_t end_dts = (uint64_t)last.first_dts + (uint64_t)llround(last.duration * 1000);
 
-            // pts
-            ts_bs.WriteBits(4, 0x02);
-            ts_bs.WriteBits(3, t_32_30);
-            ts_bs.WriteBits(1, 1);
-            ts_bs.WriteBits(15, t_29_15);
-            ts_bs.WriteBits(1, 1);
-            ts_bs.WriteBits(15, t_14_0);
-            ts_bs.WriteBits(1, 1);
+    // 时间戳0对应的墙上时间, 第一次出MPD的时候定下来, 后面不变
+    if (dash_start_ms_ == 0)
+    {
+        dash_start_ms_ = Util::GetNowMs() - end_dts;
+    }
 
-            t_32_30 = (dts & 0x00000001C0000000) >> 30;
-            t_29_15 = (dts & 0x000000003FFF8000) >> 15;
-            t_14_0  = (dts & 0x0000000000007FFF);
+    uint64_t bandwidth = total_duration > 0 ? (uint64_t)(total_bytes * 8 / total_duration) : 0;
+    bool has_video = fmp4_packetizer_.HasVideo();
 
-            if (is_video)
-            {
-                // XXX:DTS跟PTS一样的话要不要打还未知
-                //if (dts != pts)
-
-                {
-                    // dts
-                    ts_bs.WriteBits(4, 0x02);
-                    ts_bs.WriteBits(3, t_32_30);
-                    ts_bs.WriteBits(1, 1);
-                    ts_bs.WriteBits(15, t_29_15);
-                    ts_bs.WriteBits(1, 1);
-                    ts_bs.WriteBits(15, t_14_0);
-                    ts_bs.WriteBits(1, 1);
-                }
-                //else
-                //{
-                //    header_size -= 5;
-                //}
-            }
+    std::ostringstream os;
 
-            if (is_video)
-            {
-                // split nalu
-                ts_bs.WriteBytes(4, 0x00000001);
-                ts_bs.WriteBytes(1, 0x09); // 分隔符
-                ts_bs.WriteBytes(1, 0x10); // 这个随便填
-                header_size += 6;
-            }
-        }
+    os << "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+       << "<MPD xmlns=\"urn:mpeg:dash:schema:mpd:2011\" profiles=\"urn:mpeg:dash:profile:isoff-live:2011\" type=\"dynamic\"\n"
+       << "    availabilityStartTime=\"" << FormatUtc(dash_start_ms_) << "\" publishTime=\"" << FormatUtc(Util::GetNowMs()) << "\"\n"
+       << "    minimumUpdatePeriod=\"PT" << target_duration_ << "S\" minBufferTime=\"PT" << target_duration_ << "S\"\n"
+       << "    timeShiftBufferDepth=\"PT" << total_duration << "S\" suggestedPresentationDelay=\"PT" << 3 * target_duration_ << "S\">\n"
+       << "  <Period id=\"0\" start=\"PT0S\">\n"
+       << "    <AdaptationSet id=\"0\" mimeType=\"" << (has_video ? "video/mp4" : "audio/mp4") << "\" segmentAlignment=\"true\" startWithSAP=\"1\">\n";
 
-        //VERBOSE << LMSG << "header_size:" << header_size << ",ts_bs.SizeInBytes():" << ts_bs.SizeInBytes() << ",is_video:" << is_video << std::endl;
-        assert(header_size == ts_bs.SizeInBytes());
+    // 音视频在同一个切片里, 一个Representation
+    os << "      <Representation id=\"0\" codecs=\"" << fmp4_packetizer_.GetCodecs() << "\" bandwidth=\"" << bandwidth << "\"";
 
-        // SPS PPS before I frame
-        if (i == 0 && is_video)
-        {
-            if (payload.IsIFrame())
-            {
-                // nalu type在payload的第一个字节
-                ts_bs.WriteBytes(4, 0x00000001);
-                ts_bs.WriteData(sps_.size(), (const uint8_t*)sps_.data());
+    if (has_video)
+    {
+        os << " width=\"" << fmp4_packetizer_.GetWidth() << "\" height=\"" << fmp4_packetizer_.GetHeight() << "\"";
+    }
 
-                ts_bs.WriteBytes(4, 0x00000001);
-                ts_bs.WriteData(pps_.size(), (const uint8_t*)pps_.data());
+    os << ">\n"
+       << "        <SegmentTemplate timescale=\"1000\" initialization=\"init.mp4\" media=\"" << session_ << "_$Number$.m4s\" startNumber=\"" << ts_queue_.begin()->first << "\">\n"
+       << "          <SegmentTimeline>\n";
 
-                ts_bs.WriteBytes(4, 0x00000001);
-                //ts_bs.WriteBytes(1, 0x65);
-                //VERBOSE << LMSG << frame_key << " I frame" << std::endl;
-            }
-            else
+    for (auto iter = ts_queue_.begin(); iter != end; ++iter)
+    {
+        os << "            <S t=\"" << (uint64_t)iter->second.first_dts << "\" d=\"" << llround(iter->second.duration * 1000) << "\"/>\n";
+    }
+
+    os << "          </SegmentTimeline>\n"
+       << "        </SegmentTemplate>\n"
+       << "      </Representation>\n"
+       << "    </AdaptationSet>\n"
+       << "  </Period>\n"
+       << "</MPD>\n";
+
+    return os.str();
+}
+
+void MediaMuxer::PacketTs(const Payload& payload)
+{
+    TsMedia& ts_media = ts_queue_[ts_seq_];
+
+    if (! ts_media.segment)
+    {
+        ts_media.segment = std::make_shared<TsSegment>();
+        ts_media.create_ms = Util::GetNowMs();
+        ts_media.first_dts = payload.GetDts();
+        ts_media.part_first_dts = payload.GetDts();
+
+        StartPart(ts_media);
+    }
+    else if (hls_part_ms_ != 0 && NeedCutPart(ts_media, payload.GetDts()))
+    {
+        CutPart(ts_media, payload.GetDts());
+
+        ts_media.part_first_dts = payload.GetDts();
+
+        StartPart(ts_media);
+        UpdateM3U8();
+    }
+
+    ts_media.duration = (payload.GetDts() - ts_media.first_dts) / 1000.0;
+
+    // 音视频交织后相邻两帧的最大间隔, 超过part时长的是断流, 不算
+    if (payload.GetDts() > last_dts_ && payload.GetDts() - last_dts_ < hls_part_ms_ && payload.GetDts() - last_dts_ > max_dts_gap_)
+    {
+        max_dts_gap_ = payload.GetDts() - last_dts_;
+    }
+
+    last_dts_ = payload.GetDts();
+
+    // part里有IDR(纯音频的都算)才能独立解码
+    if (payload.IsIFrame() || ! HasVideoHeader())
+    {
+        ts_media.part_independent = true;
+    }
+
+    // fMP4的切片由fmp4_packetizer_写, ts只给srt打
+    if (hls_fmp4_)
+    {
+        // 视频帧在MuxTs里已经加过了
+        if (payload.IsAudio())
+        {
+            fmp4_packetizer_.AddSample(payload);
+        }
+
+        if (media_publisher_ != NULL && media_publisher_->GetSubscriber().HasType(kSrt))
+        {
+            if (! srt_segment_ || srt_segment_->GetSize() > kSrtSegmentSize)
             {
-                // P/B
-                ts_bs.WriteBytes(4, 0x00000001);
+                srt_segment_ = std::make_shared<TsSegment>();
             }
+
+            SendSrt(*srt_segment_, PacketTsFrame(payload, *srt_segment_));
         }
 
-        if (i == 0 && ! is_video && audio_header_.size() >= 2)
+        return;
+    }
+
+    size_t count = PacketTsFrame(payload, *ts_media.segment);
+
+    if (media_publisher_ != NULL && media_publisher_->GetSubscriber().HasType(kSrt))
+    {
+        SendSrt(*ts_media.segment, count);
+    }
+}
+
+size_t MediaMuxer::PacketTsFrame(const Payload& payload, TsSegment& out)
+{
+    size_t count = 0;
+
+    if (payload.IsVideo())
+    {
+        const std::string& annexb = PacketAnnexB(payload);
+
+        count = ts_packetizer_.PacketVideo((const uint8_t*)annexb.data(), annexb.size(), payload.GetPts(), payload.GetDts(), out);
+    }
+    else
+    {
+        const uint8_t* adts = NULL;
+
+        if (audio_header_.size() >= 2)
         {
             uint16_t adts_len = (uint16_t)payload.GetRawLen() + 7;
 
@@ -415,36 +591,142 @@ void MediaMuxer::PacketTs(const Payload& payload)
             adts_header_[5] &= 0x1F;
             adts_header_[5] |= ((uint8_t)((adts_len & 0x07) << 5) & 0xe0);  //frame length:value,低3bits
 
-            uint16_t calc_len = ((adts_header_[3] & 0x03) << 11) | ((uint16_t)adts_header_[4] << 3) | ((adts_header_[5] & 0xE0) >> 5);
+            adts = adts_header_;
+        }
 
-            assert(adts_len == calc_len);
+        count = ts_packetizer_.PacketAudio(payload.GetRawData(), payload.GetRawLen(), adts, payload.GetPts(), out);
+    }
 
-            ts_bs.WriteData(7, adts_header_);
-        }
+    return count;
+}
+
+void MediaMuxer::SendSrt(const TsSegment& segment, const size_t& count)
+{
+    const uint8_t* packet = segment.GetTail(count * TsPacketizer::kTsPacketSize);
+
+    for (size_t i = 0; i < count; ++i, packet += TsPacketizer::kTsPacketSize)
+    {
+        media_publisher_->GetSubscriber().SendData(kSrt, std::string((const char*)packet, TsPacketizer::kTsPacketSize));
+    }
+}
+
+void MediaMuxer::StartPart(TsMedia& ts_media)
+{
+    ts_media.part_offset = ts_media.segment->GetSize();
+    ts_media.part_independent = false;
 
-        int bytes_left = 188 - ts_bs.SizeInBytes();
+    // fMP4的part就是一个moof+mdat, 不用PAT/PMT
+    if (hls_fmp4_)
+    {
+        return;
+    }
 
-        assert(bytes_left > 0);
+    // 每个part都以PAT/PMT开头, 播放器从哪个part开始拉都能解
+    const std::string& pat = PacketTsPat();
+    ts_media.segment->Append((const uint8_t*)pat.data(), pat.size());
 
-        ts_bs.WriteData(bytes_left, data);
+    const std::string& pmt = PacketTsPmt();
+    ts_media.segment->Append((const uint8_t*)pmt.data(), pmt.size());
+}
 
-        assert(ts_bs.SizeInBytes() == 188);
-        ts_queue_[ts_seq_].ts_data.append((const char*)ts_bs.GetData(), ts_bs.SizeInBytes());
+bool MediaMuxer::NeedCutPart(const TsMedia& ts_media, const uint64_t& dts) const
+{
+    if (dts <= ts_media.part_first_dts)
+    {
+        return false;
+    }
 
-        if (media_publisher_ != NULL)
+    // 下一帧最晚在max_dts_gap_之后来, 放进这一帧可能超过part时长就在这一帧前面切, part时长不超过PART-TARGET
+    return dts - ts_media.part_first_dts + max_dts_gap_ > hls_part_ms_;
+}
+
+void MediaMuxer::CutPart(TsMedia& ts_media, const uint64_t& dts)
+{
+    if (hls_fmp4_)
+    {
+        fmp4_packetizer_.Flush(*ts_media.segment);
+    }
+
+    TsPart part;
+
+    part.offset = ts_media.part_offset;
+    part.len = ts_media.segment->GetSize() - ts_media.part_offset;
+    part.duration = (dts - ts_media.part_first_dts) / 1000.0;
+    part.independent = ts_media.part_independent;
+
+    ts_media.parts.push_back(part);
+
+    RenderPartHttp(ts_seq_, ts_media, ts_media.parts.back());
+}
+
+void MediaMuxer::RenderPartHttp(const uint64_t& seq, const TsMedia& ts_media, TsPart& part)
+{
+    std::ostringstream etag;
+    etag << "\"" << session_ << "_" << seq << "." << ts_media.parts.size() - 1 << "\"";
+
+    RenderHttp(hls_fmp4_ ? "video/iso.segment" : "video/mp2t", part.len, kHlsSegmentCacheControl, etag.str(), ts_media.create_ms / 1000, part.http);
+}
+
+void MediaMuxer::RenderSegmentHttp(const uint64_t& seq, TsMedia& ts_media)
+{
+    std::ostringstream etag;
+    etag << "\"" << session_ << "_" << seq << "\"";
+
+    RenderHttp(hls_fmp4_ ? "video/iso.segment" : "video/mp2t", ts_media.segment->GetSize(), kHlsSegmentCacheControl, etag.str(), ts_media.create_ms / 1000, ts_media.http);
+}
+
+void MediaMuxer::UpdateInitHttp()
+{
+    if (! hls_fmp4_)
+    {
+        return;
+    }
+
+    const std::string& init = fmp4_packetizer_.GetInit();
+
+    // 重新推流音视频参数可能变, 地址不变, 不能一直缓存
+    RenderHttpWithBody(init, "video/mp4", "no-cache", init_http_);
+}
+
+const std::string& MediaMuxer::PacketAnnexB(const Payload& payload)
+{
+    annexb_.clear();
+
+    bool has_sps = false;
+    for (size_t i = 0; i < payload.GetNaluCount(); ++i)
+    {
+        uint32_t len = 0;
+        if ((payload.GetNalu(i, len)[0] & 0x1F) == H264NalType_SPS)
         {
-            for (const auto& sub : media_publisher_->GetSubscriber())
-            {
-                if (sub->IsSrt())
-                {
-                    sub->SendData(std::string((const char*)ts_bs.GetData(), ts_bs.SizeInBytes()));
-                }
-            }
+            has_sps = true;
         }
+    }
 
-        data += bytes_left;
-        i += bytes_left;
+    // IDR前面带上SPS PPS, 帧里自己带了就不加
+    if (payload.IsIFrame() && ! has_sps)
+    {
+        annexb_.append((const char*)kStartCode, 4);
+        annexb_.append(sps_);
+        annexb_.append((const char*)kStartCode, 4);
+        annexb_.append(pps_);
     }
+
+    for (size_t i = 0; i < payload.GetNaluCount(); ++i)
+    {
+        uint32_t len = 0;
+        const uint8_t* nalu = payload.GetNalu(i, len);
+
+        // AUD在PES头后面统一加了
+        if (len == 0 || (nalu[0] & 0x1F) == H264NalType_AUD)
+        {
+            continue;
+        }
+
+        annexb_.append((const char*)kStartCode, 4);
+        annexb_.append((const char*)nalu, len);
+    }
+
+    return annexb_;
 }
 
 std::string& MediaMuxer::PacketTsPat()
@@ -572,61 +854,312 @@ std::string& MediaMuxer::PacketTsPmt()
 
 int MediaMuxer::OnAudio(const Payload& audio_payload)
 {
-    audio_queue_.insert(std::make_pair(audio_frame_id_, audio_payload));
+    gop_cache_.Push(audio_payload);
 
-    PacketTs(audio_payload);
+    if (NeedMuxTs())
+    {
+        MuxTs(audio_payload);
+    }
 
     ++audio_frame_recv_count_;
-    ++audio_frame_id_;
     ++audio_calc_fps_;
 
-    // XXX:可以放到定时器,满了就以后肯定都是满了,不用每次都判断
-    if (((audio_calc_fps_ != 0 && audio_queue_.size() > 20 * audio_calc_fps_) || audio_queue_.size() >= 800) && ts_queue_.size() > 10)
+    return kSuccess;
+}
+
+int MediaMuxer::OnVideo(const Payload& video_payload)
+{
+    if (video_payload.IsIFrame())
     {
-        audio_queue_.erase(audio_queue_.begin());
+        ++video_key_frame_recv_count_;
     }
 
+    gop_cache_.Push(video_payload);
+
+    if (NeedMuxTs())
+    {
+        MuxTs(video_payload);
+    }
+
+    ++video_frame_recv_count_;
+    ++video_calc_fps_;
+
     return kSuccess;
 }
 
-int MediaMuxer::OnVideo(const Payload& video_payload)
+void MediaMuxer::OnHlsRequest()
 {
-    if (video_payload.IsIFrame())
+    hls_last_request_ms_ = GetLoopNowMs();
+
+    // 镜像不自己切, 源站按最后一次请求算空闲
+    if (hls_forward_)
     {
-        if (pre_video_key_frame_id_ != 0)
+        if (hls_forward_ms_ == 0 || hls_last_request_ms_ - hls_forward_ms_ >= kHlsForwardIntervalMs)
         {
-            // 打包ts
-            UpdateM3U8();
-            ++ts_seq_;
+            hls_forward_ms_ = hls_last_request_ms_;
+            hls_forward_();
         }
 
-        ++video_key_frame_recv_count_;
+        return;
+    }
 
-        pre_video_key_frame_id_ = video_frame_id_;
-        pre_audio_key_frame_id_ = audio_frame_id_;
+    if (hls_active_)
+    {
+        return;
     }
 
-    video_queue_.insert(std::make_pair(video_frame_id_, video_payload));
+    hls_active_ = true;
 
-    PacketTs(video_payload);
+    std::cout << LMSG << "hls start, app:" << app_ << ",stream:" << stream_ << ",gop cache:" << gop_cache_.ToString() << std::endl;
 
-    ++video_frame_recv_count_;
-    ++video_frame_id_;
-    ++video_calc_fps_;
+    // srt在拉的话一直在切, 接着切就行
+    if (ts_muxing_)
+    {
+        return;
+    }
+
+    ts_muxing_ = true;
 
-    // XXX:可以放到定时器,满了就以后肯定都是满了,不用每次都判断
-    if (((video_calc_fps_ != 0 && video_queue_.size() > 20 * video_calc_fps_) || video_queue_.size() >= 800) && ts_queue_.size() > 10)
+    // 从缓存里第一个IDR开始补切, 纯音频的流全补
+    bool wait_key_frame = HasVideoHeader();
+
+    for (uint64_t seq = gop_cache_.GetBegin(); seq != gop_cache_.GetEnd(); ++seq)
     {
-        if (video_queue_.begin()->second.IsIFrame())
+        const Payload& payload = gop_cache_.Get(seq);
+
+        if (wait_key_frame)
+        {
+            if (! payload.IsVideo() || ! payload.IsIFrame())
+            {
+                continue;
+            }
+
+            wait_key_frame = false;
+        }
+
+        MuxTs(payload);
+    }
+}
+
+bool MediaMuxer::NeedMuxTs()
+{
+    if (hls_active_ && hls_idle_ms_ != 0 && GetLoopNowMs() - hls_last_request_ms_ > hls_idle_ms_)
+    {
+        std::cout << LMSG << "hls idle, app:" << app_ << ",stream:" << stream_ << std::endl;
+        hls_active_ = false;
+    }
+
+    bool need = hls_active_ || (media_publisher_ != NULL && media_publisher_->GetSubscriber().HasType(kSrt));
+
+    if (! need && ts_muxing_)
+    {
+        StopTs();
+    }
+    else if (need && ! ts_muxing_)
+    {
+        ts_muxing_ = true;
+    }
+
+    return need;
+}
+
+void MediaMuxer::MuxTs(const Payload& payload)
+{
+    // 有视频的流第一个IDR之前的不要, 不然会先切出个只有音频的空切片
+    if (ts_queue_.count(ts_seq_) == 0 && HasVideoHeader() && ! (payload.IsVideo() && payload.IsIFrame()))
+    {
+        return;
+    }
+
+    // 视频帧来了上一帧才有时长, 这一帧自己还攒着, 所以要在切之前加, 上一帧才能写进老切片
+    if (hls_fmp4_ && payload.IsVideo())
+    {
+        fmp4_packetizer_.AddSample(payload);
+    }
+
+    // 切片都从IDR开始
+    if (payload.IsVideo() && payload.IsIFrame() && ts_queue_.count(ts_seq_) != 0)
+    {
+        TsMedia& ts_media = ts_queue_[ts_seq_];
+
+        // 时长算到下一个IDR
+        ts_media.duration = (payload.GetDts() - ts_media.first_dts) / 1000.0;
+
+        if (hls_fmp4_)
+        {
+            fmp4_packetizer_.Flush(*ts_media.segment);
+        }
+
+        if (hls_part_ms_ != 0)
+        {
+            CutPart(ts_media, payload.GetDts());
+        }
+
+        RenderSegmentHttp(ts_seq_, ts_media);
+
+        ++ts_seq_;
+
+        // 所有流的切片超了预算就只留m3u8里还列着的
+        while (ts_queue_.size() > kMaxTsCount || (TsSegment::IsOverBudget() && ts_queue_.size() > kM3U8TsCount))
         {
             std::cout << LMSG << "erase " << ts_queue_.begin()->first << ".ts" << std::endl;
             ts_queue_.erase(ts_queue_.begin());
         }
 
-        video_queue_.erase(video_queue_.begin());
+        UpdateM3U8();
     }
 
-    return kSuccess;
+    PacketTs(payload);
+}
+
+void MediaMuxer::StopTs()
+{
+    std::cout << LMSG << "ts mux stop, app:" << app_ << ",stream:" << stream_ << std::endl;
+
+    // 序号接着往后排, 重新开始切的时候不会跟播放器手里的老切片重名
+    if (ts_queue_.count(ts_seq_) != 0)
+    {
+        ++ts_seq_;
+    }
+
+    ts_queue_.clear();
+    m3u8_.clear();
+    m3u8_delta_.clear();
+    ts_muxing_ = false;
+
+    fmp4_packetizer_.Reset();
+    srt_segment_.reset();
+    mpd_.clear();
+    dash_start_ms_ = 0;
+
+    for (size_t i = 0; i < 2; ++i)
+    {
+        m3u8_http_[i] = HttpCache();
+        m3u8_delta_http_[i] = HttpCache();
+    }
+
+    mpd_http_ = HttpCache();
+
+    // 镜像的播放列表是源站给的, 只是srt不拉了
+    if (hls_forward_)
+    {
+        return;
+    }
+
+    PublishHls();
+    NotifyHlsWaiter(true);
+}
+
+bool MediaMuxer::HasPlaylistFor(const uint64_t& msn, const int64_t& part) const
+{
+    if (! HasM3U8())
+    {
+        return false;
+    }
+
+    // 切片msn已经切完了
+    if (msn < hls_->seq)
+    {
+        return true;
+    }
+
+    if (msn > hls_->seq || part < 0)
+    {
+        return false;
+    }
+
+    auto iter = hls_->ts.find(hls_->seq);
+
+    return iter != hls_->ts.end() && (size_t)part < iter->second->parts.size();
+}
+
+int MediaMuxer::GetTsPart(const uint64_t& ts, const size_t& part, std::shared_ptr<TsSegment>& segment, size_t& offset, size_t& len, const HttpCache*& http) const
+{
+    auto iter = hls_->ts.find(ts);
+
+    if (iter == hls_->ts.end())
+    {
+        // 下一个切片还没开始切
+        return (hls_->muxing && ts == hls_->seq && part == 0) ? kNoEnoughData : kError;
+    }
+
+    const TsMedia& ts_media = *iter->second;
+
+    if (part < ts_media.parts.size())
+    {
+        segment = ts_media.segment;
+        offset = ts_media.parts[part].offset;
+        len = ts_media.parts[part].len;
+        http = &ts_media.parts[part].http;
+
+        return kSuccess;
+    }
+
+    if (ts == hls_->seq && part == ts_media.parts.size())
+    {
+        return kNoEnoughData;
+    }
+
+    return kError;
+}
+
+uint64_t MediaMuxer::WaitHls(const HlsCallback& callback)
+{
+    uint64_t wait_id = ++hls_wait_id_;
+
+    hls_waiter_[wait_id] = callback;
+
+    return wait_id;
+}
+
+void MediaMuxer::CancelHlsWait(const uint64_t& wait_id)
+{
+    hls_waiter_.erase(wait_id);
+}
+
+void MediaMuxer::NotifyHlsWaiter(const bool& stopped)
+{
+    if (hls_waiter_.empty())
+    {
+        return;
+    }
+
+    // 不切了就全部清掉再回调, 回调里不用再取消
+    if (stopped)
+    {
+        std::map<uint64_t, HlsCallback> hls_waiter;
+        hls_waiter.swap(hls_waiter_);
+
+        for (const auto& kv : hls_waiter)
+        {
+            kv.second(true);
+        }
+
+        return;
+    }
+
+    // 回调里会取消等待, 先把id拿出来, 回调前再确认还在等
+    std::vector<uint64_t> wait_ids;
+    wait_ids.reserve(hls_waiter_.size());
+
+    for (const auto& kv : hls_waiter_)
+    {
+        wait_ids.push_back(kv.first);
+    }
+
+    for (const auto& wait_id : wait_ids)
+    {
+        auto iter = hls_waiter_.find(wait_id);
+
+        if (iter == hls_waiter_.end())
+        {
+            continue;
+        }
+
+        HlsCallback callback = iter->second;
+
+        callback(stopped);
+    }
 }
 
 int MediaMuxer::OnMetaData(const std::string& metadata)
@@ -778,6 +1311,9 @@ int MediaMuxer::OnVideoHeader(const std::string& video_header)
         }
     }
 
+    fmp4_packetizer_.SetVideoConfig(sps_, pps_);
+    UpdateInitHttp();
+
     return kSuccess;
 }
 
@@ -856,61 +1392,19 @@ int MediaMuxer::OnAudioHeader(const std::string& audio_header)
     adts_header_[5] |= 0x1f;                                 //buffer fullness:0x7ff 高5bits 
     adts_header_[6] = 0xfc;
 
-    return kSuccess;
-}
-
-std::vector<Payload> MediaMuxer::GetFastOut()
-{
-	auto iter_video = video_queue_.find(pre_video_key_frame_id_);
-    auto iter_audio = audio_queue_.find(pre_audio_key_frame_id_);
-
-	std::vector<Payload> fast_out;
-
-    while (iter_audio != audio_queue_.end() || iter_video != video_queue_.end())
-    {    
-        if (iter_audio == audio_queue_.end())
-        {    
-            fast_out.push_back(iter_video->second);
-            ++iter_video;
-        }    
-        else if (iter_video == video_queue_.end())
-        {    
-            fast_out.push_back(iter_audio->second);
-            ++iter_audio;
-        }    
-        else 
-        {    
-            if (iter_audio->second.GetDts() > iter_video->second.GetDts())
-            {    
-                fast_out.push_back(iter_video->second);
-                ++iter_video;
-            }    
-            else 
-            {    
-                fast_out.push_back(iter_audio->second);
-                ++iter_audio;
-            }    
-        }    
-    }
+    fmp4_packetizer_.SetAudioConfig(audio_header_);
+    UpdateInitHttp();
 
-    return fast_out;
+    return kSuccess;
 }
 
 int MediaMuxer::EveryNSecond(const uint64_t& now_in_ms, const uint32_t& interval, const uint64_t& count)
 {
     UNUSED(count);
 
-    if (! video_queue_.empty())
-    {
-        std::cout << LMSG << "video queue:" << video_queue_.size() << " [" << video_queue_.begin()->first << "-" << video_queue_.rbegin()->first << "]" << std::endl;
-    }
-
-    if (! audio_queue_.empty())
-    {
-        std::cout << LMSG << "audio queue:" << audio_queue_.size() << " [" << audio_queue_.begin()->first << "-" << audio_queue_.rbegin()->first << "]" << std::endl;
-    }
+    std::cout << LMSG << "gop cache:" << gop_cache_.ToString() << std::endl;
 
-    std::cout << LMSG << "ts queue:" << ts_queue_.size() << std::endl;
+    std::cout << LMSG << "ts queue:" << ts_queue_.size() << ",all segment bytes:" << TsSegment::GetTotalBytes() << std::endl;
 
     if (pre_calc_fps_ms_ == 0)
     {
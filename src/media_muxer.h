@@ -4,15 +4,20 @@
 #include <stdint.h>
 #include <stddef.h>
 
+#include <functional>
 #include <map>
+#include <memory>
 #include <sstream>
 #include <set>
 #include <vector>
 
 #include "crc32.h"
+#include "fmp4_packetizer.h"
+#include "gop_cache.h"
 #include "media_struct.h"
 #include "ref_ptr.h"
 #include "socket_util.h"
+#include "ts_packetizer.h"
 
 class MediaPublisher;
 
@@ -34,21 +39,121 @@ public:
         stream_ = name;
     }
 
-    std::string GetM3U8()
+    const std::string& GetM3U8() const
     {
         return m3u8_;
     }
 
-    const std::string& GetTs(const uint64_t& ts) const
+    // 带_HLS_skip=YES的请求用这个, 没有能跳过的切片就是完整的
+    const std::string& GetM3U8Delta() const
     {
-        auto iter = ts_queue_.find(ts);
+        return m3u8_delta_.empty() ? m3u8_ : m3u8_delta_;
+    }
+
+    // 下面回HLS请求的都从hls_取, 源站和镜像是同一份
+
+    // 播放列表更新时生成好的响应. blocking是LL-HLS阻塞请求的, CDN可以缓存久一点
+    const HttpCache& GetM3U8Http(const bool& delta, const bool& blocking) const
+    {
+        if (delta && ! hls_->m3u8_delta_http[blocking].ok.empty())
+        {
+            return hls_->m3u8_delta_http[blocking];
+        }
+
+        return hls_->m3u8_http[blocking];
+    }
+
+    bool IsLowLatency() const
+    {
+        return hls_part_ms_ != 0;
+    }
+
+    // 切片是fMP4(CMAF), 同一套切片给HLS(EXT-X-MAP)和DASH用
+    bool IsFmp4() const
+    {
+        return hls_fmp4_;
+    }
+
+    // fMP4的init, 不是fMP4或者还没有音视频头时为空
+    const HttpCache& GetFmp4InitHttp() const
+    {
+        return hls_->init_http;
+    }
+
+    const std::string& GetMpd() const
+    {
+        return mpd_;
+    }
+
+    const HttpCache& GetMpdHttp() const
+    {
+        return hls_->mpd_http;
+    }
+
+    // 每次推流(源站的MediaMuxer)不一样, 切片地址和ETag都带上, 重新推流后CDN不会拿到旧的
+    const std::string& GetSession() const
+    {
+        return hls_->session;
+    }
+
+    uint64_t GetTargetDurationMs() const
+    {
+        return hls_->target_duration * 1000;
+    }
+
+    // 还没有播放列表(刚开始切, 或者镜像还没收到源站的)
+    bool HasM3U8() const
+    {
+        return ! hls_->m3u8_http[0].ok.empty();
+    }
+
+    // LL-HLS阻塞刷新, 播放列表里有了切片msn或者更新的才算有, part>=0时是切片msn的第part个part或者更新的
+    bool HasPlaylistFor(const uint64_t& msn, const int64_t& part) const;
+
+    // 比列表里最新的切片还超前2个以上, 直接拒绝
+    bool IsTooFarAhead(const uint64_t& msn) const
+    {
+        return msn > hls_->seq + 1;
+    }
+
+    // LL-HLS的part, 在segment的[offset, offset+len).
+    // 返回kNoEnoughData表示是正在切的那个(preload hint指的), 等切好再取
+    int GetTsPart(const uint64_t& ts, const size_t& part, std::shared_ptr<TsSegment>& segment, size_t& offset, size_t& len, const HttpCache*& http) const;
+
+    // 阻塞的HLS请求挂在这里, 播放列表更新时回调, 回调里可以取消等待.
+    // stopped表示流没了或者不切了, 这时等待已经都清掉了
+    typedef std::function<void(const bool& stopped)> HlsCallback;
+
+    uint64_t WaitHls(const HlsCallback& callback);
+    void CancelHlsWait(const uint64_t& wait_id);
 
-        if (iter == ts_queue_.end())
+    // 没有返回空, 拿到的切片可以一直用到发完. 正在切的切片http为NULL
+    std::shared_ptr<TsSegment> GetTs(const uint64_t& ts, const HttpCache*& http) const
+    {
+        auto iter = hls_->ts.find(ts);
+
+        if (iter == hls_->ts.end())
         {
-            return invalid_ts_;
+            return std::shared_ptr<TsSegment>();
         }
 
-        return iter->second.ts_data;
+        http = ts < hls_->seq ? &iter->second->http : NULL;
+
+        return iter->second->segment;
+    }
+
+    // 多reactor下别的loop上的镜像用: HLS不自己切, 有请求时forward告诉源站(隔一会一次),
+    // 源站切好的播放列表从通道发过来SetHlsPlaylist, 所有loop回的都是源站那一份
+    void SetHlsForward(const std::function<void()>& forward)
+    {
+        hls_forward_ = forward;
+    }
+
+    void SetHlsPlaylist(const std::shared_ptr<const HlsPlaylist>& hls);
+
+    const std::shared_ptr<const HlsPlaylist>& GetHlsPlaylist() const
+    {
+        return hls_;
     }
 
     const std::string& GetVideoHeader()
@@ -81,39 +186,33 @@ public:
         return ! metadata_.empty();
     }
 
-    void UpdateM3U8();
-    void PacketTs(const Payload& payload);
-    std::string& PacketTsPmt();
-    std::string& PacketTsPat();
+    // HLS播放请求(m3u8/ts)来的时候调用. 没有HLS观众的流不切ts,
+    // 第一次请求时从GOP缓存补切, 超过hls_idle_ms_没有请求就停掉
+    void OnHlsRequest();
 
-    uint16_t GetAudioContinuityCounter()
+    static void SetHlsIdleMs(const uint64_t& idle_ms)
     {
-        uint16_t ret = ts_audio_continuity_counter_;
-
-        ++ts_audio_continuity_counter_;
-
-        if (ts_audio_continuity_counter_ == 0x10)
-        {
-            ts_audio_continuity_counter_ = 0x00;
-        }
-
-        return ret;
+        hls_idle_ms_ = idle_ms;
     }
 
-    uint16_t GetVideoContinuityCounter()
+    // LL-HLS的part时长, 0表示不开LL-HLS
+    static void SetHlsPartMs(const uint64_t& part_ms)
     {
-        uint16_t ret = ts_video_continuity_counter_;
-
-        ++ts_video_continuity_counter_;
-
-        if (ts_video_continuity_counter_ == 0x10)
-        {
-            ts_video_continuity_counter_ = 0x00;
-        }
+        hls_part_ms_ = part_ms;
+    }
 
-        return ret;
+    static void SetHlsFmp4(const bool& fmp4)
+    {
+        hls_fmp4_ = fmp4;
     }
 
+    void UpdateM3U8();
+    void PacketTs(const Payload& payload);
+    // 视频帧转成带起始码的格式, 每帧转一次
+    const std::string& PacketAnnexB(const Payload& payload);
+    std::string& PacketTsPmt();
+    std::string& PacketTsPat();
+
     uint16_t GetPatContinuityCounter()
     {
         uint16_t ret = ts_pat_continuity_counter_;
@@ -148,26 +247,40 @@ public:
     int OnVideoHeader(const std::string& video_header);
     int OnAudioHeader(const std::string& audio_header);
 
-    std::vector<Payload> GetFastOut();
+    const GopCache& GetGopCache() const
+    {
+        return gop_cache_;
+    }
+
+private:
+    bool NeedMuxTs();
+    void MuxTs(const Payload& payload);
+    void StopTs();
+    void StartPart(TsMedia& ts_media);
+    bool NeedCutPart(const TsMedia& ts_media, const uint64_t& dts) const;
+    void CutPart(TsMedia& ts_media, const uint64_t& dts);
+    std::string RenderM3U8(std::map<uint64_t, TsMedia>::const_iterator first, std::map<uint64_t, TsMedia>::const_iterator end,
+                           const size_t& skip, const size_t& no_part);
+    void NotifyHlsWaiter(const bool& stopped);
+    size_t PacketTsFrame(const Payload& payload, TsSegment& out);
+    void SendSrt(const TsSegment& segment, const size_t& count);
+    std::string RenderMpd();
+    void RenderSegmentHttp(const uint64_t& seq, TsMedia& ts_media);
+    void RenderPartHttp(const uint64_t& seq, const TsMedia& ts_media, TsPart& part);
+    void UpdateInitHttp();
+    void PublishHls();
 
 private:
     std::string app_;
     std::string stream_;
 
-    std::map<uint64_t, Payload> video_queue_;
-    std::map<uint64_t, Payload> audio_queue_;
-
-    uint64_t video_frame_id_;
-    uint64_t audio_frame_id_;
+    GopCache gop_cache_;
 
     uint64_t video_frame_recv_count_;
     uint64_t audio_frame_recv_count_;
 
     uint64_t video_key_frame_recv_count_;
 
-    uint64_t pre_video_key_frame_id_;
-    uint64_t pre_audio_key_frame_id_;
-
     uint32_t video_calc_fps_;
     uint32_t audio_calc_fps_;
 
@@ -184,14 +297,20 @@ private:
     std::string pps_;
 
     // ======== ts ========
-    std::string invalid_ts_;
+    std::string annexb_;
 
     std::map<uint64_t, TsMedia> ts_queue_;
 
     std::string m3u8_;
+    std::string m3u8_delta_;
+    // [0]普通请求, [1]LL-HLS阻塞请求
+    HttpCache m3u8_http_[2];
+    HttpCache m3u8_delta_http_[2];
+    uint64_t target_duration_;
     std::string ts_pat_;
     std::string ts_pmt_;
 
+    std::string session_;
     uint64_t ts_seq_;
     uint8_t  ts_couter_;
     uint32_t ts_video_pid_;
@@ -200,8 +319,38 @@ private:
 
     uint8_t ts_pat_continuity_counter_;
     uint8_t ts_pmt_continuity_counter_;
-    uint8_t ts_audio_continuity_counter_;
-    uint8_t ts_video_continuity_counter_;
+
+    TsPacketizer ts_packetizer_;
+
+    // 在切ts(有HLS观众或者有srt订阅者)
+    bool ts_muxing_;
+    bool hls_active_;
+    uint64_t hls_last_request_ms_;
+    // 0表示开始切之后不停
+    static uint64_t hls_idle_ms_;
+
+    // ======== LL-HLS ========
+    static uint64_t hls_part_ms_;
+    uint64_t last_dts_;
+    uint64_t max_dts_gap_;
+    std::map<uint64_t, HlsCallback> hls_waiter_;
+    uint64_t hls_wait_id_;
+
+    // 回HLS请求用的, 源站每次更新播放列表换一份, 镜像的是源站发过来的. 不会为空
+    std::shared_ptr<const HlsPlaylist> hls_;
+    std::function<void()> hls_forward_;
+    uint64_t hls_forward_ms_;
+
+    // ======== fMP4/DASH ========
+    static bool hls_fmp4_;
+    Fmp4Packetizer fmp4_packetizer_;
+    // fMP4模式下srt还是要ts, 打在这个临时切片里
+    std::shared_ptr<TsSegment> srt_segment_;
+    std::string mpd_;
+    HttpCache mpd_http_;
+    HttpCache init_http_;
+    // 时间戳0对应的墙上时间, MPD的availabilityStartTime
+    uint64_t dash_start_ms_;
 
     CRC32 crc_32_;
 
@@ -4,7 +4,7 @@
 
 bool MediaPublisher::AddSubscriber(MediaSubscriber* subscriber)
 {   
-    if (subscriber_.count(subscriber))
+    if (subscriber_.Has(subscriber) || wait_header_subscriber_.count(subscriber))
     {   
         return false;
     }   
@@ -17,7 +17,7 @@ bool MediaPublisher::AddSubscriber(MediaSubscriber* subscriber)
     }
     else if (ret == kSuccess)
     {
-        subscriber_.insert(subscriber);
+        subscriber_.Add(subscriber);
     }
 
     subscriber->SetPublisher(this);
@@ -27,7 +27,7 @@ bool MediaPublisher::AddSubscriber(MediaSubscriber* subscriber)
 
 bool MediaPublisher::RemoveSubscriber(MediaSubscriber* subscriber)
 {   
-    subscriber_.erase(subscriber);
+    subscriber_.Remove(subscriber);
     wait_header_subscriber_.erase(subscriber);
 
     return true;
@@ -54,12 +54,13 @@ int MediaPublisher::OnNewSubscriber(MediaSubscriber* subscriber)
     subscriber->SendAudioHeader(media_muxer_.GetAudioHeader());
     subscriber->SendVideoHeader(media_muxer_.GetVideoHeader());
 
-    auto media_fast_out = media_muxer_.GetFastOut();
+    // 从最近一个IDR开始发
+    const GopCache& gop_cache = media_muxer_.GetGopCache();
 
-    for (const auto& payload : media_fast_out)
-    {    
-        subscriber->SendMediaData(payload);
-    }    
+    for (uint64_t seq = gop_cache.GetFastOutBegin(); seq != gop_cache.GetEnd(); ++seq)
+    {
+        subscriber->SendMediaData(gop_cache.Get(seq));
+    }
 
     return kSuccess;
 }
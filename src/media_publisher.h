@@ -2,6 +2,8 @@
 #define __MEDIA_PUBLISHER_H__
 
 #include "media_muxer.h"
+#include "subscriber_registry.h"
+#include "wire_cache.h"
 
 class HttpFlvProtocol;
 class MediaSubscriber;
@@ -13,7 +15,8 @@ class MediaPublisher
 {
 public:
     MediaPublisher()
-        : media_muxer_(this)
+        : subscriber_(this)
+        , media_muxer_(this)
     {
     }
 
@@ -25,6 +28,12 @@ public:
     {   
         return media_muxer_;
     }
+
+    // 当前帧按订阅者格式序列化后的缓存, 只能在发布者loop上分发时用
+    WireCache& GetWireCache()
+    {
+        return wire_cache_;
+    }
     
     std::set<MediaSubscriber*> GetAndClearWaitHeaderSubscriber()
     {
@@ -34,7 +43,7 @@ public:
         return ret;
     }
 
-    std::set<MediaSubscriber*> GetSubscriber()
+    SubscriberRegistry& GetSubscriber()
     {
         return subscriber_;
     }
@@ -46,10 +55,11 @@ protected:
     int OnNewSubscriber(MediaSubscriber* subscriber);
 
 protected:
-	std::set<MediaSubscriber*> subscriber_;
+    SubscriberRegistry subscriber_;
     std::set<MediaSubscriber*> wait_header_subscriber_; // 当前进程app/stream所在的流还未收齐音视频头
 
     MediaMuxer media_muxer_;
+    WireCache wire_cache_;
 };
 
 #endif // __MEDIA_PUBLISHER_H__
@@ -1,20 +1,104 @@
 #ifndef __MEDIA_STRUCT_H__
 #define __MEDIA_STRUCT_H__
 
+#include <map>
+#include <memory>
 #include <string>
+#include <vector>
+
+#include "ts_segment.h"
+
+// 预先生成好的HTTP响应, 请求来了直接发. 播放列表的ok里带着body, 切片的只有头, body从TsSegment发
+struct HttpCache
+{
+    HttpCache()
+        : last_modified(0)
+    {
+    }
+
+    // 带引号
+    std::string etag;
+    // 秒, 0表示没有Last-Modified
+    uint64_t last_modified;
+    // 200
+    std::string ok;
+    // 304
+    std::string not_modified;
+};
+
+// LL-HLS的part, 切片里的一段, 开头带PAT/PMT
+struct TsPart
+{
+    TsPart()
+        : offset(0)
+        , len(0)
+        , duration(0)
+        , independent(false)
+    {
+    }
+
+    size_t offset;
+    size_t len;
+    double duration;
+    bool independent;
+    HttpCache http;
+};
 
 struct TsMedia
 {
     TsMedia()
         :   
         duration(0),
-        first_dts(0)
+        first_dts(0),
+        part_offset(0),
+        part_first_dts(0),
+        part_independent(false),
+        create_ms(0)
     {   
     }   
 
     double duration;
     double first_dts;
-    std::string ts_data;
+    std::shared_ptr<TsSegment> segment;
+
+    // 切好的part, 正在切的part从part_offset开始
+    std::vector<TsPart> parts;
+    size_t part_offset;
+    double part_first_dts;
+    bool part_independent;
+
+    // 开始切的墙上时间, 切片/part的Last-Modified
+    uint64_t create_ms;
+    // 切完了才有, 正在切的整个切片不能缓存
+    HttpCache http;
+};
+
+// 源站loop每次更新播放列表生成一份, 生成之后不再改. 源站和别的loop上的镜像都按同一份回HLS请求,
+// 不管请求落在哪个loop, 播放列表和切片都是同一套
+struct HlsPlaylist
+{
+    HlsPlaylist()
+        : seq(0)
+        , muxing(false)
+        , target_duration(0)
+    {
+    }
+
+    std::string session;
+    // 正在切的切片序号, 比它小的都切完了
+    uint64_t seq;
+    // false是不切了, 等着的请求回404
+    bool muxing;
+    uint64_t target_duration;
+
+    // 切完的跟源站共用, 正在切的是到最后一个part为止的快照
+    std::map<uint64_t, std::shared_ptr<const TsMedia>> ts;
+
+    // [0]普通请求, [1]LL-HLS阻塞请求
+    HttpCache m3u8_http[2];
+    HttpCache m3u8_delta_http[2];
+    HttpCache mpd_http;
+    HttpCache init_http;
 };
 
 #endif // __MEDIA_STRUCT_H__
@@ -2,6 +2,7 @@
 #define __MEDIA_SUBSCRIBER_H__
 
 #include <string>
+#include <vector>
 
 #include "common_define.h"
 #include "media_publisher.h"
@@ -12,10 +13,16 @@ class Payload;
 class MediaSubscriber
 {
 public:
+    enum
+    {
+        kInvalidIndex = (size_t)-1,
+    };
+
     MediaSubscriber(const uint16_t& type)
         : type_(type)
         , expired_time_ms_(0)
         , publisher_(NULL)
+        , registry_index_(kInvalidIndex)
     {
     }
 
@@ -61,6 +68,21 @@ public:
         return 0;
     }
 
+    // 发布者每帧对每种订阅者调一次, group里[0, count)都是同一个类的订阅者, 中途被删的是NULL.
+    // 同组共用的工作(比如从WireCache取序列化好的帧)可以提到循环外面
+    virtual void SendMediaDataBatch(MediaPublisher* publisher, const std::vector<MediaSubscriber*>& group, const size_t& count, const Payload& payload)
+    {
+        UNUSED(publisher);
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (group[i] != NULL)
+            {
+                group[i]->SendMediaData(payload);
+            }
+        }
+    }
+
     virtual int SendData(const std::string& data)
     {
         UNUSED(data);
@@ -76,6 +98,12 @@ protected:
     uint16_t type_;
     uint64_t expired_time_ms_;
     MediaPublisher* publisher_;
+
+private:
+    friend class SubscriberRegistry;
+
+    // 在发布者SubscriberRegistry对应组里的下标
+    size_t registry_index_;
 };
 
 #endif // __MEDIA_SUBSCRIBER_H__
@@ -2,6 +2,7 @@
 
 #include <deque>
 #include <iostream>
+#include <vector>
 
 #include "amf_0.h"
 #include "any.h"
@@ -17,7 +18,6 @@
 #include "local_stream_center.h"
 #include "protocol_factory.h"
 #include "rtmp_protocol.h"
-#include "webrtc_protocol.h"
 #include "fd.h"
 #include "tcp_socket.h"
 #include "util.h"
@@ -28,6 +28,12 @@ static uint32_t s0_len = 1;
 static uint32_t s1_len = 4/*time*/ + 4/*zero*/ + 1528/*random*/;
 static uint32_t s2_len = 4/*time*/ + 4/*time2*/ + 1528/*random*/;
 
+// 推流端统计打印间隔
+static const uint32_t kRtmpStatIntervalMs = 5000;
+
+// 第一个chunk的头最长: 1字节basic header(cs_id都小于64) + 11字节fmt0消息头, 不用扩展时间戳
+static const size_t kMaxFirstChunkHeaderSize = 12;
+
 static uint8_t kFlashMediaServerKey[] = 
 {
 	0x47, 0x65, 0x6e, 0x75, 0x69, 0x6e, 0x65, 0x20,
@@ -118,6 +124,7 @@ RtmpProtocol::RtmpProtocol(IoLoop* io_loop, Fd* fd)
     , out_chunk_size_(128)
     , transaction_id_(0.0)
     , can_publish_(false)
+    , stat_timer_(io_loop)
 {
     std::cout << LMSG << std::endl;
 }
@@ -495,7 +502,7 @@ int RtmpProtocol::Parse(IoBuffer& io_buffer)
                 {
                     if (rtmp_msg.len == 0)
                     {
-                        rtmp_msg.msg = (uint8_t*)malloc(rtmp_msg.message_length);
+                        rtmp_msg.Alloc();
                     }
 
                     io_buffer.Skip(chunk_header_len + message_header_len);
@@ -531,10 +538,7 @@ int RtmpProtocol::Parse(IoBuffer& io_buffer)
 
             int ret = OnRtmpMessage(rtmp_msg);
 
-            free(rtmp_msg.msg);
-
-            rtmp_msg.msg = NULL;
-            rtmp_msg.len = 0;
+            rtmp_msg.Release();
 
             return ret;
         }
@@ -933,27 +937,22 @@ int RtmpProtocol::OnAudio(RtmpMessage& rtmp_msg)
             }
             else
             {
-                uint8_t* audio_raw_data = (uint8_t*)malloc(rtmp_msg.len);
-                memcpy(audio_raw_data, rtmp_msg.msg, rtmp_msg.len);
+                Payload audio_payload(rtmp_msg.payload, 0, rtmp_msg.len);
 
-                Payload audio_payload(audio_raw_data, rtmp_msg.len);
                 audio_payload.SetAudio();
                 audio_payload.SetDts(rtmp_msg.timestamp_calc);
                 audio_payload.SetPts(rtmp_msg.timestamp_calc);
 
                 media_muxer_.OnAudio(audio_payload);
 
-                for (auto& sub : subscriber_)
-                {
-                    sub->SendMediaData(audio_payload);
-                }
+                subscriber_.SendMediaData(audio_payload);
             }
         }
     }
     else
     {
-        std::cout << LMSG << "impossible?" << std::endl;
-        assert(false);
+        // 推流端发的空消息, 丢掉
+        std::cout << LMSG << "invalid msg len:" << rtmp_msg.len << std::endl;
     }
 
     return kSuccess;
@@ -991,19 +990,41 @@ int RtmpProtocol::OnVideo(RtmpMessage& rtmp_msg)
                     uint8_t* data = rtmp_msg.msg + 5;
                     size_t raw_len = rtmp_msg.len - 5;
 
-                    int got_picture = 0;
+                    // 整个消息体(去掉5字节视频头)就是一帧AVCC, 直接引用不拷贝, 记下每个NALU的位置
+                    Payload video_payload(rtmp_msg.payload, 5, raw_len);
 
+                    video_payload.SetVideo();
+                    video_payload.SetNalRefIdc(0);
+                    video_payload.SetDts(rtmp_msg.timestamp_calc);
+                    video_payload.SetPts(rtmp_msg.timestamp_calc + compositio_time_offset);
+
+                    bool bad_nalu = false;
                     size_t cur_len = 0;
                     while (cur_len < raw_len)
                     {
+                        if (raw_len - cur_len < 4)
+                        {
+                            std::cout << LMSG << "no enough data for nalu_len, cur_len:" << cur_len << ",raw_len:" << raw_len << std::endl;
+                            bad_nalu = true;
+                            break;
+                        }
+
                         uint32_t nalu_len = (data[cur_len]<<24) | (data[cur_len+1]<<16) | (data[cur_len+2]<<8) | (data[cur_len+3]);
 
-                        if (nalu_len > raw_len)
+                        if (nalu_len > raw_len - cur_len - 4)
                         {
-                            std::cout << LMSG << "nalu_len:" << nalu_len << " > raw_len:" << raw_len;
+                            std::cout << LMSG << "nalu_len:" << nalu_len << " > left:" << raw_len - cur_len - 4 << ",raw_len:" << raw_len << std::endl;
+                            bad_nalu = true;
                             break;
                         }
 
+                        // 空的NALU跳过
+                        if (nalu_len == 0)
+                        {
+                            cur_len += 4;
+                            continue;
+                        }
+
                         uint8_t nalu_header = data[cur_len+4];
 
                         uint8_t forbidden_zero_bit = (nalu_header & 0x80) >> 7;
@@ -1012,30 +1033,11 @@ int RtmpProtocol::OnVideo(RtmpMessage& rtmp_msg)
                         uint8_t nal_ref_idc = (nalu_header & 0x60) >> 5;
                         uint8_t nalu_unit_type = (nalu_header & 0x1F);
 
-                        // 4 bytes nalu_len也push,方便后面FLV/RTMP的处理
-                        uint8_t* video_raw_data = (uint8_t*)malloc(nalu_len + 4);
-                        memcpy(video_raw_data, data + cur_len, nalu_len + 4);
-
-                        Payload video_payload(video_raw_data, nalu_len + 4);
-
-                        video_payload.SetVideo();
-                        video_payload.SetDts(rtmp_msg.timestamp_calc);
-                        video_payload.SetPts(rtmp_msg.timestamp_calc);
-
-                        // SEI不能传给webrtc,不然会导致只能解码关键帧,其他帧都无法解码
-                        if (nalu_unit_type != 6)
-                        {
-                            WebrtcProtocol::BroadcastH264(video_payload);
-                        }
+                        video_payload.AddNalu(cur_len);
 
                         //std::cout << LMSG << "NALU type + 4byte payload peek:[" << Util::Bin2Hex(data+cur_len+4, 5) << std::endl;
 
-                        if (nalu_unit_type == H264NalType_SEI)
-                        {
-                            //std::cout << LMSG << "SEI [" << Util::Bin2Hex(data + cur_len + 4, nalu_len) << "]" << std::endl;
-                            to_media_muxer = false;
-                        }
-                        else if (nalu_unit_type == H264NalType_SPS)
+                        if (nalu_unit_type == H264NalType_SPS)
                         {
                             std::cout << LMSG << "SPS [" << Util::Bin2Hex(data + cur_len + 4, nalu_len) << "]" << std::endl;
                         }
@@ -1048,40 +1050,42 @@ int RtmpProtocol::OnVideo(RtmpMessage& rtmp_msg)
                             to_media_muxer = true;
                             std::cout << LMSG << "IDR" << std::endl;
                             video_payload.SetIFrame();
-                            video_payload.SetPts(rtmp_msg.timestamp_calc + compositio_time_offset);
                         }
                         else if (nalu_unit_type == H264NalType_SLICE)
                         {
                             to_media_muxer = true;
-                            video_payload.SetPts(rtmp_msg.timestamp_calc + compositio_time_offset);
-                        }
-                        else
-                        {
-                            to_media_muxer = false;
                         }
 
-                        if (to_media_muxer)
+                        // 一帧里只要有一个slice被参考, 整帧就不能丢
+                        if (nal_ref_idc > video_payload.GetNalRefIdc())
                         {
-                            media_muxer_.OnVideo(video_payload);
-
-                            for (auto& sub : subscriber_)
-                            {
-                                sub->SendMediaData(video_payload);
-                            }
+                            video_payload.SetNalRefIdc(nal_ref_idc);
                         }
 
                         cur_len += nalu_len + 4;
                     }
 
-                    assert(cur_len == raw_len);
+                    // NALU长度不对的整条消息丢掉, 不能让推流端把服务弄挂
+                    if (bad_nalu)
+                    {
+                        return kSuccess;
+                    }
+
+                    // 只有SEI/SPS/PPS的消息不分发, 每帧只分发一次
+                    if (to_media_muxer)
+                    {
+                        media_muxer_.OnVideo(video_payload);
+
+                        subscriber_.SendMediaData(video_payload);
+                    }
                 }
             }
         }
     }
     else
     {
-        std::cout << LMSG << "impossible?" << std::endl;
-        assert(false);
+        // 推流端发的空消息, 丢掉
+        std::cout << LMSG << "invalid msg len:" << rtmp_msg.len << std::endl;
     }
 
     return kSuccess;
@@ -1320,6 +1324,11 @@ int RtmpProtocol::OnPublishCommand(RtmpMessage& rtmp_msg, AmfCommand& amf_comman
 {
     SetClientPush();
 
+    stat_timer_.RunEvery(kRtmpStatIntervalMs, [this]()
+    {
+        EveryNSecond(io_loop_->GetNowMs(), kRtmpStatIntervalMs, stat_timer_.GetFireCount());
+    });
+
     double trans_id = 0;
 
     if (amf_command.size() >= 5)
@@ -1538,43 +1547,6 @@ int RtmpProtocol::OnMetaData(RtmpMessage& rtmp_msg)
 
 int RtmpProtocol::OnVideoHeader(RtmpMessage& rtmp_msg)
 {
-    // webrtc test
-    {
-        std::string video_header((const char*)rtmp_msg.msg + 5, rtmp_msg.len - 5);
-        video_header.erase(0, 6);
-
-        uint16_t sps_len = (uint8_t)(video_header[0]) << 8 | 
-                           (uint8_t)(video_header[1]);
-
-        video_header.erase(0, 2);
-
-        std::string sps = video_header.substr(0, sps_len);
-
-        std::string pps = video_header.substr(sps_len + 3);
-
-        std::cout << "sps:" << Util::Bin2Hex(sps) << std::endl;
-        std::cout << "pps:" << Util::Bin2Hex(pps) << std::endl;
-
-        // 4 bytes nalu_len也push,方便后面FLV/RTMP的处理
-        uint8_t* sps_nal = (uint8_t*)malloc(sps.size() + 4);
-        memcpy(sps_nal + 4, sps.data(), sps.size());
-
-        Payload sps_payload(sps_nal, sps.size() + 4);
-        sps_payload.SetVideo();
-        sps_payload.SetDts(rtmp_msg.timestamp_calc);
-
-        WebrtcProtocol::BroadcastH264(sps_payload);
-
-        // 4 bytes nalu_len也push,方便后面FLV/RTMP的处理
-        uint8_t* pps_nal = (uint8_t*)malloc(pps.size() + 4);
-        memcpy(pps_nal + 4, pps.data(), pps.size());
-
-        Payload pps_payload(pps_nal, pps.size() + 4);
-        pps_payload.SetVideo();
-        pps_payload.SetDts(rtmp_msg.timestamp_calc);
-        WebrtcProtocol::BroadcastH264(pps_payload);
-    }
-
     std::string video_header((const char*)rtmp_msg.msg + 5, rtmp_msg.len - 5);
 
     std::cout << LMSG << "recv video_header" << ",size:" << video_header.size() << std::endl;
@@ -1675,24 +1647,16 @@ int RtmpProtocol::HandleClose(IoBuffer& io_buffer, Fd& socket)
     UNUSED(io_buffer);
     UNUSED(socket);
 
-    for (const auto& kv : csid_head_)
-    {
-        if (kv.second.msg != NULL)
-        {
-            free(kv.second.msg);
-        }
-    }
-
-    std::cout << LMSG << "role:" << (int)role_ << std::endl;
+    std::cout << LMSG << "role:" << (int)role_ << "," << frame_dropper_.ToString() << std::endl;
 
     csid_head_.clear();
 
     if (role_ == RtmpRole::kClientPush)
     {
-        for (auto& sub : subscriber_)
+        subscriber_.ForEach([](MediaSubscriber* sub)
         {
             sub->OnStop();
-        }
+        });
 
 		g_local_stream_center.UnRegisterStream(app_, stream_, this);
     }
@@ -1723,7 +1687,7 @@ int RtmpProtocol::EveryNSecond(const uint64_t& now_in_ms, const uint32_t& interv
         media_muxer_.EveryNSecond(now_in_ms, interval, count);
     }
 
-    std::cout << LMSG << "subscriber:" << subscriber_.size() << std::endl;
+    std::cout << LMSG << "subscriber:" << subscriber_.Size() << std::endl;
 
     return kSuccess;
 }
@@ -1756,7 +1720,16 @@ int RtmpProtocol::SendRtmpMessage(const uint32_t cs_id, const uint32_t& message_
     return SendData(rtmp_message);
 }
 
-int RtmpProtocol::SendData(const RtmpMessage& cur_info, const Payload& payload, const bool& force_fmt0)
+static uint8_t* WriteU24(uint8_t* p, const uint32_t& u24)
+{
+    *p++ = (u24 >> 16) & 0xFF;
+    *p++ = (u24 >> 8) & 0xFF;
+    *p++ = u24 & 0xFF;
+
+    return p;
+}
+
+size_t RtmpProtocol::WriteFirstChunkHeader(const RtmpMessage& cur_info, const bool& force_fmt0, uint8_t* header)
 {
     const uint32_t cs_id = cur_info.cs_id;
 
@@ -1771,17 +1744,6 @@ int RtmpProtocol::SendData(const RtmpMessage& cur_info, const Payload& payload,
     uint32_t cur_message_stream_id = cur_info.message_stream_id;
     uint8_t  cur_message_type_id   = cur_info.message_type_id;
 
-    int chunk_count = 1;
-    if (cur_message_length > out_chunk_size_)
-    {
-        chunk_count = cur_message_length / out_chunk_size_;
-
-        if (cur_message_length % out_chunk_size_ != 0)
-        {
-            chunk_count += 1;
-        }
-    }
-
     int fmt = 0x0f;
 
     // new cs_id, fmt0
@@ -1817,84 +1779,83 @@ int RtmpProtocol::SendData(const RtmpMessage& cur_info, const Payload& payload,
 
     assert(fmt >= 0 && fmt <= 3);
 
-    size_t data_pos = 0;
-    for (int i = 0; i != chunk_count; ++i)
+    uint8_t* p = header;
+
+    *p++ = fmt << 6 | cs_id;
+
+    if (fmt <= 2)
     {
-        IoBuffer header;
+        p = WriteU24(p, cur_timestamp_delta);
+    }
 
-        size_t send_len = cur_message_length - (i * out_chunk_size_);
-        if (send_len > out_chunk_size_)
-        {
-            send_len = out_chunk_size_;
-        }
+    if (fmt <= 1)
+    {
+        p = WriteU24(p, cur_message_length);
+        *p++ = cur_message_type_id;
+    }
 
-        if (i == 0)
-        {
-            header.WriteU8(fmt << 6 | cs_id);
+    // message stream id是小端
+    if (fmt == 0)
+    {
+        *p++ = cur_message_stream_id & 0xFF;
+        *p++ = (cur_message_stream_id >> 8) & 0xFF;
+        *p++ = (cur_message_stream_id >> 16) & 0xFF;
+        *p++ = (cur_message_stream_id >> 24) & 0xFF;
+    }
 
-            if (fmt == 0)
-            {
-                header.WriteU24(cur_timestamp_delta);
-                header.WriteU24(cur_message_length);
-                header.WriteU8(cur_message_type_id);
-                header.WriteU32(htobe32(cur_message_stream_id));
-            }
-            else if (fmt == 1)
-            {
-                header.WriteU24(cur_timestamp_delta);
-                header.WriteU24(cur_message_length);
-                header.WriteU8(cur_message_type_id);
-            }
-            else if (fmt == 2)
-            {
-                header.WriteU24(cur_timestamp_delta);
-            }
-            else if (fmt == 3)
-            {
-            }
+    return p - header;
+}
 
-            if (payload.IsVideo())
-            {
-				if (payload.IsIFrame())
-    			{   
-    			    std::cout << LMSG << "I frame" << std::endl;
-    			    header.WriteU8(0x17);
-    			}   
-    			else
-    			{   
-    			    header.WriteU8(0x27);
-    			}   
+int RtmpProtocol::SendData(const RtmpMessage& cur_info, const Payload& payload, const bool& force_fmt0)
+{
+    const uint32_t cs_id = cur_info.cs_id;
 
-    			header.WriteU8(0x01); // AVC nalu
+    uint32_t cur_message_length = cur_info.message_length;
 
-    			uint32_t compositio_time_offset = payload.GetPts32() - payload.GetDts32();
+    int chunk_count = 1;
+    if (cur_message_length > out_chunk_size_)
+    {
+        chunk_count = cur_message_length / out_chunk_size_;
 
-    			header.WriteU24(compositio_time_offset);
-            }
-        }
-        else
+        if (cur_message_length % out_chunk_size_ != 0)
         {
-            fmt = 3;
-            header.WriteU8(fmt << 6 | cs_id);
+            chunk_count += 1;
         }
+    }
 
-        uint8_t* buf = NULL;
-        int size = 0;
+    // 第一个chunk的头单独写, 后面的fmt3头都是同一个字节, 整个消息一次writev出去
+    uint8_t header[kMaxFirstChunkHeaderSize];
+    uint8_t fmt3_header = (3 << 6) | cs_id;
 
-        size = header.Read(buf, header.Size());
-        socket_->Send(buf, size);
-        if (i == 0 && payload.IsVideo())
+    size_t header_len = WriteFirstChunkHeader(cur_info, force_fmt0, header);
+
+    const Payload* ref = (payload.GetAllData() != NULL ? &payload : NULL);
+
+    std::vector<IoVec>& iov = send_iov_;
+    iov.clear();
+
+    iov.push_back(IoVec(header, header_len));
+
+    size_t data_pos = 0;
+    for (int i = 0; i != chunk_count; ++i)
+    {
+        size_t send_len = cur_message_length - (i * out_chunk_size_);
+        if (send_len > out_chunk_size_)
         {
-            socket_->Send(cur_info.msg + data_pos, send_len - 5);
-            data_pos += send_len - 5;
+            send_len = out_chunk_size_;
         }
-        else
+
+        if (i != 0)
         {
-            socket_->Send(cur_info.msg + data_pos, send_len);
-            data_pos += send_len;
+            iov.push_back(IoVec(&fmt3_header, 1));
         }
+
+        iov.push_back(IoVec(cur_info.msg + data_pos, send_len, ref));
+        data_pos += send_len;
     }
 
+    socket_->SendV(iov.data(), iov.size());
+
     csid_pre_info_[cs_id] = cur_info;
 
     // FIXME
@@ -1903,6 +1864,11 @@ int RtmpProtocol::SendData(const RtmpMessage& cur_info, const Payload& payload,
 
 int RtmpProtocol::SendMediaData(const Payload& payload)
 {
+    if (frame_dropper_.ShouldDrop(payload, socket_->GetPendingBytes(), socket_->GetPendingMs()))
+    {
+        return 0;
+    }
+
     RtmpMessage rtmp_message;
 
     rtmp_message.cs_id = 6;
@@ -1938,7 +1904,26 @@ int RtmpProtocol::SendMediaData(const Payload& payload)
     rtmp_message.msg = payload.GetAllData();
     rtmp_message.len = payload.GetAllLen();
 
-    return SendData(rtmp_message, payload);
+    // 视频头, 数据和fmt3头所有播放者都一样, 由发布者按chunk大小缓存, 这里只加第一个chunk的消息头
+    WireCache local_cache;
+    WireCache& wire_cache = (publisher_ != NULL ? publisher_->GetWireCache() : local_cache);
+
+    const WireFrame& wire = wire_cache.GetRtmpBody(payload, out_chunk_size_, rtmp_message.cs_id);
+
+    uint8_t header[kMaxFirstChunkHeaderSize];
+    size_t header_len = WriteFirstChunkHeader(rtmp_message, false, header);
+
+    std::vector<IoVec>& iov = send_iov_;
+    iov.clear();
+
+    iov.push_back(IoVec(header, header_len));
+    iov.insert(iov.end(), wire.iov.begin(), wire.iov.end());
+
+    socket_->SendV(iov.data(), iov.size());
+
+    csid_pre_info_[rtmp_message.cs_id] = rtmp_message;
+
+    return 0;
 }
 
 int RtmpProtocol::SendVideoHeader(const std::string& header)
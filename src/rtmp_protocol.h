@@ -7,13 +7,17 @@
 #include <map>
 #include <sstream>
 #include <set>
+#include <vector>
 
 #include "crc32.h"
+#include "fd.h"
+#include "frame_dropper.h"
 #include "media_publisher.h"
 #include "media_subscriber.h"
 #include "ref_ptr.h"
 #include "socket_handler.h"
 #include "socket_util.h"
+#include "timing_wheel.h"
 
 class AmfCommand;
 class IoLoop;
@@ -95,6 +99,20 @@ struct RtmpMessage
         len = 0;
     }
 
+    // 消息体的chunk直接拼到payload里, msg指向它的数据, 音视频帧都是它上面的切片
+    void Alloc()
+    {
+        payload = Payload(message_length);
+        msg = payload.GetAllData();
+    }
+
+    void Release()
+    {
+        payload = Payload();
+        msg = NULL;
+        len = 0;
+    }
+
     std::string ToString() const
     {
         std::ostringstream os;
@@ -120,6 +138,7 @@ struct RtmpMessage
     uint8_t  message_type_id;
     uint32_t message_stream_id;
 
+    Payload  payload;
     uint8_t* msg;
     uint32_t len;
 };
@@ -240,6 +259,8 @@ public:
     int SendRtmpMessage(const uint32_t cs_id, const uint32_t& message_stream_id, const uint8_t& message_type_id, const uint8_t* data, const size_t& len);
     int SendMediaData(const Payload& media);
 
+    const FrameDropper& GetFrameDropper() const { return frame_dropper_; }
+
 	virtual int SendVideoHeader(const std::string& header);
     virtual int SendAudioHeader(const std::string& header);
     virtual int SendMetaData(const std::string& metadata);
@@ -291,6 +312,8 @@ private:
 
     int OnRtmpMessage(RtmpMessage& rtmp_msg);
     int SendData(const RtmpMessage& cur_info, const Payload& paylod = Payload(), const bool& force_fmt0 = false);
+    // 写到header里, 返回长度, 最长kMaxFirstChunkHeaderSize
+    size_t WriteFirstChunkHeader(const RtmpMessage& cur_info, const bool& force_fmt0, uint8_t* header);
 
     void GenerateRandom(uint8_t* data, const int& len);
 
@@ -312,6 +335,9 @@ private:
     std::map<uint32_t, RtmpMessage> csid_head_;
     std::map<uint32_t, RtmpMessage> csid_pre_info_;
 
+    // 拼一个消息的iov用, 每帧复用, 不再每帧分配
+    std::vector<IoVec> send_iov_;
+
     RtmpMessage pending_rtmp_msg_;
 
     std::string app_;
@@ -330,6 +356,10 @@ private:
 
     uint64_t video_frame_send_;
     uint64_t audio_frame_send_;
+
+    WheelTimer stat_timer_;
+
+    FrameDropper frame_dropper_;
 };
 
 #endif // __RTMP_PROTOCOL_H__
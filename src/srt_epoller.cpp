@@ -1,4 +1,5 @@
 #include "common_define.h"
+#include "io_loop.h"
 #include "fd.h"
 #include "srt_epoller.h"
 #include "util.h"
@@ -34,11 +35,31 @@ static void InitSrtSocketArray(SRTSOCKET* s, const int size, const int init_val)
 
 SrtEpoller::SrtEpoller()
     : IoLoop()
+    , dispatch_loop_(NULL)
+    , wait_thread_(NULL)
+    , stop_(false)
+    , dispatching_(false)
+    , dispatch_count_(0)
+    , dispatch_delay_us_(0)
+    , max_dispatch_delay_us_(0)
+    , pre_stat_ms_(0)
 {
 }
 
 SrtEpoller::~SrtEpoller()
 {
+    if (wait_thread_ != NULL)
+    {
+        {
+            std::lock_guard<std::mutex> lock(dispatch_mutex_);
+            stop_.store(true, std::memory_order_release);
+        }
+        dispatch_cond_.notify_one();
+
+        wait_thread_->join();
+        delete wait_thread_;
+    }
+
     if (poll_fd_ > 0)
     {
         close(poll_fd_);
@@ -120,6 +141,30 @@ int SrtEpoller::ModFd(Fd* fd)
 }
 
 void SrtEpoller::WaitIO(const int& timeout_in_millsecond)
+{
+    std::vector<int> can_read;
+    std::vector<int> can_write;
+
+    if (Poll(timeout_in_millsecond, can_read, can_write) > 0)
+    {
+        Dispatch(can_read, can_write);
+    }
+}
+
+int SrtEpoller::Start(IoLoop* dispatch_loop)
+{
+    if (wait_thread_ != NULL)
+    {
+        return kError;
+    }
+
+    dispatch_loop_ = dispatch_loop;
+    wait_thread_ = new std::thread(&SrtEpoller::WaitThreadMain, this);
+
+    return kSuccess;
+}
+
+int SrtEpoller::Poll(const int& timeout_in_millsecond, std::vector<int>& can_read, std::vector<int>& can_write)
 {
 	const int kWaitFdSize = 1024;
     SRTSOCKET can_read_srt_sockets[kWaitFdSize];
@@ -139,18 +184,35 @@ void SrtEpoller::WaitIO(const int& timeout_in_millsecond)
     if (ret < 0)
     {
         //std::cout << LMSG << "srt epoll error, " << srt_getlasterror_str() << std::endl;
-        return;
+        return ret;
     }
 
-    for (int i = 0; i < can_read_srt_sockets_num; ++i)
-    {   
-        int srt_socket = can_read_srt_sockets[i];
+    for (int i = 0; i < can_read_srt_sockets_num && i < kWaitFdSize; ++i)
+    {
+        if (can_read_srt_sockets[i] != SRT_INVALID_SOCK)
+        {
+            can_read.push_back(can_read_srt_sockets[i]);
+        }
+    }
 
-        if (srt_socket == SRT_INVALID_SOCK)
-        {   
-            continue;
-        }   
+    for (int i = 0; i < can_write_srt_sockets_num && i < kWaitFdSize; ++i)
+    {
+        if (can_write_srt_sockets[i] != SRT_INVALID_SOCK)
+        {
+            can_write.push_back(can_write_srt_sockets[i]);
+        }
+    }
 
+    return can_read.size() + can_write.size();
+}
+
+void SrtEpoller::Dispatch(const std::vector<int>& can_read, const std::vector<int>& can_write)
+{
+    // 分发在主loop里跑, srt socket上挂的协议看的是这个loop的时钟
+    UpdateTime();
+
+    for (const auto& srt_socket : can_read)
+    {   
         auto iter = srt_socket_map_.find(srt_socket);
 
         if (iter == srt_socket_map_.end())
@@ -169,25 +231,17 @@ void SrtEpoller::WaitIO(const int& timeout_in_millsecond)
 		if (ret == kClose || ret == kError)
 		{   
 			std::cout << LMSG << "read error, ret:" << ret << std::endl;
+            // 析构时DelFd会把它从srt_socket_map_删掉, 后面的可写事件查不到, 不会再用到
 			delete fd; 
-			return;
 		}
 	}
 
-    for (int i = 0; i < can_write_srt_sockets_num; ++i)
+    for (const auto& srt_socket : can_write)
     {   
-        int srt_socket = can_write_srt_sockets[i];
-
-        if (srt_socket == SRT_INVALID_SOCK)
-        {   
-            continue;
-        }   
-
         auto iter = srt_socket_map_.find(srt_socket);
 
         if (iter == srt_socket_map_.end())
         {   
-            std::cout << LMSG << "srt socket:" << srt_socket << " have not added into epoller" << std::endl;
             continue;
         }   
 
@@ -202,7 +256,77 @@ void SrtEpoller::WaitIO(const int& timeout_in_millsecond)
 		{   
 			std::cout << LMSG << "write error, ret:" << ret << std::endl;
 			delete fd; 
-			return;
 		}
     }
 }
+
+void SrtEpoller::WaitThreadMain()
+{
+    std::cout << LMSG << "srt wait thread running" << std::endl;
+
+    while (! stop_.load(std::memory_order_acquire))
+    {
+        std::vector<int> can_read;
+        std::vector<int> can_write;
+
+        int ret = Poll(100, can_read, can_write);
+
+        if (ret < 0)
+        {
+            // 超时也会返回错误, 其他错误(比如epoll里没有socket)避免空转
+            if (srt_getlasterror(NULL) != (MJ_AGAIN * 1000 + MN_XMTIMEOUT))
+            {
+                usleep(10*1000);
+            }
+            continue;
+        }
+
+        if (ret == 0)
+        {
+            continue;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(dispatch_mutex_);
+            dispatching_ = true;
+        }
+
+        uint64_t wakeup_us = Util::GetNowUs();
+
+        dispatch_loop_->QueueInLoop([this, can_read, can_write, wakeup_us]()
+        {
+            uint64_t now_us = Util::GetNowUs();
+            uint64_t delay_us = now_us - wakeup_us;
+
+            Dispatch(can_read, can_write);
+
+            ++dispatch_count_;
+            dispatch_delay_us_ += delay_us;
+            if (delay_us > max_dispatch_delay_us_)
+            {
+                max_dispatch_delay_us_ = delay_us;
+            }
+
+            if (now_us / 1000 - pre_stat_ms_ >= 10*1000)
+            {
+                std::cout << LMSG << "srt dispatch count:" << dispatch_count_ 
+                          << ",avg delay(us):" << dispatch_delay_us_ / dispatch_count_
+                          << ",max delay(us):" << max_dispatch_delay_us_ << std::endl;
+
+                dispatch_count_ = 0;
+                dispatch_delay_us_ = 0;
+                max_dispatch_delay_us_ = 0;
+                pre_stat_ms_ = now_us / 1000;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(dispatch_mutex_);
+                dispatching_ = false;
+            }
+            dispatch_cond_.notify_one();
+        });
+
+        std::unique_lock<std::mutex> lock(dispatch_mutex_);
+        dispatch_cond_.wait(lock, [this]() { return ! dispatching_ || stop_.load(std::memory_order_acquire); });
+    }
+}
@@ -3,8 +3,14 @@
 
 #include "io_loop.h"
 
+#include <atomic>
+#include <condition_variable>
 #include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
 
+class IoLoop;
 class Fd;
 
 class SrtEpoller : public IoLoop
@@ -22,8 +28,33 @@ public:
 
     void WaitIO(const int& timeout_in_millsecond);
 
+    // 起一个线程专门阻塞在srt_epoll_wait上, 有事件时唤醒dispatch_loop,
+    // 读写回调都在dispatch_loop线程里执行, srt不再跟tcp轮流等待
+    int Start(IoLoop* dispatch_loop);
+
+private:
+    int Poll(const int& timeout_in_millsecond, std::vector<int>& can_read, std::vector<int>& can_write);
+    void Dispatch(const std::vector<int>& can_read, const std::vector<int>& can_write);
+
+    void WaitThreadMain();
+
 private:
     std::map<int, Fd*> srt_socket_map_;
+
+    IoLoop*                    dispatch_loop_;
+    std::thread*                wait_thread_;
+    std::atomic<bool>           stop_;
+
+    // 上一批事件没处理完之前不再srt_epoll_wait, 否则水平触发会重复上报
+    std::mutex                  dispatch_mutex_;
+    std::condition_variable     dispatch_cond_;
+    bool                        dispatching_;
+
+    // 从srt_epoll_wait返回到回调执行的延迟统计
+    uint64_t                    dispatch_count_;
+    uint64_t                    dispatch_delay_us_;
+    uint64_t                    max_dispatch_delay_us_;
+    uint64_t                    pre_stat_ms_;
 };
     
 #endif // __SRT_EPOLLER_H__
@@ -77,11 +77,11 @@ int SrtProtocol::Parse(IoBuffer& io_buffer)
         ts_reader_.ParseTs(data, len);
 
         std::string media_payload((const char*)data, len);
-		for (auto& sub : subscriber_)
+        subscriber_.ForEach([&media_payload](MediaSubscriber* sub)
         {
-            std::cout << LMSG << "srt route to subscriber " << &sub << std::endl;
+            std::cout << LMSG << "srt route to subscriber " << sub << std::endl;
             sub->SendData(media_payload);
-        }
+        });
 
         //for (auto& pending_sub : wait_header_subscriber_)
         //{
@@ -158,10 +158,7 @@ void SrtProtocol::OnFrame(const Payload& frame)
         media_muxer_.OnAudio(frame);
     }
 
-	for (auto& sub : subscriber_)
-    {    
-        sub->SendMediaData(frame);
-    }
+    subscriber_.SendMediaData(frame);
 }
 
 void SrtProtocol::OnHeader(const Payload& header_frame)
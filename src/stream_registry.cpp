@@ -0,0 +1,347 @@
+#include "stream_registry.h"
+
+static const size_t kInitCapacity = 64;
+
+// 删除后留下的墓碑, 查询要跳过继续往后探测
+static StreamRegistry::Entry kTombstone;
+
+// ======== epoch回收 ========
+// 每个查过的线程一条记录, epoch为0表示不在读, 否则是进入读时看到的全局epoch.
+// 写者摘掉节点之后推进全局epoch, 所有在读的线程的epoch都比节点摘掉时大才能释放.
+// 线程都是常驻的loop线程, 记录不回收.
+struct EpochRecord
+{
+    std::atomic<uint64_t>   epoch;
+    EpochRecord*            next;
+};
+
+static std::atomic<uint64_t> g_epoch(1);
+static std::atomic<EpochRecord*> g_epoch_records(NULL);
+
+static thread_local EpochRecord* t_epoch_record = NULL;
+static thread_local int t_read_depth = 0;
+
+static EpochRecord* GetEpochRecord()
+{
+    if (t_epoch_record == NULL)
+    {
+        EpochRecord* record = new EpochRecord();
+        record->epoch.store(0, std::memory_order_relaxed);
+        record->next = g_epoch_records.load(std::memory_order_relaxed);
+
+        while (! g_epoch_records.compare_exchange_weak(record->next, record))
+        {
+        }
+
+        t_epoch_record = record;
+    }
+
+    return t_epoch_record;
+}
+
+StreamRegistry::ReadGuard::ReadGuard()
+{
+    if (t_read_depth++ == 0)
+    {
+        GetEpochRecord()->epoch.store(g_epoch.load(std::memory_order_acquire), std::memory_order_relaxed);
+        // 跟写者摘节点之后的fence配对, 要么写者看到我在读, 要么我看不到被摘掉的节点
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+}
+
+StreamRegistry::ReadGuard::~ReadGuard()
+{
+    if (--t_read_depth == 0)
+    {
+        t_epoch_record->epoch.store(0, std::memory_order_release);
+    }
+}
+
+// ======== StreamRegistry ========
+StreamRegistry::StreamRegistry()
+    : table_(NewTable(kInitCapacity))
+    , used_(0)
+    , next_id_(0)
+    , size_(0)
+{
+}
+
+StreamRegistry::~StreamRegistry()
+{
+    Table* table = table_.load(std::memory_order_relaxed);
+
+    for (size_t i = 0; i <= table->mask; ++i)
+    {
+        Entry* entry = table->slots[i].load(std::memory_order_relaxed);
+
+        if (entry != NULL && entry != &kTombstone)
+        {
+            delete entry;
+        }
+    }
+
+    FreeTable(table);
+
+    for (const auto& retired : retired_)
+    {
+        delete retired.entry;
+        FreeTable(retired.table);
+    }
+}
+
+// FNV-1a, app和stream中间当成有个'/'
+uint64_t StreamRegistry::Hash(const std::string& app, const std::string& stream)
+{
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (size_t i = 0; i < app.size(); ++i)
+    {
+        hash = (hash ^ (uint8_t)app[i]) * 1099511628211ULL;
+    }
+
+    hash = (hash ^ '/') * 1099511628211ULL;
+
+    for (size_t i = 0; i < stream.size(); ++i)
+    {
+        hash = (hash ^ (uint8_t)stream[i]) * 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+const StreamRegistry::Entry* StreamRegistry::Find(const std::string& app, const std::string& stream) const
+{
+    return Find(table_.load(std::memory_order_acquire), Hash(app, stream), app, stream);
+}
+
+const StreamRegistry::Entry* StreamRegistry::Find(const Table* table, const uint64_t& hash, const std::string& app, const std::string& stream) const
+{
+    for (size_t i = hash & table->mask; ; i = (i + 1) & table->mask)
+    {
+        const Entry* entry = table->slots[i].load(std::memory_order_acquire);
+
+        if (entry == NULL)
+        {
+            return NULL;
+        }
+
+        if (entry != &kTombstone && entry->hash == hash && entry->stream == stream && entry->app == app)
+        {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+const StreamRegistry::Entry* StreamRegistry::Any() const
+{
+    const Table* table = table_.load(std::memory_order_acquire);
+
+    for (size_t i = 0; i <= table->mask; ++i)
+    {
+        const Entry* entry = table->slots[i].load(std::memory_order_acquire);
+
+        if (entry != NULL && entry != &kTombstone)
+        {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+bool StreamRegistry::Insert(const std::string& app, const std::string& stream, MediaPublisher* publisher, IoLoop* io_loop)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    uint64_t hash = Hash(app, stream);
+
+    if (Find(table_.load(std::memory_order_relaxed), hash, app, stream) != NULL)
+    {
+        return false;
+    }
+
+    Table* table = table_.load(std::memory_order_relaxed);
+
+    // 装载率(算上墓碑)不超过一半, 探测链短, 也保证一定有空位
+    if ((used_ + 1) * 2 > table->mask + 1)
+    {
+        size_t capacity = table->mask + 1;
+
+        // 主要是墓碑的话原大小重建一下就行
+        if ((size_ + 1) * 4 > capacity)
+        {
+            capacity *= 2;
+        }
+
+        Rehash(capacity);
+        table = table_.load(std::memory_order_relaxed);
+    }
+
+    Entry* entry = new Entry();
+    entry->id = ++next_id_;
+    entry->hash = hash;
+    entry->app = app;
+    entry->stream = stream;
+    entry->publisher = publisher;
+    entry->io_loop = io_loop;
+
+    for (size_t i = hash & table->mask; ; i = (i + 1) & table->mask)
+    {
+        Entry* old = table->slots[i].load(std::memory_order_relaxed);
+
+        if (old == NULL || old == &kTombstone)
+        {
+            if (old == NULL)
+            {
+                ++used_;
+            }
+
+            table->slots[i].store(entry, std::memory_order_release);
+            break;
+        }
+    }
+
+    size_.fetch_add(1, std::memory_order_relaxed);
+
+    return true;
+}
+
+bool StreamRegistry::Erase(const std::string& app, const std::string& stream, MediaPublisher* publisher)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    uint64_t hash = Hash(app, stream);
+    Table* table = table_.load(std::memory_order_relaxed);
+
+    for (size_t i = hash & table->mask; ; i = (i + 1) & table->mask)
+    {
+        Entry* entry = table->slots[i].load(std::memory_order_relaxed);
+
+        if (entry == NULL)
+        {
+            return false;
+        }
+
+        if (entry != &kTombstone && entry->hash == hash && entry->stream == stream && entry->app == app)
+        {
+            if (entry->publisher != publisher)
+            {
+                return false;
+            }
+
+            table->slots[i].store(&kTombstone, std::memory_order_release);
+            size_.fetch_sub(1, std::memory_order_relaxed);
+
+            Retire(entry, NULL);
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+StreamRegistry::Table* StreamRegistry::NewTable(const size_t& capacity)
+{
+    Table* table = new Table();
+
+    table->mask = capacity - 1;
+    table->slots = new std::atomic<Entry*>[capacity];
+
+    for (size_t i = 0; i < capacity; ++i)
+    {
+        table->slots[i].store(NULL, std::memory_order_relaxed);
+    }
+
+    return table;
+}
+
+void StreamRegistry::FreeTable(Table* table)
+{
+    if (table != NULL)
+    {
+        delete [] table->slots;
+        delete table;
+    }
+}
+
+void StreamRegistry::Rehash(const size_t& capacity)
+{
+    Table* old_table = table_.load(std::memory_order_relaxed);
+    Table* new_table = NewTable(capacity);
+
+    // 节点直接搬过去, 不拷贝, 读者拿着的节点还是有效的
+    for (size_t i = 0; i <= old_table->mask; ++i)
+    {
+        Entry* entry = old_table->slots[i].load(std::memory_order_relaxed);
+
+        if (entry == NULL || entry == &kTombstone)
+        {
+            continue;
+        }
+
+        for (size_t j = entry->hash & new_table->mask; ; j = (j + 1) & new_table->mask)
+        {
+            if (new_table->slots[j].load(std::memory_order_relaxed) == NULL)
+            {
+                new_table->slots[j].store(entry, std::memory_order_relaxed);
+                break;
+            }
+        }
+    }
+
+    used_ = size_.load(std::memory_order_relaxed);
+
+    table_.store(new_table, std::memory_order_release);
+
+    Retire(NULL, old_table);
+}
+
+void StreamRegistry::Retire(Entry* entry, Table* table)
+{
+    Retired retired;
+    retired.epoch = g_epoch.fetch_add(1, std::memory_order_acq_rel);
+    retired.entry = entry;
+    retired.table = table;
+
+    retired_.push_back(retired);
+
+    Reclaim();
+}
+
+void StreamRegistry::Reclaim()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    // 还在读的线程里最老的epoch, 在它之前摘掉的都可以释放
+    uint64_t min_epoch = (uint64_t)-1;
+
+    for (EpochRecord* record = g_epoch_records.load(std::memory_order_acquire); record != NULL; record = record->next)
+    {
+        uint64_t epoch = record->epoch.load(std::memory_order_acquire);
+
+        if (epoch != 0 && epoch < min_epoch)
+        {
+            min_epoch = epoch;
+        }
+    }
+
+    size_t keep = 0;
+
+    for (size_t i = 0; i < retired_.size(); ++i)
+    {
+        if (retired_[i].epoch < min_epoch)
+        {
+            delete retired_[i].entry;
+            FreeTable(retired_[i].table);
+        }
+        else
+        {
+            retired_[keep++] = retired_[i];
+        }
+    }
+
+    retired_.resize(keep);
+}
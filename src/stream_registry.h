@@ -0,0 +1,95 @@
+#ifndef __STREAM_REGISTRY_H__
+#define __STREAM_REGISTRY_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class IoLoop;
+class MediaPublisher;
+
+// app/stream -> 发布者, 读多写少. 开放寻址线性探测, 查询不加锁, 任何线程都能查;
+// 注册/注销在锁里改, 删掉的节点和扩容换下来的旧表按epoch延迟释放.
+// 每个流一个节点, 键(app/stream)和hash只算一次, 节点地址就是流在进程里的唯一id.
+class StreamRegistry
+{
+public:
+    struct Entry
+    {
+        // 注册时分配, 进程里不重复. 节点释放后地址可能被复用, 要长期记着某个流用这个
+        uint64_t        id;
+        uint64_t        hash;
+        std::string     app;
+        std::string     stream;
+        MediaPublisher* publisher;
+        IoLoop*         io_loop;
+    };
+
+    // 查询期间要持有, 拿到的Entry在析构之前不会被释放. 可以嵌套
+    class ReadGuard
+    {
+    public:
+        ReadGuard();
+        ~ReadGuard();
+
+    private:
+        ReadGuard(const ReadGuard&);
+        ReadGuard& operator=(const ReadGuard&);
+    };
+
+    StreamRegistry();
+    ~StreamRegistry();
+
+    static uint64_t Hash(const std::string& app, const std::string& stream);
+
+    // 要持有ReadGuard
+    const Entry* Find(const std::string& app, const std::string& stream) const;
+    const Entry* Any() const;
+
+    bool Insert(const std::string& app, const std::string& stream, MediaPublisher* publisher, IoLoop* io_loop);
+    bool Erase(const std::string& app, const std::string& stream, MediaPublisher* publisher);
+
+    size_t Size() const { return size_.load(std::memory_order_relaxed); }
+
+private:
+    struct Table
+    {
+        size_t                  mask;
+        std::atomic<Entry*>*    slots;
+    };
+
+    struct Retired
+    {
+        uint64_t    epoch;
+        Entry*      entry;
+        Table*      table;
+    };
+
+    StreamRegistry(const StreamRegistry&);
+    StreamRegistry& operator=(const StreamRegistry&);
+
+    static Table* NewTable(const size_t& capacity);
+    static void FreeTable(Table* table);
+
+    const Entry* Find(const Table* table, const uint64_t& hash, const std::string& app, const std::string& stream) const;
+    void Rehash(const size_t& capacity);
+    void Retire(Entry* entry, Table* table);
+    void Reclaim();
+
+private:
+    std::atomic<Table*> table_;
+
+    // 下面的都在锁里改
+    std::mutex          mutex_;
+    size_t              used_; // 包括墓碑
+    uint64_t            next_id_;
+    std::atomic<size_t> size_;
+
+    std::vector<Retired> retired_;
+};
+
+#endif // __STREAM_REGISTRY_H__
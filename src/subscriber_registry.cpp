@@ -0,0 +1,183 @@
+#include <assert.h>
+
+#include "media_subscriber.h"
+#include "subscriber_registry.h"
+
+SubscriberRegistry::SubscriberRegistry(MediaPublisher* publisher)
+    : publisher_(publisher)
+    , size_(0)
+    , dispatching_(0)
+    , has_hole_(false)
+{
+}
+
+bool SubscriberRegistry::Add(MediaSubscriber* subscriber)
+{
+    if (Has(subscriber))
+    {
+        return false;
+    }
+
+    assert(subscriber->GetType() < kSubscriberTypeCount);
+
+    std::vector<MediaSubscriber*>& group = group_[subscriber->GetType()];
+
+    subscriber->registry_index_ = group.size();
+    group.push_back(subscriber);
+
+    ++size_;
+
+    return true;
+}
+
+bool SubscriberRegistry::Remove(MediaSubscriber* subscriber)
+{
+    if (! Has(subscriber))
+    {
+        return false;
+    }
+
+    std::vector<MediaSubscriber*>& group = group_[subscriber->GetType()];
+    size_t index = subscriber->registry_index_;
+
+    subscriber->registry_index_ = MediaSubscriber::kInvalidIndex;
+    --size_;
+
+    // 正在遍历, 先留个空位
+    if (dispatching_ != 0)
+    {
+        group[index] = NULL;
+        has_hole_ = true;
+    }
+    else
+    {
+        Erase(group, index);
+    }
+
+    return true;
+}
+
+bool SubscriberRegistry::Has(MediaSubscriber* subscriber) const
+{
+    if (subscriber->GetType() >= kSubscriberTypeCount)
+    {
+        return false;
+    }
+
+    const std::vector<MediaSubscriber*>& group = group_[subscriber->GetType()];
+    size_t index = subscriber->registry_index_;
+
+    return index < group.size() && group[index] == subscriber;
+}
+
+void SubscriberRegistry::Clear()
+{
+    for (int type = 0; type < kSubscriberTypeCount; ++type)
+    {
+        std::vector<MediaSubscriber*>& group = group_[type];
+
+        for (size_t i = 0; i < group.size(); ++i)
+        {
+            if (group[i] != NULL)
+            {
+                group[i]->registry_index_ = MediaSubscriber::kInvalidIndex;
+                group[i] = NULL;
+            }
+        }
+
+        if (dispatching_ == 0)
+        {
+            group.clear();
+        }
+    }
+
+    size_ = 0;
+    has_hole_ = (dispatching_ != 0);
+}
+
+void SubscriberRegistry::SendMediaData(const Payload& payload)
+{
+    BeginDispatch();
+
+    for (int type = 0; type < kSubscriberTypeCount; ++type)
+    {
+        std::vector<MediaSubscriber*>& group = group_[type];
+        size_t count = group.size();
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            // 同组都是同一个类, 随便找一个调
+            if (group[i] != NULL)
+            {
+                group[i]->SendMediaDataBatch(publisher_, group, count, payload);
+                break;
+            }
+        }
+    }
+
+    EndDispatch();
+}
+
+void SubscriberRegistry::SendData(const uint16_t& type, const std::string& data)
+{
+    if (type >= kSubscriberTypeCount)
+    {
+        return;
+    }
+
+    BeginDispatch();
+
+    std::vector<MediaSubscriber*>& group = group_[type];
+    size_t count = group.size();
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (group[i] != NULL)
+        {
+            group[i]->SendData(data);
+        }
+    }
+
+    EndDispatch();
+}
+
+void SubscriberRegistry::EndDispatch()
+{
+    if (--dispatching_ != 0 || ! has_hole_)
+    {
+        return;
+    }
+
+    has_hole_ = false;
+
+    for (int type = 0; type < kSubscriberTypeCount; ++type)
+    {
+        std::vector<MediaSubscriber*>& group = group_[type];
+
+        size_t i = 0;
+        while (i < group.size())
+        {
+            if (group[i] == NULL)
+            {
+                Erase(group, i);
+            }
+            else
+            {
+                ++i;
+            }
+        }
+    }
+}
+
+void SubscriberRegistry::Erase(std::vector<MediaSubscriber*>& group, const size_t& index)
+{
+    MediaSubscriber* last = group.back();
+
+    group[index] = last;
+    group.pop_back();
+
+    if (last != NULL && index < group.size())
+    {
+        last->registry_index_ = index;
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef __SUBSCRIBER_REGISTRY_H__
+#define __SUBSCRIBER_REGISTRY_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "common_define.h"
+
+class MediaPublisher;
+class MediaSubscriber;
+class Payload;
+
+// 发布者的订阅者列表, 按订阅者类型分组, 每组一个连续数组.
+// 订阅者自己记着在组里的下标, 增删都是O(1)(删的时候拿最后一个填坑).
+// 分发的时候每组调一次SendMediaDataBatch, 协议可以把同组共用的工作(序列化, 打包)只做一次.
+// 分发过程中删除的只置空, 分发完再整理, 分发过程中加进来的这一帧不发.
+class SubscriberRegistry
+{
+public:
+    SubscriberRegistry(MediaPublisher* publisher);
+
+    bool Add(MediaSubscriber* subscriber);
+    bool Remove(MediaSubscriber* subscriber);
+    bool Has(MediaSubscriber* subscriber) const;
+    void Clear();
+
+    size_t Size() const { return size_; }
+    bool Empty() const { return size_ == 0; }
+
+    bool HasType(const uint16_t& type) const
+    {
+        return type < kSubscriberTypeCount && ! group_[type].empty();
+    }
+
+    void SendMediaData(const Payload& payload);
+    void SendData(const uint16_t& type, const std::string& data);
+
+    // f(MediaSubscriber*), f里面可以删订阅者
+    template<typename F>
+    void ForEach(F f)
+    {
+        BeginDispatch();
+
+        for (int type = 0; type < kSubscriberTypeCount; ++type)
+        {
+            std::vector<MediaSubscriber*>& group = group_[type];
+            size_t count = group.size();
+
+            for (size_t i = 0; i < count; ++i)
+            {
+                if (group[i] != NULL)
+                {
+                    f(group[i]);
+                }
+            }
+        }
+
+        EndDispatch();
+    }
+
+private:
+    void BeginDispatch() { ++dispatching_; }
+    void EndDispatch();
+    void Erase(std::vector<MediaSubscriber*>& group, const size_t& index);
+
+private:
+    MediaPublisher* publisher_;
+
+    std::vector<MediaSubscriber*> group_[kSubscriberTypeCount];
+    size_t size_;
+
+    int dispatching_;
+    bool has_hole_;
+};
+
+#endif // __SUBSCRIBER_REGISTRY_H__
@@ -0,0 +1,209 @@
+#include <string.h>
+
+#include "ts_packetizer.h"
+#include "ts_segment.h"
+
+static const uint8_t kSyncByte          = 0x47;
+static const uint8_t kPusi              = 0x40;
+static const uint8_t kAfcPayload        = 0x10;
+static const uint8_t kAfcAdaptation     = 0x20;
+static const uint8_t kPcrFlag           = 0x10;
+static const uint8_t kStreamIdVideo     = 0xE0;
+static const uint8_t kStreamIdAudio     = 0xC0;
+static const size_t  kMaxPayloadSize    = TsPacketizer::kTsPacketSize - TsPacketizer::kTsHeaderSize;
+// 长度(1) + flag(1) + PCR(6)
+static const size_t  kPcrAdaptationSize = 8;
+static const size_t  kAdtsSize          = 7;
+
+// AUD, 所有slice类型
+static const uint8_t kAud[6] = {0x00, 0x00, 0x00, 0x01, 0x09, 0xF0};
+
+// PES里的33bit时间戳, 前4bit是flag, 中间穿插marker
+static uint8_t* WriteTimestamp(uint8_t* p, const uint8_t& flag, const uint64_t& ts)
+{
+    p[0] = (uint8_t)((flag << 4) | (((ts >> 30) & 0x07) << 1) | 0x01);
+    p[1] = (uint8_t)(ts >> 22);
+    p[2] = (uint8_t)((((ts >> 15) & 0x7F) << 1) | 0x01);
+    p[3] = (uint8_t)(ts >> 7);
+    p[4] = (uint8_t)(((ts & 0x7F) << 1) | 0x01);
+
+    return p + 5;
+}
+
+// 33bit base(90k) + 6bit保留 + 9bit ext, ext填0
+static void WritePcr(uint8_t* p, const uint64_t& pcr_base)
+{
+    p[0] = (uint8_t)(pcr_base >> 25);
+    p[1] = (uint8_t)(pcr_base >> 17);
+    p[2] = (uint8_t)(pcr_base >> 9);
+    p[3] = (uint8_t)(pcr_base >> 1);
+    p[4] = (uint8_t)(((pcr_base & 0x01) << 7) | 0x7E);
+    p[5] = 0x00;
+}
+
+TsPacketizer::TsPacketizer(const uint16_t& video_pid, const uint16_t& audio_pid)
+{
+    video_.header[0] = kSyncByte;
+    video_.header[1] = (uint8_t)((video_pid >> 8) & 0x1F);
+    video_.header[2] = (uint8_t)(video_pid & 0xFF);
+    video_.header[3] = 0;
+    video_.continuity_counter = 0;
+
+    audio_.header[0] = kSyncByte;
+    audio_.header[1] = (uint8_t)((audio_pid >> 8) & 0x1F);
+    audio_.header[2] = (uint8_t)(audio_pid & 0xFF);
+    audio_.header[3] = 0;
+    audio_.continuity_counter = 0;
+}
+
+size_t TsPacketizer::PacketVideo(const uint8_t* data, const size_t& len, const uint64_t& pts_ms, const uint64_t& dts_ms, TsSegment& out)
+{
+    uint8_t pes[32];
+    uint8_t* p = pes;
+
+    *p++ = 0x00;
+    *p++ = 0x00;
+    *p++ = 0x01;
+    *p++ = kStreamIdVideo;
+    // 视频的PES长度填0, 不限长度
+    *p++ = 0x00;
+    *p++ = 0x00;
+    *p++ = 0x80;
+    *p++ = 0xC0; // PTS + DTS
+    *p++ = 10;
+
+    p = WriteTimestamp(p, 0x03, pts_ms * 90);
+    p = WriteTimestamp(p, 0x01, dts_ms * 90);
+
+    memcpy(p, kAud, sizeof(kAud));
+    p += sizeof(kAud);
+
+    return Packet(video_, pes, p - pes, data, len, true, dts_ms, out);
+}
+
+size_t TsPacketizer::PacketAudio(const uint8_t* data, const size_t& len, const uint8_t* adts, const uint64_t& pts_ms, TsSegment& out)
+{
+    uint8_t pes[32];
+    uint8_t* p = pes;
+
+    // PES头里长度后面的3字节flag + 5字节PTS + ADTS + 负载
+    size_t pes_len = 3 + 5 + (adts != NULL ? kAdtsSize : 0) + len;
+
+    if (pes_len > 0xFFFF)
+    {
+        pes_len = 0;
+    }
+
+    *p++ = 0x00;
+    *p++ = 0x00;
+    *p++ = 0x01;
+    *p++ = kStreamIdAudio;
+    *p++ = (uint8_t)(pes_len >> 8);
+    *p++ = (uint8_t)(pes_len);
+    *p++ = 0x80;
+    *p++ = 0x80; // 只有PTS
+    *p++ = 5;
+
+    p = WriteTimestamp(p, 0x02, pts_ms * 90);
+
+    if (adts != NULL)
+    {
+        memcpy(p, adts, kAdtsSize);
+        p += kAdtsSize;
+    }
+
+    return Packet(audio_, pes, p - pes, data, len, false, 0, out);
+}
+
+size_t TsPacketizer::Packet(Stream& stream, const uint8_t* prefix, const size_t& prefix_len, const uint8_t* data, const size_t& len,
+                            const bool& with_pcr, const uint64_t& pcr_ms, TsSegment& out)
+{
+    size_t total = prefix_len + len;
+    size_t first_capacity = kMaxPayloadSize - (with_pcr ? kPcrAdaptationSize : 0);
+
+    size_t count = 1;
+    if (total > first_capacity)
+    {
+        count += (total - first_capacity + kMaxPayloadSize - 1) / kMaxPayloadSize;
+    }
+
+    // 包位一次留够, 下面直接往里填
+    uint8_t* packet = out.Reserve(count * kTsPacketSize);
+    size_t pos = 0; // 在prefix+data里的偏移
+
+    for (size_t n = 0; n < count; ++n, packet += kTsPacketSize)
+    {
+        bool first = (n == 0);
+        bool pcr = (first && with_pcr);
+
+        memcpy(packet, stream.header, kTsHeaderSize);
+
+        if (first)
+        {
+            packet[1] |= kPusi;
+        }
+
+        packet[3] = kAfcPayload | stream.continuity_counter;
+        stream.continuity_counter = (stream.continuity_counter + 1) & 0x0F;
+
+        uint8_t* p = packet + kTsHeaderSize;
+
+        size_t adaptation_size = pcr ? kPcrAdaptationSize : 0;
+        size_t payload_size = kMaxPayloadSize - adaptation_size;
+        size_t left = total - pos;
+
+        // 不够一个包的用自适应区填充
+        if (left < payload_size)
+        {
+            adaptation_size += payload_size - left;
+            payload_size = left;
+        }
+
+        if (adaptation_size > 0)
+        {
+            packet[3] |= kAfcAdaptation;
+            p[0] = (uint8_t)(adaptation_size - 1);
+
+            // 只差1个字节时只有长度字节(长度为0)
+            if (adaptation_size > 1)
+            {
+                p[1] = pcr ? kPcrFlag : 0x00;
+
+                uint8_t* stuffing = p + 2;
+
+                if (pcr)
+                {
+                    WritePcr(stuffing, pcr_ms * 90);
+                    stuffing += 6;
+                }
+
+                memset(stuffing, 0xFF, p + adaptation_size - stuffing);
+            }
+
+            p += adaptation_size;
+        }
+
+        size_t copied = 0;
+
+        if (pos < prefix_len)
+        {
+            copied = prefix_len - pos;
+
+            if (copied > payload_size)
+            {
+                copied = payload_size;
+            }
+
+            memcpy(p, prefix + pos, copied);
+        }
+
+        if (copied < payload_size)
+        {
+            memcpy(p + copied, data + (pos + copied - prefix_len), payload_size - copied);
+        }
+
+        pos += payload_size;
+    }
+
+    return count;
+}
@@ -0,0 +1,44 @@
+#ifndef __TS_PACKETIZER_H__
+#define __TS_PACKETIZER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+class TsSegment;
+
+// 一帧ES打成PES再切成188字节的TS包, 直接写进切片末尾预留好的包位里.
+// 每个PID一个4字节包头模板(同步字节+PID), 每个包只改PUSI/AFC/CC; PES头按字节拼好.
+// PAT/PMT不归这里管.
+class TsPacketizer
+{
+public:
+    enum
+    {
+        kTsPacketSize   = 188,
+        kTsHeaderSize   = 4,
+    };
+
+    TsPacketizer(const uint16_t& video_pid, const uint16_t& audio_pid);
+
+    // data是annexb, PES头后面自动加AUD. 首包带PCR. 返回写进out的包数, 包在out.GetTail里
+    size_t PacketVideo(const uint8_t* data, const size_t& len, const uint64_t& pts_ms, const uint64_t& dts_ms, TsSegment& out);
+
+    // data是裸AAC, adts是填好长度的7字节头, 为NULL时不加
+    size_t PacketAudio(const uint8_t* data, const size_t& len, const uint8_t* adts, const uint64_t& pts_ms, TsSegment& out);
+
+private:
+    struct Stream
+    {
+        uint8_t header[kTsHeaderSize];
+        uint8_t continuity_counter;
+    };
+
+    size_t Packet(Stream& stream, const uint8_t* prefix, const size_t& prefix_len, const uint8_t* data, const size_t& len,
+                  const bool& with_pcr, const uint64_t& pcr_ms, TsSegment& out);
+
+private:
+    Stream video_;
+    Stream audio_;
+};
+
+#endif // __TS_PACKETIZER_H__
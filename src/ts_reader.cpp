@@ -1203,6 +1203,12 @@ void TsReader::OnH264Video(BitBuffer& bit_buffer, const uint32_t& pts, const uin
         }   
 
         std::string header = "";
+
+        // 一个PES是一帧, 里面的slice拼成一个access unit一起分发
+        std::vector<std::pair<const uint8_t*, int>> frame_nals;
+        bool is_key_frame = false;
+        uint8_t frame_nal_ref_idc = 0;
+
         for (const auto& kv :nals)
         {
             const uint8_t* nal = kv.first;
@@ -1216,22 +1222,12 @@ void TsReader::OnH264Video(BitBuffer& bit_buffer, const uint32_t& pts, const uin
                 std::cout << LMSG << "nal_ref_idc:" << (int)nal_ref_idc << ", nal_type:" << (int) nal_type << std::endl;
                 bool dispatch = true;
 
-                uint8_t* nal_ref = (uint8_t*)malloc(len + 4);
-                nal_ref[0] = 0x00;
-                nal_ref[1] = 0x00;
-                nal_ref[2] = 0x00;
-                nal_ref[3] = 0x01;
-                memcpy(nal_ref + 4, nal, len);
-                Payload video_frame(nal_ref, len + 4);
-                video_frame.SetVideo();
-                video_frame.SetPts(pts / 90);
-                video_frame.SetDts(dts / 90);
                 // see @ https://www.itu.int/rec/dologin_pub.asp?lang=e&id=T-REC-H.264-200305-S!!PDF-E&type=items
                 // 7.3.3 Slice header syntax
                 // slice_header()
                 if (nal_type == H264NalType_IDR_SLICE)
                 {
-                    video_frame.SetIFrame();
+                    is_key_frame = true;
                 }
                 else if (nal_type == H264NalType_SLICE)
                 {
@@ -1253,9 +1249,9 @@ void TsReader::OnH264Video(BitBuffer& bit_buffer, const uint32_t& pts, const uin
 
                     if (header_complete && header_callback_)
                     {
-                        uint8_t* nal_ref = (uint8_t*)malloc(header.size());
+                        Payload header_frame(header.size());
+                        uint8_t* nal_ref = header_frame.GetAllData();
                         memcpy(nal_ref, header.data(), header.size());
-                        Payload header_frame(nal_ref, header.size());
                         header_frame.SetVideo();
                         header_callback_(header_frame);
                     }
@@ -1265,9 +1261,14 @@ void TsReader::OnH264Video(BitBuffer& bit_buffer, const uint32_t& pts, const uin
                     dispatch = false;
                 }
 
-                if (dispatch && frame_callback_)
+                if (dispatch)
                 {
-                    frame_callback_(video_frame);
+                    frame_nals.push_back(kv);
+
+                    if (nal_ref_idc > frame_nal_ref_idc)
+                    {
+                        frame_nal_ref_idc = nal_ref_idc;
+                    }
                 }
                 else
                 {
@@ -1275,6 +1276,8 @@ void TsReader::OnH264Video(BitBuffer& bit_buffer, const uint32_t& pts, const uin
                 }
             }   
         }
+
+        DispatchVideoFrame(frame_nals, pts, dts, is_key_frame, frame_nal_ref_idc);
     }
 }
 
@@ -1316,6 +1319,13 @@ void TsReader::OnH265Video(BitBuffer& bit_buffer, const uint32_t& pts, const uin
         }   
 
         std::string header = "";
+
+        // 一个PES是一帧, 里面的slice拼成一个access unit一起分发
+        std::vector<std::pair<const uint8_t*, int>> frame_nals;
+        bool is_key_frame = false;
+        // H265没有nal_ref_idc, 都当成被参考
+        uint8_t frame_nal_ref_idc = Payload::kRefNal;
+
         for (const auto& kv :nals)
         {
             const uint8_t* nal = kv.first;
@@ -1332,16 +1342,6 @@ void TsReader::OnH265Video(BitBuffer& bit_buffer, const uint32_t& pts, const uin
                                   << ",layer_id=" << (int)layer_id << ",tid=" << (int)tid << std::endl;
                 bool dispatch = true;
 
-                uint8_t* nal_ref = (uint8_t*)malloc(len + 4);
-                nal_ref[0] = 0x00;
-                nal_ref[1] = 0x00;
-                nal_ref[2] = 0x00;
-                nal_ref[3] = 0x01;
-                memcpy(nal_ref + 4, nal, len);
-                Payload video_frame(nal_ref, len + 4);
-                video_frame.SetVideo();
-                video_frame.SetPts(pts / 90);
-                video_frame.SetDts(dts / 90);
                 // see @ https://www.itu.int/rec/dologin.asp?lang=e&id=T-REC-H.265-201504-S!!PDF-E&type=items
                 // 7.3.6.1 General slice segment header syntax
                 // slice_segment_header( ) {
@@ -1349,7 +1349,7 @@ void TsReader::OnH265Video(BitBuffer& bit_buffer, const uint32_t& pts, const uin
                 	nal_type == H265NalType_BLA_W_RADL || nal_type == H265NalType_CRA_NUT ||
                 	nal_type == H265NalType_IDR_N_LP || nal_type == H265NalType_IDR_W_RADL)
                 {
-                    video_frame.SetIFrame();
+                    is_key_frame = true;
                 }
                 else if (nal_type == H264NalType_SLICE)
                 {
@@ -1377,9 +1377,9 @@ void TsReader::OnH265Video(BitBuffer& bit_buffer, const uint32_t& pts, const uin
 
                     if (header_complete && header_callback_)
                     {
-                        uint8_t* nal_ref = (uint8_t*)malloc(header.size());
+                        Payload header_frame(header.size());
+                        uint8_t* nal_ref = header_frame.GetAllData();
                         memcpy(nal_ref, header.data(), header.size());
-                        Payload header_frame(nal_ref, header.size());
                         header_frame.SetVideo();
                         header_callback_(header_frame);
                     }
@@ -1389,9 +1389,9 @@ void TsReader::OnH265Video(BitBuffer& bit_buffer, const uint32_t& pts, const uin
                     dispatch = false;
                 }
 
-                if (dispatch && frame_callback_)
+                if (dispatch)
                 {
-                    frame_callback_(video_frame);
+                    frame_nals.push_back(kv);
                 }
                 else
                 {
@@ -1400,7 +1400,55 @@ void TsReader::OnH265Video(BitBuffer& bit_buffer, const uint32_t& pts, const uin
                 }
             }   
         }
+
+        DispatchVideoFrame(frame_nals, pts, dts, is_key_frame, frame_nal_ref_idc);
+    }
+}
+
+void TsReader::DispatchVideoFrame(const std::vector<std::pair<const uint8_t*, int>>& nals, const uint32_t& pts, const uint32_t& dts,
+                                  const bool& is_key_frame, const uint8_t& nal_ref_idc)
+{
+    if (nals.empty() || ! frame_callback_)
+    {
+        return;
     }
+
+    size_t frame_len = 0;
+    for (const auto& kv : nals)
+    {
+        frame_len += 4 + kv.second;
+    }
+
+    // 起始码换成4字节长度(AVCC), 跟RTMP推上来的一样
+    Payload video_frame(frame_len);
+    uint8_t* p = video_frame.GetAllData();
+    uint32_t offset = 0;
+
+    for (const auto& kv : nals)
+    {
+        uint32_t len = kv.second;
+
+        p[offset] = (len >> 24) & 0xFF;
+        p[offset + 1] = (len >> 16) & 0xFF;
+        p[offset + 2] = (len >> 8) & 0xFF;
+        p[offset + 3] = len & 0xFF;
+        memcpy(p + offset + 4, kv.first, len);
+
+        video_frame.AddNalu(offset);
+        offset += 4 + len;
+    }
+
+    video_frame.SetVideo();
+    video_frame.SetNalRefIdc(nal_ref_idc);
+    video_frame.SetPts(pts / 90);
+    video_frame.SetDts(dts / 90);
+
+    if (is_key_frame)
+    {
+        video_frame.SetIFrame();
+    }
+
+    frame_callback_(video_frame);
 }
 
 void TsReader::OnAudio(BitBuffer& bit_buffer, const uint32_t& pts)
@@ -1414,7 +1462,8 @@ void TsReader::OnAudio(BitBuffer& bit_buffer, const uint32_t& pts)
 
         // adts to audio special config
         const uint8_t* p = bit_buffer.CurData();
-        uint8_t* audio_header_ref = (uint8_t*)malloc(2);
+        Payload header_frame(2);
+        uint8_t* audio_header_ref = header_frame.GetAllData();
     	audio_header_ref[0] = 0x00;
     	audio_header_ref[1] = 0x00;
          
@@ -1483,7 +1532,6 @@ void TsReader::OnAudio(BitBuffer& bit_buffer, const uint32_t& pts)
     	audio_header_ref[0] = (profile << 3) | (sampling_frequency_index >> 1); 
     	audio_header_ref[1] = ((sampling_frequency_index & 0x01) << 7) | (channel_configuration << 3); 
 
-        Payload header_frame(audio_header_ref, 2);
         header_frame.SetAudio();
         if (header_callback_)
         {
@@ -1498,13 +1546,13 @@ void TsReader::OnAudio(BitBuffer& bit_buffer, const uint32_t& pts)
             std::cout << LMSG << "no more than " << len << " bytes left, left " << bit_buffer.BytesLeft() << std::endl;
             break;
         }
-        uint8_t* audio_ref = (uint8_t*)malloc(len + 2);
+        Payload audio_frame(len + 2);
+        uint8_t* audio_ref = audio_frame.GetAllData();
         audio_ref[0] = 0xAF;
         audio_ref[1] = 0x01;
         memcpy(audio_ref + 2, bit_buffer.CurData(), len);
         bit_buffer.SkipBytes(len);
 
-        Payload audio_frame(audio_ref, len + 2);
         audio_frame.SetAudio();
         //audio_frame.SetDts(pts / 90 + i * (sample_rate / 1024.0 / channles));
         audio_frame.SetDts((cal_pts + i * (90000.0/(44100.0/1024.0/2))) / 90.0);
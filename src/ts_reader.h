@@ -3,6 +3,7 @@
 
 #include <functional>
 #include <map>
+#include <vector>
 
 class BitBuffer;
 class Payload;
@@ -46,6 +47,9 @@ private:
     void OnH264Video(BitBuffer& bit_buffer, const uint32_t& pts, const uint32_t& dts);
     void OnH265Video(BitBuffer& bit_buffer, const uint32_t& pts, const uint32_t& dts);
 
+    void DispatchVideoFrame(const std::vector<std::pair<const uint8_t*, int>>& nals, const uint32_t& pts, const uint32_t& dts,
+                            const bool& is_key_frame, const uint8_t& nal_ref_idc);
+
 private:
     uint16_t pmt_pid_;
     uint16_t video_pid_;
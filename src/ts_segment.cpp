@@ -0,0 +1,242 @@
+#include <errno.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <iostream>
+
+#include "common_define.h"
+#include "fd.h"
+#include "ts_segment.h"
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+
+// 188的整数倍, 加上块头正好落在内存池64KB那一档
+static const size_t kBlockSize = 188 * 348;
+
+uint64_t TsSegment::budget_bytes_ = 0;
+bool TsSegment::use_memfd_ = false;
+std::atomic<uint64_t> TsSegment::total_bytes_(0);
+
+static int CreateMemfd()
+{
+#if defined(__NR_memfd_create)
+    return syscall(__NR_memfd_create, "tms_ts", MFD_CLOEXEC);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+TsSegment::TsSegment()
+    : size_(0)
+    , memfd_(-1)
+    , memfd_size_(0)
+    , memfd_failed_(false)
+    , snapshot_(false)
+{
+    if (use_memfd_)
+    {
+        memfd_ = CreateMemfd();
+
+        if (memfd_ < 0)
+        {
+            std::cout << LMSG << "memfd_create failed:" << strerror(errno) << ", segment in memory" << std::endl;
+        }
+    }
+}
+
+TsSegment::TsSegment(const TsSegment* base)
+    : blocks_(base->blocks_)
+    , size_(base->size_)
+    , memfd_(-1)
+    , memfd_size_(base->memfd_size_)
+    , memfd_failed_(true)
+    , snapshot_(true)
+{
+    if (base->memfd_ >= 0 && memfd_size_ != 0)
+    {
+        memfd_ = dup(base->memfd_);
+
+        // dup失败就只能不要memfd里那段了
+        if (memfd_ < 0)
+        {
+            std::cout << LMSG << "dup memfd failed:" << strerror(errno) << std::endl;
+
+            blocks_.clear();
+            size_ = 0;
+            memfd_size_ = 0;
+        }
+    }
+
+    SetShared();
+}
+
+TsSegment::~TsSegment()
+{
+    if (memfd_ >= 0)
+    {
+        close(memfd_);
+    }
+
+    if (! snapshot_)
+    {
+        total_bytes_.fetch_sub(size_, std::memory_order_relaxed);
+    }
+}
+
+void TsSegment::SetShared() const
+{
+    for (const auto& block : blocks_)
+    {
+        block.payload.SetShared();
+    }
+}
+
+std::shared_ptr<TsSegment> TsSegment::Snapshot() const
+{
+    return std::shared_ptr<TsSegment>(new TsSegment(this));
+}
+
+uint8_t* TsSegment::Reserve(const size_t& len)
+{
+    if (blocks_.empty() || blocks_.back().payload.GetAllLen() - blocks_.back().len < len)
+    {
+        // 暂存块写满了刷进memfd, 刷失败的话后面的就留在内存里
+        if (memfd_ >= 0 && ! memfd_failed_ && ! blocks_.empty() && FlushToMemfd() == kSuccess)
+        {
+            blocks_.clear();
+        }
+
+        NewBlock(len);
+    }
+
+    Block& block = blocks_.back();
+    uint8_t* data = block.payload.GetAllData() + block.len;
+
+    block.len += len;
+    size_ += len;
+    total_bytes_.fetch_add(len, std::memory_order_relaxed);
+
+    return data;
+}
+
+void TsSegment::Append(const uint8_t* data, const size_t& len)
+{
+    memcpy(Reserve(len), data, len);
+}
+
+const uint8_t* TsSegment::GetTail(const size_t& len) const
+{
+    const Block& block = blocks_.back();
+
+    return block.payload.GetAllData() + block.len - len;
+}
+
+int TsSegment::Send(Fd& socket, const std::string& header, const size_t& offset, const size_t& len)
+{
+    size_t end = offset + len;
+
+    if (end > size_)
+    {
+        end = size_;
+    }
+
+    std::vector<IoVec> iov;
+    iov.reserve(blocks_.size() + 1);
+
+    iov.push_back(IoVec((const uint8_t*)header.data(), header.size()));
+
+    // memfd里是[0, memfd_size_), 后面的在块里
+    if (offset < memfd_size_)
+    {
+        int ret = socket.SendV(iov.data(), iov.size());
+
+        if (ret < 0)
+        {
+            return ret;
+        }
+
+        ret = socket.SendFile(memfd_, offset, (end < memfd_size_ ? end : memfd_size_) - offset, shared_from_this());
+
+        if (ret < 0)
+        {
+            return ret;
+        }
+
+        iov.clear();
+    }
+
+    // 块只会往后追加, 现在的长度以内的数据不会再变, 直接引用
+    size_t pos = memfd_size_;
+
+    for (const auto& block : blocks_)
+    {
+        size_t begin = offset > pos ? offset - pos : 0;
+        size_t stop = end < pos + block.len ? end - pos : block.len;
+
+        if (end <= pos)
+        {
+            break;
+        }
+
+        if (begin < stop)
+        {
+            iov.push_back(IoVec(block.payload.GetAllData() + begin, stop - begin, &block.payload));
+        }
+
+        pos += block.len;
+    }
+
+    if (iov.empty())
+    {
+        return kSuccess;
+    }
+
+    return socket.SendV(iov.data(), iov.size());
+}
+
+TsSegment::Block& TsSegment::NewBlock(const size_t& len)
+{
+    blocks_.push_back(Block());
+
+    Block& block = blocks_.back();
+    block.payload = Payload(len > kBlockSize ? len : kBlockSize);
+    block.len = 0;
+
+    return block;
+}
+
+int TsSegment::FlushToMemfd()
+{
+    Block& block = blocks_.back();
+    size_t written = 0;
+
+    while (written < block.len)
+    {
+        ssize_t ret = pwrite(memfd_, block.payload.GetAllData() + written, block.len - written, memfd_size_ + written);
+
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            std::cout << LMSG << "write memfd failed:" << strerror(errno) << std::endl;
+
+            // 已经刷进去的还在memfd里, 这个切片剩下的都放内存
+            memfd_failed_ = true;
+
+            return kError;
+        }
+
+        written += ret;
+    }
+
+    memfd_size_ += block.len;
+
+    return kSuccess;
+}
@@ -0,0 +1,113 @@
+#ifndef __TS_SEGMENT_H__
+#define __TS_SEGMENT_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ref_ptr.h"
+
+class Fd;
+
+// 一个HLS ts切片, 只往后追加, 写过的字节不再改. 所有请求共用, 发送时不拷贝:
+// 内存模式下数据在一串引用计数的块里, writev直接引用块;
+// memfd模式下写满的块刷进memfd, 用sendfile发, 发送队列持有切片直到发完.
+// 所有流保留的切片总字节数有个预算, 超了各个流少留几个切片.
+class TsSegment : public std::enable_shared_from_this<TsSegment>
+{
+public:
+    TsSegment();
+    ~TsSegment();
+
+    // 在末尾留出len字节连续空间给调用者填
+    uint8_t* Reserve(const size_t& len);
+
+    void Append(const uint8_t* data, const size_t& len);
+
+    // 最后len字节, 要在同一次Reserve里
+    const uint8_t* GetTail(const size_t& len) const;
+
+    size_t GetSize() const
+    {
+        return size_;
+    }
+
+    bool Empty() const
+    {
+        return size_ == 0;
+    }
+
+    // 先发header再发整个切片
+    int Send(Fd& socket, const std::string& header)
+    {
+        return Send(socket, header, 0, size_);
+    }
+
+    // 先发header再发切片里[offset, offset+len)这段, LL-HLS的part就是切片里的一段
+    int Send(Fd& socket, const std::string& header, const size_t& offset, const size_t& len);
+
+    // 要交给别的loop发之前调用, 之后块的引用计数是原子的
+    void SetShared() const;
+
+    // 现在写好的这些数据的只读快照, 跟原切片共用块(memfd dup一份), 原切片可以接着往后写.
+    // 正在切的切片给别的loop用这个, 快照不算预算
+    std::shared_ptr<TsSegment> Snapshot() const;
+
+    static void SetBudget(const uint64_t& budget_bytes)
+    {
+        budget_bytes_ = budget_bytes;
+    }
+
+    static void SetUseMemfd(const bool& use_memfd)
+    {
+        use_memfd_ = use_memfd;
+    }
+
+    static bool IsOverBudget()
+    {
+        return budget_bytes_ != 0 && total_bytes_.load(std::memory_order_relaxed) > budget_bytes_;
+    }
+
+    static uint64_t GetTotalBytes()
+    {
+        return total_bytes_.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Block
+    {
+        Payload payload;
+        size_t  len;
+    };
+
+    TsSegment(const TsSegment&);
+    TsSegment& operator=(const TsSegment&);
+
+    // Snapshot用, 不开memfd
+    explicit TsSegment(const TsSegment* base);
+
+    Block& NewBlock(const size_t& len);
+    int FlushToMemfd();
+
+private:
+    std::vector<Block> blocks_;
+    size_t size_;
+
+    // memfd模式下blocks_里只有一个暂存块, 写满了刷进memfd, 发送时memfd里的用sendfile, 暂存块的用writev
+    int memfd_;
+    size_t memfd_size_;
+    bool memfd_failed_;
+
+    // 快照不再写, 字节数算在原切片上
+    bool snapshot_;
+
+    static uint64_t budget_bytes_;
+    static bool use_memfd_;
+    static std::atomic<uint64_t> total_bytes_;
+};
+
+#endif // __TS_SEGMENT_H__
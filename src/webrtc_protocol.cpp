@@ -20,6 +20,8 @@
 #include "webrtc/p2p/base/stun.h"
 
 const int kWebRtcRecvTimeoutInMs = 10000;
+const int kWebRtcIdleCheckIntervalMs = 2000;
+const int kWebRtcPliIntervalMs = 2500;
 
 const int SRTP_MASTER_KEY_KEY_LEN = 16;
 const int SRTP_MASTER_KEY_SALT_LEN = 14;
@@ -92,7 +94,56 @@ enum class WebRTCPayloadType
 const uint32_t kVideoSSRC = 3233846889;
 const uint32_t kAudioSSRC = 3233846890;
 
-std::set<WebrtcProtocol*> WebrtcProtocol::all_protocols_;
+// 给SRTP的认证tag留出空间
+const size_t kH264RtpMaxPayload = 900;
+
+
+// AVCDecoderConfigurationRecord里取第一个SPS和PPS
+static bool ParseAvcDecoderConfig(const std::string& header, std::string& sps, std::string& pps)
+{
+    const uint8_t* data = (const uint8_t*)header.data();
+    size_t size = header.size();
+
+    if (size < 8 || data[0] != 0x01)
+    {
+        return false;
+    }
+
+    size_t pos = 5;
+
+    if ((data[pos++] & 0x1F) == 0)
+    {
+        return false;
+    }
+
+    size_t sps_len = (data[pos] << 8) | data[pos + 1];
+    pos += 2;
+
+    if (pos + sps_len + 3 > size)
+    {
+        return false;
+    }
+
+    sps.assign((const char*)data + pos, sps_len);
+    pos += sps_len;
+
+    if (data[pos++] == 0)
+    {
+        return false;
+    }
+
+    size_t pps_len = (data[pos] << 8) | data[pos + 1];
+    pos += 2;
+
+    if (pos + pps_len > size)
+    {
+        return false;
+    }
+
+    pps.assign((const char*)data + pos, pps_len);
+
+    return true;
+}
 
 WebrtcProtocol::WebrtcProtocol(IoLoop* io_loop, Fd* socket)
     : MediaPublisher()
@@ -111,25 +162,52 @@ WebrtcProtocol::WebrtcProtocol(IoLoop* io_loop, Fd* socket)
     , send_begin_time_(Util::GetNowMs())
     , datachannel_open_(false)
     , video_seq_(0)
-    , pre_recv_data_time_ms_(Util::GetNowMs())
+    , video_ssrc_(kVideoSSRC)
+    , pre_recv_data_time_ms_(io_loop->GetNowMs())
+    , idle_timer_(io_loop)
+    , pli_timer_(io_loop)
 {
     std::cout << LMSG << std::endl;
 }
 
 WebrtcProtocol::~WebrtcProtocol()
 {
-    close(socket_->fd());
-    all_protocols_.erase(this);
+    // fd由UdpSocket关闭
 }
 
-void WebrtcProtocol::BroadcastH264(const Payload& payload)
+void WebrtcProtocol::StartTimer()
 {
-    for (const auto& webrtc_protocol : all_protocols_)
+    idle_timer_.RunEvery(kWebRtcIdleCheckIntervalMs, std::bind(&WebrtcProtocol::OnIdleTimer, this));
+
+    pli_timer_.RunEvery(kWebRtcPliIntervalMs, [this]()
     {
-        webrtc_protocol->SendMediaData(payload);
-    }
+        EveryNMillSecond(io_loop_->GetNowMs(), kWebRtcPliIntervalMs, pli_timer_.GetFireCount());
+    });
 }
 
+void WebrtcProtocol::OnIdleTimer()
+{
+    if (! CheckCanClose())
+    {
+        return;
+    }
+
+    if (register_publisher_stream_)
+    {
+        subscriber_.ForEach([](MediaSubscriber* sub)
+        {
+            sub->OnStop();
+        });
+
+        g_local_stream_center.UnRegisterStream("webrtc", "test", this);
+    }
+
+    idle_timer_.Cancel();
+    pli_timer_.Cancel();
+
+    // 连带析构this, 本轮后面的分发/flush可能还指向socket_, 不能直接delete
+    io_loop_->DeleteFdLater(socket_);
+}
 
 int WebrtcProtocol::HandleRead(IoBuffer& io_buffer, Fd& socket)
 {
@@ -149,7 +227,7 @@ int WebrtcProtocol::Parse(IoBuffer& io_buffer)
 
     if (len > 0)
     {
-        pre_recv_data_time_ms_ = Util::GetNowMs();
+        pre_recv_data_time_ms_ = io_loop_->GetNowMs();
 
 		if ((data[0] == 0) || (data[0] == 1)) 
    		{   
@@ -694,7 +772,6 @@ int WebrtcProtocol::OnStun(const uint8_t* data, const size_t& len)
                 udp_socket->ModName("udp <-> " + GetUdpSocket()->GetClientIp() + ":" + Util::Num2Str(GetUdpSocket()->GetClientPort()));
 
                 WebrtcProtocol* webrtc_protocol = (WebrtcProtocol*)udp_socket->socket_handler();
-                all_protocols_.insert(webrtc_protocol);
 
                 SessionInfo session_info;
                 g_webrtc_session_mgr.GetSession(g_remote_ice_ufrag, session_info);
@@ -705,6 +782,7 @@ int WebrtcProtocol::OnStun(const uint8_t* data, const size_t& len)
                 webrtc_protocol->SetRemotePwd(g_remote_ice_pwd);
                 // FIXME:这里可能需要根据角色,比如客户端是上行还是下行来做SetConnectState还是SetAcceptState
                 webrtc_protocol->SetConnectState();
+                webrtc_protocol->StartTimer();
             }
             else
             {
@@ -1758,6 +1836,12 @@ int WebrtcProtocol::Handshake()
                     else
                     {
                         std::cout << LMSG << "srtp_send init success" << std::endl;
+
+                        // 能发了再订阅, 订阅的时候就会收到序列头和GOP缓存
+                        if (publisher_ == NULL)
+                        {
+                            SubscribeStream();
+                        }
                     }
 
         			delete [] key;
@@ -1936,7 +2020,7 @@ int WebrtcProtocol::EveryNMillSecond(const uint64_t& now_in_ms, const uint32_t&
     +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
     :            Feedback Control Information (FCI)                 :
 */
-    if (dtls_handshake_done_ && count % 50 == 0)
+    if (dtls_handshake_done_)
     {
         // PLI, 可以工作
         {
@@ -2144,159 +2228,137 @@ void WebrtcProtocol::SendBindingIndication()
     GetUdpSocket()->Send(binding_indication_header.GetData(), binding_indication_header.SizeInBytes());
 }
 
-// 注意, 要拒绝SEI帧发送,不然chrome只能解码关键帧
 int WebrtcProtocol::SendMediaData(const Payload& payload)
 {
-    if (! DtlsHandshakeDone())
+    if (! DtlsHandshakeDone() || publisher_ == NULL)
     {
-        std::cout << LMSG << "dtls handshake no done" << std::endl;
         return -1;
     }
 
-    if (payload.IsAudio())
+    if (! payload.IsVideo() || payload.GetNaluCount() == 0)
     {
         return 0;
     }
 
-    const uint8_t* frame_data = payload.GetRawData();
-    int frame_len = payload.GetRawLen();
-    uint32_t dts = payload.GetDts();
-    webrtc::RTPVideoTypeHeader rtp_video_head;
-
-    std::cout << "media data peek:\n" << Util::Bin2Hex(frame_data, frame_len > 128 ? 128 : frame_len) << std::endl;
-
-    webrtc::RTPVideoHeaderH264& rtp_header_h264 = rtp_video_head.H264;
-
-    webrtc::FrameType frame_type = webrtc::kVideoFrameDelta;
-
+    // 同一个流的webrtc订阅者共用发布者上打好的包
+    const H264RtpPacketizer& packetizer = publisher_->GetWireCache().GetRtpPackets(payload, (uint8_t)WebRTCPayloadType::H264, kH264RtpMaxPayload);
 
-    // FIXME:key frame
+    return SendRtpPackets(packetizer);
+}
 
-    // 编码后的视频帧打包为RTP
-    webrtc::RtpPacketizer* rtp_packetizer = webrtc::RtpPacketizer::Create(webrtc::kRtpVideoH264, 900, &rtp_video_head, frame_type);
+void WebrtcProtocol::SendMediaDataBatch(MediaPublisher* publisher, const std::vector<MediaSubscriber*>& group, const size_t& count, const Payload& payload)
+{
+    if (! payload.IsVideo() || payload.GetNaluCount() == 0)
+    {
+        return;
+    }
 
-    webrtc::RTPFragmentationHeader fragment_header;
-    fragment_header.VerifyAndAllocateFragmentationHeader(1);
+    // 整组只打一次包
+    const H264RtpPacketizer& packetizer = publisher->GetWireCache().GetRtpPackets(payload, (uint8_t)WebRTCPayloadType::H264, kH264RtpMaxPayload);
 
-    fragment_header.fragmentationOffset[0] = 0;
-    fragment_header.fragmentationLength[0] = frame_len;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (group[i] == NULL)
+        {
+            continue;
+        }
 
-    std::cout << LMSG << "fragment_header.fragmentationVectorSize:" << fragment_header.fragmentationVectorSize << std::endl;
-    rtp_packetizer->SetPayloadData(frame_data, frame_len, &fragment_header);
+        WebrtcProtocol* webrtc = static_cast<WebrtcProtocol*>(group[i]);
 
-    bool last_packet = false;
-    do  
-    {   
-        uint8_t rtp[1500] = {0};
-        uint8_t* rtp_packet = rtp + 12; 
-        size_t rtp_packet_len = 0;
-        if (! rtp_packetizer->NextPacket(rtp_packet, &rtp_packet_len, &last_packet))
-        {   
-            std::cout << LMSG << "packet rtp error" << std::endl;
-        }   
-        else
-        {   
-            // DEUBG
-            {
-                uint8_t debug[1500];
-                memcpy(debug, rtp_packet, rtp_packet_len);
-                webrtc::RtpDepacketizer::ParsedPayload parsed_payload;
-                if (! h264_depacket_.Parse(&parsed_payload, debug, rtp_packet_len))
-                {
-                    std::cout << LMSG << "parse h264 failed" << std::endl;
-                }
-                else
-                {
-                    std::cout << LMSG << "payload_length:" << parsed_payload.payload_length
-                                 << ",this:" << this
-                                 << ",video_seq:" << video_seq_
-                                 << ",frame_type:" << parsed_payload.frame_type
-                                 << ",payload_length:" << parsed_payload.payload_length
-                                 << ",frame_type:" << parsed_payload.frame_type
-                                 << ",isFirstPacket:" << parsed_payload.type.Video.isFirstPacket
-                                 << ",width:" << parsed_payload.type.Video.width
-                                 << ",height:" << parsed_payload.type.Video.height
-                                 << ",nalu_type:" << (int)parsed_payload.type.Video.codecHeader.H264.nalu_type
-                                 << ",packetization_type:" << parsed_payload.type.Video.codecHeader.H264.packetization_type
-                                 << ",dump:\n" << Util::Bin2Hex(parsed_payload.payload, parsed_payload.payload_length > 32 ? 32 : parsed_payload.payload_length)
-                                 << std::endl;
-                }
-            }
+        if (webrtc->DtlsHandshakeDone() && webrtc->publisher_ != NULL)
+        {
+            webrtc->SendRtpPackets(packetizer);
+        }
+    }
+}
 
-            RtpHeader rtp_header;
+int WebrtcProtocol::SendRtpPackets(const H264RtpPacketizer& packetizer)
+{
+    if (! DtlsHandshakeDone())
+    {
+        return -1;
+    }
 
-            rtp_header.setSSRC(kVideoSSRC);
-            rtp_header.setMarker(last_packet ? 1 : 0); 
-            rtp_header.setSeqNumber(video_seq_);
-            rtp_header.setPayloadType((uint8_t)WebRTCPayloadType::H264);
-            rtp_header.setTimestamp(dts * 90);
+    for (int i = 0; i < packetizer.GetPacketCount(); ++i)
+    {
+        size_t len = 0;
+        const uint8_t* packet = packetizer.GetPacket(i, len);
 
-            memcpy(rtp, &rtp_header, rtp_header.getHeaderLength()/*rtp head size*/);
+        uint8_t protect_buf[H264RtpPacketizer::kMaxPacketSize];
+        memcpy(protect_buf, packet, len);
 
-            uint8_t protect_buf[1500];
-            int protect_buf_len = rtp_header.getHeaderLength() + rtp_packet_len;
-            int ret = ProtectRtp(rtp, protect_buf_len, protect_buf, protect_buf_len);
+        H264RtpPacketizer::SetSeqAndSsrc(protect_buf, video_seq_, video_ssrc_);
 
-            if (ret == 0)
-            {
-                std::cout << "ProtectRtp success" << std::endl;
-                send_map_[video_seq_] = std::string((const char*)protect_buf, protect_buf_len);
+        int protect_buf_len = len;
+        int ret = srtp_protect(srtp_send_, protect_buf, &protect_buf_len);
 
-                if (send_map_.size() >= 5000)
-                {
-                    send_map_.erase(send_map_.begin());
-                }
+        if (ret == 0)
+        {
+            send_map_[video_seq_] = std::string((const char*)protect_buf, protect_buf_len);
 
-                GetUdpSocket()->Send((const uint8_t*)protect_buf, protect_buf_len);
-            }
-            else
+            if (send_map_.size() >= 5000)
             {
-                std::cout << LMSG << "ProtectRtp failed:" << ret << std::endl;
+                send_map_.erase(send_map_.begin());
             }
 
-            ++video_seq_;
-
-            std::cout << LMSG << "srtp protect_buf_len:" << protect_buf_len << std::endl;
-        }   
-    }   
-    while (! last_packet);
+            GetUdpSocket()->Send((const uint8_t*)protect_buf, protect_buf_len);
+        }
+        else
+        {
+            std::cout << LMSG << "ProtectRtp failed:" << ret << std::endl;
+        }
 
-	delete rtp_packetizer;
+        ++video_seq_;
+    }
 
     return 0;
 }
 
 int WebrtcProtocol::SendVideoHeader(const std::string& header)
 {
-    if (header[0] == 0x00 && header[1] == 0x00 && header[2] == 0x00 && header[3] == 0x01)
-    {
-        std::string sps = header.substr(0, header.size() - 4 - 5);
-        std::string pps = header.substr(sps.size());
+    std::cout << LMSG << "video header=\n" << Util::Bin2Hex(header) << std::endl;
 
-        std::cout << "header=" << Util::Bin2Hex(header) << std::endl;
-        std::cout << "sps=" << Util::Bin2Hex(sps) << std::endl;
-        std::cout << "pps=" << Util::Bin2Hex(pps) << std::endl;
+    if (publisher_ == NULL || header.size() < 4)
+    {
+        return 0;
+    }
 
-        uint8_t* sps_buffer = (uint8_t*)malloc(sps.size());
-        memcpy(sps_buffer, (const uint8_t*)sps.data(), sps.size());
-        Payload nal_sps(sps_buffer, sps.size());
-        nal_sps.SetVideo();
-        nal_sps.SetDts(0);
+    std::string sps;
+    std::string pps;
 
-        SendMediaData(nal_sps);
+    if (header[0] == 0x00 && header[1] == 0x00 && header[2] == 0x00 && header[3] == 0x01)
+    {
+        // 00000001 sps 00000001 pps
+        size_t pps_pos = header.find(std::string("\x00\x00\x00\x01", 4), 4);
 
-        uint8_t* pps_buffer = (uint8_t*)malloc(pps.size());
-        memcpy(pps_buffer, (const uint8_t*)pps.data(), pps.size());
-        Payload nal_pps(pps_buffer, pps.size());
-        nal_pps.SetVideo();
-        nal_pps.SetDts(0);
+        if (pps_pos == std::string::npos)
+        {
+            return 0;
+        }
 
-        SendMediaData(nal_pps);
+        sps = header.substr(4, pps_pos - 4);
+        pps = header.substr(pps_pos + 4);
     }
-    else
+    else if (! ParseAvcDecoderConfig(header, sps, pps))
     {
+        std::cout << LMSG << "invalid video header" << std::endl;
+        return 0;
     }
-    std::cout << LMSG << "video header=\n" << Util::Bin2Hex(header) << std::endl;
+
+    std::cout << "sps=" << Util::Bin2Hex(sps) << std::endl;
+    std::cout << "pps=" << Util::Bin2Hex(pps) << std::endl;
+
+    // 存在发布者的packetizer里, 下一个IDR一起发
+    publisher_->GetWireCache().SetH264ParameterSet(sps, pps, (uint8_t)WebRTCPayloadType::H264, kH264RtpMaxPayload);
+
+    return 0;
+}
+
+int WebrtcProtocol::OnStop()
+{
+    // 发布者要析构了
+    publisher_ = NULL;
+
     return 0;
 }
 
@@ -2323,7 +2385,7 @@ int WebrtcProtocol::SendData(const std::string& data)
 
 bool WebrtcProtocol::CheckCanClose()
 {
-    uint64_t now_ms = Util::GetNowMs();
+    uint64_t now_ms = io_loop_->GetNowMs();
 
     if (now_ms - pre_recv_data_time_ms_ >= kWebRtcRecvTimeoutInMs)
     {
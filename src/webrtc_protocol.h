@@ -9,10 +9,12 @@
 #include "srtp2/srtp.h"
 
 #include "bit_buffer.h"
+#include "h264_rtp_packetizer.h"
 #include "media_publisher.h"
 #include "media_subscriber.h"
 #include "ref_ptr.h"
 #include "socket_handler.h"
+#include "timing_wheel.h"
 #include "webrtc_session_mgr.h"
 
 #include "webrtc/modules/rtp_rtcp/source/rtp_format_vp8.h"
@@ -173,8 +175,6 @@ public:
     WebrtcProtocol(IoLoop* io_loop, Fd* socket);
     ~WebrtcProtocol();
 
-    static void BroadcastH264(const Payload& payload);
-
 	virtual int HandleRead(IoBuffer& io_buffer, Fd& socket);
 	virtual int HandleClose(IoBuffer& io_buffer, Fd& socket) 
     { 
@@ -190,6 +190,9 @@ public:
     int EveryNSecond(const uint64_t& now_in_ms, const uint32_t& interval, const uint64_t& count);
     int EveryNMillSecond(const uint64_t& now_in_ms, const uint32_t& interval, const uint64_t& count);
 
+    // 每个对端一个protocol, 建好之后开始空闲检测和PLI
+    void StartTimer();
+
     void SetConnectState();
     void SetAcceptState();
     void SendBindingRequest();
@@ -245,13 +248,20 @@ public:
     int SendSctpData(const uint8_t* data, const int& len, const int& type);
 
     virtual int SendMediaData(const Payload& payload);
+    virtual void SendMediaDataBatch(MediaPublisher* publisher, const std::vector<MediaSubscriber*>& group, const size_t& count, const Payload& payload);
     virtual int SendVideoHeader(const std::string& header);
+    virtual int OnStop();
+
+    // 把流上已经打好的RTP包改成自己的SSRC和序号, 加密后发出去
+    int SendRtpPackets(const H264RtpPacketizer& packetizer);
 
     virtual int SendData(const std::string& data);
 
     bool CheckCanClose();
 
 private:
+    void OnIdleTimer();
+
     int OnStun(const uint8_t* data, const size_t& len);
     int OnDtls(const uint8_t* data, const size_t& len);
     int OnRtpRtcp(const uint8_t* data, const size_t& len);
@@ -274,8 +284,6 @@ private:
         all_packet_recv_map_[(int)type] += count;
     }
 
-private:
-    static std::set<WebrtcProtocol*> all_protocols_;
 private:
     IoLoop* io_loop_;
     Fd* socket_;
@@ -334,8 +342,12 @@ private:
     std::map<uint32_t, std::string> send_map_;
 
     uint32_t video_seq_;
+    uint32_t video_ssrc_;
 
     uint64_t pre_recv_data_time_ms_;
+
+    WheelTimer idle_timer_;
+    WheelTimer pli_timer_;
 };
 
 #endif // __WEBRTC_PROTOCOL_H__
@@ -0,0 +1,264 @@
+#include "common_define.h"
+#include "wire_cache.h"
+
+// FLV tag type
+static const uint8_t kFlvTagAudio = 8;
+static const uint8_t kFlvTagVideo = 9;
+
+static uint8_t* WriteU24(uint8_t* p, const uint32_t& u24)
+{
+    p[0] = (u24 >> 16) & 0xFF;
+    p[1] = (u24 >> 8) & 0xFF;
+    p[2] = u24 & 0xFF;
+
+    return p + 3;
+}
+
+// AVC视频tag的5字节头: FrameType|CodecID, AVCPacketType, CompositionTime
+static uint8_t* WriteAvcHeader(uint8_t* p, const Payload& payload)
+{
+    p[0] = payload.IsIFrame() ? 0x17 : 0x27;
+    p[1] = 0x01; // AVC nalu
+
+    return WriteU24(p + 2, payload.GetPts32() - payload.GetDts32());
+}
+
+WireCache::WireCache()
+    : frame_count_(0)
+    , next_replace_(0)
+    , rtp_packetizer_(NULL)
+    , hit_count_(0)
+    , build_count_(0)
+{
+}
+
+WireCache::~WireCache()
+{
+    delete rtp_packetizer_;
+}
+
+const WireFrame& WireCache::GetFlvTag(const Payload& payload)
+{
+    WireFrame* frame = Find(payload, kWireFlv, 0);
+
+    if (frame != NULL)
+    {
+        return *frame;
+    }
+
+    WireFrame& wire = Alloc(payload, kWireFlv, 0);
+
+    uint32_t data_size = payload.GetAllLen() + (payload.IsVideo() ? 5 : 0);
+
+    wire.header = Payload(payload.IsVideo() ? 16 : 11);
+
+    uint8_t* p = wire.header.GetAllData();
+
+    *p++ = payload.IsVideo() ? kFlvTagVideo : kFlvTagAudio;
+    p = WriteU24(p, data_size);
+    p = WriteU24(p, payload.GetDts32() & 0x00FFFFFF);
+    *p++ = (payload.GetDts32() >> 24) & 0xFF;
+    p = WriteU24(p, 0);
+
+    if (payload.IsVideo())
+    {
+        WriteAvcHeader(p, payload);
+    }
+
+    wire.iov.push_back(IoVec(wire.header.GetAllData(), wire.header.GetAllLen(), &wire.header));
+    wire.iov.push_back(IoVec(wire.body.GetAllData(), wire.body.GetAllLen(), &wire.body));
+
+    return wire;
+}
+
+const WireFrame& WireCache::GetRtmpBody(const Payload& payload, const uint32_t& chunk_size, const uint8_t& cs_id)
+{
+    WireFrame* frame = Find(payload, kWireRtmp, chunk_size);
+
+    if (frame != NULL)
+    {
+        return *frame;
+    }
+
+    WireFrame& wire = Alloc(payload, kWireRtmp, chunk_size);
+
+    // 视频头5字节, 后面跟一个fmt3头, 所有后续chunk共用这个字节
+    size_t avc_len = payload.IsVideo() ? 5 : 0;
+
+    wire.header = Payload(avc_len + 1);
+
+    uint8_t* p = wire.header.GetAllData();
+
+    if (payload.IsVideo())
+    {
+        p = WriteAvcHeader(p, payload);
+    }
+
+    *p = (3 << 6) | cs_id;
+
+    const uint8_t* fmt3_header = p;
+
+    size_t message_length = avc_len + payload.GetAllLen();
+    size_t data_pos = 0;
+
+    if (avc_len != 0)
+    {
+        wire.iov.push_back(IoVec(wire.header.GetAllData(), avc_len, &wire.header));
+    }
+
+    for (size_t pos = 0; pos < message_length; pos += chunk_size)
+    {
+        size_t send_len = message_length - pos;
+        if (send_len > chunk_size)
+        {
+            send_len = chunk_size;
+        }
+
+        if (pos == 0)
+        {
+            send_len -= avc_len;
+        }
+        else
+        {
+            wire.iov.push_back(IoVec(fmt3_header, 1, &wire.header));
+        }
+
+        wire.iov.push_back(IoVec(wire.body.GetAllData() + data_pos, send_len, &wire.body));
+        data_pos += send_len;
+    }
+
+    return wire;
+}
+
+const H264RtpPacketizer& WireCache::GetRtpPackets(const Payload& payload, const uint8_t& payload_type, const size_t& max_payload)
+{
+    H264RtpPacketizer& packetizer = GetRtpPacketizer(payload_type, max_payload);
+
+    if (rtp_frame_.GetAllData() != NULL && IsSameFrame(rtp_frame_, payload))
+    {
+        ++hit_count_;
+        return packetizer;
+    }
+
+    ++build_count_;
+
+    rtp_frame_ = payload;
+
+    packetizer.Clear();
+
+    // SEI不能发给webrtc, 不然chrome只能解码关键帧. AUD也不用发
+    int last = -1;
+    for (size_t i = 0; i < payload.GetNaluCount(); ++i)
+    {
+        uint32_t len = 0;
+        uint8_t nalu_type = payload.GetNalu(i, len)[0] & 0x1F;
+
+        if (nalu_type == H264NalType_IDR_SLICE || nalu_type == H264NalType_SLICE)
+        {
+            last = i;
+        }
+    }
+
+    for (int i = 0; i <= last; ++i)
+    {
+        uint32_t len = 0;
+        const uint8_t* nalu = payload.GetNalu(i, len);
+        uint8_t nalu_type = nalu[0] & 0x1F;
+
+        if (len == 0 || nalu_type == H264NalType_SEI || nalu_type == H264NalType_AUD)
+        {
+            continue;
+        }
+
+        packetizer.Packetize(nalu, len, payload.GetDts32() * 90, i == last);
+    }
+
+    return packetizer;
+}
+
+void WireCache::SetH264ParameterSet(const std::string& sps, const std::string& pps, const uint8_t& payload_type, const size_t& max_payload)
+{
+    H264RtpPacketizer& packetizer = GetRtpPacketizer(payload_type, max_payload);
+
+    packetizer.Packetize((const uint8_t*)sps.data(), sps.size(), 0, false);
+    packetizer.Packetize((const uint8_t*)pps.data(), pps.size(), 0, false);
+
+    // 下一帧重新打包
+    packetizer.Clear();
+    rtp_frame_ = Payload();
+}
+
+H264RtpPacketizer& WireCache::GetRtpPacketizer(const uint8_t& payload_type, const size_t& max_payload)
+{
+    if (rtp_packetizer_ == NULL)
+    {
+        rtp_packetizer_ = new H264RtpPacketizer(payload_type, max_payload);
+    }
+
+    return *rtp_packetizer_;
+}
+
+bool WireCache::IsSameFrame(const Payload& lhs, const Payload& rhs)
+{
+    return lhs.GetAllData() == rhs.GetAllData() && lhs.GetAllLen() == rhs.GetAllLen() &&
+           lhs.GetDts() == rhs.GetDts() && lhs.GetPts() == rhs.GetPts() &&
+           lhs.IsIFrame() == rhs.IsIFrame() && lhs.IsVideo() == rhs.IsVideo();
+}
+
+WireFrame* WireCache::Find(const Payload& payload, const uint8_t& format, const uint32_t& chunk_size)
+{
+    if (frame_count_ == 0 || ! IsSameFrame(frame_[0].body, payload))
+    {
+        return NULL;
+    }
+
+    for (int i = 0; i < frame_count_; ++i)
+    {
+        if (frame_[i].format == format && frame_[i].chunk_size == chunk_size)
+        {
+            ++hit_count_;
+            return &frame_[i];
+        }
+    }
+
+    return NULL;
+}
+
+WireFrame& WireCache::Alloc(const Payload& payload, const uint8_t& format, const uint32_t& chunk_size)
+{
+    ++build_count_;
+
+    // 换帧了, 之前缓存的全部作废
+    if (frame_count_ != 0 && ! IsSameFrame(frame_[0].body, payload))
+    {
+        for (int i = 0; i < frame_count_; ++i)
+        {
+            frame_[i].header = Payload();
+            frame_[i].body = Payload();
+        }
+
+        frame_count_ = 0;
+        next_replace_ = 0;
+    }
+
+    int index = 0;
+
+    if (frame_count_ < kMaxWireFrame)
+    {
+        index = frame_count_++;
+    }
+    else
+    {
+        // 同一帧格式太多(各种chunk大小), 轮流替换, 不能换掉0号, 它用来比较是不是同一帧
+        index = 1 + next_replace_++ % (kMaxWireFrame - 1);
+    }
+
+    WireFrame& wire = frame_[index];
+
+    wire.format = format;
+    wire.chunk_size = chunk_size;
+    wire.body = payload;
+    wire.iov.clear();
+
+    return wire;
+}
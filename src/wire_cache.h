@@ -0,0 +1,86 @@
+#ifndef __WIRE_CACHE_H__
+#define __WIRE_CACHE_H__
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "fd.h"
+#include "h264_rtp_packetizer.h"
+#include "ref_ptr.h"
+
+enum WireFormat
+{
+    kWireFlv    = 0,
+    kWireRtmp   = 1,
+};
+
+// 一帧在某种格式下序列化好的样子. header里放这个格式要插进去的所有头,
+// iov按顺序指向header或者body(原始帧)的片段, ref都填好, 发送队列只挂引用.
+// 每个订阅者自己的状态(FLV的pre_tag_size, RTMP第一个chunk的消息头)不在这里, 发的时候自己加在前面.
+struct WireFrame
+{
+    WireFrame()
+        : format(kWireFlv)
+        , chunk_size(0)
+    {
+    }
+
+    uint8_t             format;
+    uint32_t            chunk_size;
+    Payload             header;
+    Payload             body;
+    std::vector<IoVec>  iov;
+};
+
+// 每个发布者一个, 缓存当前在分发的这一帧. 同一帧分发给所有订阅者时,
+// 每种(格式, chunk大小)只在第一个订阅者用到时序列化一次, 之后的直接复用.
+// 只在发布者所在loop上用, 跨loop的订阅者由那边的CrossLoopPublisher自己缓存.
+class WireCache
+{
+public:
+    WireCache();
+    ~WireCache();
+
+    // FLV tag, 不包括前面的PreviousTagSize
+    const WireFrame& GetFlvTag(const Payload& payload);
+
+    // RTMP消息去掉第一个chunk的消息头之后的部分(视频头 + 数据 + 中间的fmt3头)
+    const WireFrame& GetRtmpBody(const Payload& payload, const uint32_t& chunk_size, const uint8_t& cs_id);
+
+    // webrtc订阅者用的H264 RTP包, 有webrtc订阅者用到才创建packetizer, 每帧只打一次包
+    const H264RtpPacketizer& GetRtpPackets(const Payload& payload, const uint8_t& payload_type, const size_t& max_payload);
+
+    // 序列头里的SPS/PPS, 下一个IDR的时候用STAP-A一起发
+    void SetH264ParameterSet(const std::string& sps, const std::string& pps, const uint8_t& payload_type, const size_t& max_payload);
+
+    uint64_t GetHitCount() const { return hit_count_; }
+    uint64_t GetBuildCount() const { return build_count_; }
+
+private:
+    WireCache(const WireCache&);
+    WireCache& operator=(const WireCache&);
+
+    static bool IsSameFrame(const Payload& lhs, const Payload& rhs);
+    H264RtpPacketizer& GetRtpPacketizer(const uint8_t& payload_type, const size_t& max_payload);
+    WireFrame* Find(const Payload& payload, const uint8_t& format, const uint32_t& chunk_size);
+    WireFrame& Alloc(const Payload& payload, const uint8_t& format, const uint32_t& chunk_size);
+
+private:
+    enum
+    {
+        kMaxWireFrame = 4,
+    };
+
+    WireFrame   frame_[kMaxWireFrame];
+    int         frame_count_;
+    int         next_replace_;
+
+    H264RtpPacketizer*  rtp_packetizer_;
+    Payload             rtp_frame_;
+
+    uint64_t    hit_count_;
+    uint64_t    build_count_;
+};
+
+#endif // __WIRE_CACHE_H__
@@ -0,0 +1,356 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "epoller.h"
+#include "global.h"
+#include "http_hls_protocol.h"
+#include "io_loop_thread.h"
+#include "media_publisher.h"
+#include "socket_util.h"
+#include "tcp_socket.h"
+#include "util.h"
+
+using namespace std;
+
+// 多loop HLS检查:
+// 源站推流在loop A, loop B通过跨loop转发拿到同一份切片
+// 播放列表轮流从两个loop拉, 列表里每个切片/part再从两个loop各拉一遍, 每个请求单独连接
+// 状态码, 内容, ETag必须完全一致
+// 用法: ./hls_multi_loop_check [轮数] [part毫秒, 0不开LL-HLS] [1用fMP4]
+
+LocalStreamCenter g_local_stream_center;
+IoLoop* g_epoll = NULL;
+SSL_CTX* g_tls_ctx = NULL;
+SSL_CTX* g_dtls_ctx = NULL;
+string g_dtls_fingerprint = "";
+string g_local_ice_pwd = "";
+string g_local_ice_ufrag = "";
+string g_remote_ice_pwd = "";
+string g_remote_ice_ufrag = "";
+string g_server_ip = "";
+
+static const string kAvcc("\x01\x64\x00\x1f\xff\xe1\x00\x1a\x67\x64\x00\x1f\xac\xd9\x40\x50\x05\xbb\x01\x10\x00\x00\x03\x00\x10\x00\x00\x03\x03\x20\xf1\x83\x19\x60\x01\x00\x05\x68\xeb\xe3\xcb\x22\xc0", 42);
+static const string kAsc("\x12\x10", 2);
+
+class FakePublisher : public MediaPublisher
+{
+public:
+    void OnHeader()
+    {
+        media_muxer_.OnAudioHeader(kAsc);
+        media_muxer_.OnVideoHeader(kAvcc);
+    }
+
+    void OnFrame(const Payload& payload)
+    {
+        if (payload.IsVideo())
+        {
+            media_muxer_.OnVideo(payload);
+        }
+        else
+        {
+            media_muxer_.OnAudio(payload);
+        }
+
+        subscriber_.SendMediaData(payload);
+    }
+};
+
+struct HttpResponse
+{
+    int status;
+    string etag;
+    string body;
+};
+
+static Payload MakeVideo(const bool& key, const size_t& len, const uint64_t& ts)
+{
+    Payload payload(4 + len);
+    uint8_t* data = payload.GetAllData();
+    data[0] = len >> 24;
+    data[1] = len >> 16;
+    data[2] = len >> 8;
+    data[3] = len;
+    data[4] = key ? 0x65 : 0x41;
+    for (size_t i = 5; i < 4 + len; ++i)
+    {
+        data[i] = rand() & 0x7f;
+    }
+
+    payload.SetVideo();
+    if (key)
+    {
+        payload.SetIFrame();
+    }
+    payload.SetDts(ts);
+    payload.SetPts(ts);
+    payload.AddNalu(0);
+
+    return payload;
+}
+
+static Payload MakeAudio(const size_t& len, const uint64_t& ts)
+{
+    Payload payload(len);
+    memset(payload.GetAllData(), 0x21, len);
+    payload.SetAudio();
+    payload.SetDts(ts);
+    payload.SetPts(ts);
+
+    return payload;
+}
+
+static SocketHandler* HandlerFactory(IoLoop* io_loop, Fd* socket)
+{
+    return new HttpHlsProtocol(io_loop, socket);
+}
+
+static bool Listen(IoLoop* io_loop, const uint16_t& port)
+{
+    int fd = socket_util::CreateNonBlockTcpSocket();
+    socket_util::ReuseAddr(fd);
+    if (socket_util::Bind(fd, "127.0.0.1", port) != 0 || socket_util::Listen(fd) != 0)
+    {
+        cout << "listen " << port << " failed" << endl;
+        return false;
+    }
+    socket_util::SetNonBlock(fd);
+
+    TcpSocket* server = new TcpSocket(io_loop, fd, HandlerFactory);
+    server->AsServerSocket();
+    server->EnableRead();
+
+    return true;
+}
+
+// 阻塞短连接, 只认Content-Length
+static HttpResponse HttpGet(const uint16_t& port, const string& path)
+{
+    HttpResponse response;
+    response.status = 0;
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0)
+    {
+        close(fd);
+        return response;
+    }
+
+    string request = "GET " + path + " HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+    if (write(fd, request.data(), request.size()) != (ssize_t)request.size())
+    {
+        close(fd);
+        return response;
+    }
+
+    string buf;
+    size_t header_end = string::npos;
+    long content_length = -1;
+    while (true)
+    {
+        if (header_end == string::npos && (header_end = buf.find("\r\n\r\n")) != string::npos)
+        {
+            response.status = atoi(buf.c_str() + 9);
+
+            size_t pos = buf.find("Content-Length:");
+            if (pos != string::npos && pos < header_end)
+            {
+                content_length = atol(buf.c_str() + pos + 15);
+            }
+
+            pos = buf.find("ETag: ");
+            if (pos != string::npos && pos < header_end)
+            {
+                response.etag = buf.substr(pos + 6, buf.find("\r\n", pos) - pos - 6);
+            }
+
+            if (content_length < 0)
+            {
+                break;
+            }
+        }
+
+        if (header_end != string::npos && (long)(buf.size() - header_end - 4) >= content_length)
+        {
+            response.body = buf.substr(header_end + 4, content_length);
+            break;
+        }
+
+        char tmp[64 * 1024];
+        ssize_t nbytes = read(fd, tmp, sizeof(tmp));
+        if (nbytes <= 0)
+        {
+            break;
+        }
+        buf.append(tmp, nbytes);
+    }
+
+    close(fd);
+
+    return response;
+}
+
+// 播放列表里的切片和part地址
+static vector<string> GetUris(const string& m3u8)
+{
+    vector<string> uris;
+
+    size_t pos = 0;
+    while (pos < m3u8.size())
+    {
+        size_t eol = m3u8.find('\n', pos);
+        if (eol == string::npos)
+        {
+            eol = m3u8.size();
+        }
+
+        string line = m3u8.substr(pos, eol - pos);
+        size_t uri = line.find("URI=\"");
+        if (line.find("#EXT-X-PART:") == 0 && uri != string::npos)
+        {
+            uris.push_back(line.substr(uri + 5, line.find('"', uri + 5) - uri - 5));
+        }
+        else if (! line.empty() && line[0] != '#')
+        {
+            uris.push_back(line);
+        }
+
+        pos = eol + 1;
+    }
+
+    return uris;
+}
+
+int main(int argc, char* argv[])
+{
+    int rounds = argc > 1 ? atoi(argv[1]) : 12;
+    int part_ms = argc > 2 ? atoi(argv[2]) : 0;
+    bool fmp4 = argc > 3 && atoi(argv[3]) != 0;
+
+    MediaMuxer::SetHlsIdleMs(0);
+    if (part_ms > 0)
+    {
+        MediaMuxer::SetHlsPartMs(part_ms);
+    }
+    MediaMuxer::SetHlsFmp4(fmp4);
+
+    Epoller* origin_loop = new Epoller();
+    origin_loop->Create();
+    Epoller* mirror_loop = new Epoller();
+    mirror_loop->Create();
+
+    uint16_t origin_port = 18000 + getpid() % 1000;
+    uint16_t mirror_port = origin_port + 1000;
+    if (! Listen(origin_loop, origin_port) || ! Listen(mirror_loop, mirror_port))
+    {
+        return -1;
+    }
+
+    IoLoopThread origin_thread(0, origin_loop);
+    IoLoopThread mirror_thread(1, mirror_loop);
+    origin_thread.Start(-1);
+    mirror_thread.Start(-1);
+
+    FakePublisher* publisher = NULL;
+    origin_loop->QueueInLoop([&publisher]()
+    {
+        publisher = new FakePublisher();
+        publisher->OnHeader();
+        g_local_stream_center.RegisterStream("live", "check", publisher);
+    });
+
+    // 25fps, GOP 0.48s
+    atomic<bool> stop(false);
+    thread feeder([&]()
+    {
+        uint64_t audio_ts = 0;
+        for (int i = 0; ! stop; ++i)
+        {
+            uint64_t video_ts = i * 40;
+            bool key = (i % 12 == 0);
+
+            vector<Payload> frames;
+            while (audio_ts <= video_ts)
+            {
+                frames.push_back(MakeAudio(300, audio_ts));
+                audio_ts += 21;
+            }
+            frames.push_back(MakeVideo(key, key ? 20000 : 4000, video_ts));
+
+            // 在这个线程生成, 在loop线程释放
+            for (const auto& frame : frames)
+            {
+                frame.SetShared();
+            }
+
+            origin_loop->QueueInLoop([&publisher, frames]()
+            {
+                for (const auto& frame : frames)
+                {
+                    publisher->OnFrame(frame);
+                }
+            });
+
+            usleep(40000);
+        }
+    });
+
+    int checked = 0;
+    int failed = 0;
+    for (int round = 0; round < rounds && failed == 0; ++round)
+    {
+        usleep(300000);
+
+        uint16_t list_port = (round % 2) ? origin_port : mirror_port;
+        HttpResponse list = HttpGet(list_port, "/live/check/check.m3u8");
+        if (list.status != 200)
+        {
+            cout << "round " << round << " playlist status " << list.status << endl;
+            ++failed;
+            continue;
+        }
+
+        vector<string> uris = GetUris(list.body);
+        for (const auto& uri : uris)
+        {
+            HttpResponse from_origin = HttpGet(origin_port, "/live/check/" + uri);
+            HttpResponse from_mirror = HttpGet(mirror_port, "/live/check/" + uri);
+            if (from_origin.status != 200 || from_mirror.status != 200 || from_origin.body.empty() ||
+                from_origin.body != from_mirror.body || from_origin.etag != from_mirror.etag)
+            {
+                cout << "round " << round << " uri " << uri << " mismatch"
+                     << ", origin " << from_origin.status << " " << from_origin.body.size() << " " << from_origin.etag
+                     << ", mirror " << from_mirror.status << " " << from_mirror.body.size() << " " << from_mirror.etag << endl;
+                ++failed;
+                break;
+            }
+            ++checked;
+        }
+
+        cout << "round " << round << ": playlist from " << (list_port == origin_port ? "origin" : "mirror")
+             << ", " << uris.size() << " uris identical on both loops" << endl;
+    }
+
+    stop = true;
+    feeder.join();
+
+    cout << "checked " << checked << " segment/part fetches, " << (failed == 0 ? "ok" : "FAILED") << endl;
+
+    // loop线程不退出, 直接结束进程
+    _exit((failed == 0 && checked > 0) ? 0 : 1);
+}
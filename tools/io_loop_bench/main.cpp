@@ -0,0 +1,427 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "epoller.h"
+#include "io_uring_loop.h"
+#include "socket_handler.h"
+#include "socket_util.h"
+#include "tcp_socket.h"
+#include "timing_wheel.h"
+#include "util.h"
+
+using namespace std;
+
+// 扇出压测: 一个loop每10ms给N个订阅者发一帧(11字节拷贝的头 + 引用的payload), 跟拉流转发一样.
+// loop cpu是从第一帧到所有发送队列清空, loop线程用掉的cpu时间.
+// 订阅者在fork出来的子进程里, 边收边校验每个连接的字节流.
+// 对比epoll, io_uring只用就绪通知, io_uring完成模式(multishot accept/recv + 批量SENDMSG)
+// 一轮发多帧的时候(一次读到音视频好几个消息), epoll每帧一次writev, 完成模式合成一个SENDMSG
+// 用法: ./io_loop_bench [帧数] [payload字节数] [每轮帧数] [订阅者数...]
+
+static const size_t kHeaderLen = 11;
+static const char kHello[] = "hello";
+static const size_t kHelloLen = sizeof(kHello) - 1;
+
+struct BenchResult
+{
+    uint64_t    send_cpu_us;
+    uint64_t    deliver_wall_us;
+    uint64_t    enter_count;
+    bool        ok;
+};
+
+static uint64_t GetThreadCpuUs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static uint64_t GetMonotonicUs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+// 第frame帧在连接字节流里offset处应该是什么
+static uint8_t ExpectByte(const uint64_t& frame, const size_t& offset)
+{
+    if (offset < kHeaderLen)
+    {
+        return offset == 0 ? 0x09 : (offset <= 4 ? (uint8_t)(frame >> ((offset - 1) * 8)) : 0);
+    }
+
+    return (uint8_t)frame;
+}
+
+class BenchHandler : public SocketHandler
+{
+public:
+    BenchHandler(vector<Fd*>* subscribers, uint64_t* hello_bytes)
+        : subscribers_(subscribers)
+        , hello_bytes_(hello_bytes)
+    {
+    }
+
+    virtual int HandleAccept(Fd& socket)
+    {
+        subscribers_->push_back(&socket);
+        return kSuccess;
+    }
+
+    virtual int HandleRead(IoBuffer& io_buffer, Fd& socket)
+    {
+        UNUSED(socket);
+
+        *hello_bytes_ += io_buffer.Size();
+        io_buffer.Skip(io_buffer.Size());
+
+        return kSuccess;
+    }
+
+    virtual int HandleClose(IoBuffer& io_buffer, Fd& socket)
+    {
+        UNUSED(io_buffer);
+
+        for (auto& subscriber : *subscribers_)
+        {
+            if (subscriber == &socket)
+            {
+                subscriber = NULL;
+            }
+        }
+
+        return kSuccess;
+    }
+
+private:
+    vector<Fd*>*    subscribers_;
+    uint64_t*       hello_bytes_;
+};
+
+// 子进程: 连上去, 打个招呼, 然后收完所有帧, 结果写进pipe
+static void RunClients(const uint16_t& port, const int& count, const uint64_t& frames, const size_t& frame_len, const int& result_fd)
+{
+    int epoll_fd = epoll_create(1024);
+    vector<int> fds(count, -1);
+    vector<uint64_t> offsets(count, 0);
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    for (int i = 0; i < count; ++i)
+    {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0 || connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0 || write(fd, kHello, kHelloLen) != (ssize_t)kHelloLen)
+        {
+            cout << "client " << i << " connect failed, err:" << strerror(errno) << endl;
+            _exit(1);
+        }
+
+        socket_util::SetNonBlock(fd);
+
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.u32 = i;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+
+        fds[i] = fd;
+    }
+
+    uint64_t expect = (uint64_t)count * frames * frame_len;
+    uint64_t received = 0;
+    uint64_t errors = 0;
+    uint64_t deadline_us = GetMonotonicUs() + 120 * 1000000ULL;
+
+    vector<uint8_t> buf(256 * 1024);
+    while (received < expect && GetMonotonicUs() < deadline_us)
+    {
+        struct epoll_event events[1024];
+        int num_event = epoll_wait(epoll_fd, events, 1024, 1000);
+
+        for (int i = 0; i < num_event; ++i)
+        {
+            int index = events[i].data.u32;
+            ssize_t bytes = read(fds[index], buf.data(), buf.size());
+
+            if (bytes <= 0)
+            {
+                continue;
+            }
+
+            uint64_t& offset = offsets[index];
+            for (ssize_t j = 0; j < bytes; ++j, ++offset)
+            {
+                if (buf[j] != ExpectByte(offset / frame_len, offset % frame_len))
+                {
+                    ++errors;
+                }
+            }
+
+            received += bytes;
+        }
+    }
+
+    uint64_t result[3] = { GetMonotonicUs(), received == expect ? 1ULL : 0ULL, errors };
+    if (write(result_fd, result, sizeof(result)) != sizeof(result))
+    {
+        _exit(1);
+    }
+
+    // 等父进程收完结果再断开
+    char c;
+    if (read(result_fd, &c, 1) < 0)
+    {
+        _exit(1);
+    }
+
+    _exit(0);
+}
+
+static IoLoop* CreateLoop(const string& backend)
+{
+    if (backend == "epoll")
+    {
+        Epoller* epoller = new Epoller();
+        epoller->Create();
+        return epoller;
+    }
+
+    IoUringLoop::SetCompletionIo(backend == "io_uring_completion");
+
+    IoUringLoop* io_uring_loop = new IoUringLoop();
+    if (io_uring_loop->Create() != 0 || io_uring_loop->IsCompletionMode() != (backend == "io_uring_completion"))
+    {
+        delete io_uring_loop;
+        return NULL;
+    }
+
+    return io_uring_loop;
+}
+
+static bool RunOnce(const string& backend, const int& count, const uint64_t& frames, const size_t& payload_len, const uint64_t& frames_per_round, BenchResult& result)
+{
+    memset(&result, 0, sizeof(result));
+
+    int listen_fd = socket_util::CreateNonBlockTcpSocket();
+    socket_util::ReuseAddr(listen_fd);
+    socket_util::Bind(listen_fd, "127.0.0.1", 0);
+    // 默认的backlog太小, 一万个连接一起来会丢SYN
+    listen(listen_fd, 65535);
+
+    string local_ip;
+    uint16_t port = 0;
+    socket_util::GetSocketName(listen_fd, local_ip, port);
+
+    int result_pipe[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, result_pipe) != 0)
+    {
+        return false;
+    }
+
+    size_t frame_len = kHeaderLen + payload_len;
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        close(listen_fd);
+        close(result_pipe[0]);
+        RunClients(port, count, frames, frame_len, result_pipe[1]);
+    }
+    close(result_pipe[1]);
+
+    IoLoop* loop = CreateLoop(backend);
+    if (loop == NULL)
+    {
+        cout << backend << " not available" << endl;
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        close(listen_fd);
+        close(result_pipe[0]);
+        return false;
+    }
+
+    vector<Fd*> subscribers;
+    uint64_t hello_bytes = 0;
+
+    TcpSocket* server = new TcpSocket(loop, listen_fd, [&subscribers, &hello_bytes](IoLoop* io_loop, Fd* socket)
+    {
+        UNUSED(io_loop);
+        UNUSED(socket);
+        return new BenchHandler(&subscribers, &hello_bytes);
+    });
+    server->AsServerSocket();
+    server->EnableRead();
+
+    uint64_t frame = 0;
+    uint64_t begin_cpu_us = 0;
+    uint64_t begin_wall_us = 0;
+    uint64_t begin_enter = 0;
+
+    // 一轮里所有订阅者的发送在完成模式下一次io_uring_enter提交
+    auto send_frame = [&]()
+    {
+        Payload payload(payload_len);
+        memset(payload.GetAllData(), (uint8_t)frame, payload_len);
+
+        uint8_t header[kHeaderLen];
+        for (size_t i = 0; i < kHeaderLen; ++i)
+        {
+            header[i] = ExpectByte(frame, i);
+        }
+
+        IoVec iov[2] = { IoVec(header, kHeaderLen), IoVec(payload.GetAllData(), payload_len, &payload) };
+
+        for (auto& subscriber : subscribers)
+        {
+            if (subscriber != NULL)
+            {
+                subscriber->SendV(iov, 2);
+            }
+        }
+
+        ++frame;
+    };
+
+    // 定时器要在loop之前析构
+    WheelTimer* timer = new WheelTimer(loop);
+    timer->RunEvery(10, [&]()
+    {
+        if (begin_wall_us == 0)
+        {
+            // 都连上并且都收到招呼了才开始
+            if (subscribers.size() == (size_t)count && hello_bytes == count * kHelloLen)
+            {
+                begin_cpu_us = GetThreadCpuUs();
+                begin_wall_us = GetMonotonicUs();
+                begin_enter = backend == "epoll" ? 0 : ((IoUringLoop*)loop)->GetEnterCount();
+            }
+            else
+            {
+                return;
+            }
+        }
+
+        if (frame < frames)
+        {
+            for (uint64_t i = 0; i < frames_per_round && frame < frames; ++i)
+            {
+                send_frame();
+            }
+            return;
+        }
+
+        for (auto& subscriber : subscribers)
+        {
+            if (subscriber != NULL && subscriber->GetPendingBytes() > 0)
+            {
+                return;
+            }
+        }
+
+        result.send_cpu_us = GetThreadCpuUs() - begin_cpu_us;
+        result.enter_count = backend == "epoll" ? 0 : ((IoUringLoop*)loop)->GetEnterCount() - begin_enter;
+
+        timer->Cancel();
+        loop->Quit();
+    });
+
+    loop->RunIOLoop(100);
+
+    uint64_t child_result[3] = { 0, 0, 0 };
+    if (read(result_pipe[0], child_result, sizeof(child_result)) == sizeof(child_result))
+    {
+        result.deliver_wall_us = child_result[0] - begin_wall_us;
+        result.ok = (child_result[1] == 1 && child_result[2] == 0);
+    }
+    if (write(result_pipe[0], "x", 1) != 1)
+    {
+        result.ok = false;
+    }
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    close(result_pipe[0]);
+
+    delete timer;
+    for (auto& subscriber : subscribers)
+    {
+        delete subscriber;
+    }
+    delete server;
+    delete loop;
+
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    uint64_t frames = argc > 1 ? strtoull(argv[1], NULL, 10) : 100;
+    size_t payload_len = argc > 2 ? strtoull(argv[2], NULL, 10) : 1400;
+    uint64_t frames_per_round = argc > 3 ? strtoull(argv[3], NULL, 10) : 1;
+
+    vector<int> counts;
+    for (int i = 4; i < argc; ++i)
+    {
+        counts.push_back(atoi(argv[i]));
+    }
+    if (counts.empty())
+    {
+        counts = { 1000, 5000, 10000 };
+    }
+
+    // 服务端一个订阅者一个fd, 客户端在子进程里
+    struct rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+
+    // 连接的accept/close日志太多
+    cout.setstate(ios::failbit);
+
+    const string backends[] = { "epoll", "io_uring_poll", "io_uring_completion" };
+
+    vector<string> lines;
+    for (const auto& count : counts)
+    {
+        for (const auto& backend : backends)
+        {
+            BenchResult result;
+            if (! RunOnce(backend, count, frames, payload_len, frames_per_round, result))
+            {
+                continue;
+            }
+
+            char line[256];
+            snprintf(line, sizeof(line), "%-20s subs %6d  loop cpu %8.1f ms  %6.0f ns/send  delivered %8.1f ms  io_uring_enter %6lu  %s",
+                     backend.c_str(), count, result.send_cpu_us / 1000.0, result.send_cpu_us * 1000.0 / count / frames,
+                     result.deliver_wall_us / 1000.0, (unsigned long)result.enter_count, result.ok ? "ok" : "FAILED");
+            lines.push_back(line);
+        }
+    }
+
+    cout.clear();
+    cout << "frames " << frames << ", payload " << payload_len << " bytes + " << kHeaderLen << " bytes header, " << frames_per_round << " frames per round" << endl;
+    for (const auto& line : lines)
+    {
+        cout << line << endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,245 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "epoller.h"
+#include "payload_pool.h"
+#include "ref_ptr.h"
+#include "util.h"
+
+using namespace std;
+
+// PayloadPool和malloc对比:
+// 1. 同一个loop里分配释放, 留一个窗口的块不释放, 像GOP缓存那样先进先出
+// 2. loop分配, 别的线程释放, 像跨loop转发那样
+// 3. loop析构之后才释放它分出去的块
+// 用法: ./payload_pool_bench [次数]
+
+static const size_t kSizes[] = { 188, 1400, 4096, 16 * 1024, 60 * 1024 };
+static const size_t kSizeNum = sizeof(kSizes) / sizeof(kSizes[0]);
+static const size_t kWindow = 256;
+static const size_t kBatch = 64;
+
+struct MallocBlock
+{
+    uint8_t* data;
+};
+
+static double NsPerOp(const uint64_t& begin_us, const uint64_t& count)
+{
+    return (Util::GetNowUs() - begin_us) * 1000.0 / count;
+}
+
+static void BenchLocal(const uint64_t& count)
+{
+    deque<Payload> window;
+
+    uint64_t begin_us = Util::GetNowUs();
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        Payload payload(kSizes[i % kSizeNum]);
+        payload.GetAllData()[0] = (uint8_t)i;
+
+        window.push_back(payload);
+        if (window.size() > kWindow)
+        {
+            window.pop_front();
+        }
+    }
+    window.clear();
+    double pool_ns = NsPerOp(begin_us, count);
+
+    deque<MallocBlock> malloc_window;
+
+    begin_us = Util::GetNowUs();
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        MallocBlock block;
+        block.data = (uint8_t*)malloc(sizeof(RefPtr) + kSizes[i % kSizeNum]);
+        block.data[sizeof(RefPtr)] = (uint8_t)i;
+
+        malloc_window.push_back(block);
+        if (malloc_window.size() > kWindow)
+        {
+            free(malloc_window.front().data);
+            malloc_window.pop_front();
+        }
+    }
+    for (auto& block : malloc_window)
+    {
+        free(block.data);
+    }
+    double malloc_ns = NsPerOp(begin_us, count);
+
+    cout << "local  alloc+free: pool " << pool_ns << " ns/op, malloc " << malloc_ns << " ns/op" << endl;
+}
+
+// loop线程分配, 一批一批交给释放线程
+template<typename T>
+class Handoff
+{
+public:
+    Handoff()
+        : done_(false)
+    {
+    }
+
+    void Push(vector<T>& batch)
+    {
+        unique_lock<mutex> lock(mutex_);
+        queue_.push_back(vector<T>());
+        queue_.back().swap(batch);
+        cond_.notify_one();
+    }
+
+    void Done()
+    {
+        unique_lock<mutex> lock(mutex_);
+        done_ = true;
+        cond_.notify_one();
+    }
+
+    bool Pop(vector<T>& batch)
+    {
+        unique_lock<mutex> lock(mutex_);
+        cond_.wait(lock, [this]() { return done_ || ! queue_.empty(); });
+
+        if (queue_.empty())
+        {
+            return false;
+        }
+
+        batch.swap(queue_.front());
+        queue_.pop_front();
+
+        return true;
+    }
+
+private:
+    mutex mutex_;
+    condition_variable cond_;
+    deque<vector<T> > queue_;
+    bool done_;
+};
+
+static void BenchRemote(const uint64_t& count)
+{
+    Handoff<Payload> payload_handoff;
+    thread payload_releaser([&]()
+    {
+        vector<Payload> batch;
+        while (payload_handoff.Pop(batch))
+        {
+            batch.clear();
+        }
+    });
+
+    uint64_t begin_us = Util::GetNowUs();
+    vector<Payload> batch;
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        Payload payload(kSizes[i % kSizeNum]);
+        payload.GetAllData()[0] = (uint8_t)i;
+        payload.SetShared();
+
+        batch.push_back(payload);
+        if (batch.size() == kBatch)
+        {
+            payload_handoff.Push(batch);
+        }
+    }
+    payload_handoff.Push(batch);
+    payload_handoff.Done();
+    payload_releaser.join();
+    double pool_ns = NsPerOp(begin_us, count);
+
+    Handoff<MallocBlock> malloc_handoff;
+    thread malloc_releaser([&]()
+    {
+        vector<MallocBlock> batch;
+        while (malloc_handoff.Pop(batch))
+        {
+            for (auto& block : batch)
+            {
+                free(block.data);
+            }
+        }
+    });
+
+    begin_us = Util::GetNowUs();
+    vector<MallocBlock> malloc_batch;
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        MallocBlock block;
+        block.data = (uint8_t*)malloc(sizeof(RefPtr) + kSizes[i % kSizeNum]);
+        block.data[sizeof(RefPtr)] = (uint8_t)i;
+
+        malloc_batch.push_back(block);
+        if (malloc_batch.size() == kBatch)
+        {
+            malloc_handoff.Push(malloc_batch);
+        }
+    }
+    malloc_handoff.Push(malloc_batch);
+    malloc_handoff.Done();
+    malloc_releaser.join();
+    double malloc_ns = NsPerOp(begin_us, count);
+
+    cout << "remote alloc+free: pool " << pool_ns << " ns/op, malloc " << malloc_ns << " ns/op" << endl;
+}
+
+static void RunInLoop(Epoller* loop, const function<void()>& task)
+{
+    loop->QueueInLoop([loop, task]()
+    {
+        task();
+        loop->Quit();
+    });
+
+    loop->RunIOLoop(100);
+}
+
+int main(int argc, char* argv[])
+{
+    uint64_t count = 2000000;
+
+    if (argc > 1)
+    {
+        count = strtoull(argv[1], NULL, 10);
+    }
+
+    Epoller* loop = new Epoller();
+    loop->Create();
+
+    // 最后留一批块到loop析构之后才还, 池子要等最后一个还回来再释放
+    vector<Payload> survivors;
+    RunInLoop(loop, [count, &survivors]()
+    {
+        BenchLocal(count);
+        BenchRemote(count);
+
+        for (size_t i = 0; i < 1000; ++i)
+        {
+            survivors.push_back(Payload(kSizes[i % kSizeNum]));
+            survivors.back().SetShared();
+        }
+    });
+
+    delete loop;
+
+    thread late_releaser([&survivors]()
+    {
+        survivors.clear();
+    });
+    late_releaser.join();
+
+    cout << "release after loop teardown: ok" << endl;
+
+    return 0;
+}
@@ -0,0 +1,881 @@
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "amf_0.h"
+#include "any.h"
+#include "epoller.h"
+#include "global.h"
+#include "http_flv_protocol.h"
+#include "io_buffer.h"
+#include "io_loop_thread.h"
+#include "io_uring_loop.h"
+#include "rtmp_protocol.h"
+#include "socket_util.h"
+#include "tcp_socket.h"
+#include "util.h"
+
+using namespace std;
+
+// 多reactor压测: N路RTMP推流, M个HTTP-FLV播放, worker数从1跑到W
+// 服务端在fork出来的进程里, 跟tms一样每个loop用SO_REUSEPORT各自监听rtmp/http-flv端口, 连接落到哪个loop由内核决定,
+// 推流和播放不在一个loop的走跨loop转发.
+// 客户端在另一个子进程里, 一个epoll线程驱动所有连接: 推流按25fps实时发, 视频NALU里带发送时间,
+// 播放端解析FLV, 统计预热之后发出的视频帧收到多少, 码率和端到端延迟.
+// cpu取自/proc, 服务端包括所有loop线程.
+// 用法: ./rtmp_flv_load [推流数] [播放数] [最大worker数] [秒数] [视频kbps] [epoll|io_uring]
+
+LocalStreamCenter g_local_stream_center;
+IoLoop* g_epoll = NULL;
+SSL_CTX* g_tls_ctx = NULL;
+SSL_CTX* g_dtls_ctx = NULL;
+string g_dtls_fingerprint = "";
+string g_local_ice_pwd = "";
+string g_local_ice_ufrag = "";
+string g_remote_ice_pwd = "";
+string g_remote_ice_ufrag = "";
+string g_server_ip = "";
+
+static const string kAvcc("\x01\x64\x00\x1f\xff\xe1\x00\x1a\x67\x64\x00\x1f\xac\xd9\x40\x50\x05\xbb\x01\x10\x00\x00\x03\x00\x10\x00\x00\x03\x03\x20\xf1\x83\x19\x60\x01\x00\x05\x68\xeb\xe3\xcb\x22\xc0", 42);
+static const string kAsc("\x12\x10", 2);
+
+static const uint64_t kFrameIntervalUs = 40000;
+static const uint64_t kGopFrames = 25;
+static const size_t kAudioLen = 200;
+static const uint64_t kWarmupUs = 2000000;
+static const uint64_t kDrainUs = 1000000;
+static const size_t kHandshakeLen = 1 + 1536 + 1536;
+static const size_t kMaxPublishQueue = 4 * 1024 * 1024;
+// FLV视频tag: 5字节AVC头 + 4字节NALU长度 + 1字节NALU头, 后面8字节是发送时间
+static const size_t kStampOffset = 10;
+// 延迟直方图, 100us一格, 最多10s
+static const uint64_t kLatencyBucketUs = 100;
+static const size_t kLatencyBuckets = 100000;
+
+struct LoadResult
+{
+    uint64_t    expected_frames;
+    uint64_t    recv_frames;
+    uint64_t    recv_bytes;
+    uint64_t    window_us;
+    uint64_t    latency_sum_us;
+    uint64_t    latency_p50_us;
+    uint64_t    latency_p99_us;
+    uint64_t    latency_max_us;
+    uint64_t    players_ok;
+    uint64_t    publish_stalls;
+};
+
+enum ConnState
+{
+    kPublishHandshake = 0,
+    kPublishing       = 1,
+    kPlayHttpHeader   = 2,
+    kPlayFlvHeader    = 3,
+    kPlayTag          = 4,
+};
+
+struct LoadConn
+{
+    int         fd;
+    int         state;
+    uint32_t    stream;
+    bool        want_write;
+    string      out;
+    size_t      out_pos;
+    string      in;
+    size_t      in_pos;
+    uint64_t    recv_frames;
+};
+
+static uint64_t GetMonotonicUs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+// /proc/<pid>/stat里的utime + stime, 包括所有线程
+static uint64_t GetProcessCpuUs(const pid_t& pid)
+{
+    ifstream stat_file("/proc/" + Util::Num2Str(pid) + "/stat");
+    string stat;
+    getline(stat_file, stat);
+
+    size_t pos = stat.rfind(')');
+    if (pos == string::npos)
+    {
+        return 0;
+    }
+
+    // ')'后面从第3个字段state开始, utime和stime是第14,15个
+    vector<string> fields = Util::SepStr(stat.substr(pos + 2), " ");
+    if (fields.size() < 13)
+    {
+        return 0;
+    }
+
+    uint64_t ticks = Util::Str2Num<uint64_t>(fields[11]) + Util::Str2Num<uint64_t>(fields[12]);
+
+    return ticks * 1000000ULL / sysconf(_SC_CLK_TCK);
+}
+
+static void AppendU24(string& out, const uint32_t& val)
+{
+    out += (char)(val >> 16);
+    out += (char)(val >> 8);
+    out += (char)val;
+}
+
+static void AppendU32(string& out, const uint32_t& val)
+{
+    out += (char)(val >> 24);
+    AppendU24(out, val);
+}
+
+// 客户端把chunk size设得比消息大, 每个消息就是一个fmt0的chunk
+static void AppendRtmpMessage(string& out, const uint8_t& cs_id, const uint8_t& type_id, const uint32_t& timestamp, const string& body)
+{
+    const uint32_t message_stream_id = 1;
+
+    out += (char)cs_id;
+    AppendU24(out, timestamp);
+    AppendU24(out, body.size());
+    out += (char)type_id;
+    out.append((const char*)&message_stream_id, 4);
+    out += body;
+}
+
+static string EncodeAmf0(const vector<any::Any*>& input)
+{
+    IoBuffer output;
+    Amf0::Encode(input, output);
+
+    uint8_t* data = NULL;
+    int len = output.Read(data, output.Size());
+
+    return string((const char*)data, len);
+}
+
+// C2之后一口气发完: set chunk size, connect, createStream, publish, 音视频头
+static string MakePublishCommands(const uint32_t& stream)
+{
+    string out;
+
+    string chunk_size;
+    AppendU32(chunk_size, 16 * 1024 * 1024);
+    AppendRtmpMessage(out, 2, kSetChunkSize, 0, chunk_size);
+
+    any::String connect("connect");
+    any::Double connect_id(1.0);
+    any::String app("live");
+    any::String tc_url("rtmp://127.0.0.1/live");
+    any::Map connect_object({{"app", (any::Any*)&app}, {"tcUrl", (any::Any*)&tc_url}});
+    AppendRtmpMessage(out, 3, kAmf0Command, 0, EncodeAmf0({&connect, &connect_id, &connect_object}));
+
+    any::String create_stream("createStream");
+    any::Double create_stream_id(2.0);
+    any::Null null;
+    AppendRtmpMessage(out, 3, kAmf0Command, 0, EncodeAmf0({&create_stream, &create_stream_id, &null}));
+
+    any::String publish("publish");
+    any::Double publish_id(3.0);
+    any::String stream_name("s" + Util::Num2Str(stream));
+    AppendRtmpMessage(out, 3, kAmf0Command, 0, EncodeAmf0({&publish, &publish_id, &null, &stream_name, &app}));
+
+    AppendRtmpMessage(out, 6, kVideo, 0, string("\x17\x00\x00\x00\x00", 5) + kAvcc);
+    AppendRtmpMessage(out, 4, kAudio, 0, string("\xaf\x00", 2) + kAsc);
+
+    return out;
+}
+
+static void AppendVideoFrame(string& out, const uint64_t& frame, const size_t& frame_len, const uint64_t& now_us)
+{
+    bool key = (frame % kGopFrames == 0);
+    size_t nalu_len = (key ? frame_len * 4 : frame_len);
+
+    string body(5 + 4 + nalu_len, '\x5a');
+    body[0] = key ? 0x17 : 0x27;
+    body[1] = 0x01;
+    body[2] = body[3] = body[4] = 0;
+    body[5] = nalu_len >> 24;
+    body[6] = nalu_len >> 16;
+    body[7] = nalu_len >> 8;
+    body[8] = nalu_len;
+    body[9] = key ? 0x65 : 0x41;
+    memcpy(&body[kStampOffset], &now_us, sizeof(now_us));
+
+    AppendRtmpMessage(out, 6, kVideo, frame * kFrameIntervalUs / 1000, body);
+}
+
+static void AppendAudioFrames(string& out, const uint64_t& frame)
+{
+    string body(2 + kAudioLen, '\x21');
+    body[0] = 0xaf;
+    body[1] = 0x01;
+
+    // 每个视频帧间隔两个音频帧
+    uint32_t timestamp = frame * kFrameIntervalUs / 1000;
+    AppendRtmpMessage(out, 4, kAudio, timestamp, body);
+    AppendRtmpMessage(out, 4, kAudio, timestamp + kFrameIntervalUs / 2000, body);
+}
+
+static int Connect(const uint16_t& port)
+{
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0)
+    {
+        cerr << "connect " << port << " failed, err:" << strerror(errno) << endl;
+        _exit(1);
+    }
+
+    socket_util::SetNonBlock(fd);
+
+    return fd;
+}
+
+static void UpdateEvents(const int& epoll_fd, LoadConn& conn, const uint32_t& index)
+{
+    bool want_write = (conn.out_pos < conn.out.size());
+    if (want_write == conn.want_write)
+    {
+        return;
+    }
+
+    struct epoll_event event;
+    event.events = EPOLLIN | (want_write ? (uint32_t)EPOLLOUT : 0);
+    event.data.u32 = index;
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn.fd, &event);
+
+    conn.want_write = want_write;
+}
+
+static void Flush(const int& epoll_fd, LoadConn& conn, const uint32_t& index)
+{
+    while (conn.out_pos < conn.out.size())
+    {
+        ssize_t bytes = write(conn.fd, conn.out.data() + conn.out_pos, conn.out.size() - conn.out_pos);
+        if (bytes <= 0)
+        {
+            break;
+        }
+        conn.out_pos += bytes;
+    }
+
+    if (conn.out_pos == conn.out.size())
+    {
+        conn.out.clear();
+        conn.out_pos = 0;
+    }
+    else if (conn.out_pos > 1024 * 1024)
+    {
+        conn.out.erase(0, conn.out_pos);
+        conn.out_pos = 0;
+    }
+
+    UpdateEvents(epoll_fd, conn, index);
+}
+
+class PlayStat
+{
+public:
+    PlayStat()
+        : window_begin_us_(0)
+        , window_end_us_(0)
+        , recv_frames_(0)
+        , recv_bytes_(0)
+        , latency_sum_us_(0)
+        , latency_max_us_(0)
+        , latency_buckets_(kLatencyBuckets, 0)
+    {
+    }
+
+    void SetWindow(const uint64_t& begin_us, const uint64_t& end_us)
+    {
+        window_begin_us_ = begin_us;
+        window_end_us_ = end_us;
+    }
+
+    bool InWindow(const uint64_t& send_us) const
+    {
+        return window_begin_us_ != 0 && send_us >= window_begin_us_ && send_us < window_end_us_;
+    }
+
+    void OnVideo(const uint64_t& send_us, const size_t& tag_len)
+    {
+        if (! InWindow(send_us))
+        {
+            return;
+        }
+
+        uint64_t latency_us = GetMonotonicUs() - send_us;
+
+        ++recv_frames_;
+        recv_bytes_ += tag_len;
+        latency_sum_us_ += latency_us;
+        latency_max_us_ = max(latency_max_us_, latency_us);
+        ++latency_buckets_[min<uint64_t>(latency_us / kLatencyBucketUs, kLatencyBuckets - 1)];
+    }
+
+    void OnAudio(const size_t& tag_len)
+    {
+        if (window_begin_us_ != 0 && GetMonotonicUs() >= window_begin_us_ && GetMonotonicUs() < window_end_us_)
+        {
+            recv_bytes_ += tag_len;
+        }
+    }
+
+    void Fill(LoadResult& result) const
+    {
+        result.recv_frames = recv_frames_;
+        result.recv_bytes = recv_bytes_;
+        result.window_us = window_end_us_ - window_begin_us_;
+        result.latency_sum_us = latency_sum_us_;
+        result.latency_max_us = latency_max_us_;
+        result.latency_p50_us = Percentile(0.5);
+        result.latency_p99_us = Percentile(0.99);
+    }
+
+private:
+    uint64_t Percentile(const double& ratio) const
+    {
+        uint64_t target = recv_frames_ * ratio;
+        uint64_t count = 0;
+        for (size_t i = 0; i < kLatencyBuckets; ++i)
+        {
+            count += latency_buckets_[i];
+            if (count > target)
+            {
+                return i * kLatencyBucketUs;
+            }
+        }
+
+        return 0;
+    }
+
+private:
+    uint64_t window_begin_us_;
+    uint64_t window_end_us_;
+    uint64_t recv_frames_;
+    uint64_t recv_bytes_;
+    uint64_t latency_sum_us_;
+    uint64_t latency_max_us_;
+    vector<uint64_t> latency_buckets_;
+};
+
+// 解析收到的FLV, 每个完整的视频tag记一次
+static void ParseFlv(LoadConn& conn, PlayStat& stat)
+{
+    while (true)
+    {
+        const uint8_t* data = (const uint8_t*)conn.in.data() + conn.in_pos;
+        size_t left = conn.in.size() - conn.in_pos;
+
+        if (conn.state == kPlayHttpHeader)
+        {
+            size_t end = conn.in.find("\r\n\r\n", conn.in_pos);
+            if (end == string::npos)
+            {
+                break;
+            }
+
+            if (conn.in.compare(conn.in_pos, 12, "HTTP/1.1 200") != 0)
+            {
+                cerr << "stream " << conn.stream << " play failed: " << conn.in.substr(conn.in_pos, end - conn.in_pos) << endl;
+                _exit(1);
+            }
+
+            conn.in_pos = end + 4;
+            conn.state = kPlayFlvHeader;
+        }
+        else if (conn.state == kPlayFlvHeader)
+        {
+            if (left < 9)
+            {
+                break;
+            }
+
+            conn.in_pos += 9;
+            conn.state = kPlayTag;
+        }
+        else
+        {
+            // 4字节PreviousTagSize + 11字节tag头
+            if (left < 15)
+            {
+                break;
+            }
+
+            uint8_t tag_type = data[4];
+            size_t data_len = (data[5] << 16) | (data[6] << 8) | data[7];
+            if (left < 15 + data_len)
+            {
+                break;
+            }
+
+            const uint8_t* tag_data = data + 15;
+            if (tag_type == kVideo && data_len >= kStampOffset + 8 && tag_data[1] == 1)
+            {
+                uint64_t send_us = 0;
+                memcpy(&send_us, tag_data + kStampOffset, sizeof(send_us));
+
+                ++conn.recv_frames;
+                stat.OnVideo(send_us, 15 + data_len);
+            }
+            else if (tag_type == kAudio)
+            {
+                stat.OnAudio(15 + data_len);
+            }
+
+            conn.in_pos += 15 + data_len;
+        }
+    }
+
+    if (conn.in_pos == conn.in.size())
+    {
+        conn.in.clear();
+        conn.in_pos = 0;
+    }
+    else if (conn.in_pos > 1024 * 1024)
+    {
+        conn.in.erase(0, conn.in_pos);
+        conn.in_pos = 0;
+    }
+}
+
+// 客户端子进程: 先推流再播放, 预热之后开始统计, 统计开始和结束各往mark_fd写一个字节
+static void RunClients(const uint16_t& rtmp_port, const uint16_t& flv_port, const uint32_t& publishers, const uint32_t& players,
+                       const uint64_t& seconds, const size_t& frame_len, const int& mark_fd)
+{
+    // amf编码也打日志, 出错信息走stderr
+    int null_fd = open("/dev/null", O_WRONLY);
+    dup2(null_fd, STDOUT_FILENO);
+    close(null_fd);
+
+    int epoll_fd = epoll_create(1024);
+    vector<LoadConn> conns(publishers + players);
+
+    for (uint32_t i = 0; i < conns.size(); ++i)
+    {
+        LoadConn& conn = conns[i];
+        bool publisher = (i < publishers);
+
+        conn.fd = Connect(publisher ? rtmp_port : flv_port);
+        conn.stream = publisher ? i : (i - publishers) % publishers;
+        conn.want_write = false;
+        conn.out_pos = 0;
+        conn.in_pos = 0;
+        conn.recv_frames = 0;
+
+        if (publisher)
+        {
+            // C0 + C1, 简单握手, 收到S0S1S2再发C2
+            conn.state = kPublishHandshake;
+            conn.out.assign(1 + 1536, '\0');
+            conn.out[0] = 0x03;
+        }
+        else
+        {
+            conn.state = kPlayHttpHeader;
+            conn.out = "GET /live/s" + Util::Num2Str(conn.stream) + ".flv HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+        }
+
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.u32 = i;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, conn.fd, &event);
+
+        Flush(epoll_fd, conn, i);
+    }
+
+    PlayStat stat;
+    vector<uint64_t> published(publishers, 0);
+    uint64_t publish_stalls = 0;
+    uint64_t frame = 0;
+
+    uint64_t start_us = GetMonotonicUs();
+    uint64_t window_begin_us = start_us + kWarmupUs;
+    uint64_t window_end_us = start_us + seconds * 1000000ULL;
+    uint64_t stop_us = window_end_us + kDrainUs;
+    stat.SetWindow(window_begin_us, window_end_us);
+
+    bool window_begun = false;
+    bool window_ended = false;
+    uint64_t next_frame_us = start_us;
+
+    vector<char> buf(256 * 1024);
+    while (true)
+    {
+        uint64_t now_us = GetMonotonicUs();
+        if (now_us >= stop_us)
+        {
+            break;
+        }
+
+        if (! window_begun && now_us >= window_begin_us)
+        {
+            window_begun = true;
+            if (write(mark_fd, "b", 1) != 1)
+            {
+                _exit(1);
+            }
+        }
+
+        if (! window_ended && now_us >= window_end_us)
+        {
+            window_ended = true;
+            if (write(mark_fd, "e", 1) != 1)
+            {
+                _exit(1);
+            }
+        }
+
+        // 按时间补帧, 客户端慢了也不少发
+        while (now_us >= next_frame_us && next_frame_us < window_end_us)
+        {
+            for (uint32_t i = 0; i < publishers; ++i)
+            {
+                LoadConn& conn = conns[i];
+                if (conn.state != kPublishing)
+                {
+                    continue;
+                }
+
+                if (conn.out.size() - conn.out_pos > kMaxPublishQueue)
+                {
+                    ++publish_stalls;
+                    continue;
+                }
+
+                AppendVideoFrame(conn.out, frame, frame_len, next_frame_us);
+                AppendAudioFrames(conn.out, frame);
+                Flush(epoll_fd, conn, i);
+
+                if (stat.InWindow(next_frame_us))
+                {
+                    ++published[i];
+                }
+            }
+
+            ++frame;
+            next_frame_us += kFrameIntervalUs;
+        }
+
+        int timeout_ms = next_frame_us > now_us ? (next_frame_us - now_us) / 1000 + 1 : 1;
+
+        struct epoll_event events[1024];
+        int num_event = epoll_wait(epoll_fd, events, 1024, timeout_ms);
+
+        for (int i = 0; i < num_event; ++i)
+        {
+            uint32_t index = events[i].data.u32;
+            LoadConn& conn = conns[index];
+
+            if (events[i].events & EPOLLOUT)
+            {
+                Flush(epoll_fd, conn, index);
+            }
+
+            if (! (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)))
+            {
+                continue;
+            }
+
+            ssize_t bytes = read(conn.fd, buf.data(), buf.size());
+            if (bytes == 0 || (bytes < 0 && errno != EAGAIN))
+            {
+                cerr << (index < publishers ? "publisher " : "player ") << index << " closed by server" << endl;
+                _exit(1);
+            }
+            if (bytes < 0)
+            {
+                continue;
+            }
+
+            if (conn.state == kPublishing)
+            {
+                // 服务端的控制消息和命令回包不用管
+                continue;
+            }
+
+            conn.in.append(buf.data(), bytes);
+
+            if (conn.state == kPublishHandshake)
+            {
+                if (conn.in.size() >= kHandshakeLen)
+                {
+                    conn.in.clear();
+                    conn.state = kPublishing;
+                    conn.out.append(1536, '\0');
+                    conn.out += MakePublishCommands(conn.stream);
+                    Flush(epoll_fd, conn, index);
+                }
+                continue;
+            }
+
+            ParseFlv(conn, stat);
+        }
+    }
+
+    LoadResult result;
+    memset(&result, 0, sizeof(result));
+    stat.Fill(result);
+    result.publish_stalls = publish_stalls;
+
+    for (uint32_t i = publishers; i < conns.size(); ++i)
+    {
+        result.expected_frames += published[conns[i].stream];
+        if (conns[i].recv_frames > 0)
+        {
+            ++result.players_ok;
+        }
+    }
+
+    if (write(mark_fd, &result, sizeof(result)) != sizeof(result))
+    {
+        _exit(1);
+    }
+
+    _exit(0);
+}
+
+static SocketHandler* GenRtmpProtocol(IoLoop* io_loop, Fd* socket)
+{
+    return new RtmpProtocol(io_loop, socket);
+}
+
+static SocketHandler* GenHttpFlvProtocol(IoLoop* io_loop, Fd* socket)
+{
+    return new HttpFlvProtocol(io_loop, socket);
+}
+
+static void Listen(IoLoop* io_loop, const uint16_t& port, const bool& reuse_port, HandlerFactoryT handler_factory)
+{
+    int fd = socket_util::CreateNonBlockTcpSocket();
+    socket_util::ReuseAddr(fd);
+    if (reuse_port)
+    {
+        socket_util::ReusePort(fd);
+    }
+
+    // 默认的backlog太小, 几千个连接一起来会丢SYN
+    if (socket_util::Bind(fd, "127.0.0.1", port) != 0 || listen(fd, 65535) != 0)
+    {
+        cerr << "listen " << port << " failed" << endl;
+        _exit(1);
+    }
+    socket_util::SetNonBlock(fd);
+
+    TcpSocket* server = new TcpSocket(io_loop, fd, handler_factory);
+    server->AsServerSocket();
+    server->EnableRead();
+}
+
+static IoLoop* CreateIoLoop(const string& io_loop_type)
+{
+    if (io_loop_type == "io_uring")
+    {
+        IoUringLoop* io_uring_loop = new IoUringLoop();
+        if (io_uring_loop->Create() == 0)
+        {
+            return io_uring_loop;
+        }
+
+        cerr << "create io_uring loop failed" << endl;
+        _exit(1);
+    }
+
+    Epoller* epoller = new Epoller();
+    epoller->Create();
+
+    return epoller;
+}
+
+// 服务端子进程: 跟tms的多reactor一样, loop 0在主线程, 其余每个worker一个线程, 都监听好了往ready_fd写一个字节
+static void RunServer(const uint32_t& workers, const uint16_t& rtmp_port, const uint16_t& flv_port, const string& io_loop_type, const int& ready_fd)
+{
+    // 服务端每个连接都打很多日志, 压测时不要
+    int null_fd = open("/dev/null", O_WRONLY);
+    dup2(null_fd, STDOUT_FILENO);
+    close(null_fd);
+
+    signal(SIGPIPE, SIG_IGN);
+
+    vector<IoLoop*> all_loop;
+    for (uint32_t index = 0; index < workers; ++index)
+    {
+        IoLoop* io_loop = CreateIoLoop(io_loop_type);
+
+        Listen(io_loop, rtmp_port, workers > 1, GenRtmpProtocol);
+        Listen(io_loop, flv_port, workers > 1, GenHttpFlvProtocol);
+
+        all_loop.push_back(io_loop);
+    }
+    g_epoll = all_loop[0];
+
+    for (uint32_t index = 1; index < workers; ++index)
+    {
+        IoLoopThread* io_loop_thread = new IoLoopThread(index, all_loop[index]);
+        io_loop_thread->Start(-1);
+    }
+
+    if (write(ready_fd, "r", 1) != 1)
+    {
+        _exit(1);
+    }
+
+    all_loop[0]->RunIOLoop(100);
+
+    _exit(0);
+}
+
+static bool RunOnce(const uint32_t& workers, const uint32_t& publishers, const uint32_t& players, const uint64_t& seconds,
+                    const size_t& frame_len, const string& io_loop_type, const uint16_t& port_base, LoadResult& result,
+                    uint64_t& server_cpu_us, uint64_t& client_cpu_us)
+{
+    uint16_t rtmp_port = port_base;
+    uint16_t flv_port = port_base + 1;
+
+    int server_pipe[2];
+    int client_pipe[2];
+    if (pipe(server_pipe) != 0 || pipe(client_pipe) != 0)
+    {
+        return false;
+    }
+
+    pid_t server_pid = fork();
+    if (server_pid == 0)
+    {
+        close(server_pipe[0]);
+        RunServer(workers, rtmp_port, flv_port, io_loop_type, server_pipe[1]);
+    }
+    close(server_pipe[1]);
+
+    char mark = 0;
+    if (read(server_pipe[0], &mark, 1) != 1)
+    {
+        cout << "server failed to start" << endl;
+        waitpid(server_pid, NULL, 0);
+        return false;
+    }
+    close(server_pipe[0]);
+
+    pid_t client_pid = fork();
+    if (client_pid == 0)
+    {
+        close(client_pipe[0]);
+        RunClients(rtmp_port, flv_port, publishers, players, seconds, frame_len, client_pipe[1]);
+    }
+    close(client_pipe[1]);
+
+    bool ok = false;
+    uint64_t server_begin_us = 0;
+    uint64_t client_begin_us = 0;
+    if (read(client_pipe[0], &mark, 1) == 1)
+    {
+        server_begin_us = GetProcessCpuUs(server_pid);
+        client_begin_us = GetProcessCpuUs(client_pid);
+
+        if (read(client_pipe[0], &mark, 1) == 1)
+        {
+            server_cpu_us = GetProcessCpuUs(server_pid) - server_begin_us;
+            client_cpu_us = GetProcessCpuUs(client_pid) - client_begin_us;
+
+            ok = (read(client_pipe[0], &result, sizeof(result)) == sizeof(result));
+        }
+    }
+    close(client_pipe[0]);
+
+    waitpid(client_pid, NULL, 0);
+    kill(server_pid, SIGKILL);
+    waitpid(server_pid, NULL, 0);
+
+    return ok;
+}
+
+int main(int argc, char* argv[])
+{
+    uint32_t publishers = argc > 1 ? atoi(argv[1]) : 10;
+    uint32_t players = argc > 2 ? atoi(argv[2]) : 1000;
+    uint32_t max_workers = argc > 3 ? atoi(argv[3]) : 4;
+    uint64_t seconds = argc > 4 ? atoi(argv[4]) : 10;
+    uint64_t kbps = argc > 5 ? atoi(argv[5]) : 1000;
+    string io_loop_type = argc > 6 ? argv[6] : "epoll";
+
+    if (publishers == 0 || max_workers == 0 || seconds * 1000000ULL <= kWarmupUs)
+    {
+        cout << "Usage:" << argv[0] << " [publishers] [players] [max_workers] [seconds > 2] [video_kbps] [epoll|io_uring]" << endl;
+        return -1;
+    }
+
+    // 每帧视频的字节数, 关键帧是4倍, 每秒一个
+    size_t frame_len = kbps * 1000 / 8 * kFrameIntervalUs / 1000000 * kGopFrames / (kGopFrames + 3);
+
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    cout << publishers << " rtmp publishers, " << players << " http-flv players, " << kbps << " kbps video + "
+         << (2 * (kAudioLen + 2) * 8 * 1000000 / kFrameIntervalUs / 1000) << " kbps audio, "
+         << seconds << "s (first " << kWarmupUs / 1000000 << "s warmup), " << io_loop_type << ", "
+         << sysconf(_SC_NPROCESSORS_ONLN) << " cpus" << endl;
+    cout << "workers  video frames recv/expected   recv Mbit/s  latency avg/p50/p99/max ms   server cpu  client cpu" << endl;
+
+    uint16_t port_base = 20000 + getpid() % 1000 * 20;
+    for (uint32_t workers = 1; workers <= max_workers; ++workers)
+    {
+        LoadResult result;
+        memset(&result, 0, sizeof(result));
+        uint64_t server_cpu_us = 0;
+        uint64_t client_cpu_us = 0;
+
+        if (! RunOnce(workers, publishers, players, seconds, frame_len, io_loop_type, port_base + workers * 2, result, server_cpu_us, client_cpu_us))
+        {
+            cout << workers << " workers: failed" << endl;
+            return -1;
+        }
+
+        double window_s = result.window_us / 1000000.0;
+        char line[256];
+        snprintf(line, sizeof(line), "%7u  %10lu/%-10lu %6.2f%%  %11.1f  %6.1f/%5.1f/%5.1f/%6.1f   %9.1f%%  %9.1f%%",
+                 workers, result.recv_frames, result.expected_frames,
+                 result.expected_frames ? 100.0 * result.recv_frames / result.expected_frames : 0.0,
+                 result.recv_bytes * 8 / window_s / 1000000,
+                 result.recv_frames ? result.latency_sum_us / 1000.0 / result.recv_frames : 0.0,
+                 result.latency_p50_us / 1000.0, result.latency_p99_us / 1000.0, result.latency_max_us / 1000.0,
+                 100.0 * server_cpu_us / result.window_us, 100.0 * client_cpu_us / result.window_us);
+        cout << line << endl;
+
+        if (result.players_ok != players || result.publish_stalls != 0)
+        {
+            cout << "  players with frames:" << result.players_ok << "/" << players << ", publisher stalls:" << result.publish_stalls << endl;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,167 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "h264_rtp_packetizer.h"
+#include "ref_ptr.h"
+#include "util.h"
+#include "wire_cache.h"
+
+using namespace std;
+
+// webrtc H264分发, 每秒能分发多少帧(每帧发给所有对端):
+// 1. 每个对端自己打包, 以前BroadcastH264对每个对端调SendMediaData就是这样
+// 2. 每个流只打一次包, 对端从WireCache::GetRtpPackets拿, 现在的SendMediaData/SendMediaDataBatch
+// 两种对端都要拷贝包, 改自己的序号和SSRC. SRTP两种都一样, 不算在里面
+// 帧: 每25帧一个60KB的IDR(前面带SPS/PPS), 其余8KB, RTP负载900字节
+// 用法: ./rtp_fanout_bench [每种跑的毫秒数]
+
+static const uint8_t kPayloadType = 102;
+static const size_t kMaxPayload = 900;
+static const int kGopFrames = 25;
+static const uint32_t kSsrc = 3233846889;
+
+static volatile uint64_t g_sink = 0;
+
+// AVCC, 一帧一个NALU, IDR前面带SPS/PPS
+static Payload MakeFrame(const bool& key, const size_t& len)
+{
+    static const uint8_t kSps[] = { 0x67, 0x64, 0x00, 0x1f, 0xac, 0xd9, 0x40, 0x50, 0x05, 0xbb, 0x01, 0x10 };
+    static const uint8_t kPps[] = { 0x68, 0xeb, 0xe3, 0xcb, 0x22, 0xc0 };
+
+    vector<uint8_t> data;
+    auto append_nalu = [&data](const uint8_t* nalu, const size_t& nalu_len)
+    {
+        data.push_back(nalu_len >> 24);
+        data.push_back(nalu_len >> 16);
+        data.push_back(nalu_len >> 8);
+        data.push_back(nalu_len);
+        data.insert(data.end(), nalu, nalu + nalu_len);
+    };
+
+    vector<uint8_t> slice(len);
+    for (auto& c : slice)
+    {
+        c = rand();
+    }
+    slice[0] = key ? 0x65 : 0x41;
+
+    vector<uint32_t> offsets;
+    if (key)
+    {
+        offsets.push_back(data.size());
+        append_nalu(kSps, sizeof(kSps));
+        offsets.push_back(data.size());
+        append_nalu(kPps, sizeof(kPps));
+    }
+    offsets.push_back(data.size());
+    append_nalu(slice.data(), slice.size());
+
+    Payload payload(data.size());
+    memcpy(payload.GetAllData(), data.data(), data.size());
+    payload.SetVideo();
+    if (key)
+    {
+        payload.SetIFrame();
+    }
+    for (const auto& offset : offsets)
+    {
+        payload.AddNalu(offset);
+    }
+
+    return payload;
+}
+
+// 对端发送: 拷出来改序号和SSRC, 后面本来是srtp_protect和sendmsg
+static void SendToPeer(const H264RtpPacketizer& packetizer, uint16_t& seq)
+{
+    for (int i = 0; i < packetizer.GetPacketCount(); ++i)
+    {
+        size_t len = 0;
+        const uint8_t* packet = packetizer.GetPacket(i, len);
+
+        uint8_t buf[H264RtpPacketizer::kMaxPacketSize];
+        memcpy(buf, packet, len);
+        H264RtpPacketizer::SetSeqAndSsrc(buf, seq++, kSsrc);
+
+        g_sink += buf[len - 1];
+    }
+}
+
+static void PacketizeFrame(H264RtpPacketizer& packetizer, const Payload& payload)
+{
+    packetizer.Clear();
+
+    size_t last = payload.GetNaluCount() - 1;
+    for (size_t i = 0; i < payload.GetNaluCount(); ++i)
+    {
+        uint32_t len = 0;
+        const uint8_t* nalu = payload.GetNalu(i, len);
+
+        packetizer.Packetize(nalu, len, payload.GetDts32() * 90, i == last);
+    }
+}
+
+static double Bench(const vector<Payload>& gop, const int& peers, const bool& per_peer, const uint64_t& duration_ms)
+{
+    vector<uint16_t> seq(peers, 0);
+    WireCache wire_cache;
+    uint64_t frames = 0;
+
+    uint64_t begin_us = Util::GetNowUs();
+    uint64_t end_us = begin_us + duration_ms * 1000;
+
+    while (Util::GetNowUs() < end_us)
+    {
+        Payload payload = gop[frames % gop.size()];
+        payload.SetDts(frames * 40);
+        payload.SetPts(frames * 40);
+
+        for (int peer = 0; peer < peers; ++peer)
+        {
+            if (per_peer)
+            {
+                H264RtpPacketizer packetizer(kPayloadType, kMaxPayload);
+                PacketizeFrame(packetizer, payload);
+                SendToPeer(packetizer, seq[peer]);
+            }
+            else
+            {
+                SendToPeer(wire_cache.GetRtpPackets(payload, kPayloadType, kMaxPayload), seq[peer]);
+            }
+        }
+
+        ++frames;
+    }
+
+    return frames * 1000000.0 / (Util::GetNowUs() - begin_us);
+}
+
+int main(int argc, char* argv[])
+{
+    uint64_t duration_ms = argc > 1 ? atoi(argv[1]) : 1000;
+
+    srand(1);
+    vector<Payload> gop;
+    for (int i = 0; i < kGopFrames; ++i)
+    {
+        gop.push_back(MakeFrame(i == 0, i == 0 ? 60 * 1024 : 8 * 1024));
+    }
+
+    cout << "peers  per-peer packetize frames/s  once per stream frames/s" << endl;
+
+    for (int peers : { 100, 500, 1000 })
+    {
+        double per_peer = Bench(gop, peers, true, duration_ms);
+        double once = Bench(gop, peers, false, duration_ms);
+
+        char line[256];
+        snprintf(line, sizeof(line), "%5d  %27.0f  %24.0f", peers, per_peer, once);
+        cout << line << endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,338 @@
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "epoller.h"
+#include "io_buffer.h"
+#include "socket_handler.h"
+#include "socket_util.h"
+#include "srt_epoller.h"
+#include "srt_socket.h"
+#include "srt_socket_util.h"
+#include "tcp_socket.h"
+#include "util.h"
+
+#include "srt/srt.h"
+
+using namespace std;
+
+// SRT收包到转发给订阅者的延迟, 对比两种主循环:
+// old: 以前的main, epoll等100ms, 再srt_epoll_wait(0)轮询一次
+// new: 现在的main, srt事件由SrtEpoller的等待线程阻塞等待, QueueInLoop唤醒主loop执行回调
+// 发送线程每隔interval毫秒发一个1316字节的包, 包里带发送时间. 服务端SrtSocket读到后转给一个tcp订阅者, Send的时候记延迟.
+// 收发两端关掉TSBPD, 量的是收包到回调的调度延迟, tms配置的SRT latency两种方式都要再加上.
+// tcp_busy: 另起一个线程每1ms往主loop的另一个tcp连接写一个字节, 主loop不会在epoll_wait里睡满100ms
+// 每种组合在单独的子进程里跑
+// 用法: ./srt_latency [包数] [间隔ms]
+
+static const size_t kPacketLen = 1316;
+
+struct LatencyResult
+{
+    uint64_t    count;
+    uint64_t    avg_us;
+    uint64_t    p50_us;
+    uint64_t    p99_us;
+    uint64_t    max_us;
+};
+
+static uint64_t GetMonotonicUs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+// 读到的每个包都转给订阅者, 转发时记延迟
+class ForwardHandler : public SocketHandler
+{
+public:
+    ForwardHandler(Fd* subscriber, vector<uint64_t>* latencies)
+        : subscriber_(subscriber)
+        , latencies_(latencies)
+    {
+    }
+
+    virtual int HandleRead(IoBuffer& io_buffer, Fd& socket)
+    {
+        while (io_buffer.Size() >= kPacketLen)
+        {
+            uint8_t* packet = NULL;
+            io_buffer.Read(packet, kPacketLen);
+
+            uint64_t send_us = 0;
+            memcpy(&send_us, packet, sizeof(send_us));
+
+            if (subscriber_ != NULL)
+            {
+                subscriber_->Send(packet, kPacketLen);
+                latencies_->push_back(GetMonotonicUs() - send_us);
+            }
+        }
+
+        return kSuccess;
+    }
+
+    virtual int HandleClose(IoBuffer& io_buffer, Fd& socket)
+    {
+        return kSuccess;
+    }
+
+private:
+    Fd* subscriber_;
+    vector<uint64_t>* latencies_;
+};
+
+// 订阅者和tcp_busy连接, 收到的都扔掉
+class DiscardHandler : public SocketHandler
+{
+public:
+    virtual int HandleRead(IoBuffer& io_buffer, Fd& socket)
+    {
+        io_buffer.Skip(io_buffer.Size());
+        return kSuccess;
+    }
+
+    virtual int HandleClose(IoBuffer& io_buffer, Fd& socket)
+    {
+        return kSuccess;
+    }
+};
+
+static SocketHandler* GenDiscardHandler(IoLoop* io_loop, Fd* socket)
+{
+    return new DiscardHandler();
+}
+
+// 主loop上挂一个连接, 另一端交给线程, 返回线程那一端
+static TcpSocket* CreateLoopSocket(IoLoop* io_loop, int& peer_fd)
+{
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+    {
+        return NULL;
+    }
+
+    socket_util::SetNonBlock(fds[0]);
+
+    TcpSocket* socket = new TcpSocket(io_loop, fds[0], GenDiscardHandler);
+    socket->SetConnected();
+    socket->EnableRead();
+
+    peer_fd = fds[1];
+
+    return socket;
+}
+
+static void RunOnce(const bool& new_loop, const bool& tcp_busy, const uint16_t& port, const uint64_t& packets,
+                    const uint64_t& interval_ms, const int& result_fd)
+{
+    // SrtSocket每次读都打日志
+    int null_fd = open("/dev/null", O_WRONLY);
+    dup2(null_fd, STDOUT_FILENO);
+    close(null_fd);
+
+    signal(SIGPIPE, SIG_IGN);
+    srt_startup();
+
+    Epoller* io_loop = new Epoller();
+    io_loop->Create();
+
+    SrtEpoller* srt_epoller = new SrtEpoller();
+    srt_epoller->Create();
+
+    // 订阅者的另一端由线程读掉
+    int subscriber_peer_fd = -1;
+    TcpSocket* subscriber = CreateLoopSocket(io_loop, subscriber_peer_fd);
+
+    int busy_peer_fd = -1;
+    TcpSocket* busy_socket = tcp_busy ? CreateLoopSocket(io_loop, busy_peer_fd) : NULL;
+
+    vector<uint64_t> latencies;
+    latencies.reserve(packets);
+
+    int server_fd = srt_socket_util::CreateSrtSocket();
+    srt_socket_util::SetTransTypeLive(server_fd);
+    srt_socket_util::SetTspbdMode(server_fd, 0);
+    srt_socket_util::SetBlock(server_fd, false);
+    if (srt_socket_util::Bind(server_fd, "127.0.0.1", port) != 0 || srt_socket_util::Listen(server_fd) != 0)
+    {
+        _exit(1);
+    }
+
+    SrtSocket* server = new SrtSocket(srt_epoller, server_fd, [subscriber, &latencies](IoLoop* io_loop, Fd* socket)
+    {
+        return new ForwardHandler(subscriber, &latencies);
+    });
+    server->AsServerSocket();
+    server->EnableRead();
+
+    atomic<bool> done(false);
+
+    thread drainer([subscriber_peer_fd]()
+    {
+        char buf[64 * 1024];
+        while (read(subscriber_peer_fd, buf, sizeof(buf)) > 0)
+        {
+        }
+    });
+
+    thread busy_writer([busy_peer_fd, &done]()
+    {
+        while (busy_peer_fd >= 0 && ! done)
+        {
+            if (write(busy_peer_fd, "x", 1) != 1)
+            {
+                break;
+            }
+            usleep(1000);
+        }
+    });
+
+    thread sender([port, packets, interval_ms, io_loop, &done]()
+    {
+        int fd = srt_socket_util::CreateSrtSocket();
+        srt_socket_util::SetTransTypeLive(fd);
+        srt_socket_util::SetTspbdMode(fd, 0);
+        if (srt_socket_util::Connect(fd, "127.0.0.1", port) != 0)
+        {
+            _exit(1);
+        }
+
+        // 等服务端accept
+        usleep(200 * 1000);
+
+        uint8_t packet[kPacketLen];
+        memset(packet, 0x47, sizeof(packet));
+
+        uint64_t next_us = GetMonotonicUs();
+        for (uint64_t i = 0; i < packets; ++i)
+        {
+            next_us += interval_ms * 1000;
+            uint64_t now_us = GetMonotonicUs();
+            if (next_us > now_us)
+            {
+                usleep(next_us - now_us);
+            }
+
+            uint64_t send_us = GetMonotonicUs();
+            memcpy(packet, &send_us, sizeof(send_us));
+            srt_sendmsg(fd, (const char*)packet, sizeof(packet), -1, 0);
+        }
+
+        usleep(300 * 1000);
+        srt_close(fd);
+
+        done = true;
+        io_loop->Quit();
+    });
+
+    if (new_loop)
+    {
+        srt_epoller->Start(io_loop);
+        io_loop->RunIOLoop(100);
+    }
+    else
+    {
+        while (! done)
+        {
+            io_loop->WaitIO(100);
+            srt_epoller->WaitIO(0);
+        }
+    }
+
+    sender.join();
+    busy_writer.join();
+
+    LatencyResult result;
+    memset(&result, 0, sizeof(result));
+    result.count = latencies.size();
+    if (! latencies.empty())
+    {
+        sort(latencies.begin(), latencies.end());
+
+        uint64_t sum = 0;
+        for (const auto& latency : latencies)
+        {
+            sum += latency;
+        }
+
+        result.avg_us = sum / latencies.size();
+        result.p50_us = latencies[latencies.size() / 2];
+        result.p99_us = latencies[latencies.size() * 99 / 100];
+        result.max_us = latencies.back();
+    }
+
+    if (write(result_fd, &result, sizeof(result)) != sizeof(result))
+    {
+        _exit(1);
+    }
+
+    // 线程和srt都不收拾了, 直接退出
+    _exit(0);
+}
+
+int main(int argc, char* argv[])
+{
+    uint64_t packets = argc > 1 ? atoi(argv[1]) : 500;
+    uint64_t interval_ms = argc > 2 ? atoi(argv[2]) : 20;
+
+    if (packets == 0)
+    {
+        cout << "Usage:" << argv[0] << " [packets] [interval_ms]" << endl;
+        return -1;
+    }
+
+    cout << packets << " srt packets, one every " << interval_ms << "ms, srt recv -> tcp subscriber send latency" << endl;
+    cout << "loop  tcp       packets   avg ms   p50 ms   p99 ms   max ms" << endl;
+
+    uint16_t port_base = 30000 + getpid() % 1000 * 4;
+    for (int tcp_busy = 0; tcp_busy <= 1; ++tcp_busy)
+    {
+        for (int new_loop = 0; new_loop <= 1; ++new_loop)
+        {
+            int result_pipe[2];
+            if (pipe(result_pipe) != 0)
+            {
+                return -1;
+            }
+
+            pid_t pid = fork();
+            if (pid == 0)
+            {
+                close(result_pipe[0]);
+                RunOnce(new_loop, tcp_busy, port_base + tcp_busy * 2 + new_loop, packets, interval_ms, result_pipe[1]);
+            }
+            close(result_pipe[1]);
+
+            LatencyResult result;
+            if (read(result_pipe[0], &result, sizeof(result)) != sizeof(result))
+            {
+                cout << (new_loop ? "new" : "old") << " failed" << endl;
+                return -1;
+            }
+            close(result_pipe[0]);
+            waitpid(pid, NULL, 0);
+
+            char line[256];
+            snprintf(line, sizeof(line), "%-4s  %-4s  %10lu  %7.2f  %7.2f  %7.2f  %7.2f",
+                     new_loop ? "new" : "old", tcp_busy ? "busy" : "idle", result.count,
+                     result.avg_us / 1000.0, result.p50_us / 1000.0, result.p99_us / 1000.0, result.max_us / 1000.0);
+            cout << line << endl;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,216 @@
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "stream_registry.h"
+#include "util.h"
+
+using namespace std;
+
+// 按app/stream查发布者, 每秒查多少次:
+// 1. 以前LocalStreamCenter的做法: 两层std::map, 一把全局锁
+// 2. StreamRegistry, 查询不加锁
+// 随机查已注册的流, 每个线程查固定次数. 先跑一轮注销/注册和查询并发的检查, 稳定的流不能查丢
+// 用法: ./stream_registry_bench [流数] [每线程查询次数] [最多线程数]
+
+struct StreamInfo
+{
+    MediaPublisher* publisher;
+    IoLoop*         io_loop;
+};
+
+class MapRegistry
+{
+public:
+    void Insert(const string& app, const string& stream, MediaPublisher* publisher)
+    {
+        lock_guard<mutex> lock(mutex_);
+        streams_[app][stream] = StreamInfo{ publisher, NULL };
+    }
+
+    MediaPublisher* Find(const string& app, const string& stream)
+    {
+        lock_guard<mutex> lock(mutex_);
+
+        auto iter_app = streams_.find(app);
+        if (iter_app == streams_.end())
+        {
+            return NULL;
+        }
+
+        auto iter_stream = iter_app->second.find(stream);
+        if (iter_stream == iter_app->second.end())
+        {
+            return NULL;
+        }
+
+        return iter_stream->second.publisher;
+    }
+
+private:
+    mutex mutex_;
+    map<string, map<string, StreamInfo>> streams_;
+};
+
+static vector<string> g_apps;
+static vector<string> g_streams;
+
+static MediaPublisher* PublisherOf(const int& index)
+{
+    return (MediaPublisher*)(intptr_t)(index + 1);
+}
+
+static MediaPublisher* FindInRegistry(const StreamRegistry& registry, const string& app, const string& stream)
+{
+    StreamRegistry::ReadGuard guard;
+    const StreamRegistry::Entry* entry = registry.Find(app, stream);
+
+    return entry == NULL ? NULL : entry->publisher;
+}
+
+// 返回每秒查询次数, 查不到的算错
+template<typename FindT>
+static double Bench(FindT find, const int& threads, const int& queries, uint64_t& miss)
+{
+    atomic<uint64_t> total_miss(0);
+    vector<thread> workers;
+    int count = g_apps.size();
+
+    uint64_t begin_us = Util::GetNowUs();
+    for (int t = 0; t < threads; ++t)
+    {
+        workers.emplace_back([&, t]()
+        {
+            uint64_t local_miss = 0;
+            uint32_t x = t * 7919 + 1;
+
+            for (int i = 0; i < queries; ++i)
+            {
+                x = x * 1103515245 + 12345;
+                int index = (x >> 8) % count;
+
+                if (find(g_apps[index], g_streams[index]) != PublisherOf(index))
+                {
+                    ++local_miss;
+                }
+            }
+
+            total_miss += local_miss;
+        });
+    }
+
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+    uint64_t cost_us = Util::GetNowUs() - begin_us;
+
+    miss = total_miss;
+
+    return cost_us == 0 ? 0 : (double)queries * threads * 1000000.0 / cost_us;
+}
+
+// 偶数下标的流反复注销再注册, 另一个线程一直查奇数下标的, 返回查丢的次数
+static uint64_t ChurnCheck(StreamRegistry& registry, const int& rounds)
+{
+    int count = g_apps.size();
+    atomic<bool> stop(false);
+    atomic<uint64_t> miss(0);
+
+    thread reader([&]()
+    {
+        while (! stop)
+        {
+            for (int i = 1; i < count; i += 194)
+            {
+                if (FindInRegistry(registry, g_apps[i], g_streams[i]) != PublisherOf(i))
+                {
+                    ++miss;
+                }
+            }
+        }
+    });
+
+    for (int round = 0; round < rounds; ++round)
+    {
+        for (int i = 0; i < count; i += 2)
+        {
+            registry.Erase(g_apps[i], g_streams[i], PublisherOf(i));
+        }
+
+        for (int i = 0; i < count; i += 2)
+        {
+            registry.Insert(g_apps[i], g_streams[i], PublisherOf(i), NULL);
+        }
+    }
+
+    stop = true;
+    reader.join();
+
+    return miss;
+}
+
+int main(int argc, char* argv[])
+{
+    int count = argc > 1 ? atoi(argv[1]) : 100000;
+    int queries = argc > 2 ? atoi(argv[2]) : 2000000;
+    int max_threads = argc > 3 ? atoi(argv[3]) : 4;
+
+    for (int i = 0; i < count; ++i)
+    {
+        g_apps.push_back("live" + to_string(i % 16));
+        g_streams.push_back("stream_" + to_string(i));
+    }
+
+    MapRegistry map_registry;
+    StreamRegistry registry;
+
+    for (int i = 0; i < count; ++i)
+    {
+        map_registry.Insert(g_apps[i], g_streams[i], PublisherOf(i));
+        registry.Insert(g_apps[i], g_streams[i], PublisherOf(i), NULL);
+    }
+
+    cout << count << " streams, " << queries << " lookups per thread" << endl;
+
+    uint64_t churn_miss = ChurnCheck(registry, 20);
+    cout << "churn: erase/insert half of the streams 20 times while reading the others, miss " << churn_miss << endl;
+
+    if (registry.Size() != (size_t)count)
+    {
+        cout << "registry size " << registry.Size() << " != " << count << endl;
+        return 1;
+    }
+
+    cout << "threads  map+mutex M/s  registry M/s" << endl;
+
+    for (int threads = 1; threads <= max_threads; threads *= 2)
+    {
+        uint64_t map_miss = 0;
+        uint64_t registry_miss = 0;
+
+        double map_qps = Bench([&map_registry](const string& app, const string& stream)
+        {
+            return map_registry.Find(app, stream);
+        }, threads, queries, map_miss);
+
+        double registry_qps = Bench([&registry](const string& app, const string& stream)
+        {
+            return FindInRegistry(registry, app, stream);
+        }, threads, queries, registry_miss);
+
+        char line[256];
+        snprintf(line, sizeof(line), "%7d  %13.2f  %12.2f%s", threads, map_qps / 1e6, registry_qps / 1e6,
+                 (map_miss != 0 || registry_miss != 0) ? "  MISS" : "");
+        cout << line << endl;
+    }
+
+    return churn_miss == 0 ? 0 : 1;
+}
@@ -0,0 +1,384 @@
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bit_stream.h"
+#include "global.h"
+#include "media_publisher.h"
+#include "ts_packetizer.h"
+#include "ts_segment.h"
+#include "util.h"
+
+using namespace std;
+
+// TS封装吞吐, MB/s按ES字节算, 每个关键帧开一个新切片:
+// 1. TsPacketizer写进TsSegment, 现在MediaMuxer切ts就是这么做的
+// 2. 以前MediaMuxer::PacketTs的做法做对照: 每个包一个BitStream按位写, 再append进切片string
+// 3. MediaMuxer整条路径: OnVideo/OnAudio, 包括AVCC转annexb, 切片, 播放列表
+// 帧: 25fps视频, 每50帧一个120KB的IDR, 其余200B~15KB; 每帧视频两帧150~450B的音频
+// 用法: ./ts_mux_bench [轮数]
+
+LocalStreamCenter g_local_stream_center;
+IoLoop* g_epoll = NULL;
+SSL_CTX* g_tls_ctx = NULL;
+SSL_CTX* g_dtls_ctx = NULL;
+string g_dtls_fingerprint = "";
+string g_local_ice_pwd = "";
+string g_local_ice_ufrag = "";
+string g_remote_ice_pwd = "";
+string g_remote_ice_ufrag = "";
+string g_server_ip = "";
+
+static const string kAvcc("\x01\x64\x00\x1f\xff\xe1\x00\x1a\x67\x64\x00\x1f\xac\xd9\x40\x50\x05\xbb\x01\x10\x00\x00\x03\x00\x10\x00\x00\x03\x03\x20\xf1\x83\x19\x60\x01\x00\x05\x68\xeb\xe3\xcb\x22\xc0", 42);
+static const string kAsc("\x12\x10", 2);
+
+static const uint16_t kVideoPid = 0x100;
+static const uint16_t kAudioPid = 0x101;
+static const int kVideoFrames = 3000;
+static const int kGopFrames = 50;
+
+struct Frame
+{
+    bool        video;
+    bool        key;
+    uint64_t    pts;
+    uint64_t    dts;
+    string      data;
+};
+
+// 以前的做法, 字段顺序跟TsPacketizer出来的一样
+class BitStreamPacketizer
+{
+public:
+    BitStreamPacketizer()
+        : video_cc_(0)
+        , audio_cc_(0)
+    {
+    }
+
+    void Packet(const Frame& frame, const uint8_t* prefix, const size_t& prefix_len, string& out)
+    {
+        bool is_video = frame.video;
+        const uint8_t* data = (const uint8_t*)frame.data.data();
+        size_t left = frame.data.size();
+        bool first = true;
+
+        while (first || left > 0)
+        {
+            BitStream ts_bs;
+
+            // PES头: 000001 + stream id + 长度 + flag + PTS/DTS
+            BitStream pes_bs;
+            if (first)
+            {
+                pes_bs.WriteBytes(3, (uint32_t)0x000001);
+                pes_bs.WriteBytes(1, is_video ? 0xe0 : 0xc0);
+                pes_bs.WriteBytes(2, is_video ? 0 : (uint64_t)(left + prefix_len + 8));
+                pes_bs.WriteBytes(1, 0x80);
+                pes_bs.WriteBytes(1, is_video ? 0xc0 : 0x80);
+                pes_bs.WriteBytes(1, is_video ? 10 : 5);
+                WriteTimestamp(pes_bs, is_video ? 0x03 : 0x02, frame.pts * 90);
+                if (is_video)
+                {
+                    WriteTimestamp(pes_bs, 0x01, frame.dts * 90);
+                }
+                pes_bs.WriteData(prefix_len, prefix);
+            }
+
+            size_t header_len = 4 + (first && is_video ? 8 : 0) + pes_bs.SizeInBytes();
+            size_t payload_len = left < 188 - header_len ? left : 188 - header_len;
+            size_t stuffing = 188 - header_len - payload_len;
+
+            // 首包带PCR, 不满的包用自适应区填充, 只差1个字节时只有长度字节
+            bool with_pcr = first && is_video;
+            bool with_adaptation = with_pcr || stuffing > 0;
+
+            ts_bs.WriteBytes(1, 0x47);
+            ts_bs.WriteBits(1, 0);
+            ts_bs.WriteBits(1, first ? 1 : 0);
+            ts_bs.WriteBits(1, 0);
+            ts_bs.WriteBits(13, is_video ? kVideoPid : kAudioPid);
+            ts_bs.WriteBits(2, 0);
+            ts_bs.WriteBits(2, with_adaptation ? 3 : 1);
+            ts_bs.WriteBits(4, is_video ? (video_cc_++ & 0x0F) : (audio_cc_++ & 0x0F));
+
+            if (with_adaptation)
+            {
+                if (with_pcr)
+                {
+                    ts_bs.WriteBytes(1, 7 + stuffing);
+                    ts_bs.WriteBytes(1, 0x10);
+                    ts_bs.WriteBits(33, frame.dts * 90);
+                    ts_bs.WriteBits(6, 0x3F);
+                    ts_bs.WriteBits(9, 0);
+                }
+                else
+                {
+                    ts_bs.WriteBytes(1, stuffing - 1);
+                    if (stuffing > 1)
+                    {
+                        ts_bs.WriteBytes(1, 0x00);
+                    }
+                    stuffing = stuffing > 1 ? stuffing - 2 : 0;
+                }
+
+                for (size_t i = 0; i < stuffing; ++i)
+                {
+                    ts_bs.WriteBytes(1, 0xFF);
+                }
+            }
+
+            if (first)
+            {
+                ts_bs.WriteData(pes_bs.SizeInBytes(), pes_bs.GetData());
+            }
+
+            ts_bs.WriteData(payload_len, data);
+
+            out.append((const char*)ts_bs.GetData(), ts_bs.SizeInBytes());
+
+            data += payload_len;
+            left -= payload_len;
+            first = false;
+        }
+    }
+
+private:
+    static void WriteTimestamp(BitStream& bs, const uint8_t& prefix, const uint64_t& ts)
+    {
+        bs.WriteBits(4, prefix);
+        bs.WriteBits(3, (ts >> 30) & 0x07);
+        bs.WriteBits(1, 1);
+        bs.WriteBits(15, (ts >> 15) & 0x7FFF);
+        bs.WriteBits(1, 1);
+        bs.WriteBits(15, ts & 0x7FFF);
+        bs.WriteBits(1, 1);
+    }
+
+private:
+    uint8_t video_cc_;
+    uint8_t audio_cc_;
+};
+
+static vector<Frame> GenFrames(size_t& es_bytes)
+{
+    vector<Frame> frames;
+    es_bytes = 0;
+
+    srand(1);
+    for (int i = 0; i < kVideoFrames; ++i)
+    {
+        Frame video;
+        video.video = true;
+        video.key = (i % kGopFrames == 0);
+        video.dts = i * 40;
+        video.pts = video.dts + 80;
+        video.data.resize(video.key ? 120000 : 200 + rand() % 15000);
+        for (auto& c : video.data)
+        {
+            c = rand();
+        }
+        es_bytes += video.data.size();
+        frames.push_back(video);
+
+        for (int k = 0; k < 2; ++k)
+        {
+            Frame audio;
+            audio.video = false;
+            audio.key = false;
+            audio.dts = audio.pts = i * 40 + k * 20;
+            audio.data.resize(150 + rand() % 300);
+            for (auto& c : audio.data)
+            {
+                c = rand();
+            }
+            es_bytes += audio.data.size();
+            frames.push_back(audio);
+        }
+    }
+
+    return frames;
+}
+
+// MediaMuxer收的是AVCC, 一帧一个NALU
+static Payload ToPayload(const Frame& frame)
+{
+    if (! frame.video)
+    {
+        Payload payload(frame.data.size());
+        memcpy(payload.GetAllData(), frame.data.data(), frame.data.size());
+        payload.SetAudio();
+        payload.SetDts(frame.dts);
+        payload.SetPts(frame.pts);
+
+        return payload;
+    }
+
+    size_t len = frame.data.size();
+    Payload payload(4 + len);
+    uint8_t* data = payload.GetAllData();
+    data[0] = len >> 24;
+    data[1] = len >> 16;
+    data[2] = len >> 8;
+    data[3] = len;
+    memcpy(data + 4, frame.data.data(), len);
+    data[4] = frame.key ? 0x65 : 0x41;
+
+    payload.SetVideo();
+    if (frame.key)
+    {
+        payload.SetIFrame();
+    }
+    payload.SetDts(frame.dts);
+    payload.SetPts(frame.pts);
+    payload.AddNalu(0);
+
+    return payload;
+}
+
+static double MBps(const size_t& bytes, const uint64_t& begin_us)
+{
+    uint64_t cost_us = Util::GetNowUs() - begin_us;
+
+    return cost_us == 0 ? 0 : bytes / (double)cost_us;
+}
+
+static double BenchTsPacketizer(const vector<Frame>& frames, const size_t& es_bytes)
+{
+    static const uint8_t kAdts[7] = { 0xFF, 0xF1, 0x50, 0x80, 0x00, 0x1F, 0xFC };
+
+    TsPacketizer packetizer(kVideoPid, kAudioPid);
+    unique_ptr<TsSegment> segment;
+    size_t packets = 0;
+
+    uint64_t begin_us = Util::GetNowUs();
+    for (const auto& frame : frames)
+    {
+        if (frame.key || ! segment)
+        {
+            segment.reset(new TsSegment());
+        }
+
+        if (frame.video)
+        {
+            packets += packetizer.PacketVideo((const uint8_t*)frame.data.data(), frame.data.size(), frame.pts, frame.dts, *segment);
+        }
+        else
+        {
+            packets += packetizer.PacketAudio((const uint8_t*)frame.data.data(), frame.data.size(), kAdts, frame.pts, *segment);
+        }
+    }
+    segment.reset();
+
+    return packets == 0 ? 0 : MBps(es_bytes, begin_us);
+}
+
+static double BenchBitStream(const vector<Frame>& frames, const size_t& es_bytes)
+{
+    static const uint8_t kAud[6] = { 0x00, 0x00, 0x00, 0x01, 0x09, 0xF0 };
+    static const uint8_t kAdts[7] = { 0xFF, 0xF1, 0x50, 0x80, 0x00, 0x1F, 0xFC };
+
+    BitStreamPacketizer packetizer;
+    string segment;
+    size_t bytes = 0;
+
+    uint64_t begin_us = Util::GetNowUs();
+    for (const auto& frame : frames)
+    {
+        if (frame.key)
+        {
+            bytes += segment.size();
+            segment = string();
+        }
+
+        if (frame.video)
+        {
+            packetizer.Packet(frame, kAud, sizeof(kAud), segment);
+        }
+        else
+        {
+            packetizer.Packet(frame, kAdts, sizeof(kAdts), segment);
+        }
+    }
+    bytes += segment.size();
+
+    return bytes == 0 ? 0 : MBps(es_bytes, begin_us);
+}
+
+static double BenchMediaMuxer(const vector<Payload>& payloads, const size_t& es_bytes)
+{
+    MediaPublisher* publisher = new MediaPublisher();
+    MediaMuxer& muxer = publisher->GetMediaMuxer();
+
+    muxer.OnAudioHeader(kAsc);
+    muxer.OnVideoHeader(kAvcc);
+    muxer.OnHlsRequest();
+
+    uint64_t begin_us = Util::GetNowUs();
+    for (const auto& payload : payloads)
+    {
+        if (payload.IsVideo())
+        {
+            muxer.OnVideo(payload);
+        }
+        else
+        {
+            muxer.OnAudio(payload);
+        }
+    }
+    double mbps = MBps(es_bytes, begin_us);
+
+    delete publisher;
+
+    return mbps;
+}
+
+int main(int argc, char* argv[])
+{
+    int rounds = argc > 1 ? atoi(argv[1]) : 5;
+
+    // 一直切, 不看播放请求
+    MediaMuxer::SetHlsIdleMs(0);
+
+    size_t es_bytes = 0;
+    vector<Frame> frames = GenFrames(es_bytes);
+
+    vector<Payload> payloads;
+    for (const auto& frame : frames)
+    {
+        payloads.push_back(ToPayload(frame));
+    }
+
+    cout << kVideoFrames << " video + " << kVideoFrames * 2 << " audio frames, " << es_bytes / 1000000.0 << " MB ES, "
+         << kVideoFrames / kGopFrames << " segments" << endl;
+    cout << "round  TsPacketizer MB/s  BitStream MB/s  MediaMuxer MB/s" << endl;
+
+    // MediaMuxer每个切片都打日志
+    int stdout_fd = dup(STDOUT_FILENO);
+    int null_fd = open("/dev/null", O_WRONLY);
+
+    for (int round = 0; round < rounds; ++round)
+    {
+        double ts_packetizer = BenchTsPacketizer(frames, es_bytes);
+        double bit_stream = BenchBitStream(frames, es_bytes);
+
+        dup2(null_fd, STDOUT_FILENO);
+        double media_muxer = BenchMediaMuxer(payloads, es_bytes);
+        dup2(stdout_fd, STDOUT_FILENO);
+
+        char line[256];
+        snprintf(line, sizeof(line), "%5d  %17.0f  %14.0f  %15.0f", round, ts_packetizer, bit_stream, media_muxer);
+        cout << line << endl;
+    }
+
+    close(null_fd);
+    close(stdout_fd);
+
+    return 0;
+}
@@ -0,0 +1,245 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <string>
+
+#include "common_define.h"
+#include "epoller.h"
+#include "io_buffer.h"
+#include "socket_handler.h"
+#include "socket_util.h"
+#include "udp_socket.h"
+#include "util.h"
+
+using namespace std;
+
+// UDP收包, 每秒能收多少个包, 只算收的时间(每轮先把包都发进接收缓冲区再收):
+// 1. 以前的做法: 每个包recvfrom进一个新的IoBuffer(4096), 每个包都把地址转成字符串
+// 2. UdpSocket::OnRead, recvmmsg一次收一批到线程的接收环里, GRO关掉
+// 3. 同上, 开GRO, 发送端用GSO一次发50个包, 环回上才会合并
+// 包1200字节, 发到127.0.0.1
+// 用法: ./udp_recv_bench [轮数] [每轮包数]
+
+static const uint16_t kPort = 19601;
+static const size_t kPacketSize = 1200;
+// 一个GSO消息总长不能超过64K
+static const int kGsoSegments = 50;
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+
+static uint64_t g_handled = 0;
+static uint64_t g_bytes = 0;
+
+class CountHandler : public SocketHandler
+{
+public:
+    CountHandler(IoLoop* io_loop, Fd* socket)
+    {
+    }
+
+    virtual int HandleRead(IoBuffer& io_buffer, Fd& socket)
+    {
+        uint8_t* data = NULL;
+        g_bytes += io_buffer.Read(data, io_buffer.Size());
+        ++g_handled;
+
+        return kSuccess;
+    }
+
+    virtual int HandleClose(IoBuffer& io_buffer, Fd& socket)
+    {
+        return kSuccess;
+    }
+};
+
+enum Mode
+{
+    kRecvfrom       = 0,
+    kRecvmmsg       = 1,
+    kRecvmmsgGro    = 2,
+};
+
+static int CreateReceiver()
+{
+    int fd = socket_util::CreateNonBlockUdpSocket();
+    socket_util::ReuseAddr(fd);
+
+    if (socket_util::Bind(fd, "127.0.0.1", kPort) < 0)
+    {
+        cout << LMSG << "bind 127.0.0.1:" << kPort << " failed" << endl;
+        exit(1);
+    }
+
+    // 一轮的包都要放得下
+    int rcvbuf = 256 * 1024 * 1024;
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf)) < 0)
+    {
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    }
+
+    return fd;
+}
+
+static int CreateSender(const bool& gso)
+{
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kPort);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    connect(fd, (sockaddr*)&addr, sizeof(addr));
+
+    if (gso)
+    {
+        int segment_size = kPacketSize;
+        if (setsockopt(fd, SOL_UDP, UDP_SEGMENT, &segment_size, sizeof(segment_size)) < 0)
+        {
+            cout << LMSG << "UDP_SEGMENT not supported" << endl;
+        }
+    }
+
+    return fd;
+}
+
+// 返回发出去的包数
+static int SendRound(const int& fd, const bool& gso, const int& packets)
+{
+    static uint8_t buf[kPacketSize * kGsoSegments];
+    buf[0] = 0x80;
+
+    int sent = 0;
+    while (sent < packets)
+    {
+        int n = gso ? min(kGsoSegments, packets - sent) : 1;
+
+        if (send(fd, buf, n * kPacketSize, 0) < 0)
+        {
+            break;
+        }
+
+        sent += n;
+    }
+
+    return sent;
+}
+
+static void RecvfromDrain(const int& fd)
+{
+    sockaddr_in src_addr;
+    string ip;
+    uint16_t port = 0;
+
+    while (true)
+    {
+        IoBuffer io_buffer(4096);
+        socklen_t src_addr_len = sizeof(src_addr);
+
+        if (io_buffer.ReadFromFdAndWrite(fd, (sockaddr*)&src_addr, &src_addr_len) <= 0)
+        {
+            break;
+        }
+
+        socket_util::SocketAddrInetToIpPort(src_addr, ip, port);
+
+        uint8_t* data = NULL;
+        g_bytes += io_buffer.Read(data, io_buffer.Size());
+        ++g_handled;
+    }
+}
+
+static double Bench(IoLoop* io_loop, const Mode& mode, const int& rounds, const int& packets, uint64_t& sent)
+{
+    int fd = CreateReceiver();
+    bool gso = (mode == kRecvmmsgGro);
+    int send_fd = CreateSender(gso);
+
+    UdpSocket* udp_socket = NULL;
+    if (mode != kRecvfrom)
+    {
+        udp_socket = new UdpSocket(io_loop, fd, [](IoLoop* loop, Fd* socket)
+        {
+            return (SocketHandler*)new CountHandler(loop, socket);
+        });
+
+        if (mode == kRecvmmsg)
+        {
+            int off = 0;
+            setsockopt(fd, SOL_UDP, UDP_GRO, &off, sizeof(off));
+        }
+    }
+
+    g_handled = 0;
+    g_bytes = 0;
+    sent = 0;
+    uint64_t cost_us = 0;
+
+    for (int round = 0; round < rounds; ++round)
+    {
+        sent += SendRound(send_fd, gso, packets);
+
+        uint64_t begin_us = Util::GetNowUs();
+        if (udp_socket != NULL)
+        {
+            udp_socket->OnRead();
+        }
+        else
+        {
+            RecvfromDrain(fd);
+        }
+        cost_us += Util::GetNowUs() - begin_us;
+    }
+
+    close(send_fd);
+    if (udp_socket != NULL)
+    {
+        // Fd析构时关fd
+        delete udp_socket;
+    }
+    else
+    {
+        close(fd);
+    }
+
+    return cost_us == 0 ? 0 : g_handled * 1000000.0 / cost_us;
+}
+
+int main(int argc, char* argv[])
+{
+    int rounds = argc > 1 ? atoi(argv[1]) : 50;
+    int packets = argc > 2 ? atoi(argv[2]) : 20000;
+
+    Epoller io_loop;
+    io_loop.Create();
+
+    static const char* kModeName[] = { "recvfrom+IoBuffer", "recvmmsg", "recvmmsg+gro(sender gso)" };
+
+    cout << rounds << " rounds x " << packets << " packets x " << kPacketSize << " bytes" << endl;
+
+    for (int mode = kRecvfrom; mode <= kRecvmmsgGro; ++mode)
+    {
+        uint64_t sent = 0;
+        double pps = Bench(&io_loop, (Mode)mode, rounds, packets, sent);
+
+        char line[256];
+        snprintf(line, sizeof(line), "%-26s sent %9lu  handled %9lu  %10.0f pkt/s",
+                 kModeName[mode], sent, g_handled, pps);
+        cout << line << endl;
+    }
+
+    return 0;
+}